@@ -0,0 +1,57 @@
+// AllocationCounter.h
+
+#ifndef ALLOCATIONCOUNTER_H_
+#define ALLOCATIONCOUNTER_H_
+
+/**
+ * Replaces the global operator new and operator delete of a program with versions that count the
+ * heap allocations in allocations, for the programs that check or report them (AllocationTest,
+ * MatrixBenchmark). Replacement operators must be defined once per program, so this header is
+ * included by a single translation unit of the program, and never by the library headers.
+ */
+
+// ------------------ Includes ------------------------------
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/**
+ * Number of heap allocations since the start of the program.
+ */
+static std::atomic<unsigned long long> allocations(0);
+
+/**
+ * Counts the allocations of the program.
+ * @param size Number of bytes
+ * @return The allocated memory
+ * @throws bad_alloc if the memory cannot be allocated
+ */
+void* operator new(std::size_t size)
+{
+	allocations++;
+	void* memory = std::malloc(size == 0 ? 1 : size);
+	if (memory == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+/**
+ * Releases memory allocated by operator new. GCC cannot see that the replaced operator new
+ * returns memory from malloc once this is inlined, hence the pragma.
+ * @param memory The memory
+ */
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+#endif /* ALLOCATIONCOUNTER_H_ */
@@ -0,0 +1,113 @@
+// AllocationTest.cpp
+
+/**
+ * Checks that the operations of Matrix<T> that write into an existing matrix reuse its buffer:
+ * once a loop has run a first time (which allocates the buffers of the result and the packing
+ * buffers of the products), every further iteration of c = a + b, c += a, c *= s, c = a * b and
+ * of a move assignment must make no heap allocation, in the sequential and the parallel modes.
+ *
+ * Usage: AllocationTest
+ * Returns 0 if every check passes, 1 otherwise.
+ */
+
+// ------------------ Includes ------------------------------
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+#include "Matrix.hpp"
+#include "AllocationCounter.h"
+
+/**
+ * Size of the square matrices, number of threads of the pool in the parallel mode, and number of
+ * warm-up and checked iterations of every loop. A loop is warmed up several times, so that every
+ * thread of the pool has run a part of it and allocated its own packing buffers.
+ */
+static const unsigned int SIZE = 256;
+static const unsigned int THREADS = 4;
+static const unsigned int WARM_UP_ITERATIONS = 5;
+static const unsigned int ITERATIONS = 10;
+
+/**
+ * Runs a loop WARM_UP_ITERATIONS times, then ITERATIONS times, and checks that the later runs made
+ * no heap allocation.
+ * @param name The name of the loop, printed with the result
+ * @param body The body of the loop
+ * @return true if the check passed, false otherwise.
+ */
+static bool checkSteadyState(const std::string& name, const std::function<void()>& body)
+{
+	for (unsigned int i = 0; i < WARM_UP_ITERATIONS; i++)
+	{
+		body();
+	}
+	unsigned long long before = allocations.load();
+	for (unsigned int i = 0; i < ITERATIONS; i++)
+	{
+		body();
+	}
+	unsigned long long made = allocations.load() - before;
+	std::cout << (made == 0 ? "ok     " : "FAILED ") << name << ": " << made
+			  << " allocations in " << ITERATIONS << " iterations\n";
+	return made == 0;
+}
+
+/**
+ * Checks the loops with the given execution.
+ * @param execution The execution
+ * @param mode The name of the execution, printed with the results
+ * @return true if every check passed, false otherwise.
+ */
+static bool checkExecution(Execution execution, const std::string& mode)
+{
+	ExecutionPolicy::setExecution(execution);
+	Matrix<double> a(SIZE, SIZE);
+	Matrix<double> b(SIZE, SIZE);
+	for (unsigned int i = 0; i < SIZE; i++)
+	{
+		for (unsigned int j = 0; j < SIZE; j++)
+		{
+			a(i, j) = (double)(i + j) / SIZE;
+			b(i, j) = (double)i / (j + 1);
+		}
+	}
+	Matrix<double> c(SIZE, SIZE);
+	Matrix<double> d(SIZE, SIZE);
+
+	bool passed = true;
+	passed &= checkSteadyState(mode + " c = a + b", [&]()
+	{
+		c = a + b;
+	});
+	passed &= checkSteadyState(mode + " c += a", [&]()
+	{
+		c += a;
+	});
+	passed &= checkSteadyState(mode + " c *= s", [&]()
+	{
+		c *= 0.5;
+	});
+	passed &= checkSteadyState(mode + " c = a * b", [&]()
+	{
+		c = a * b;
+	});
+	passed &= checkSteadyState(mode + " move assignment", [&]()
+	{
+		d = std::move(c);
+		c = std::move(d);
+	});
+	return passed;
+}
+
+/**
+ * Runs the checks.
+ * @return 0 if every check passed, 1 otherwise.
+ */
+int main()
+{
+	ThreadPool::setThreadCount(THREADS);
+	bool passed = checkExecution(Execution::SEQUENTIAL, "sequential");
+	passed &= checkExecution(Execution::PARALLEL, "parallel");
+	ExecutionPolicy::setExecution(Execution::AUTO);
+	return passed ? 0 : 1;
+}
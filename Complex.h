@@ -0,0 +1,219 @@
+// Complex.h
+
+#ifndef COMPLEX_H_
+#define COMPLEX_H_
+
+// ------------------ Includes ------------------------------
+#include <cmath>
+#include <iostream>
+
+/**
+ * This class represents a complex number with double precision real and imaginary parts.
+ *
+ * The two parts are its only data members, stored real part first, so an array of Complex has the
+ * layout of an array of interleaved (real, imaginary) doubles. The kernels of Matrix<Complex>
+ * (see ComplexKernels.h) and the matrix files rely on it.
+ */
+class Complex
+{
+public:
+	// ------------------ Constructors ----------------------
+	/**
+	 * Initiates the number.
+	 * @param real The real part
+	 * @param imaginary The imaginary part
+	 */
+	Complex(double real = 0, double imaginary = 0) : _real(real), _imaginary(imaginary)
+	{
+	}
+
+	// ------------------ Methods ---------------------------
+	/**
+	 * @return The real part.
+	 */
+	double real() const
+	{
+		return _real;
+	}
+
+	/**
+	 * @return The imaginary part.
+	 */
+	double imag() const
+	{
+		return _imaginary;
+	}
+
+	/**
+	 * @return The conjugate of this.
+	 */
+	Complex conj() const
+	{
+		return Complex(_real, -_imaginary);
+	}
+
+	// ------------------ Operators -------------------------
+	/**
+	 * + operator.
+	 * @param other The other number
+	 * @return The sum of this and other.
+	 */
+	Complex operator+(const Complex& other) const
+	{
+		return Complex(_real + other._real, _imaginary + other._imaginary);
+	}
+
+	/**
+	 * - operator.
+	 * @param other The other number
+	 * @return The difference of this and other.
+	 */
+	Complex operator-(const Complex& other) const
+	{
+		return Complex(_real - other._real, _imaginary - other._imaginary);
+	}
+
+	/**
+	 * Unary - operator.
+	 * @return The negation of this.
+	 */
+	Complex operator-() const
+	{
+		return Complex(-_real, -_imaginary);
+	}
+
+	/**
+	 * * operator.
+	 * @param other The other number
+	 * @return The product of this and other.
+	 */
+	Complex operator*(const Complex& other) const
+	{
+		return Complex(_real * other._real - _imaginary * other._imaginary,
+					   _real * other._imaginary + _imaginary * other._real);
+	}
+
+	/**
+	 * / operator.
+	 * @param other The other number, not 0
+	 * @return The quotient of this and other.
+	 */
+	Complex operator/(const Complex& other) const
+	{
+		double norm = other._real * other._real + other._imaginary * other._imaginary;
+		return Complex((_real * other._real + _imaginary * other._imaginary) / norm,
+					   (_imaginary * other._real - _real * other._imaginary) / norm);
+	}
+
+	/**
+	 * += operator. Adds other to this.
+	 * @param other The other number
+	 * @return Reference to this.
+	 */
+	Complex& operator+=(const Complex& other)
+	{
+		_real += other._real;
+		_imaginary += other._imaginary;
+		return *this;
+	}
+
+	/**
+	 * -= operator. Subtracts other from this.
+	 * @param other The other number
+	 * @return Reference to this.
+	 */
+	Complex& operator-=(const Complex& other)
+	{
+		_real -= other._real;
+		_imaginary -= other._imaginary;
+		return *this;
+	}
+
+	/**
+	 * *= operator. Multiplies this by other.
+	 * @param other The other number
+	 * @return Reference to this.
+	 */
+	Complex& operator*=(const Complex& other)
+	{
+		return *this = *this * other;
+	}
+
+	/**
+	 * /= operator. Divides this by other.
+	 * @param other The other number, not 0
+	 * @return Reference to this.
+	 */
+	Complex& operator/=(const Complex& other)
+	{
+		return *this = *this / other;
+	}
+
+	/**
+	 * == operator.
+	 * @param other The other number
+	 * @return true if the parts of this and other are equal, false otherwise.
+	 */
+	bool operator==(const Complex& other) const
+	{
+		return _real == other._real && _imaginary == other._imaginary;
+	}
+
+	/**
+	 * != operator.
+	 * @param other The other number
+	 * @return The opposite of == operator.
+	 */
+	bool operator!=(const Complex& other) const
+	{
+		return !(*this == other);
+	}
+
+	/**
+	 * << operator. Writes the number like "1.5-2i", with the format of the stream.
+	 * @param os The output stream
+	 * @param number The number
+	 * @return Reference to os.
+	 */
+	friend std::ostream& operator<<(std::ostream& os, const Complex& number)
+	{
+		os << number._real;
+		if (!std::signbit(number._imaginary))
+		{
+			os << '+';
+		}
+		return os << number._imaginary << 'i';
+	}
+
+	/**
+	 * >> operator. Reads a number written like "1.5-2i". The failbit of the stream is set if there
+	 * is no valid number, and number is then left unchanged.
+	 * @param is The input stream
+	 * @param number The number read
+	 * @return Reference to is.
+	 */
+	friend std::istream& operator>>(std::istream& is, Complex& number)
+	{
+		double real, imaginary;
+		char unit;
+		if (is >> real >> imaginary >> unit)
+		{
+			if (unit == 'i')
+			{
+				number = Complex(real, imaginary);
+			}
+			else
+			{
+				is.setstate(std::ios::failbit);
+			}
+		}
+		return is;
+	}
+
+private:
+	// ------------------ Data members ----------------------
+	double _real; /**< The real part */
+	double _imaginary; /**< The imaginary part */
+};
+
+#endif /* COMPLEX_H_ */
@@ -0,0 +1,566 @@
+// ComplexKernels.h
+
+#ifndef COMPLEXKERNELS_H_
+#define COMPLEXKERNELS_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+#include "Complex.h"
+#include "Gemm.h"
+#include "ElementKernels.h"
+
+/**
+ * The kernels of Matrix<Complex>. The cells are stored as interleaved (real, imaginary) pairs of
+ * doubles (see Complex.h), and the kernels work on the doubles instead of calling the operators of
+ * Complex cell by cell:
+ * - + and - are the double kernels over twice as many elements.
+ * - Multiplying by a complex scalar uses vectors of pairs: alpha * x is
+ *   re(alpha) * x + im(alpha) * (-im(x), re(x)), so one pair swap and two multiplies per vector.
+ * - Dot products accumulate the products of the pairs, (re(a) * re(x), im(a) * im(x)), and of the
+ *   swapped pairs, (re(a) * im(x), im(a) * re(x)): the real part is the difference of the sums of
+ *   the first vector's halves and the imaginary part the sum of the second vector.
+ * - The product has a blocked engine of its own. Its packing splits the cells into a plane of real
+ *   parts and a plane of imaginary parts, so the micro-kernel is four real multiply-adds on
+ *   contiguous vectors, and conjugated operands (the conjugate transpose) are conjugated while
+ *   packing, at no cost.
+ */
+
+static_assert(sizeof(Complex) == 2 * sizeof(double) && std::is_trivially_copyable<Complex>::value,
+			  "Complex cells are stored as interleaved pairs of doubles");
+
+#ifdef MATRIX_SIMD_X86
+
+/**
+ * The loops of the complex kernels for instruction set Isa, on n interleaved pairs of doubles.
+ */
+template <class Isa>
+struct ComplexSimdLoops;
+
+#define MATRIX_COMPLEX_SIMD_LOOPS(ISA, TARGET) \
+template <> \
+struct ComplexSimdLoops<ISA> \
+{ \
+	template <bool ACCUMULATE> \
+	TARGET static void scale(double* dst, const double* a, const Complex& alpha, std::size_t n) \
+	{ \
+		typedef SimdVector<ISA, double> V; \
+		double pattern[V::WIDTH]; \
+		for (unsigned int i = 0; i < V::WIDTH; i += 2) \
+		{ \
+			pattern[i] = -alpha.imag(); \
+			pattern[i + 1] = alpha.imag(); \
+		} \
+		typename V::Vector real = V::set1(alpha.real()), imaginary = V::load(pattern); \
+		std::size_t i = 0; \
+		for (; i + V::WIDTH <= 2 * n; i += V::WIDTH) \
+		{ \
+			typename V::Vector x = V::load(a + i); \
+			typename V::Vector product = V::add(V::mul(real, x), \
+												V::mul(imaginary, V::swapPairs(x))); \
+			V::store(dst + i, ACCUMULATE ? V::add(V::load(dst + i), product) : product); \
+		} \
+		for (; i < 2 * n; i += 2) \
+		{ \
+			double re = alpha.real() * a[i] - alpha.imag() * a[i + 1]; \
+			double im = alpha.real() * a[i + 1] + alpha.imag() * a[i]; \
+			dst[i] = ACCUMULATE ? dst[i] + re : re; \
+			dst[i + 1] = ACCUMULATE ? dst[i + 1] + im : im; \
+		} \
+	} \
+	\
+	template <unsigned int ROWS> \
+	TARGET static void dots(const double* a, std::size_t lda, const double* x, std::size_t n, \
+							Complex* out) \
+	{ \
+		typedef SimdVector<ISA, double> V; \
+		typename V::Vector same[ROWS], swapped[ROWS]; \
+		for (unsigned int r = 0; r < ROWS; r++) \
+		{ \
+			same[r] = V::set1(0); \
+			swapped[r] = V::set1(0); \
+		} \
+		std::size_t i = 0; \
+		for (; i + V::WIDTH <= 2 * n; i += V::WIDTH) \
+		{ \
+			typename V::Vector xv = V::load(x + i), xs = V::swapPairs(xv); \
+			for (unsigned int r = 0; r < ROWS; r++) \
+			{ \
+				typename V::Vector av = V::load(a + r * lda + i); \
+				same[r] = V::add(same[r], V::mul(av, xv)); \
+				swapped[r] = V::add(swapped[r], V::mul(av, xs)); \
+			} \
+		} \
+		for (unsigned int r = 0; r < ROWS; r++) \
+		{ \
+			double cells[V::WIDTH], swappedCells[V::WIDTH]; \
+			V::store(cells, same[r]); \
+			V::store(swappedCells, swapped[r]); \
+			double re = 0, im = 0; \
+			for (unsigned int j = 0; j < V::WIDTH; j += 2) \
+			{ \
+				re += cells[j] - cells[j + 1]; \
+				im += swappedCells[j] + swappedCells[j + 1]; \
+			} \
+			const double* row = a + r * lda; \
+			for (std::size_t j = i; j < 2 * n; j += 2) \
+			{ \
+				re += row[j] * x[j] - row[j + 1] * x[j + 1]; \
+				im += row[j] * x[j + 1] + row[j + 1] * x[j]; \
+			} \
+			out[r] = Complex(re, im); \
+		} \
+	} \
+};
+
+MATRIX_COMPLEX_SIMD_LOOPS(SimdSse2, MATRIX_TARGET("sse2"))
+MATRIX_COMPLEX_SIMD_LOOPS(SimdAvx2, MATRIX_TARGET("avx2"))
+MATRIX_COMPLEX_SIMD_LOOPS(SimdAvx512, MATRIX_TARGET("avx512f"))
+
+#undef MATRIX_COMPLEX_SIMD_LOOPS
+
+#endif /* MATRIX_SIMD_X86 */
+
+/**
+ * Specialization for the Complex class (see above). The instruction set of the multiplying loops
+ * is detected on the first call, like for double.
+ */
+template <>
+class ElementKernels<Complex>
+{
+public:
+	/**
+	 * Computes dst[i] = a[i] + b[i] for every i < n.
+	 * @param dst The destination array
+	 * @param a The first source array
+	 * @param b The second source array
+	 * @param n Number of elements
+	 */
+	static void add(Complex* dst, const Complex* a, const Complex* b, std::size_t n)
+	{
+		ElementKernels<double>::add(_parts(dst), _parts(a), _parts(b), 2 * n);
+	}
+
+	/**
+	 * Computes dst[i] = a[i] - b[i] for every i < n.
+	 * @param dst The destination array
+	 * @param a The first source array
+	 * @param b The second source array
+	 * @param n Number of elements
+	 */
+	static void subtract(Complex* dst, const Complex* a, const Complex* b, std::size_t n)
+	{
+		ElementKernels<double>::subtract(_parts(dst), _parts(a), _parts(b), 2 * n);
+	}
+
+	/**
+	 * Computes dst[i] = alpha * a[i] for every i < n.
+	 * @param dst The destination array
+	 * @param a The source array
+	 * @param alpha The scale
+	 * @param n Number of elements
+	 */
+	static void scale(Complex* dst, const Complex* a, const Complex& alpha, std::size_t n)
+	{
+		_table().scale(_parts(dst), _parts(a), alpha, n);
+	}
+
+	/**
+	 * Computes y[i] += alpha * x[i] for every i < n.
+	 * @param n Number of elements
+	 * @param alpha The scale of x
+	 * @param x The source array
+	 * @param y The destination array
+	 */
+	static void axpy(std::size_t n, const Complex& alpha, const Complex* x, Complex* y)
+	{
+		_table().axpy(_parts(y), _parts(x), alpha, n);
+	}
+
+	/**
+	 * Computes the sum of a[i] * x[i] for every i < n.
+	 * @param a The first array
+	 * @param x The second array
+	 * @param n Number of elements
+	 * @return The dot product.
+	 */
+	static Complex dot(const Complex* a, const Complex* x, std::size_t n)
+	{
+		Complex sum;
+		_table().dot(_parts(a), 0, _parts(x), n, &sum);
+		return sum;
+	}
+
+	/**
+	 * Computes the dot products of four rows of a matrix with x, reading x once:
+	 * out[r] = the sum of a[r * lda + i] * x[i] for every i < n, for every r < 4.
+	 * @param a The first cell of the first row
+	 * @param lda Distance between two consecutive rows
+	 * @param x The vector
+	 * @param n Number of elements of the rows and of x
+	 * @param out The four dot products
+	 */
+	static void dot4(const Complex* a, std::size_t lda, const Complex* x, std::size_t n,
+					 Complex* out)
+	{
+		_table().dot4(_parts(a), 2 * lda, _parts(x), n, out);
+	}
+
+private:
+	/**
+	 * The multiplying loops chosen for the running CPU.
+	 */
+	struct _Table
+	{
+		void (*scale)(double*, const double*, const Complex&, std::size_t);
+		void (*axpy)(double*, const double*, const Complex&, std::size_t);
+		void (*dot)(const double*, std::size_t, const double*, std::size_t, Complex*);
+		void (*dot4)(const double*, std::size_t, const double*, std::size_t, Complex*);
+	};
+
+	/**
+	 * @param cells Complex cells
+	 * @return The interleaved parts of the cells.
+	 */
+	static double* _parts(Complex* cells)
+	{
+		return reinterpret_cast<double*>(cells);
+	}
+
+	static const double* _parts(const Complex* cells)
+	{
+		return reinterpret_cast<const double*>(cells);
+	}
+
+	/**
+	 * The portable loop: computes dst[i] = alpha * a[i] (or dst[i] += alpha * a[i]) on n pairs.
+	 */
+	template <bool ACCUMULATE>
+	static void _scale(double* dst, const double* a, const Complex& alpha, std::size_t n)
+	{
+		for (std::size_t i = 0; i < 2 * n; i += 2)
+		{
+			double re = alpha.real() * a[i] - alpha.imag() * a[i + 1];
+			double im = alpha.real() * a[i + 1] + alpha.imag() * a[i];
+			dst[i] = ACCUMULATE ? dst[i] + re : re;
+			dst[i + 1] = ACCUMULATE ? dst[i + 1] + im : im;
+		}
+	}
+
+	/**
+	 * The portable loop: computes the dot products of ROWS rows of pairs with x.
+	 */
+	template <unsigned int ROWS>
+	static void _dots(const double* a, std::size_t lda, const double* x, std::size_t n,
+					  Complex* out)
+	{
+		for (unsigned int r = 0; r < ROWS; r++)
+		{
+			const double* row = a + r * lda;
+			double re = 0, im = 0;
+			for (std::size_t j = 0; j < 2 * n; j += 2)
+			{
+				re += row[j] * x[j] - row[j + 1] * x[j + 1];
+				im += row[j] * x[j + 1] + row[j + 1] * x[j];
+			}
+			out[r] = Complex(re, im);
+		}
+	}
+
+#ifdef MATRIX_SIMD_X86
+	/**
+	 * @return The loops of instruction set Isa.
+	 */
+	template <class Isa>
+	static _Table _tableOf()
+	{
+		_Table table = {&ComplexSimdLoops<Isa>::template scale<false>,
+						&ComplexSimdLoops<Isa>::template scale<true>,
+						&ComplexSimdLoops<Isa>::template dots<1>,
+						&ComplexSimdLoops<Isa>::template dots<4>};
+		return table;
+	}
+
+	/**
+	 * @return The loops chosen for the running CPU, detected on the first call.
+	 */
+	static const _Table& _table()
+	{
+		static const _Table table = __builtin_cpu_supports("avx512f") ? _tableOf<SimdAvx512>() :
+									__builtin_cpu_supports("avx2") ? _tableOf<SimdAvx2>() :
+									_tableOf<SimdSse2>();
+		return table;
+	}
+#else
+	/**
+	 * @return The portable loops.
+	 */
+	static const _Table& _table()
+	{
+		static const _Table table = {&_scale<false>, &_scale<true>, &_dots<1>, &_dots<4>};
+		return table;
+	}
+#endif /* MATRIX_SIMD_X86 */
+};
+
+/**
+ * The blocked engine of products of complex numbers T (with double parts), with the blocking of
+ * Gemm<T, true>: a KC X NC panel of B is packed once and reused by every MC X KC block of A, and an
+ * MR X NR micro-kernel accumulates its part of C in registers.
+ *
+ * The packed slivers are split: for every index of the common dimension, a sliver of A holds the
+ * MR real parts followed by the MR imaginary parts, and a sliver of B the NR real parts followed
+ * by the NR imaginary parts. The micro-kernel then computes the real and imaginary parts of its
+ * tile as separate arrays of doubles, with vector multiply-adds along the rows of the tile.
+ */
+template <class T>
+class ComplexGemm
+{
+public:
+	/**
+	 * Computes C = alpha * A * B, or C += alpha * A * B if accumulate is true.
+	 * @param m Number of rows of A and C
+	 * @param n Number of columns of B and C
+	 * @param k Number of columns of A and rows of B
+	 * @param alpha Scale of the product
+	 * @param a The first cell of A
+	 * @param rsA Distance between two consecutive rows of A
+	 * @param csA Distance between two consecutive columns of A
+	 * @param b The first cell of B
+	 * @param rsB Distance between two consecutive rows of B
+	 * @param csB Distance between two consecutive columns of B
+	 * @param c The first cell of C
+	 * @param ldc Distance between two consecutive rows of C
+	 * @param accumulate Whether the product is added to C instead of overwriting it
+	 * @param conjugateA Whether the cells of A are read conjugated
+	 * @param conjugateB Whether the cells of B are read conjugated
+	 */
+	static void multiply(unsigned int m, unsigned int n, unsigned int k, const T& alpha,
+						 const T* a, std::size_t rsA, std::size_t csA,
+						 const T* b, std::size_t rsB, std::size_t csB,
+						 T* c, std::size_t ldc, bool accumulate = false,
+						 bool conjugateA = false, bool conjugateB = false)
+	{
+		if (m == 0 || n == 0)
+		{
+			return;
+		}
+		if (k == 0)
+		{
+			if (!accumulate)
+			{
+				for (unsigned int i = 0; i < m; i++)
+				{
+					std::fill(c + i * ldc, c + i * ldc + n, T(0));
+				}
+			}
+			return;
+		}
+
+		std::vector<double>& packedA = _buffer(0);
+		std::vector<double>& packedB = _buffer(1);
+		for (unsigned int jc = 0; jc < n; jc += NC)
+		{
+			unsigned int nc = std::min(NC, n - jc);
+			for (unsigned int pc = 0; pc < k; pc += KC)
+			{
+				unsigned int kc = std::min(KC, k - pc);
+				bool add = accumulate || pc > 0;
+				_pack<NR>(nc, kc, b + pc * rsB + jc * csB, csB, rsB, conjugateB, packedB);
+				for (unsigned int ic = 0; ic < m; ic += MC)
+				{
+					unsigned int mc = std::min(MC, m - ic);
+					_pack<MR>(mc, kc, a + ic * rsA + pc * csA, rsA, csA, conjugateA, packedA);
+					_macroKernel(mc, nc, kc, alpha, packedA.data(), packedB.data(),
+								 c + ic * ldc + jc, ldc, add);
+				}
+			}
+		}
+	}
+
+private:
+	/**
+	 * Rows of C computed by one call to the micro-kernel.
+	 */
+	static const unsigned int MR = 4;
+
+	/**
+	 * Columns of C computed by one call to the micro-kernel. The tile is 2 X MR X NR doubles.
+	 */
+	static const unsigned int NR = 4;
+
+	/**
+	 * Depth of a block, chosen so that an MR X KC sliver of A and a KC X NR sliver of B stay in L1.
+	 */
+	static const unsigned int KC = 128;
+
+	/**
+	 * Rows of a block of A, chosen so that the packed MC X KC block stays in L2.
+	 */
+	static const unsigned int MC = 96;
+
+	/**
+	 * Columns of a panel of B, chosen so that the packed KC X NC panel stays in L3.
+	 */
+	static const unsigned int NC = 2048;
+
+	/**
+	 * @param index The buffer number
+	 * @return A packing buffer owned by the calling thread, reused between calls.
+	 */
+	static std::vector<double>& _buffer(int index)
+	{
+		static thread_local std::vector<double> buffers[2];
+		return buffers[index];
+	}
+
+	/**
+	 * Packs a block into consecutive split slivers of W lines (rows of A or columns of B), each
+	 * stored along the common dimension: for every index of it, the W real parts and then the W
+	 * imaginary parts. The last sliver is padded with zeros.
+	 * @param lines Number of lines of the block
+	 * @param depth Length of the lines (the common dimension)
+	 * @param x The first cell of the block
+	 * @param lineStride Distance between two consecutive lines
+	 * @param stride Distance between two consecutive cells of a line
+	 * @param conjugate Whether the cells are conjugated
+	 * @param packed The destination buffer
+	 */
+	template <unsigned int W>
+	static void _pack(unsigned int lines, unsigned int depth, const T* x,
+					  std::size_t lineStride, std::size_t stride, bool conjugate,
+					  std::vector<double>& packed)
+	{
+		unsigned int slivers = (lines + W - 1) / W;
+		packed.resize((std::size_t)slivers * 2 * W * depth);
+		double* out = packed.data();
+		double sign = conjugate ? -1.0 : 1.0;
+		for (unsigned int l = 0; l < lines; l += W)
+		{
+			unsigned int w = std::min(W, lines - l);
+			for (unsigned int p = 0; p < depth; p++)
+			{
+				const T* cell = x + l * lineStride + p * stride;
+				for (unsigned int i = 0; i < w; i++)
+				{
+					out[i] = cell[i * lineStride].real();
+					out[W + i] = sign * cell[i * lineStride].imag();
+				}
+				for (unsigned int i = w; i < W; i++)
+				{
+					out[i] = 0;
+					out[W + i] = 0;
+				}
+				out += 2 * W;
+			}
+		}
+	}
+
+	/**
+	 * Multiplies a packed block of A by a packed panel of B into C.
+	 * @param mc Number of rows of the block
+	 * @param nc Number of columns of the panel
+	 * @param kc The common dimension
+	 * @param alpha Scale of the product
+	 * @param packedA The packed block of A
+	 * @param packedB The packed panel of B
+	 * @param c The first cell of the block of C
+	 * @param ldc Distance between two consecutive rows of C
+	 * @param accumulate Whether the product is added to C instead of overwriting it
+	 */
+	static void _macroKernel(unsigned int mc, unsigned int nc, unsigned int kc,
+							 const T& alpha, const double* packedA, const double* packedB,
+							 T* c, std::size_t ldc, bool accumulate)
+	{
+		for (unsigned int jr = 0; jr < nc; jr += NR)
+		{
+			unsigned int nr = std::min(NR, nc - jr);
+			for (unsigned int ir = 0; ir < mc; ir += MR)
+			{
+				unsigned int mr = std::min(MR, mc - ir);
+				_microKernel(kc, alpha, packedA + (std::size_t)2 * ir * kc,
+							 packedB + (std::size_t)2 * jr * kc, c + ir * ldc + jr, ldc, mr, nr,
+							 accumulate);
+			}
+		}
+	}
+
+	/**
+	 * Computes an MR X NR tile of C from a split sliver of A and a split sliver of B. The real and
+	 * imaginary parts of the tile are accumulated in local arrays the compiler keeps in vector
+	 * registers, and only the mr X nr valid part of it is written to C.
+	 * @param kc The common dimension
+	 * @param alpha Scale of the product
+	 * @param a The packed sliver of A
+	 * @param b The packed sliver of B
+	 * @param c The first cell of the tile of C
+	 * @param ldc Distance between two consecutive rows of C
+	 * @param mr Number of valid rows of the tile
+	 * @param nr Number of valid columns of the tile
+	 * @param accumulate Whether the product is added to C instead of overwriting it
+	 */
+	static void _microKernel(unsigned int kc, const T& alpha, const double* a,
+							 const double* b, T* c, std::size_t ldc, unsigned int mr,
+							 unsigned int nr, bool accumulate)
+	{
+		double real[MR][NR] = {};
+		double imaginary[MR][NR] = {};
+		for (unsigned int p = 0; p < kc; p++)
+		{
+			for (unsigned int i = 0; i < MR; i++)
+			{
+				double ar = a[i], ai = a[MR + i];
+				for (unsigned int j = 0; j < NR; j++)
+				{
+					real[i][j] += ar * b[j] - ai * b[NR + j];
+					imaginary[i][j] += ar * b[NR + j] + ai * b[j];
+				}
+			}
+			a += 2 * MR;
+			b += 2 * NR;
+		}
+
+		for (unsigned int i = 0; i < mr; i++)
+		{
+			T* row = c + i * ldc;
+			for (unsigned int j = 0; j < nr; j++)
+			{
+				T cell = alpha * T(real[i][j], imaginary[i][j]);
+				row[j] = accumulate ? row[j] + cell : cell;
+			}
+		}
+	}
+};
+
+template <class T>
+const unsigned int ComplexGemm<T>::MR;
+
+template <class T>
+const unsigned int ComplexGemm<T>::NR;
+
+template <class T>
+const unsigned int ComplexGemm<T>::KC;
+
+template <class T>
+const unsigned int ComplexGemm<T>::MC;
+
+template <class T>
+const unsigned int ComplexGemm<T>::NC;
+
+/**
+ * Specialization for the Complex class: products of Complex matrices use the blocked engine above.
+ */
+template <>
+struct GemmTraits<Complex>
+{
+	static const bool BLOCKED = true;
+};
+
+template <>
+class Gemm<Complex, true> : public ComplexGemm<Complex>
+{
+};
+
+#endif /* COMPLEXKERNELS_H_ */
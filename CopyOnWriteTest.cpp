@@ -0,0 +1,244 @@
+// CopyOnWriteTest.cpp
+
+/**
+ * Checks the copy-on-write cells of Matrix<T, SharedAllocator<T> > (see MatrixStorage.h): a copy
+ * written in place, in the sequential and the parallel modes, copies the shared cells once and
+ * leaves the matrix it was copied from unchanged, and a copy that is assigned a new value gets new
+ * cells without copying the shared ones.
+ *
+ * Usage: CopyOnWriteTest
+ * Returns 0 if every check passes, 1 otherwise.
+ */
+
+// ------------------ Includes ------------------------------
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <utility>
+#include "Matrix.hpp"
+
+/**
+ * Size of the square matrices (large enough for the parallel mode to split the operations) and
+ * number of threads of the pool in the parallel mode.
+ */
+static const unsigned int SIZE = 512;
+static const unsigned int THREADS = 4;
+
+/**
+ * Number of cells of a non-zero value copied into buffers of CopyCountingAllocator. New cells are
+ * set to zero, so this counts the cells copied from other buffers.
+ */
+static std::atomic<unsigned long long> copiedCells(0);
+
+/**
+ * An allocator counting the non-zero cells copied into its buffers in copiedCells.
+ */
+template <class T>
+class CopyCountingAllocator
+{
+public:
+	typedef T value_type;
+
+	template <class U>
+	struct rebind
+	{
+		typedef CopyCountingAllocator<U> other;
+	};
+
+	CopyCountingAllocator()
+	{
+	}
+
+	template <class U>
+	CopyCountingAllocator(const CopyCountingAllocator<U>&)
+	{
+	}
+
+	T* allocate(std::size_t size)
+	{
+		return static_cast<T*>(::operator new(size * sizeof(T)));
+	}
+
+	void deallocate(T* memory, std::size_t)
+	{
+		::operator delete(memory);
+	}
+
+	template <class U, class... Args>
+	void construct(U* cell, Args&&... args)
+	{
+		::new ((void*)cell) U(std::forward<Args>(args)...);
+	}
+
+	void construct(T* cell, const T& value)
+	{
+		if (value != T())
+		{
+			copiedCells++;
+		}
+		::new ((void*)cell) T(value);
+	}
+
+	template <class U>
+	void destroy(U* cell)
+	{
+		cell->~U();
+	}
+
+	template <class U>
+	bool operator==(const CopyCountingAllocator<U>&) const
+	{
+		return true;
+	}
+
+	template <class U>
+	bool operator!=(const CopyCountingAllocator<U>&) const
+	{
+		return false;
+	}
+};
+
+/**
+ * Matrices with copy-on-write cells, whose copied cells are counted.
+ */
+typedef Matrix<double, SharedAllocator<double, CopyCountingAllocator<double> > > SharedMatrix;
+
+/**
+ * @param seed A value the cells depend on
+ * @return A square matrix of SIZE rows with distinct cells. Its cells are a copy of the ones
+ * 		   written through the () operator, so they can be shared.
+ */
+static SharedMatrix makeMatrix(double seed)
+{
+	SharedMatrix matrix(SIZE, SIZE);
+	for (unsigned int i = 0; i < SIZE; i++)
+	{
+		for (unsigned int j = 0; j < SIZE; j++)
+		{
+			matrix(i, j) = seed + i * 0.5 + j * 0.25;
+		}
+	}
+	return SharedMatrix(matrix);
+}
+
+/**
+ * Copies a matrix, checks that the copy shares its cells, writes the copy and compares both with
+ * the expected results.
+ * @param name The name of the check, printed with the result
+ * @param write Writes the copy
+ * @param expected Computes the expected copy from the original, without copy-on-write
+ * @param detaches Whether the write must copy the shared cells (once), or give the copy new cells
+ * @return true if the check passed, false otherwise.
+ */
+static bool checkWrite(const std::string& name, const std::function<void(SharedMatrix&)>& write,
+					   const std::function<Matrix<double>(const Matrix<double>&)>& expected,
+					   bool detaches)
+{
+	const SharedMatrix original = makeMatrix(1);
+	SharedMatrix copy = original;
+	bool shared = static_cast<const SharedMatrix&>(copy).data() == original.data();
+	unsigned long long copied = copiedCells.load();
+	write(copy);
+	copied = copiedCells.load() - copied;
+
+	Matrix<double> plain(original);
+	bool passed = shared && copied == (detaches ? (unsigned long long)SIZE * SIZE : 0) &&
+				  Matrix<double>(copy) == expected(plain) && Matrix<double>(original) == plain &&
+				  original == makeMatrix(1);
+	std::cout << (passed ? "ok     " : "FAILED ") << name << ": " << copied << " cells copied\n";
+	return passed;
+}
+
+/**
+ * Runs the checks with the given execution.
+ * @param execution The execution
+ * @param mode The name of the execution, printed with the results
+ * @return true if every check passed, false otherwise.
+ */
+static bool checkExecution(Execution execution, const std::string& mode)
+{
+	ExecutionPolicy::setExecution(execution);
+	const SharedMatrix other = makeMatrix(2);
+
+	bool passed = true;
+	passed &= checkWrite(mode + " copy *= s", [](SharedMatrix& copy)
+	{
+		copy *= 2.0;
+	}, [](const Matrix<double>& original)
+	{
+		return Matrix<double>(original * 2.0);
+	}, true);
+	passed &= checkWrite(mode + " copy.axpy(s, other)", [&other](SharedMatrix& copy)
+	{
+		copy.axpy(3.0, other);
+	}, [&other](const Matrix<double>& original)
+	{
+		return Matrix<double>(original + Matrix<double>(other) * 3.0);
+	}, true);
+	passed &= checkWrite(mode + " copy.transposeInPlace()", [](SharedMatrix& copy)
+	{
+		copy.transposeInPlace();
+	}, [](const Matrix<double>& original)
+	{
+		return Matrix<double>(original.trans());
+	}, true);
+	passed &= checkWrite(mode + " copy += other", [&other](SharedMatrix& copy)
+	{
+		copy += other;
+	}, [&other](const Matrix<double>& original)
+	{
+		return Matrix<double>(original + Matrix<double>(other));
+	}, true);
+	passed &= checkWrite(mode + " copy = copy.trans()", [](SharedMatrix& copy)
+	{
+		copy = copy.trans();
+	}, [](const Matrix<double>& original)
+	{
+		return Matrix<double>(original.trans());
+	}, false);
+	passed &= checkWrite(mode + " copy = other + other", [&other](SharedMatrix& copy)
+	{
+		copy = other + other;
+	}, [&other](const Matrix<double>&)
+	{
+		return Matrix<double>(Matrix<double>(other) + Matrix<double>(other));
+	}, false);
+	passed &= checkWrite(mode + " copy = copy + other", [&other](SharedMatrix& copy)
+	{
+		copy = copy + other;
+	}, [&other](const Matrix<double>& original)
+	{
+		return Matrix<double>(original + Matrix<double>(other));
+	}, false);
+	passed &= checkWrite(mode + " copy = other * other", [&other](SharedMatrix& copy)
+	{
+		copy = other * other;
+	}, [&other](const Matrix<double>&)
+	{
+		return Matrix<double>(Matrix<double>(other) * Matrix<double>(other));
+	}, false);
+	passed &= checkWrite(mode + " copy = other.trans()", [&other](SharedMatrix& copy)
+	{
+		copy = other.trans();
+	}, [&other](const Matrix<double>&)
+	{
+		return Matrix<double>(Matrix<double>(other).trans());
+	}, false);
+	return passed;
+}
+
+/**
+ * Runs the checks.
+ * @return 0 if every check passed, 1 otherwise.
+ */
+int main()
+{
+	ThreadPool::setThreadCount(THREADS);
+	bool passed = checkExecution(Execution::SEQUENTIAL, "sequential");
+	passed &= checkExecution(Execution::PARALLEL, "parallel");
+	ExecutionPolicy::setExecution(Execution::AUTO);
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,570 @@
+// ElementKernels.h
+
+#ifndef ELEMENTKERNELS_H_
+#define ELEMENTKERNELS_H_
+
+// ------------------ Includes ------------------------------
+#include <cstddef>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && \
+	!defined(MATRIX_NO_SIMD)
+#define MATRIX_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * This class holds the element-wise kernels used by Matrix<T> on its flat cell arrays:
+ * dst = a + b, dst = a - b, dst = alpha * a and y += alpha * x. The destination may be the same
+ * array as one of the sources. It also holds the dot products of the matrix-vector products (see
+ * Gemv.h). This generic version is a plain loop; float, double and int get vectorized versions
+ * below when compiling for x86.
+ */
+template <class T>
+class ElementKernels
+{
+public:
+	/**
+	 * Computes dst[i] = a[i] + b[i] for every i < n.
+	 * @param dst The destination array
+	 * @param a The first source array
+	 * @param b The second source array
+	 * @param n Number of elements
+	 */
+	static void add(T* dst, const T* a, const T* b, std::size_t n)
+	{
+		for (std::size_t i = 0; i < n; i++)
+		{
+			dst[i] = a[i] + b[i];
+		}
+	}
+
+	/**
+	 * Computes dst[i] = a[i] - b[i] for every i < n.
+	 * @param dst The destination array
+	 * @param a The first source array
+	 * @param b The second source array
+	 * @param n Number of elements
+	 */
+	static void subtract(T* dst, const T* a, const T* b, std::size_t n)
+	{
+		for (std::size_t i = 0; i < n; i++)
+		{
+			dst[i] = a[i] - b[i];
+		}
+	}
+
+	/**
+	 * Computes dst[i] = alpha * a[i] for every i < n.
+	 * @param dst The destination array
+	 * @param a The source array
+	 * @param alpha The scale
+	 * @param n Number of elements
+	 */
+	static void scale(T* dst, const T* a, const T& alpha, std::size_t n)
+	{
+		for (std::size_t i = 0; i < n; i++)
+		{
+			dst[i] = alpha * a[i];
+		}
+	}
+
+	/**
+	 * Computes y[i] += alpha * x[i] for every i < n.
+	 * @param n Number of elements
+	 * @param alpha The scale of x
+	 * @param x The source array
+	 * @param y The destination array
+	 */
+	static void axpy(std::size_t n, const T& alpha, const T* x, T* y)
+	{
+		for (std::size_t i = 0; i < n; i++)
+		{
+			y[i] += alpha * x[i];
+		}
+	}
+
+	/**
+	 * Computes the sum of a[i] * x[i] for every i < n.
+	 * @param a The first array
+	 * @param x The second array
+	 * @param n Number of elements
+	 * @return The dot product.
+	 */
+	static T dot(const T* a, const T* x, std::size_t n)
+	{
+		T sum(0);
+		for (std::size_t i = 0; i < n; i++)
+		{
+			sum += a[i] * x[i];
+		}
+		return sum;
+	}
+
+	/**
+	 * Computes the dot products of four rows of a matrix with x, reading x once:
+	 * out[r] = the sum of a[r * lda + i] * x[i] for every i < n, for every r < 4.
+	 * @param a The first cell of the first row
+	 * @param lda Distance between two consecutive rows
+	 * @param x The vector
+	 * @param n Number of elements of the rows and of x
+	 * @param out The four dot products
+	 */
+	static void dot4(const T* a, std::size_t lda, const T* x, std::size_t n, T* out)
+	{
+		for (unsigned int r = 0; r < 4; r++)
+		{
+			out[r] = dot(a + r * lda, x, n);
+		}
+	}
+};
+
+#ifdef MATRIX_SIMD_X86
+
+#define MATRIX_TARGET(isa) __attribute__((target(isa)))
+
+/**
+ * Tags for the instruction sets the kernels are compiled for.
+ */
+struct SimdSse2 {};
+struct SimdAvx2 {};
+struct SimdAvx512 {};
+
+/**
+ * The vector type and operations of instruction set Isa on elements of type T. Vectors of double
+ * also swap the two elements of every pair (swapPairs), for complex numbers stored as interleaved
+ * (real, imaginary) pairs.
+ */
+template <class Isa, class T>
+struct SimdVector;
+
+template <>
+struct SimdVector<SimdSse2, double>
+{
+	typedef __m128d Vector;
+	static const unsigned int WIDTH = 2;
+	MATRIX_TARGET("sse2") static Vector load(const double* p) { return _mm_loadu_pd(p); }
+	MATRIX_TARGET("sse2") static void store(double* p, Vector v) { _mm_storeu_pd(p, v); }
+	MATRIX_TARGET("sse2") static Vector set1(double x) { return _mm_set1_pd(x); }
+	MATRIX_TARGET("sse2") static Vector add(Vector a, Vector b) { return _mm_add_pd(a, b); }
+	MATRIX_TARGET("sse2") static Vector sub(Vector a, Vector b) { return _mm_sub_pd(a, b); }
+	MATRIX_TARGET("sse2") static Vector mul(Vector a, Vector b) { return _mm_mul_pd(a, b); }
+	MATRIX_TARGET("sse2") static Vector swapPairs(Vector a) { return _mm_shuffle_pd(a, a, 1); }
+};
+
+template <>
+struct SimdVector<SimdSse2, float>
+{
+	typedef __m128 Vector;
+	static const unsigned int WIDTH = 4;
+	MATRIX_TARGET("sse2") static Vector load(const float* p) { return _mm_loadu_ps(p); }
+	MATRIX_TARGET("sse2") static void store(float* p, Vector v) { _mm_storeu_ps(p, v); }
+	MATRIX_TARGET("sse2") static Vector set1(float x) { return _mm_set1_ps(x); }
+	MATRIX_TARGET("sse2") static Vector add(Vector a, Vector b) { return _mm_add_ps(a, b); }
+	MATRIX_TARGET("sse2") static Vector sub(Vector a, Vector b) { return _mm_sub_ps(a, b); }
+	MATRIX_TARGET("sse2") static Vector mul(Vector a, Vector b) { return _mm_mul_ps(a, b); }
+};
+
+template <>
+struct SimdVector<SimdSse2, int>
+{
+	typedef __m128i Vector;
+	static const unsigned int WIDTH = 4;
+	MATRIX_TARGET("sse2") static Vector load(const int* p)
+	{
+		return _mm_loadu_si128((const __m128i*)p);
+	}
+	MATRIX_TARGET("sse2") static void store(int* p, Vector v) { _mm_storeu_si128((__m128i*)p, v); }
+	MATRIX_TARGET("sse2") static Vector set1(int x) { return _mm_set1_epi32(x); }
+	MATRIX_TARGET("sse2") static Vector add(Vector a, Vector b) { return _mm_add_epi32(a, b); }
+	MATRIX_TARGET("sse2") static Vector sub(Vector a, Vector b) { return _mm_sub_epi32(a, b); }
+	/**
+	 * SSE2 has no 32-bit low multiply, so the even and odd lanes are multiplied separately.
+	 */
+	MATRIX_TARGET("sse2") static Vector mul(Vector a, Vector b)
+	{
+		__m128i even = _mm_mul_epu32(a, b);
+		__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+								  _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+};
+
+template <>
+struct SimdVector<SimdAvx2, double>
+{
+	typedef __m256d Vector;
+	static const unsigned int WIDTH = 4;
+	MATRIX_TARGET("avx2") static Vector load(const double* p) { return _mm256_loadu_pd(p); }
+	MATRIX_TARGET("avx2") static void store(double* p, Vector v) { _mm256_storeu_pd(p, v); }
+	MATRIX_TARGET("avx2") static Vector set1(double x) { return _mm256_set1_pd(x); }
+	MATRIX_TARGET("avx2") static Vector add(Vector a, Vector b) { return _mm256_add_pd(a, b); }
+	MATRIX_TARGET("avx2") static Vector sub(Vector a, Vector b) { return _mm256_sub_pd(a, b); }
+	MATRIX_TARGET("avx2") static Vector mul(Vector a, Vector b) { return _mm256_mul_pd(a, b); }
+	MATRIX_TARGET("avx2") static Vector swapPairs(Vector a) { return _mm256_permute_pd(a, 0x5); }
+};
+
+template <>
+struct SimdVector<SimdAvx2, float>
+{
+	typedef __m256 Vector;
+	static const unsigned int WIDTH = 8;
+	MATRIX_TARGET("avx2") static Vector load(const float* p) { return _mm256_loadu_ps(p); }
+	MATRIX_TARGET("avx2") static void store(float* p, Vector v) { _mm256_storeu_ps(p, v); }
+	MATRIX_TARGET("avx2") static Vector set1(float x) { return _mm256_set1_ps(x); }
+	MATRIX_TARGET("avx2") static Vector add(Vector a, Vector b) { return _mm256_add_ps(a, b); }
+	MATRIX_TARGET("avx2") static Vector sub(Vector a, Vector b) { return _mm256_sub_ps(a, b); }
+	MATRIX_TARGET("avx2") static Vector mul(Vector a, Vector b) { return _mm256_mul_ps(a, b); }
+};
+
+template <>
+struct SimdVector<SimdAvx2, int>
+{
+	typedef __m256i Vector;
+	static const unsigned int WIDTH = 8;
+	MATRIX_TARGET("avx2") static Vector load(const int* p)
+	{
+		return _mm256_loadu_si256((const __m256i*)p);
+	}
+	MATRIX_TARGET("avx2") static void store(int* p, Vector v)
+	{
+		_mm256_storeu_si256((__m256i*)p, v);
+	}
+	MATRIX_TARGET("avx2") static Vector set1(int x) { return _mm256_set1_epi32(x); }
+	MATRIX_TARGET("avx2") static Vector add(Vector a, Vector b) { return _mm256_add_epi32(a, b); }
+	MATRIX_TARGET("avx2") static Vector sub(Vector a, Vector b) { return _mm256_sub_epi32(a, b); }
+	MATRIX_TARGET("avx2") static Vector mul(Vector a, Vector b)
+	{
+		return _mm256_mullo_epi32(a, b);
+	}
+};
+
+template <>
+struct SimdVector<SimdAvx512, double>
+{
+	typedef __m512d Vector;
+	static const unsigned int WIDTH = 8;
+	MATRIX_TARGET("avx512f") static Vector load(const double* p) { return _mm512_loadu_pd(p); }
+	MATRIX_TARGET("avx512f") static void store(double* p, Vector v) { _mm512_storeu_pd(p, v); }
+	MATRIX_TARGET("avx512f") static Vector set1(double x) { return _mm512_set1_pd(x); }
+	MATRIX_TARGET("avx512f") static Vector add(Vector a, Vector b) { return _mm512_add_pd(a, b); }
+	MATRIX_TARGET("avx512f") static Vector sub(Vector a, Vector b) { return _mm512_sub_pd(a, b); }
+	MATRIX_TARGET("avx512f") static Vector mul(Vector a, Vector b) { return _mm512_mul_pd(a, b); }
+	MATRIX_TARGET("avx512f") static Vector swapPairs(Vector a)
+	{
+		return _mm512_mask_permute_pd(a, 0xFF, a, 0x55);
+	}
+};
+
+template <>
+struct SimdVector<SimdAvx512, float>
+{
+	typedef __m512 Vector;
+	static const unsigned int WIDTH = 16;
+	MATRIX_TARGET("avx512f") static Vector load(const float* p) { return _mm512_loadu_ps(p); }
+	MATRIX_TARGET("avx512f") static void store(float* p, Vector v) { _mm512_storeu_ps(p, v); }
+	MATRIX_TARGET("avx512f") static Vector set1(float x) { return _mm512_set1_ps(x); }
+	MATRIX_TARGET("avx512f") static Vector add(Vector a, Vector b) { return _mm512_add_ps(a, b); }
+	MATRIX_TARGET("avx512f") static Vector sub(Vector a, Vector b) { return _mm512_sub_ps(a, b); }
+	MATRIX_TARGET("avx512f") static Vector mul(Vector a, Vector b) { return _mm512_mul_ps(a, b); }
+};
+
+template <>
+struct SimdVector<SimdAvx512, int>
+{
+	typedef __m512i Vector;
+	static const unsigned int WIDTH = 16;
+	MATRIX_TARGET("avx512f") static Vector load(const int* p) { return _mm512_loadu_si512(p); }
+	MATRIX_TARGET("avx512f") static void store(int* p, Vector v) { _mm512_storeu_si512(p, v); }
+	MATRIX_TARGET("avx512f") static Vector set1(int x) { return _mm512_set1_epi32(x); }
+	MATRIX_TARGET("avx512f") static Vector add(Vector a, Vector b)
+	{
+		return _mm512_add_epi32(a, b);
+	}
+	MATRIX_TARGET("avx512f") static Vector sub(Vector a, Vector b)
+	{
+		return _mm512_sub_epi32(a, b);
+	}
+	MATRIX_TARGET("avx512f") static Vector mul(Vector a, Vector b)
+	{
+		return _mm512_mullo_epi32(a, b);
+	}
+};
+
+/**
+ * The loops of the element-wise kernels for instruction set Isa. Each loop has to be compiled for
+ * the instruction set of the vectors it uses, so the same bodies are stamped out once per set.
+ */
+template <class Isa>
+struct SimdLoops;
+
+#define MATRIX_SIMD_LOOPS(ISA, TARGET) \
+template <> \
+struct SimdLoops<ISA> \
+{ \
+	template <class T, bool SUBTRACT> \
+	TARGET static void binary(T* dst, const T* a, const T* b, std::size_t n) \
+	{ \
+		typedef SimdVector<ISA, T> V; \
+		std::size_t i = 0; \
+		for (; i + 2 * V::WIDTH <= n; i += 2 * V::WIDTH) \
+		{ \
+			typename V::Vector x0 = V::load(a + i), x1 = V::load(a + i + V::WIDTH); \
+			typename V::Vector y0 = V::load(b + i), y1 = V::load(b + i + V::WIDTH); \
+			V::store(dst + i, SUBTRACT ? V::sub(x0, y0) : V::add(x0, y0)); \
+			V::store(dst + i + V::WIDTH, SUBTRACT ? V::sub(x1, y1) : V::add(x1, y1)); \
+		} \
+		for (; i < n; i++) \
+		{ \
+			dst[i] = SUBTRACT ? a[i] - b[i] : a[i] + b[i]; \
+		} \
+	} \
+	\
+	template <class T> \
+	TARGET static void scale(T* dst, const T* a, const T& alpha, std::size_t n) \
+	{ \
+		typedef SimdVector<ISA, T> V; \
+		typename V::Vector factor = V::set1(alpha); \
+		std::size_t i = 0; \
+		for (; i + 2 * V::WIDTH <= n; i += 2 * V::WIDTH) \
+		{ \
+			V::store(dst + i, V::mul(factor, V::load(a + i))); \
+			V::store(dst + i + V::WIDTH, V::mul(factor, V::load(a + i + V::WIDTH))); \
+		} \
+		for (; i < n; i++) \
+		{ \
+			dst[i] = alpha * a[i]; \
+		} \
+	} \
+	\
+	template <class T> \
+	TARGET static void axpy(std::size_t n, const T& alpha, const T* x, T* y) \
+	{ \
+		typedef SimdVector<ISA, T> V; \
+		typename V::Vector factor = V::set1(alpha); \
+		std::size_t i = 0; \
+		for (; i + 2 * V::WIDTH <= n; i += 2 * V::WIDTH) \
+		{ \
+			typename V::Vector y0 = V::add(V::load(y + i), V::mul(factor, V::load(x + i))); \
+			typename V::Vector y1 = V::add(V::load(y + i + V::WIDTH), \
+										   V::mul(factor, V::load(x + i + V::WIDTH))); \
+			V::store(y + i, y0); \
+			V::store(y + i + V::WIDTH, y1); \
+		} \
+		for (; i < n; i++) \
+		{ \
+			y[i] += alpha * x[i]; \
+		} \
+	} \
+	\
+	template <class T> \
+	TARGET static T dot(const T* a, const T* x, std::size_t n) \
+	{ \
+		typedef SimdVector<ISA, T> V; \
+		typename V::Vector s0 = V::set1(T(0)), s1 = V::set1(T(0)); \
+		std::size_t i = 0; \
+		for (; i + 2 * V::WIDTH <= n; i += 2 * V::WIDTH) \
+		{ \
+			s0 = V::add(s0, V::mul(V::load(a + i), V::load(x + i))); \
+			s1 = V::add(s1, V::mul(V::load(a + i + V::WIDTH), V::load(x + i + V::WIDTH))); \
+		} \
+		T sum = total<T>(V::add(s0, s1)); \
+		for (; i < n; i++) \
+		{ \
+			sum += a[i] * x[i]; \
+		} \
+		return sum; \
+	} \
+	\
+	template <class T> \
+	TARGET static void dot4(const T* a, std::size_t lda, const T* x, std::size_t n, T* out) \
+	{ \
+		typedef SimdVector<ISA, T> V; \
+		const T* a0 = a; \
+		const T* a1 = a + lda; \
+		const T* a2 = a + 2 * lda; \
+		const T* a3 = a + 3 * lda; \
+		typename V::Vector s0 = V::set1(T(0)), s1 = s0, s2 = s0, s3 = s0; \
+		std::size_t i = 0; \
+		for (; i + V::WIDTH <= n; i += V::WIDTH) \
+		{ \
+			typename V::Vector xv = V::load(x + i); \
+			s0 = V::add(s0, V::mul(V::load(a0 + i), xv)); \
+			s1 = V::add(s1, V::mul(V::load(a1 + i), xv)); \
+			s2 = V::add(s2, V::mul(V::load(a2 + i), xv)); \
+			s3 = V::add(s3, V::mul(V::load(a3 + i), xv)); \
+		} \
+		out[0] = total<T>(s0); \
+		out[1] = total<T>(s1); \
+		out[2] = total<T>(s2); \
+		out[3] = total<T>(s3); \
+		for (; i < n; i++) \
+		{ \
+			out[0] += a0[i] * x[i]; \
+			out[1] += a1[i] * x[i]; \
+			out[2] += a2[i] * x[i]; \
+			out[3] += a3[i] * x[i]; \
+		} \
+	} \
+	\
+	template <class T> \
+	TARGET static T total(typename SimdVector<ISA, T>::Vector v) \
+	{ \
+		typedef SimdVector<ISA, T> V; \
+		T cells[V::WIDTH]; \
+		V::store(cells, v); \
+		T sum(0); \
+		for (unsigned int i = 0; i < V::WIDTH; i++) \
+		{ \
+			sum += cells[i]; \
+		} \
+		return sum; \
+	} \
+};
+
+MATRIX_SIMD_LOOPS(SimdSse2, MATRIX_TARGET("sse2"))
+MATRIX_SIMD_LOOPS(SimdAvx2, MATRIX_TARGET("avx2"))
+MATRIX_SIMD_LOOPS(SimdAvx512, MATRIX_TARGET("avx512f"))
+
+#undef MATRIX_SIMD_LOOPS
+
+/**
+ * Element-wise kernels for float, double and int. The widest instruction set supported by the
+ * running CPU is detected on the first call, and later calls go straight to its loops.
+ */
+template <class T>
+class SimdElementKernels
+{
+public:
+	/**
+	 * Computes dst[i] = a[i] + b[i] for every i < n.
+	 * @param dst The destination array
+	 * @param a The first source array
+	 * @param b The second source array
+	 * @param n Number of elements
+	 */
+	static void add(T* dst, const T* a, const T* b, std::size_t n)
+	{
+		_table().add(dst, a, b, n);
+	}
+
+	/**
+	 * Computes dst[i] = a[i] - b[i] for every i < n.
+	 * @param dst The destination array
+	 * @param a The first source array
+	 * @param b The second source array
+	 * @param n Number of elements
+	 */
+	static void subtract(T* dst, const T* a, const T* b, std::size_t n)
+	{
+		_table().subtract(dst, a, b, n);
+	}
+
+	/**
+	 * Computes dst[i] = alpha * a[i] for every i < n.
+	 * @param dst The destination array
+	 * @param a The source array
+	 * @param alpha The scale
+	 * @param n Number of elements
+	 */
+	static void scale(T* dst, const T* a, const T& alpha, std::size_t n)
+	{
+		_table().scale(dst, a, alpha, n);
+	}
+
+	/**
+	 * Computes y[i] += alpha * x[i] for every i < n.
+	 * @param n Number of elements
+	 * @param alpha The scale of x
+	 * @param x The source array
+	 * @param y The destination array
+	 */
+	static void axpy(std::size_t n, const T& alpha, const T* x, T* y)
+	{
+		_table().axpy(n, alpha, x, y);
+	}
+
+	/**
+	 * Computes the sum of a[i] * x[i] for every i < n.
+	 * @param a The first array
+	 * @param x The second array
+	 * @param n Number of elements
+	 * @return The dot product.
+	 */
+	static T dot(const T* a, const T* x, std::size_t n)
+	{
+		return _table().dot(a, x, n);
+	}
+
+	/**
+	 * Computes the dot products of four rows of a matrix with x, reading x once:
+	 * out[r] = the sum of a[r * lda + i] * x[i] for every i < n, for every r < 4.
+	 * @param a The first cell of the first row
+	 * @param lda Distance between two consecutive rows
+	 * @param x The vector
+	 * @param n Number of elements of the rows and of x
+	 * @param out The four dot products
+	 */
+	static void dot4(const T* a, std::size_t lda, const T* x, std::size_t n, T* out)
+	{
+		_table().dot4(a, lda, x, n, out);
+	}
+
+private:
+	/**
+	 * The loops chosen for the running CPU.
+	 */
+	struct _Table
+	{
+		void (*add)(T*, const T*, const T*, std::size_t);
+		void (*subtract)(T*, const T*, const T*, std::size_t);
+		void (*scale)(T*, const T*, const T&, std::size_t);
+		void (*axpy)(std::size_t, const T&, const T*, T*);
+		T (*dot)(const T*, const T*, std::size_t);
+		void (*dot4)(const T*, std::size_t, const T*, std::size_t, T*);
+	};
+
+	/**
+	 * @return The loops of instruction set Isa.
+	 */
+	template <class Isa>
+	static _Table _tableOf()
+	{
+		_Table table = {&SimdLoops<Isa>::template binary<T, false>,
+						&SimdLoops<Isa>::template binary<T, true>,
+						&SimdLoops<Isa>::template scale<T>,
+						&SimdLoops<Isa>::template axpy<T>,
+						&SimdLoops<Isa>::template dot<T>,
+						&SimdLoops<Isa>::template dot4<T>};
+		return table;
+	}
+
+	/**
+	 * @return The loops chosen for the running CPU, detected on the first call.
+	 */
+	static const _Table& _table()
+	{
+		static const _Table table = __builtin_cpu_supports("avx512f") ? _tableOf<SimdAvx512>() :
+									__builtin_cpu_supports("avx2") ? _tableOf<SimdAvx2>() :
+									_tableOf<SimdSse2>();
+		return table;
+	}
+};
+
+template <>
+class ElementKernels<float> : public SimdElementKernels<float>
+{
+};
+
+template <>
+class ElementKernels<double> : public SimdElementKernels<double>
+{
+};
+
+template <>
+class ElementKernels<int> : public SimdElementKernels<int>
+{
+};
+
+#endif /* MATRIX_SIMD_X86 */
+
+#endif /* ELEMENTKERNELS_H_ */
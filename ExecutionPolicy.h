@@ -0,0 +1,496 @@
+// ExecutionPolicy.h
+
+#ifndef EXECUTIONPOLICY_H_
+#define EXECUTIONPOLICY_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ThreadPool.h"
+#include "Gemm.h"
+#include "ElementKernels.h"
+#include "MatrixProfiler.h"
+
+/**
+ * How the operations of Matrix<T> are run.
+ */
+enum class Execution
+{
+	AUTO, /**< Chosen per operation by the cost model of ExecutionPolicy */
+	SEQUENTIAL, /**< Always on the calling thread */
+	PARALLEL /**< Always split between the threads of the pool */
+};
+
+/**
+ * The kinds of operations the cost model tells apart.
+ */
+enum class Operation
+{
+	ELEMENTWISE, /**< Cell by cell evaluation: +, -, scaling, copies */
+	TRANSPOSE, /**< Transposed copies */
+	PRODUCT /**< Matrix products */
+};
+
+/**
+ * The sizes from which the cost model of ExecutionPolicy switches strategy.
+ */
+struct ExecutionThresholds
+{
+	unsigned long long elementwiseBytes; /**< Bytes written from which + and - run in parallel */
+	unsigned long long transposeBytes; /**< Bytes written from which transposes run in parallel */
+	unsigned long long productFlops; /**< Multiply-adds from which products run in parallel */
+	unsigned long long blockedFlops; /**< Multiply-adds from which products are blocked */
+};
+
+/**
+ * This class decides how every operation of Matrix<T> is run. Under Execution::AUTO (the default)
+ * an operation runs in parallel only when its sequential time is expected to be several times
+ * the cost of handing work to the thread pool, and products too small to amortize the packing of
+ * the blocked engine run as a plain loop.
+ *
+ * The thresholds of the cost model are set on first use: read from the file named by the
+ * MATRIX_THRESHOLDS environment variable if it is set, or calibrated by timing the thread pool
+ * and the kernels on the running machine otherwise. They can also be loaded or set explicitly.
+ * Operations run in the chunks of a parallel loop, or while another thread sets the thresholds,
+ * use the defaults instead of waiting, and forced executions never set them.
+ *
+ * The execution set by setExecution applies to all threads, and ScopedExecution overrides it on
+ * the calling thread for the duration of a scope.
+ */
+class ExecutionPolicy
+{
+public:
+	// ------------------ Policy ----------------------------
+	/**
+	 * Sets the execution used by all threads without a scoped override.
+	 * @param execution The execution
+	 */
+	static void setExecution(Execution execution)
+	{
+		_global().store(execution);
+	}
+
+	/**
+	 * @return The execution used by the calling thread.
+	 */
+	static Execution execution()
+	{
+		const _Override& local = _local();
+		return local.active ? local.execution : _global().load();
+	}
+
+	// ------------------ Cost model ------------------------
+	/**
+	 * Decides whether an operation is split between the threads of the pool.
+	 * @param operation The kind of operation
+	 * @param work The size of the operation: bytes written for ELEMENTWISE and TRANSPOSE,
+	 * 		   multiply-adds for PRODUCT
+	 * @return true if the operation should run in parallel, false otherwise.
+	 */
+	static bool parallel(Operation operation, unsigned long long work)
+	{
+		bool parallel = _decide(operation, work);
+		MATRIX_PROFILE_PATH(parallel);
+		return parallel;
+	}
+
+	/**
+	 * Decides whether a product is computed by the blocked engine or by a plain loop.
+	 * @param flops The number of multiply-adds of the product
+	 * @return true if the product should use the blocked engine, false otherwise.
+	 */
+	static bool blocked(unsigned long long flops)
+	{
+		// Forced executions do not use the cost model, so they do not set its thresholds
+		const ExecutionThresholds& limits =
+			execution() == Execution::AUTO ? thresholds() : _current();
+		return flops >= limits.blockedFlops;
+	}
+
+	// ------------------ Thresholds ------------------------
+	/**
+	 * Returns the thresholds of the cost model, set by the first call made outside the chunks of
+	 * the thread pool. A call from a chunk does not set them, since the calibration would time
+	 * the pool while its threads run the other chunks of the loop. While one thread sets them,
+	 * the other calls, and the calls nested in the chunks the calibrating thread runs while it
+	 * waits for the pool (see ThreadPool::parallelFor()), return the defaults without waiting.
+	 * @return The thresholds, or the defaults while they are not set.
+	 */
+	static const ExecutionThresholds& thresholds()
+	{
+		_State& state = _state();
+		_Status unset = _Status::UNSET;
+		if (state.status.load(std::memory_order_acquire) == _Status::READY)
+		{
+			return state.thresholds;
+		}
+		if (ThreadPool::inChunk() ||
+			!state.status.compare_exchange_strong(unset, _Status::CALIBRATING))
+		{
+			return _defaults();
+		}
+
+		ExecutionThresholds initial = _defaults();
+		try
+		{
+			const char* path = std::getenv("MATRIX_THRESHOLDS");
+			if (path == nullptr || !_read(path, initial))
+			{
+				initial = calibrate();
+			}
+		}
+		catch (...)
+		{
+			state.status.store(_Status::UNSET);
+			throw;
+		}
+		state.thresholds = initial;
+		state.status.store(_Status::READY, std::memory_order_release);
+		return state.thresholds;
+	}
+
+	/**
+	 * Sets the thresholds of the cost model. Must not be called while other threads run
+	 * operations.
+	 * @param thresholds The thresholds
+	 */
+	static void setThresholds(const ExecutionThresholds& thresholds)
+	{
+		_State& state = _state();
+		state.thresholds = thresholds;
+		state.status.store(_Status::READY, std::memory_order_release);
+	}
+
+	/**
+	 * Loads the thresholds of the cost model from a file of "name value" lines, where name is
+	 * elementwise_bytes, transpose_bytes, product_flops or blocked_flops. Missing names keep their
+	 * current value; lines starting with # are ignored. Must not be called while other threads
+	 * run operations.
+	 * @param path The path of the file
+	 * @return true if the file was read, false if it cannot be opened or is malformed.
+	 */
+	static bool loadThresholds(const std::string& path)
+	{
+		ExecutionThresholds loaded = thresholds();
+		if (!_read(path.c_str(), loaded))
+		{
+			return false;
+		}
+		setThresholds(loaded);
+		return true;
+	}
+
+	/**
+	 * Measures the thresholds on the running machine: the time of handing empty chunks to the
+	 * thread pool, and the speed of the element-wise kernels and of both product engines on
+	 * double. An operation goes parallel once its sequential time is OVERHEAD_FACTOR times the
+	 * hand-off time. Takes a few milliseconds.
+	 * @return The measured thresholds.
+	 */
+	static ExecutionThresholds calibrate()
+	{
+		static const std::size_t ELEMENTWISE_CELLS = 1 << 16;
+		static const unsigned int PRODUCT_SIZE = 64;
+		ExecutionThresholds measured = _defaults();
+		ThreadPool& pool = ThreadPool::instance();
+		if (pool.threadCount() > 1)
+		{
+			double overhead = _best([&pool]()
+			{
+				pool.parallelFor(0, pool.threadCount(), 1, [](unsigned int, unsigned int) {});
+			});
+
+			std::vector<double> a(ELEMENTWISE_CELLS, 1.0), b(ELEMENTWISE_CELLS, 2.0);
+			double addTime = _best([&a, &b]()
+			{
+				ElementKernels<double>::add(a.data(), a.data(), b.data(), a.size());
+			});
+			double bytesPerSecond = ELEMENTWISE_CELLS * sizeof(double) / addTime;
+			measured.elementwiseBytes = (unsigned long long)(OVERHEAD_FACTOR * overhead *
+															 bytesPerSecond);
+			measured.transposeBytes = measured.elementwiseBytes;
+
+			std::vector<double> c(PRODUCT_SIZE * PRODUCT_SIZE);
+			double productTime = _best([&a, &c]()
+			{
+				Gemm<double>::multiply(PRODUCT_SIZE, PRODUCT_SIZE, PRODUCT_SIZE, 1.0, a.data(),
+									   PRODUCT_SIZE, 1, a.data(), PRODUCT_SIZE, 1, c.data(),
+									   PRODUCT_SIZE);
+			});
+			double flopsPerSecond = (double)PRODUCT_SIZE * PRODUCT_SIZE * PRODUCT_SIZE /
+									productTime;
+			measured.productFlops = (unsigned long long)(OVERHEAD_FACTOR * overhead *
+														 flopsPerSecond);
+		}
+
+		measured.blockedFlops = _measureBlocked();
+		return measured;
+	}
+
+private:
+	/**
+	 * How many times the sequential time of a parallel operation has to exceed the cost of
+	 * handing it to the pool.
+	 */
+	static constexpr double OVERHEAD_FACTOR = 4;
+
+	/**
+	 * An execution set for the calling thread only.
+	 */
+	struct _Override
+	{
+		bool active; /**< Whether the override is set */
+		Execution execution; /**< The execution */
+	};
+
+	/**
+	 * The steps of the initialization of the thresholds.
+	 */
+	enum class _Status
+	{
+		UNSET, /**< Not set yet */
+		CALIBRATING, /**< Being read or calibrated by a thread */
+		READY /**< Set */
+	};
+
+	/**
+	 * The thresholds and their one-time initialization.
+	 */
+	struct _State
+	{
+		std::atomic<_Status> status{_Status::UNSET}; /**< The initialization of the thresholds */
+		ExecutionThresholds thresholds; /**< The thresholds, once status is READY */
+	};
+
+	/**
+	 * The cost model of parallel(), before it is recorded by MatrixProfiler.
+	 * @param operation The kind of operation
+	 * @param work Its work, in the unit of its threshold
+	 * @return Whether it runs in parallel.
+	 */
+	static bool _decide(Operation operation, unsigned long long work)
+	{
+		Execution current = execution();
+		if (current != Execution::AUTO)
+		{
+			return current == Execution::PARALLEL;
+		}
+		if (ThreadPool::instance().threadCount() <= 1)
+		{
+			return false;
+		}
+		const ExecutionThresholds& limits = thresholds();
+		switch (operation)
+		{
+		case Operation::ELEMENTWISE:
+			return work >= limits.elementwiseBytes;
+		case Operation::TRANSPOSE:
+			return work >= limits.transposeBytes;
+		default:
+			return work >= limits.productFlops;
+		}
+	}
+
+	/**
+	 * @return The execution of all threads.
+	 */
+	static std::atomic<Execution>& _global()
+	{
+		static std::atomic<Execution> execution(Execution::AUTO);
+		return execution;
+	}
+
+	/**
+	 * @return The override of the calling thread.
+	 */
+	static _Override& _local()
+	{
+		static thread_local _Override local = {false, Execution::AUTO};
+		return local;
+	}
+
+	/**
+	 * @return The process-wide state of the cost model.
+	 */
+	static _State& _state()
+	{
+		static _State state;
+		return state;
+	}
+
+	/**
+	 * @return The thresholds used when nothing is measured.
+	 */
+	static const ExecutionThresholds& _defaults()
+	{
+		static const ExecutionThresholds defaults = {1ull << 20, 1ull << 20, 1ull << 22,
+													 1ull << 12};
+		return defaults;
+	}
+
+	/**
+	 * @return The thresholds if they are set, the defaults otherwise, without setting them.
+	 */
+	static const ExecutionThresholds& _current()
+	{
+		_State& state = _state();
+		if (state.status.load(std::memory_order_acquire) == _Status::READY)
+		{
+			return state.thresholds;
+		}
+		return _defaults();
+	}
+
+	/**
+	 * @param func The function to time
+	 * @return The best time of several runs of func, in seconds.
+	 */
+	template <class Func>
+	static double _best(const Func& func)
+	{
+		static const unsigned int RUNS = 8;
+		double best = 0;
+		for (unsigned int i = 0; i < RUNS; i++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			func();
+			std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+			if (i == 0 || time.count() < best)
+			{
+				best = time.count();
+			}
+		}
+		return std::max(best, 1e-9);
+	}
+
+	/**
+	 * Times square double products with both engines, growing the size until the blocked one
+	 * is faster.
+	 * @return The number of multiply-adds from which the blocked engine wins.
+	 */
+	static unsigned long long _measureBlocked()
+	{
+		static const unsigned int MAX_SIZE = 64;
+		std::vector<double> a(MAX_SIZE * MAX_SIZE, 1.0), c(MAX_SIZE * MAX_SIZE);
+		for (unsigned int size = 8; size < MAX_SIZE; size += 8)
+		{
+			double loop = _best([&a, &c, size]()
+			{
+				Gemm<double, false>::multiply(size, size, size, 1.0, a.data(), size, 1, a.data(),
+											  size, 1, c.data(), size);
+			});
+			double blocked = _best([&a, &c, size]()
+			{
+				Gemm<double>::multiply(size, size, size, 1.0, a.data(), size, 1, a.data(), size, 1,
+									   c.data(), size);
+			});
+			if (blocked < loop)
+			{
+				return (unsigned long long)size * size * size;
+			}
+		}
+		return (unsigned long long)MAX_SIZE * MAX_SIZE * MAX_SIZE;
+	}
+
+	/**
+	 * Reads thresholds from a file of "name value" lines.
+	 * @param path The path of the file
+	 * @param thresholds The thresholds to update
+	 * @return true if the file was read, false if it cannot be opened or is malformed.
+	 */
+	static bool _read(const char* path, ExecutionThresholds& thresholds)
+	{
+		std::ifstream file(path);
+		if (!file)
+		{
+			return false;
+		}
+		ExecutionThresholds read = thresholds;
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream fields(line);
+			std::string name;
+			unsigned long long value;
+			if (!(fields >> name) || name[0] == '#')
+			{
+				continue;
+			}
+			if (!(fields >> value))
+			{
+				return false;
+			}
+			if (name == "elementwise_bytes")
+			{
+				read.elementwiseBytes = value;
+			}
+			else if (name == "transpose_bytes")
+			{
+				read.transposeBytes = value;
+			}
+			else if (name == "product_flops")
+			{
+				read.productFlops = value;
+			}
+			else if (name == "blocked_flops")
+			{
+				read.blockedFlops = value;
+			}
+			else
+			{
+				return false;
+			}
+		}
+		thresholds = read;
+		return true;
+	}
+
+	friend class ScopedExecution;
+};
+
+/**
+ * Overrides the execution of the calling thread until the end of the scope, restoring the
+ * previous one when destroyed:
+ *
+ *     {
+ *         ScopedExecution sequential(Execution::SEQUENTIAL);
+ *         c = a * b; // runs on this thread only
+ *     }
+ */
+class ScopedExecution
+{
+public:
+	/**
+	 * Sets the execution of the calling thread.
+	 * @param execution The execution
+	 */
+	explicit ScopedExecution(Execution execution) : _previous(ExecutionPolicy::_local())
+	{
+		ExecutionPolicy::_Override& local = ExecutionPolicy::_local();
+		local.active = true;
+		local.execution = execution;
+	}
+
+	/**
+	 * Destructor. Restores the previous execution of the calling thread.
+	 */
+	~ScopedExecution()
+	{
+		ExecutionPolicy::_local() = _previous;
+	}
+
+private:
+	ScopedExecution(const ScopedExecution&) = delete;
+	ScopedExecution& operator=(const ScopedExecution&) = delete;
+
+	// ------------------ Data members ----------------------
+	ExecutionPolicy::_Override _previous; /**< The execution before this scope */
+};
+
+#endif /* EXECUTIONPOLICY_H_ */
@@ -0,0 +1,500 @@
+// FixedMatrix.h
+
+#ifndef FIXEDMATRIX_H_
+#define FIXEDMATRIX_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include "MatrixExpression.h"
+#include "WrongDimensionsException.h"
+#include "OutOfMatrixException.h"
+
+/**
+ * Calls func(0), ..., func(N - 1), unrolled at compile time.
+ */
+template <unsigned int N>
+struct FixedUnroll
+{
+	template <class Func>
+	static void apply(const Func& func)
+	{
+		FixedUnroll<N - 1>::apply(func);
+		func(N - 1);
+	}
+};
+
+template <>
+struct FixedUnroll<0>
+{
+	template <class Func>
+	static void apply(const Func&)
+	{
+	}
+};
+
+/**
+ * This class represents a mathematical matrix of R X C cells, with dimensions known at compile
+ * time. The cells are stored inline, row by row, so fixed matrices are never allocated on the heap,
+ * and their operations are unrolled loops without any dimension check at run time: adding,
+ * multiplying or comparing fixed matrices of mismatching dimensions does not compile.
+ *
+ * A fixed matrix is also a matrix expression, so it can be used together with Matrix<T> (e.g.
+ * Matrix<T> m = fixed * dynamic) and assigned to a Matrix<T>. A fixed matrix can be initiated from
+ * a Matrix<T> of the same dimensions.
+ */
+template <class T, unsigned int R, unsigned int C>
+class FixedMatrix : public MatrixExpression<FixedMatrix<T, R, C> >
+{
+	static_assert(R > 0 && C > 0, "A fixed matrix has at least one row and one column");
+
+public:
+	/**
+	 * The type of the cells.
+	 */
+	typedef T value_type;
+
+	/**
+	 * Defining the const_iterator of FixedMatrix as a pointer to its cells.
+	 */
+	typedef const T* const_iterator;
+
+	// ------------------ Constructors ----------------------
+	/**
+	 * Initiates the matrix and sets its cells to 0.
+	 */
+	FixedMatrix()
+	{
+		_cells.fill(T(0));
+	}
+
+	/**
+	 * Initiates the matrix with the given cells.
+	 * @param cells The cells of the matrix, row by row
+	 */
+	explicit FixedMatrix(const std::array<T, R * C>& cells) : _cells(cells)
+	{
+	}
+
+	/**
+	 * Initiates the matrix with the cells of a matrix.
+	 * @param matrix The matrix
+	 * @throws WrongDimensionsException if matrix does not have R rows and C columns.
+	 */
+	template <class Allocator>
+	explicit FixedMatrix(const Matrix<T, Allocator>& matrix)
+	{
+		if (matrix.rows() != R || matrix.cols() != C)
+		{
+			throw WrongDimensionsException();
+		}
+		const T* source = matrix.data();
+		FixedUnroll<R * C>::apply([this, source](unsigned int i) { _cells[i] = source[i]; });
+	}
+
+	// ------------ Operators and Operations ----------------
+	/**
+	 * += operator. Adds other to this.
+	 * @param other The other matrix
+	 * @return reference to this
+	 */
+	FixedMatrix& operator+=(const FixedMatrix& other)
+	{
+		FixedUnroll<R * C>::apply([this, &other](unsigned int i) { _cells[i] += other._cells[i]; });
+		return *this;
+	}
+
+	/**
+	 * -= operator. Subtracts other from this.
+	 * @param other The other matrix
+	 * @return reference to this
+	 */
+	FixedMatrix& operator-=(const FixedMatrix& other)
+	{
+		FixedUnroll<R * C>::apply([this, &other](unsigned int i) { _cells[i] -= other._cells[i]; });
+		return *this;
+	}
+
+	/**
+	 * *= operator. Multiply the cells of this by a scalar.
+	 * @param scalar The scalar
+	 * @return reference to this
+	 */
+	FixedMatrix& operator*=(const T& scalar)
+	{
+		FixedUnroll<R * C>::apply([this, &scalar](unsigned int i) { _cells[i] *= scalar; });
+		return *this;
+	}
+
+	/**
+	 * *= operator. Multiply this by a square matrix.
+	 * @param other The other matrix
+	 * @return reference to this
+	 */
+	FixedMatrix& operator*=(const FixedMatrix<T, C, C>& other)
+	{
+		*this = *this * other;
+		return *this;
+	}
+
+	/**
+	 * Returns the transposed matrix of this (conjugated for Complex cells).
+	 * @return The transposed matrix.
+	 */
+	FixedMatrix<T, C, R> trans() const
+	{
+		FixedMatrix<T, C, R> result;
+		T* out = result.data();
+		FixedUnroll<R>::apply([this, out](unsigned int i)
+		{
+			FixedUnroll<C>::apply([this, out, i](unsigned int j)
+			{
+				out[j * R + i] = ElementConjugate<T>::apply(_cells[i * C + j]);
+			});
+		});
+		return result;
+	}
+
+	/**
+	 * Calculates and returns the trace of this. Only square matrices have a trace.
+	 * @return The trace.
+	 */
+	T trace() const
+	{
+		static_assert(R == C, "Only a square matrix has a trace");
+		T trace(0);
+		FixedUnroll<R>::apply([this, &trace](unsigned int i) { trace += _cells[i * (C + 1)]; });
+		return trace;
+	}
+
+	/**
+	 * () operator. Returns the cell located in the given coordinates. The coordinates are only
+	 * checked when NDEBUG is not defined; use at() for an access that is always checked.
+	 * @param row The cell row number
+	 * @param col The cell column number
+	 * @return The requested cell
+	 * @throws OutOfMatrixException if the requested cell is not exist in the matrix (without
+	 * 		   NDEBUG).
+	 */
+	T& operator()(unsigned int row, unsigned int col)
+	{
+#ifndef NDEBUG
+		_checkCell(row, col);
+#endif
+		return _cells[row * C + col];
+	}
+
+	/**
+	 * () operator. Returns the cell located in the given coordinates (const FixedMatrix). The
+	 * coordinates are only checked when NDEBUG is not defined.
+	 * @param row The cell row number
+	 * @param col The cell column number
+	 * @return The requested cell
+	 * @throws OutOfMatrixException if the requested cell is not exist in the matrix (without
+	 * 		   NDEBUG).
+	 */
+	const T& operator()(unsigned int row, unsigned int col) const
+	{
+#ifndef NDEBUG
+		_checkCell(row, col);
+#endif
+		return _cells[row * C + col];
+	}
+
+	/**
+	 * Returns the cell located in the given coordinates.
+	 * @param row The cell row number
+	 * @param col The cell column number
+	 * @return The requested cell
+	 * @throws OutOfMatrixException if the requested cell is not exist in the matrix.
+	 */
+	T& at(unsigned int row, unsigned int col)
+	{
+		_checkCell(row, col);
+		return _cells[row * C + col];
+	}
+
+	/**
+	 * Returns the cell located in the given coordinates (const FixedMatrix).
+	 * @param row The cell row number
+	 * @param col The cell column number
+	 * @return The requested cell
+	 * @throws OutOfMatrixException if the requested cell is not exist in the matrix.
+	 */
+	const T& at(unsigned int row, unsigned int col) const
+	{
+		_checkCell(row, col);
+		return _cells[row * C + col];
+	}
+
+	/**
+	 * @return The first cell of the matrix. The cells are stored row by row.
+	 */
+	T* data()
+	{
+		return _cells.data();
+	}
+
+	/**
+	 * @return The first cell of the matrix (const FixedMatrix).
+	 */
+	const T* data() const
+	{
+		return _cells.data();
+	}
+
+	/**
+	 * @return true if this matrix is square, false otherwise.
+	 */
+	static constexpr bool isSquareMatrix()
+	{
+		return R == C;
+	}
+
+	/**
+	 * @return The number of rows of the matrix.
+	 */
+	static constexpr unsigned int rows()
+	{
+		return R;
+	}
+
+	/**
+	 * @return The number of columns of the matrix.
+	 */
+	static constexpr unsigned int cols()
+	{
+		return C;
+	}
+
+	// ------------------ Iterator --------------------------
+	/**
+	 * @return iterator for the first cell of the matrix.
+	 */
+	const_iterator begin() const
+	{
+		return _cells.data();
+	}
+
+	/**
+	 * @return iterator for one after the last cell of the matrix.
+	 */
+	const_iterator end() const
+	{
+		return _cells.data() + R * C;
+	}
+
+	// ------------------ Evaluation ------------------------
+	/**
+	 * @return The cells of this as an operand of matrix expressions.
+	 */
+	MatrixOperand<T> operand() const
+	{
+		return MatrixOperand<T>(_cells.data(), R, C, C, 1);
+	}
+
+	/**
+	 * @param row The row number
+	 * @return The cells of the row.
+	 */
+	const T* rowPointer(unsigned int row) const
+	{
+		return _cells.data() + row * C;
+	}
+
+	/**
+	 * Writes the cells of a row to out.
+	 * @param row The row number
+	 * @param out The destination, holding C cells
+	 */
+	void evalRow(unsigned int row, T* out, unsigned int depth) const
+	{
+		operand().evalRow(row, out, depth);
+	}
+
+	/**
+	 * @param begin The first cell of the destination
+	 * @param end One after the last cell of the destination
+	 * @param rowStride Distance between two consecutive rows of the destination
+	 * @return Whether the cells of this overlap the destination.
+	 */
+	bool overlaps(const T* begin, const T* end, std::size_t rowStride) const
+	{
+		return operand().overlaps(begin, end, rowStride);
+	}
+
+	/**
+	 * @param begin The first cell of the destination
+	 * @param end One after the last cell of the destination
+	 * @param rowStride Distance between two consecutive rows of the destination
+	 * @return true if evaluating this row by row into the destination may read overwritten cells.
+	 */
+	bool conflicts(const T* begin, const T* end, std::size_t rowStride) const
+	{
+		return operand().conflicts(begin, end, rowStride);
+	}
+
+private:
+	// ------------------ Data members ----------------------
+	std::array<T, R * C> _cells; /**< Cells of the matrix */
+
+	// ------------------ Private functions -----------------
+	/**
+	 * Checks that the given coordinates are inside the matrix.
+	 * @param row The cell row number
+	 * @param col The cell column number
+	 * @throws OutOfMatrixException if the cell is not exist in the matrix.
+	 */
+	static void _checkCell(unsigned int row, unsigned int col)
+	{
+		if (row >= R || col >= C)
+		{
+			throw OutOfMatrixException();
+		}
+	}
+};
+
+/**
+ * Fixed matrices are held in larger expressions as operands referring to their cells.
+ */
+template <class T, unsigned int R, unsigned int C>
+struct ExpressionOperand<FixedMatrix<T, R, C> >
+{
+	typedef MatrixOperand<T> type;
+
+	static type make(const FixedMatrix<T, R, C>& matrix)
+	{
+		return matrix.operand();
+	}
+};
+
+/**
+ * Fixed matrices are given to the multiplication engine as they are.
+ */
+template <class T, unsigned int R, unsigned int C>
+struct GemmOperand<FixedMatrix<T, R, C> >
+{
+	typedef MatrixOperand<T> type;
+
+	static type make(const FixedMatrix<T, R, C>& matrix)
+	{
+		return matrix.operand();
+	}
+};
+
+// ------------------ Operators -------------------------
+/**
+ * + operator. Returns the sum of left and right, which must have the same dimensions.
+ * @param left The left matrix
+ * @param right The right matrix
+ * @return The result matrix
+ */
+template <class T, unsigned int R1, unsigned int C1, unsigned int R2, unsigned int C2>
+FixedMatrix<T, R1, C1> operator+(const FixedMatrix<T, R1, C1>& left,
+								 const FixedMatrix<T, R2, C2>& right)
+{
+	static_assert(R1 == R2 && C1 == C2, "Adding matrices of different dimensions");
+	FixedMatrix<T, R1, C1> result(left);
+	return result += right;
+}
+
+/**
+ * - operator. Returns the difference of left and right, which must have the same dimensions.
+ * @param left The left matrix
+ * @param right The right matrix
+ * @return The result matrix
+ */
+template <class T, unsigned int R1, unsigned int C1, unsigned int R2, unsigned int C2>
+FixedMatrix<T, R1, C1> operator-(const FixedMatrix<T, R1, C1>& left,
+								 const FixedMatrix<T, R2, C2>& right)
+{
+	static_assert(R1 == R2 && C1 == C2, "Subtracting matrices of different dimensions");
+	FixedMatrix<T, R1, C1> result(left);
+	return result -= right;
+}
+
+/**
+ * * operator. Returns the product of left and right (according to matrices multiplication). The
+ * number of columns of left must be the number of rows of right. Every row of the result is
+ * accumulated from the rows of right, so the unrolled row updates can be vectorized.
+ * @param left The left matrix
+ * @param right The right matrix
+ * @return The result matrix
+ */
+template <class T, unsigned int R, unsigned int K1, unsigned int K2, unsigned int C>
+FixedMatrix<T, R, C> operator*(const FixedMatrix<T, R, K1>& left,
+							   const FixedMatrix<T, K2, C>& right)
+{
+	static_assert(K1 == K2, "Multiplying matrices of mismatching dimensions");
+	FixedMatrix<T, R, C> result;
+	const T* a = left.data();
+	const T* b = right.data();
+	T* out = result.data();
+	FixedUnroll<R>::apply([a, b, out](unsigned int i)
+	{
+		FixedUnroll<K1>::apply([a, b, out, i](unsigned int k)
+		{
+			const T scale = a[i * K1 + k];
+			FixedUnroll<C>::apply([b, out, i, k, &scale](unsigned int j)
+			{
+				out[i * C + j] += scale * b[k * C + j];
+			});
+		});
+	});
+	return result;
+}
+
+/**
+ * * operator. Returns matrix multiplied by a scalar.
+ * @param matrix The matrix
+ * @param scalar The scalar
+ * @return The result matrix
+ */
+template <class T, unsigned int R, unsigned int C>
+FixedMatrix<T, R, C> operator*(const FixedMatrix<T, R, C>& matrix,
+							   const typename FixedMatrix<T, R, C>::value_type& scalar)
+{
+	FixedMatrix<T, R, C> result(matrix);
+	return result *= scalar;
+}
+
+/**
+ * * operator. Returns matrix multiplied by a scalar.
+ * @param scalar The scalar
+ * @param matrix The matrix
+ * @return The result matrix
+ */
+template <class T, unsigned int R, unsigned int C>
+FixedMatrix<T, R, C> operator*(const typename FixedMatrix<T, R, C>::value_type& scalar,
+							   const FixedMatrix<T, R, C>& matrix)
+{
+	return matrix * scalar;
+}
+
+/**
+ * == operator. Compare between left and right, which must have the same dimensions.
+ * @param left The left matrix
+ * @param right The right matrix
+ * @return true if left and right are equal, false otherwise.
+ */
+template <class T, unsigned int R1, unsigned int C1, unsigned int R2, unsigned int C2>
+bool operator==(const FixedMatrix<T, R1, C1>& left, const FixedMatrix<T, R2, C2>& right)
+{
+	static_assert(R1 == R2 && C1 == C2, "Comparing matrices of different dimensions");
+	return std::equal(left.begin(), left.end(), right.begin());
+}
+
+/**
+ * != operator. Returns the opposite of == operator.
+ * @param left The left matrix
+ * @param right The right matrix
+ * @return true if left and right are not equal, false otherwise.
+ */
+template <class T, unsigned int R1, unsigned int C1, unsigned int R2, unsigned int C2>
+bool operator!=(const FixedMatrix<T, R1, C1>& left, const FixedMatrix<T, R2, C2>& right)
+{
+	return !(left == right);
+}
+
+#endif /* FIXEDMATRIX_H_ */
@@ -0,0 +1,378 @@
+// Gemm.h
+
+#ifndef GEMM_H_
+#define GEMM_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Conjugation applied to the cells of a transposed matrix. Element types with a conjugate
+ * (Complex) specialize it, for the others transposing only swaps the indices.
+ */
+template <class T>
+struct ElementConjugate
+{
+	/**
+	 * Whether transposing conjugates the cells.
+	 */
+	static const bool CONJUGATES = false;
+
+	/**
+	 * @param x The cell
+	 * @return The conjugate of x.
+	 */
+	static const T& apply(const T& x)
+	{
+		return x;
+	}
+};
+
+/**
+ * Properties of the multiplication engine of T. Element types that get a blocked engine of their
+ * own (Complex, see ComplexKernels.h) specialize it.
+ */
+template <class T>
+struct GemmTraits
+{
+	/**
+	 * Whether Gemm<T> is the blocked engine rather than the plain triple loop.
+	 */
+	static const bool BLOCKED = std::is_arithmetic<T>::value;
+};
+
+/**
+ * This class is the matrix multiplication engine used by Matrix<T>. It computes
+ * C = alpha * A * B (or C += alpha * A * B) where A is m X k, B is k X n and C is m X n.
+ * A and B are given by a pointer and a row and column stride, so transposed operands can be
+ * multiplied without being copied, and either of them can be read conjugated (see
+ * ElementConjugate), so the conjugate transpose of a complex matrix is not copied either. C is
+ * row-major with the given leading dimension.
+ *
+ * This generic version is the plain triple loop, used for element types that are not arithmetic.
+ */
+template <class T, bool = GemmTraits<T>::BLOCKED>
+class Gemm
+{
+public:
+	/**
+	 * Computes C = alpha * A * B, or C += alpha * A * B if accumulate is true.
+	 * @param m Number of rows of A and C
+	 * @param n Number of columns of B and C
+	 * @param k Number of columns of A and rows of B
+	 * @param alpha Scale of the product
+	 * @param a The first cell of A
+	 * @param rsA Distance between two consecutive rows of A
+	 * @param csA Distance between two consecutive columns of A
+	 * @param b The first cell of B
+	 * @param rsB Distance between two consecutive rows of B
+	 * @param csB Distance between two consecutive columns of B
+	 * @param c The first cell of C
+	 * @param ldc Distance between two consecutive rows of C
+	 * @param accumulate Whether the product is added to C instead of overwriting it
+	 * @param conjugateA Whether the cells of A are read conjugated
+	 * @param conjugateB Whether the cells of B are read conjugated
+	 */
+	static void multiply(unsigned int m, unsigned int n, unsigned int k, const T& alpha,
+						 const T* a, std::size_t rsA, std::size_t csA,
+						 const T* b, std::size_t rsB, std::size_t csB,
+						 T* c, std::size_t ldc, bool accumulate = false,
+						 bool conjugateA = false, bool conjugateB = false)
+	{
+		for (unsigned int i = 0; i < m; i++)
+		{
+			for (unsigned int j = 0; j < n; j++)
+			{
+				T cell(0);
+				for (unsigned int p = 0; p < k; p++)
+				{
+					const T& x = a[i * rsA + p * csA];
+					const T& y = b[p * rsB + j * csB];
+					cell += (conjugateA ? ElementConjugate<T>::apply(x) : x) *
+							(conjugateB ? ElementConjugate<T>::apply(y) : y);
+				}
+				T& target = c[i * ldc + j];
+				target = accumulate ? target + alpha * cell : alpha * cell;
+			}
+		}
+	}
+};
+
+/**
+ * Specialization for arithmetic element types. The product is computed in blocks sized for the
+ * caches: a KC X NC panel of B is packed once and reused by every MC X KC block of A, and an
+ * MR X NR micro-kernel accumulates its part of C in registers while streaming through both packed
+ * panels contiguously. Arithmetic cells are their own conjugates, so the conjugation flags are
+ * ignored.
+ */
+template <class T>
+class Gemm<T, true>
+{
+public:
+	/**
+	 * Computes C = alpha * A * B, or C += alpha * A * B if accumulate is true.
+	 * @param m Number of rows of A and C
+	 * @param n Number of columns of B and C
+	 * @param k Number of columns of A and rows of B
+	 * @param alpha Scale of the product
+	 * @param a The first cell of A
+	 * @param rsA Distance between two consecutive rows of A
+	 * @param csA Distance between two consecutive columns of A
+	 * @param b The first cell of B
+	 * @param rsB Distance between two consecutive rows of B
+	 * @param csB Distance between two consecutive columns of B
+	 * @param c The first cell of C
+	 * @param ldc Distance between two consecutive rows of C
+	 * @param accumulate Whether the product is added to C instead of overwriting it
+	 * @param conjugateA Ignored, see above
+	 * @param conjugateB Ignored, see above
+	 */
+	static void multiply(unsigned int m, unsigned int n, unsigned int k, const T& alpha,
+						 const T* a, std::size_t rsA, std::size_t csA,
+						 const T* b, std::size_t rsB, std::size_t csB,
+						 T* c, std::size_t ldc, bool accumulate = false,
+						 bool /* conjugateA */ = false, bool /* conjugateB */ = false)
+	{
+		if (m == 0 || n == 0)
+		{
+			return;
+		}
+		if (k == 0)
+		{
+			if (!accumulate)
+			{
+				for (unsigned int i = 0; i < m; i++)
+				{
+					std::fill(c + i * ldc, c + i * ldc + n, T(0));
+				}
+			}
+			return;
+		}
+
+		std::vector<T>& packedA = _buffer(0);
+		std::vector<T>& packedB = _buffer(1);
+		for (unsigned int jc = 0; jc < n; jc += NC)
+		{
+			unsigned int nc = std::min(NC, n - jc);
+			for (unsigned int pc = 0; pc < k; pc += KC)
+			{
+				unsigned int kc = std::min(KC, k - pc);
+				bool add = accumulate || pc > 0;
+				_packB(kc, nc, b + pc * rsB + jc * csB, rsB, csB, packedB);
+				for (unsigned int ic = 0; ic < m; ic += MC)
+				{
+					unsigned int mc = std::min(MC, m - ic);
+					_packA(mc, kc, a + ic * rsA + pc * csA, rsA, csA, packedA);
+					_macroKernel(mc, nc, kc, alpha, packedA.data(), packedB.data(),
+								 c + ic * ldc + jc, ldc, add);
+				}
+			}
+		}
+	}
+
+private:
+	/**
+	 * Rows of C computed by one call to the micro-kernel.
+	 */
+	static const unsigned int MR = 4;
+
+	/**
+	 * Columns of C computed by one call to the micro-kernel: 64 bytes of T (16 cells for smaller
+	 * types). The micro-kernel is compiled for the target of the build, baseline x86-64 with the
+	 * Makefile's flags, so a row of its tile is four 128-bit SSE2 vectors (two 256-bit vectors
+	 * when built with -mavx).
+	 */
+	static const unsigned int NR = sizeof(T) >= 4 ? 64 / sizeof(T) : 16;
+
+	/**
+	 * Depth of a block, chosen so that an MR X KC sliver of A and a KC X NR sliver of B stay in L1.
+	 */
+	static const unsigned int KC = 256;
+
+	/**
+	 * Rows of a block of A, chosen so that the packed MC X KC block stays in L2.
+	 */
+	static const unsigned int MC = 96;
+
+	/**
+	 * Columns of a panel of B, chosen so that the packed KC X NC panel stays in L3.
+	 */
+	static const unsigned int NC = 4096;
+
+	/**
+	 * @param index The buffer number
+	 * @return A packing buffer owned by the calling thread, reused between calls.
+	 */
+	static std::vector<T>& _buffer(int index)
+	{
+		static thread_local std::vector<T> buffers[2];
+		return buffers[index];
+	}
+
+	/**
+	 * Packs an mc X kc block of A into consecutive MR-row slivers, each stored column by column.
+	 * The last sliver is padded with zeros.
+	 * @param mc Number of rows of the block
+	 * @param kc Number of columns of the block
+	 * @param a The first cell of the block
+	 * @param rsA Distance between two consecutive rows of A
+	 * @param csA Distance between two consecutive columns of A
+	 * @param packed The destination buffer
+	 */
+	static void _packA(unsigned int mc, unsigned int kc, const T* a, std::size_t rsA,
+					   std::size_t csA, std::vector<T>& packed)
+	{
+		unsigned int slivers = (mc + MR - 1) / MR;
+		packed.resize((std::size_t)slivers * MR * kc);
+		T* out = packed.data();
+		for (unsigned int ir = 0; ir < mc; ir += MR)
+		{
+			unsigned int mr = std::min(MR, mc - ir);
+			for (unsigned int p = 0; p < kc; p++)
+			{
+				for (unsigned int i = 0; i < mr; i++)
+				{
+					out[i] = a[(ir + i) * rsA + p * csA];
+				}
+				for (unsigned int i = mr; i < MR; i++)
+				{
+					out[i] = T(0);
+				}
+				out += MR;
+			}
+		}
+	}
+
+	/**
+	 * Packs a kc X nc panel of B into consecutive NR-column slivers, each stored row by row.
+	 * The last sliver is padded with zeros.
+	 * @param kc Number of rows of the panel
+	 * @param nc Number of columns of the panel
+	 * @param b The first cell of the panel
+	 * @param rsB Distance between two consecutive rows of B
+	 * @param csB Distance between two consecutive columns of B
+	 * @param packed The destination buffer
+	 */
+	static void _packB(unsigned int kc, unsigned int nc, const T* b, std::size_t rsB,
+					   std::size_t csB, std::vector<T>& packed)
+	{
+		unsigned int slivers = (nc + NR - 1) / NR;
+		packed.resize((std::size_t)slivers * NR * kc);
+		T* out = packed.data();
+		for (unsigned int jr = 0; jr < nc; jr += NR)
+		{
+			unsigned int nr = std::min(NR, nc - jr);
+			for (unsigned int p = 0; p < kc; p++)
+			{
+				const T* row = b + p * rsB + jr * csB;
+				if (csB == 1)
+				{
+					std::copy(row, row + nr, out);
+				}
+				else
+				{
+					for (unsigned int j = 0; j < nr; j++)
+					{
+						out[j] = row[j * csB];
+					}
+				}
+				for (unsigned int j = nr; j < NR; j++)
+				{
+					out[j] = T(0);
+				}
+				out += NR;
+			}
+		}
+	}
+
+	/**
+	 * Multiplies a packed block of A by a packed panel of B into C.
+	 * @param mc Number of rows of the block
+	 * @param nc Number of columns of the panel
+	 * @param kc The common dimension
+	 * @param alpha Scale of the product
+	 * @param packedA The packed block of A
+	 * @param packedB The packed panel of B
+	 * @param c The first cell of the block of C
+	 * @param ldc Distance between two consecutive rows of C
+	 * @param accumulate Whether the product is added to C instead of overwriting it
+	 */
+	static void _macroKernel(unsigned int mc, unsigned int nc, unsigned int kc, const T& alpha,
+							 const T* packedA, const T* packedB, T* c, std::size_t ldc,
+							 bool accumulate)
+	{
+		for (unsigned int jr = 0; jr < nc; jr += NR)
+		{
+			unsigned int nr = std::min(NR, nc - jr);
+			for (unsigned int ir = 0; ir < mc; ir += MR)
+			{
+				unsigned int mr = std::min(MR, mc - ir);
+				_microKernel(kc, alpha, packedA + (std::size_t)ir * kc,
+							 packedB + (std::size_t)jr * kc, c + ir * ldc + jr, ldc, mr, nr,
+							 accumulate);
+			}
+		}
+	}
+
+	/**
+	 * Computes an MR X NR tile of C from an MR-row sliver of A and an NR-column sliver of B. The
+	 * tile is accumulated in a local array the compiler keeps in vector registers, and only the
+	 * mr X nr valid part of it is written to C.
+	 * @param kc The common dimension
+	 * @param alpha Scale of the product
+	 * @param a The packed sliver of A
+	 * @param b The packed sliver of B
+	 * @param c The first cell of the tile of C
+	 * @param ldc Distance between two consecutive rows of C
+	 * @param mr Number of valid rows of the tile
+	 * @param nr Number of valid columns of the tile
+	 * @param accumulate Whether the product is added to C instead of overwriting it
+	 */
+	static void _microKernel(unsigned int kc, const T& alpha, const T* a, const T* b, T* c,
+							 std::size_t ldc, unsigned int mr, unsigned int nr, bool accumulate)
+	{
+		T acc[MR][NR] = {};
+		for (unsigned int p = 0; p < kc; p++)
+		{
+			for (unsigned int i = 0; i < MR; i++)
+			{
+				T ai = a[i];
+				for (unsigned int j = 0; j < NR; j++)
+				{
+					acc[i][j] += ai * b[j];
+				}
+			}
+			a += MR;
+			b += NR;
+		}
+
+		for (unsigned int i = 0; i < mr; i++)
+		{
+			T* row = c + i * ldc;
+			for (unsigned int j = 0; j < nr; j++)
+			{
+				row[j] = accumulate ? row[j] + alpha * acc[i][j] : alpha * acc[i][j];
+			}
+		}
+	}
+};
+
+template <class T>
+const unsigned int Gemm<T, true>::MR;
+
+template <class T>
+const unsigned int Gemm<T, true>::NR;
+
+template <class T>
+const unsigned int Gemm<T, true>::KC;
+
+template <class T>
+const unsigned int Gemm<T, true>::MC;
+
+template <class T>
+const unsigned int Gemm<T, true>::NC;
+
+#endif /* GEMM_H_ */
@@ -0,0 +1,217 @@
+// Gemv.h
+
+#ifndef GEMV_H_
+#define GEMV_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include "Gemm.h"
+#include "ElementKernels.h"
+#include "ExecutionPolicy.h"
+#include "ThreadPool.h"
+
+/**
+ * This class is the matrix-vector multiplication engine used by Matrix<T>. A is m X n, row-major
+ * with the given leading dimension, and vectors are contiguous arrays of cells.
+ *
+ * A matrix-vector product reads every cell of A once and does a single multiply-add with it, so it
+ * is bound by the memory bandwidth. The kernels are arranged to read A exactly once, as a stream:
+ * - y = A * x takes the dot products of four rows of A at a time with x (ElementKernels<T>::dot4),
+ *   so x is loaded once per four rows and stays in the cache.
+ * - y = A^T * x adds the scaled rows of A to y a column block at a time, so the part of y being
+ *   updated stays in L1 while the rows of A stream through.
+ * - A batch of products with the same matrix is a matrix product with the vectors, computed by
+ *   Gemm<T>, which reads A once for all of them.
+ * Large products are split between the pool threads by ExecutionPolicy: the rows of A (or the
+ * columns of A for the transposed product), so every thread streams its own part of A.
+ */
+template <class T>
+class Gemv
+{
+public:
+	/**
+	 * Computes y = alpha * A * x, or y += alpha * A * x if accumulate is true.
+	 * @param m Number of rows of A and cells of y
+	 * @param n Number of columns of A and cells of x
+	 * @param alpha Scale of the product
+	 * @param a The first cell of A
+	 * @param lda Distance between two consecutive rows of A
+	 * @param x The cells of x
+	 * @param y The cells of y, not overlapping A or x
+	 * @param accumulate Whether the product is added to y instead of overwriting it
+	 */
+	static void multiply(unsigned int m, unsigned int n, const T& alpha, const T* a,
+						 std::size_t lda, const T* x, T* y, bool accumulate = false)
+	{
+		_split(m, n, ROW_GRAIN, [=](unsigned int rowBegin, unsigned int rowEnd)
+		{
+			T dots[4];
+			unsigned int i = rowBegin;
+			for (; i + 4 <= rowEnd; i += 4)
+			{
+				ElementKernels<T>::dot4(a + i * lda, lda, x, n, dots);
+				for (unsigned int r = 0; r < 4; r++)
+				{
+					y[i + r] = accumulate ? y[i + r] + alpha * dots[r] : alpha * dots[r];
+				}
+			}
+			for (; i < rowEnd; i++)
+			{
+				T dot = ElementKernels<T>::dot(a + i * lda, x, n);
+				y[i] = accumulate ? y[i] + alpha * dot : alpha * dot;
+			}
+		});
+	}
+
+	/**
+	 * Computes y = alpha * A^T * x, or y += alpha * A^T * x if accumulate is true. A is read
+	 * conjugated if conjugate is true (the conjugate transpose of Complex matrices).
+	 * @param m Number of rows of A and cells of x
+	 * @param n Number of columns of A and cells of y
+	 * @param alpha Scale of the product
+	 * @param a The first cell of A
+	 * @param lda Distance between two consecutive rows of A
+	 * @param x The cells of x
+	 * @param y The cells of y, not overlapping A or x
+	 * @param accumulate Whether the product is added to y instead of overwriting it
+	 * @param conjugate Whether the cells of A are read conjugated
+	 */
+	static void multiplyTransposed(unsigned int m, unsigned int n, const T& alpha, const T* a,
+								   std::size_t lda, const T* x, T* y, bool accumulate = false,
+								   bool conjugate = false)
+	{
+		conjugate = conjugate && ElementConjugate<T>::CONJUGATES;
+		_split(n, m, COLUMN_BLOCK, [=](unsigned int colBegin, unsigned int colEnd)
+		{
+			for (unsigned int c = colBegin; c < colEnd; c += COLUMN_BLOCK)
+			{
+				unsigned int width = std::min(COLUMN_BLOCK, colEnd - c);
+				if (conjugate)
+				{
+					_conjugateBlock(m, width, alpha, a + c, lda, x, y + c, accumulate);
+					continue;
+				}
+				if (!accumulate)
+				{
+					std::fill(y + c, y + c + width, T(0));
+				}
+				for (unsigned int i = 0; i < m; i++)
+				{
+					ElementKernels<T>::axpy(width, alpha * x[i], a + i * lda + c, y + c);
+				}
+			}
+		});
+	}
+
+	/**
+	 * Computes the products of A with count vectors: y_v = A * x_v for every v < count.
+	 * @param m Number of rows of A and cells of every y_v
+	 * @param n Number of columns of A and cells of every x_v
+	 * @param count Number of vectors
+	 * @param a The first cell of A
+	 * @param lda Distance between two consecutive rows of A
+	 * @param xs The vectors x_v, one after the other
+	 * @param ys The vectors y_v, one after the other, not overlapping A or xs
+	 */
+	static void multiplyBatch(unsigned int m, unsigned int n, unsigned int count, const T* a,
+							  std::size_t lda, const T* xs, T* ys)
+	{
+		if (count == 1)
+		{
+			multiply(m, n, T(1), a, lda, xs, ys);
+			return;
+		}
+
+		// The vectors are the rows of a count X n matrix X, and the results the rows of
+		// Y = X * A^T, whose columns are split between the threads with the rows of A.
+		auto cols = [=](unsigned int colBegin, unsigned int colEnd)
+		{
+			Gemm<T>::multiply(count, colEnd - colBegin, n, T(1), xs, n, 1, a + colBegin * lda, 1,
+							  lda, ys + colBegin, m);
+		};
+		if (ExecutionPolicy::parallel(Operation::PRODUCT, (unsigned long long)m * n * count))
+		{
+			ThreadPool::instance().parallelFor(0, m, ROW_GRAIN, cols);
+		}
+		else
+		{
+			cols(0, m);
+		}
+	}
+
+private:
+	/**
+	 * Minimal number of rows of A given to a thread.
+	 */
+	static const unsigned int ROW_GRAIN = 16;
+
+	/**
+	 * Columns of y updated together by the transposed product, sized for L1.
+	 */
+	static const unsigned int COLUMN_BLOCK = 2048;
+
+	/**
+	 * Minimal number of cells of A given to a thread.
+	 */
+	static const unsigned long long MIN_CELLS_PER_CHUNK = 1 << 15;
+
+	/**
+	 * Computes a column block of y = alpha * A^H * x (see multiplyTransposed()). The conjugate of
+	 * a sum is the sum of the conjugates, so A^T * conj(x) is accumulated in a buffer of the
+	 * calling thread and conjugated once.
+	 */
+	static void _conjugateBlock(unsigned int m, unsigned int width, const T& alpha, const T* a,
+								std::size_t lda, const T* x, T* y, bool accumulate)
+	{
+		static thread_local std::vector<T> buffer;
+		buffer.assign(width, T(0));
+		for (unsigned int i = 0; i < m; i++)
+		{
+			ElementKernels<T>::axpy(width, ElementConjugate<T>::apply(x[i]), a + i * lda,
+									buffer.data());
+		}
+		for (unsigned int j = 0; j < width; j++)
+		{
+			T cell = alpha * ElementConjugate<T>::apply(buffer[j]);
+			y[j] = accumulate ? y[j] + cell : cell;
+		}
+	}
+
+	/**
+	 * Runs func on the range [0, count) of rows (or columns) of A, split between the pool threads
+	 * if the product is large enough.
+	 * @param count Number of rows (or columns) of A
+	 * @param length Number of cells of A in every row (or column)
+	 * @param grain Minimal number of rows (or columns) given to a thread
+	 * @param func Function called as func(begin, end)
+	 */
+	template <class Func>
+	static void _split(unsigned int count, unsigned int length, unsigned int grain,
+					   const Func& func)
+	{
+		unsigned long long cells = (unsigned long long)count * length;
+		if (!ExecutionPolicy::parallel(Operation::ELEMENTWISE, cells * sizeof(T)))
+		{
+			func(0, count);
+			return;
+		}
+		if (length > 0 && (unsigned long long)grain * length < MIN_CELLS_PER_CHUNK)
+		{
+			grain = (unsigned int)((MIN_CELLS_PER_CHUNK + length - 1) / length);
+		}
+		ThreadPool::instance().parallelFor(0, count, grain, func);
+	}
+};
+
+template <class T>
+const unsigned int Gemv<T>::ROW_GRAIN;
+
+template <class T>
+const unsigned int Gemv<T>::COLUMN_BLOCK;
+
+template <class T>
+const unsigned long long Gemv<T>::MIN_CELLS_PER_CHUNK;
+
+#endif /* GEMV_H_ */
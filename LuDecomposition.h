@@ -0,0 +1,387 @@
+// LuDecomposition.h
+
+#ifndef LUDECOMPOSITION_H_
+#define LUDECOMPOSITION_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include "Gemm.h"
+#include "ElementKernels.h"
+#include "ExecutionPolicy.h"
+#include "ThreadPool.h"
+
+/**
+ * The magnitude used to choose the pivots of the LU decomposition. Element types that are not
+ * ordered (Complex) specialize it.
+ */
+template <class T>
+struct ElementMagnitude
+{
+	/**
+	 * @param x The cell
+	 * @return The absolute value of x.
+	 */
+	static double apply(const T& x)
+	{
+		return x < T(0) ? -(double)x : (double)x;
+	}
+};
+
+/**
+ * The type the LU decomposition of a matrix of T is computed in. Integral cells cannot be divided
+ * exactly, so they are decomposed as double.
+ */
+template <class T, bool = std::is_integral<T>::value>
+struct LuElement
+{
+	typedef T type;
+
+	/**
+	 * @param x A result computed in type
+	 * @return x as a T.
+	 */
+	static T convert(const type& x)
+	{
+		return x;
+	}
+};
+
+template <class T>
+struct LuElement<T, true>
+{
+	typedef double type;
+
+	static T convert(double x)
+	{
+		return (T)std::llround(x);
+	}
+};
+
+/**
+ * This class is the LU decomposition engine used by Matrix<T>. It factors an n X n row-major
+ * matrix A in place into P * A = L * U, with partial pivoting: L is unit lower triangular (its
+ * diagonal is not stored), U is upper triangular, and P swaps row i with row pivots[i], for i from
+ * 0 to n - 1 in order.
+ *
+ * The decomposition is blocked and right-looking. Every NB-column panel is factored recursively
+ * (its two halves are factored in turn, the right one after being updated by the left one), the
+ * rows of U to the right of the panel are solved with the triangle of L, and the rest of the
+ * matrix is updated with a product by Gemm<T>. Almost all the work is then in Gemm<T>, and the
+ * large products and triangular solves are split between the pool threads by ExecutionPolicy.
+ */
+template <class T>
+class LuDecomposition
+{
+public:
+	/**
+	 * Factors A in place.
+	 * @param n Number of rows and columns of A
+	 * @param a The first cell of A
+	 * @param lda Distance between two consecutive rows of A
+	 * @param pivots Receives the n row swaps of P
+	 * @return true if A was factored, false if it is singular (a whole column had no nonzero
+	 * 		   pivot), in which case A is left partly factored.
+	 */
+	static bool factor(unsigned int n, T* a, std::size_t lda, unsigned int* pivots)
+	{
+		for (unsigned int j = 0; j < n; j += NB)
+		{
+			unsigned int jb = std::min(NB, n - j);
+			if (!_panel(a, lda, n, j, n - j, jb, pivots))
+			{
+				return false;
+			}
+			unsigned int rest = n - j - jb;
+			if (rest > 0)
+			{
+				T* diagonal = a + j * lda + j;
+				_lowerSolve(jb, diagonal, lda, diagonal + jb, lda, rest);
+				_update(rest, rest, jb, diagonal + jb * lda, lda, diagonal + jb, lda,
+						diagonal + jb * lda + jb, lda);
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Solves A * X = B in place, where A was factored by factor().
+	 * @param n Number of rows and columns of A, and rows of B
+	 * @param lu The first cell of the factored A
+	 * @param lda Distance between two consecutive rows of the factored A
+	 * @param pivots The row swaps returned by factor()
+	 * @param nrhs Number of columns of B
+	 * @param b The first cell of B, replaced by X
+	 * @param ldb Distance between two consecutive rows of B
+	 */
+	static void solve(unsigned int n, const T* lu, std::size_t lda, const unsigned int* pivots,
+					  unsigned int nrhs, T* b, std::size_t ldb)
+	{
+		for (unsigned int i = 0; i < n; i++)
+		{
+			if (pivots[i] != i)
+			{
+				std::swap_ranges(b + i * ldb, b + i * ldb + nrhs, b + pivots[i] * ldb);
+			}
+		}
+
+		// The columns of B are independent, so they are split between the threads
+		unsigned long long flops = (unsigned long long)n * n * nrhs;
+		_forColumns(flops, nrhs, [=](unsigned int colBegin, unsigned int colEnd)
+		{
+			unsigned int cols = colEnd - colBegin;
+			T* x = b + colBegin;
+			for (unsigned int j = 0; j < n; j += NB)
+			{
+				unsigned int jb = std::min(NB, n - j);
+				Gemm<T>::multiply(jb, cols, j, T(-1), lu + j * lda, lda, 1, x, ldb, 1,
+								  x + j * ldb, ldb, true);
+				_lowerSolveColumns(jb, lu + j * lda + j, lda, x + j * ldb, ldb, cols);
+			}
+			for (unsigned int end = n; end > 0;)
+			{
+				unsigned int jb = (end - 1) % NB + 1, j = end - jb;
+				Gemm<T>::multiply(jb, cols, n - end, T(-1), lu + j * lda + end, lda, 1,
+								  x + end * ldb, ldb, 1, x + j * ldb, ldb, true);
+				_upperSolveColumns(jb, lu + j * lda + j, lda, x + j * ldb, ldb, cols);
+				end = j;
+			}
+		});
+	}
+
+	/**
+	 * @param n Number of rows and columns of A
+	 * @param lu The first cell of the factored A
+	 * @param lda Distance between two consecutive rows of the factored A
+	 * @param pivots The row swaps returned by factor()
+	 * @return The determinant of A: the product of the diagonal of U, negated for every swap.
+	 */
+	static T determinant(unsigned int n, const T* lu, std::size_t lda, const unsigned int* pivots)
+	{
+		T det(1);
+		for (unsigned int i = 0; i < n; i++)
+		{
+			det *= lu[i * lda + i];
+			if (pivots[i] != i)
+			{
+				det = -det;
+			}
+		}
+		return det;
+	}
+
+private:
+	/**
+	 * Columns of a panel.
+	 */
+	static const unsigned int NB = 128;
+
+	/**
+	 * Columns of a panel from which it is factored recursively rather than column by column.
+	 */
+	static const unsigned int PANEL = 16;
+
+	/**
+	 * Minimal number of columns given to a thread by the triangular solves.
+	 */
+	static const unsigned int COLUMN_GRAIN = 64;
+
+	/**
+	 * Factors a panel of A in place: the columns [r, r + w) on the rows [r, r + m). The row swaps
+	 * are applied to whole rows of A.
+	 * @param a The first cell of A
+	 * @param lda Distance between two consecutive rows of A
+	 * @param n Number of columns of A
+	 * @param r The first row and column of the panel
+	 * @param m Number of rows of the panel
+	 * @param w Number of columns of the panel
+	 * @param pivots The row swaps of A
+	 * @return false if a column has no nonzero pivot, true otherwise.
+	 */
+	static bool _panel(T* a, std::size_t lda, unsigned int n, unsigned int r, unsigned int m,
+					   unsigned int w, unsigned int* pivots)
+	{
+		if (w <= PANEL)
+		{
+			return _unblocked(a, lda, n, r, m, w, pivots);
+		}
+		unsigned int w1 = w / 2, w2 = w - w1;
+		if (!_panel(a, lda, n, r, m, w1, pivots))
+		{
+			return false;
+		}
+		T* diagonal = a + r * lda + r;
+		_lowerSolve(w1, diagonal, lda, diagonal + w1, lda, w2);
+		_update(m - w1, w2, w1, diagonal + w1 * lda, lda, diagonal + w1, lda,
+				diagonal + w1 * lda + w1, lda);
+		return _panel(a, lda, n, r + w1, m - w1, w2, pivots);
+	}
+
+	/**
+	 * Factors a panel of A column by column (see _panel()).
+	 */
+	static bool _unblocked(T* a, std::size_t lda, unsigned int n, unsigned int r, unsigned int m,
+						   unsigned int w, unsigned int* pivots)
+	{
+		unsigned int end = r + m;
+		for (unsigned int k = r; k < r + w; k++)
+		{
+			unsigned int pivot = k;
+			double largest = ElementMagnitude<T>::apply(a[k * lda + k]);
+			for (unsigned int i = k + 1; i < end; i++)
+			{
+				double magnitude = ElementMagnitude<T>::apply(a[i * lda + k]);
+				if (magnitude > largest)
+				{
+					pivot = i;
+					largest = magnitude;
+				}
+			}
+			if (largest == 0)
+			{
+				return false;
+			}
+			pivots[k] = pivot;
+			if (pivot != k)
+			{
+				std::swap_ranges(a + k * lda, a + k * lda + n, a + pivot * lda);
+			}
+
+			const T* top = a + k * lda;
+			T reciprocal = T(1) / top[k];
+			for (unsigned int i = k + 1; i < end; i++)
+			{
+				T* row = a + i * lda;
+				row[k] *= reciprocal;
+				T factor = -row[k];
+				for (unsigned int j = k + 1; j < r + w; j++)
+				{
+					row[j] += factor * top[j];
+				}
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Computes B = L^-1 * B, where L is the w X w unit lower triangle of l, splitting the columns
+	 * of B between the pool threads when it is worth it.
+	 * @param w Number of rows and columns of L and rows of B
+	 * @param l The first cell of L
+	 * @param ldl Distance between two consecutive rows of L
+	 * @param b The first cell of B
+	 * @param ldb Distance between two consecutive rows of B
+	 * @param cols Number of columns of B
+	 */
+	static void _lowerSolve(unsigned int w, const T* l, std::size_t ldl, T* b, std::size_t ldb,
+							unsigned int cols)
+	{
+		unsigned long long flops = (unsigned long long)w * w * cols / 2;
+		_forColumns(flops, cols, [=](unsigned int colBegin, unsigned int colEnd)
+		{
+			_lowerSolveColumns(w, l, ldl, b + colBegin, ldb, colEnd - colBegin);
+		});
+	}
+
+	/**
+	 * Computes B = L^-1 * B on the calling thread (see _lowerSolve()).
+	 */
+	static void _lowerSolveColumns(unsigned int w, const T* l, std::size_t ldl, T* b,
+								   std::size_t ldb, unsigned int cols)
+	{
+		for (unsigned int i = 1; i < w; i++)
+		{
+			T* row = b + i * ldb;
+			for (unsigned int k = 0; k < i; k++)
+			{
+				ElementKernels<T>::axpy(cols, -l[i * ldl + k], b + k * ldb, row);
+			}
+		}
+	}
+
+	/**
+	 * Computes B = U^-1 * B on the calling thread, where U is the w X w upper triangle of u.
+	 * @param w Number of rows and columns of U and rows of B
+	 * @param u The first cell of U
+	 * @param ldu Distance between two consecutive rows of U
+	 * @param b The first cell of B
+	 * @param ldb Distance between two consecutive rows of B
+	 * @param cols Number of columns of B
+	 */
+	static void _upperSolveColumns(unsigned int w, const T* u, std::size_t ldu, T* b,
+								   std::size_t ldb, unsigned int cols)
+	{
+		for (unsigned int i = w; i-- > 0;)
+		{
+			T* row = b + i * ldb;
+			for (unsigned int k = i + 1; k < w; k++)
+			{
+				ElementKernels<T>::axpy(cols, -u[i * ldu + k], b + k * ldb, row);
+			}
+			ElementKernels<T>::scale(row, row, T(1) / u[i * ldu + i], cols);
+		}
+	}
+
+	/**
+	 * Computes C -= A * B with Gemm<T>, splitting the rows of C between the pool threads when it
+	 * is worth it.
+	 * @param m Number of rows of A and C
+	 * @param n Number of columns of B and C
+	 * @param k Number of columns of A and rows of B
+	 * @param a The first cell of A
+	 * @param lda Distance between two consecutive rows of A
+	 * @param b The first cell of B
+	 * @param ldb Distance between two consecutive rows of B
+	 * @param c The first cell of C
+	 * @param ldc Distance between two consecutive rows of C
+	 */
+	static void _update(unsigned int m, unsigned int n, unsigned int k, const T* a,
+						std::size_t lda, const T* b, std::size_t ldb, T* c, std::size_t ldc)
+	{
+		auto rows = [=](unsigned int rowBegin, unsigned int rowEnd)
+		{
+			Gemm<T>::multiply(rowEnd - rowBegin, n, k, T(-1), a + rowBegin * lda, lda, 1, b, ldb,
+							  1, c + rowBegin * ldc, ldc, true);
+		};
+		if (ExecutionPolicy::parallel(Operation::PRODUCT, (unsigned long long)m * n * k))
+		{
+			ThreadPool::instance().parallelFor(0, m, 1, rows);
+		}
+		else
+		{
+			rows(0, m);
+		}
+	}
+
+	/**
+	 * Runs func on the columns [0, cols), split between the pool threads when it is worth it.
+	 * @param flops The number of multiply-adds of the whole range
+	 * @param cols Number of columns
+	 * @param func Function called as func(colBegin, colEnd)
+	 */
+	template <class Func>
+	static void _forColumns(unsigned long long flops, unsigned int cols, const Func& func)
+	{
+		if (ExecutionPolicy::parallel(Operation::PRODUCT, flops))
+		{
+			ThreadPool::instance().parallelFor(0, cols, COLUMN_GRAIN, func);
+		}
+		else
+		{
+			func(0, cols);
+		}
+	}
+};
+
+template <class T>
+const unsigned int LuDecomposition<T>::NB;
+
+template <class T>
+const unsigned int LuDecomposition<T>::PANEL;
+
+template <class T>
+const unsigned int LuDecomposition<T>::COLUMN_GRAIN;
+
+#endif /* LUDECOMPOSITION_H_ */
@@ -4,23 +4,169 @@
 #define MATRIX_HPP_
 
 // ------------------ Includes ------------------------------
+#include <cmath>
+#include <fstream>
 #include <iostream>
-#include <thread>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
+#include "ThreadPool.h"
+#include "Gemm.h"
+#include "Gemv.h"
+#include "ElementKernels.h"
+#include "MatrixExpression.h"
+#include "MatrixSpan.h"
+#include "MatrixView.h"
+#include "Transpose.h"
+#include "ExecutionPolicy.h"
+#include "MatrixFile.h"
+#include "MatrixText.h"
+#include "MatrixAllocator.h"
+#include "MatrixStorage.h"
+#include "NumaPolicy.h"
+#include "MatrixProfiler.h"
+#include "FixedMatrix.h"
+#include "SparseMatrix.h"
+#include "MatrixBatch.h"
+#include "LuDecomposition.h"
 #include "WrongDimensionsException.h"
 #include "NoSquareException.h"
 #include "OutOfMatrixException.h"
 #include "IllegalMatrixException.h"
 #include "IllegalVectorException.h"
+#include "MatrixFileException.h"
+#include "SingularMatrixException.h"
 #include "Complex.h"
+#include "ComplexKernels.h"
+
+/**
+ * Specialization for the Complex class: transposing a complex matrix conjugates its cells.
+ */
+template <>
+struct ElementConjugate<Complex>
+{
+	static const bool CONJUGATES = true;
+
+	static Complex apply(const Complex& x)
+	{
+		return x.conj();
+	}
+};
+
+/**
+ * Specialization for the Complex class: the pivots of complex matrices are chosen by the sum of the
+ * absolute values of the parts, which orders them like the modulus up to a factor of sqrt(2) and
+ * needs no square root.
+ */
+template <>
+struct ElementMagnitude<Complex>
+{
+	static double apply(const Complex& x)
+	{
+		return std::fabs(x.real()) + std::fabs(x.imag());
+	}
+};
+
+/**
+ * Specialization for the Complex class: Complex cells are stored in matrix files as complex
+ * numbers.
+ */
+template <>
+struct MatrixFileElement<Complex>
+{
+	static const MatrixFileElementKind KIND = MatrixFileElementKind::COMPLEX;
+};
+
+/**
+ * Specialization for the Complex class: Complex cells are written as text like "1.5-2i", the real
+ * and imaginary parts formatted as double cells.
+ */
+template <>
+struct TextFormat<Complex>
+{
+	static const bool FAST = true;
+
+	/**
+	 * @param style The style
+	 * @return The largest number of characters format() writes.
+	 */
+	static std::size_t maxLength(const TextStyle& style)
+	{
+		return 2 * TextFormat<double>::maxLength(style) + 2;
+	}
+
+	/**
+	 * Writes a cell.
+	 * @param out Where to write, with room for maxLength(style) characters
+	 * @param value The cell
+	 * @param style The style
+	 * @return One after the last character written.
+	 */
+	static char* format(char* out, const Complex& value, const TextStyle& style)
+	{
+		out = TextFormat<double>::format(out, value.real(), style);
+		char* imaginary = out;
+		out = TextFormat<double>::format(out + 1, value.imag(), style);
+		if (imaginary[1] == '-')
+		{
+			out = std::copy(imaginary + 1, out, imaginary);
+		}
+		else
+		{
+			*imaginary = '+';
+		}
+		*out++ = 'i';
+		return out;
+	}
+
+	/**
+	 * Reads a cell. The text must not start with a white space.
+	 * @param first The first character
+	 * @param last One after the last character
+	 * @param value The cell read
+	 * @return One after the last character of the cell, or nullptr if there is no valid cell.
+	 */
+	static const char* parse(const char* first, const char* last, Complex& value)
+	{
+		double real, imaginary;
+		first = TextFormat<double>::parse(first, last, real);
+		if (first == nullptr || first == last || (*first != '+' && *first != '-'))
+		{
+			return nullptr;
+		}
+		first = TextFormat<double>::parse(first, last, imaginary);
+		if (first == nullptr || first == last || *first != 'i')
+		{
+			return nullptr;
+		}
+		value = Complex(real, imaginary);
+		return first + 1;
+	}
+};
 
 /**
  * This class represents a generic mathematical matrix.
+ *
+ * The operators +, - and * and trans() return expressions that are evaluated when assigned to a
+ * matrix (see MatrixExpression.h).
+ *
+ * The cells are stored with Allocator, by default AlignedAllocator<T> (aligned on a cache line).
+ * Matrices created and destroyed often can use PoolAllocator<T> to reuse the buffers of released
+ * matrices (see MatrixAllocator.h), and matrices copied far more often than written can use
+ * SharedAllocator<T>, whose copies share their cells until one of them is written (see
+ * MatrixStorage.h). Matrices of different allocators are used together in expressions and can be
+ * assigned to each other.
  */
-template <class T>
-class Matrix
+template <class T, class Allocator>
+class Matrix : public MatrixExpression<Matrix<T, Allocator> >
 {
 public:
+	/**
+	 * The type of the cells.
+	 */
+	typedef T value_type;
+
 	// ------------------ Constructors ----------------------
 	/**
 	 * Default constructor. Initiates the matrix with size of 1X1 and sets its cell to 0.
@@ -42,14 +188,14 @@ public:
 	 * @param other The other matrix
 	 * @throws bad_alloc if the memory allocation fails
 	 */
-	Matrix(const Matrix<T>& other);
+	Matrix(const Matrix<T, Allocator>& other);
 
 	/**
 	 * Move Constructor. Move the rvalue of other to this.
 	 * @param other The other matrix
 	 * @throws bad_alloc if the memory allocation fails
 	 */
-	Matrix(Matrix<T> && other);
+	Matrix(Matrix<T, Allocator> && other);
 
 	/**
 	 * Initiates the matrix with the size of rows X cols and sets its cells to the items of cells.
@@ -62,6 +208,25 @@ public:
 	 */
 	Matrix(unsigned int rows, unsigned int cols, const std::vector<T>& cells);
 
+	/**
+	 * Initiates the matrix with the size of rows X cols and takes the items of cells as its cells,
+	 * without copying them.
+	 * @param rows Number of rows
+	 * @param cols Number of columns
+	 * @param cells vector containing the cells of the matrix, left empty.
+	 * @throws IllegalMatrixException if one of the arguments rows and cols (but not both) is 0.
+	 * @throws IllegalVectorException if the size of cells is not matching rows and cols.
+	 */
+	Matrix(unsigned int rows, unsigned int cols, std::vector<T, Allocator>&& cells);
+
+	/**
+	 * Initiates the matrix with the value of an expression.
+	 * @param expr The expression
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	template <class E>
+	Matrix(const MatrixExpression<E>& expr);
+
 	// ------------------ Destructor ------------------------
 	/**
 	 * Destructor for Matrix<T>.
@@ -75,97 +240,334 @@ public:
 	 * @return reference to this
 	 * @throws bad_alloc if the memory allocation fails
 	 */
-	Matrix<T>& operator=(const Matrix<T>& other);
+	Matrix<T, Allocator>& operator=(const Matrix<T, Allocator>& other);
 
 	/**
-	 * + operator. Adds this and other and returns the new matrix.
+	 * Move assignment operator. Takes the cells of the rvalue other, giving it the old cells of
+	 * this in exchange.
 	 * @param other The other matrix
-	 * @return The result matrix
-	 * @throws bad_alloc if the memory allocation fails
-	 * @throws WrongDimensionsExceptions if the dimensions of this and other are not the same.
+	 * @return reference to this
 	 */
-	const Matrix<T> operator+(const Matrix<T>& other) const;
+	Matrix<T, Allocator>& operator=(Matrix<T, Allocator>&& other);
 
 	/**
-	 * - operator. Subtracts other from this and returns the new matrix.
-	 * @param other The other matrix
-	 * @return The result matrix
+	 * = operator. Assigns the value of an expression to this, evaluating it in a single pass.
+	 * @param expr The expression
+	 * @return reference to this
 	 * @throws bad_alloc if the memory allocation fails
-	 * @throws WrongDimensionsExceptions if the dimensions of this and other are not the same.
 	 */
-	const Matrix<T> operator-(const Matrix<T>& other) const;
+	template <class E>
+	Matrix<T, Allocator>& operator=(const MatrixExpression<E>& expr);
 
 	/**
-	 * * operator. Multiply this and other (according to matrices multiplication) and returns the
-	 * new matrix.
-	 * @param other The other matrix
-	 * @return The result matrix.
+	 * += operator. Adds the value of an expression to this in place.
+	 * @param expr The expression
+	 * @return reference to this
+	 * @throws WrongDimensionsExceptions if the dimensions of this and expr are not the same.
+	 */
+	template <class E>
+	Matrix<T, Allocator>& operator+=(const MatrixExpression<E>& expr);
+
+	/**
+	 * -= operator. Subtracts the value of an expression from this in place.
+	 * @param expr The expression
+	 * @return reference to this
+	 * @throws WrongDimensionsExceptions if the dimensions of this and expr are not the same.
+	 */
+	template <class E>
+	Matrix<T, Allocator>& operator-=(const MatrixExpression<E>& expr);
+
+	/**
+	 * *= operator. Multiply this by the value of an expression (according to matrices
+	 * multiplication). The product is computed into a buffer kept by the calling thread, which then
+	 * takes the old cells of this, so repeated multiplications do not allocate memory.
+	 * @param expr The expression
+	 * @return reference to this
 	 * @throws bad_alloc if the memory allocation fails
 	 * @throws WrongDimensionsExceptions if number of columns of this is not equal to the number of
-	 * 		   rows of other.
+	 * 		   rows of expr.
+	 */
+	template <class E>
+	Matrix<T, Allocator>& operator*=(const MatrixExpression<E>& expr);
+
+	/**
+	 * *= operator. Multiply the cells of this by a scalar in place.
+	 * @param scalar The scalar
+	 * @return reference to this
+	 */
+	Matrix<T, Allocator>& operator*=(const T& scalar);
+
+	/**
+	 * Adds alpha * other to this in place.
+	 * @param alpha The scale of other
+	 * @param other The other matrix
+	 * @return reference to this
+	 * @throws WrongDimensionsExceptions if the dimensions of this and other are not the same.
 	 */
-	const Matrix<T> operator*(const Matrix<T>& other) const;
+	Matrix<T, Allocator>& axpy(const T& alpha, const Matrix<T, Allocator>& other);
 
 	/**
 	 * == operator. Compare between this and other.
 	 * @param other The other matrix
 	 * @return true if this and other are equal, false otherwise.
 	 */
-	bool operator==(const Matrix<T>& other) const;
+	bool operator==(const Matrix<T, Allocator>& other) const;
 
 	/**
 	 * != operator. Returns the opposite of == operator.
 	 * @param other The other matrix
 	 * @return true if this and other are not equal, false otherwise.
 	 */
-	bool operator!=(const Matrix<T>& other) const;
+	bool operator!=(const Matrix<T, Allocator>& other) const;
 
 	/**
-	 * Calculates and returns the transposed matrix of this.
+	 * Returns the transposed matrix of this (conjugated for Complex cells). The result refers to
+	 * the cells of this and is computed only when assigned to a matrix.
 	 * @return The transposed matrix.
-	 * @throws bad_alloc if the memory allocation fails
 	 */
-	const Matrix<T> trans() const;
+	MatrixOperand<T> trans() const;
+
+	/**
+	 * Transposes this in place (conjugated for Complex cells). A square matrix is transposed
+	 * without a second buffer; other shapes are transposed into the scratch matrix, whose cells
+	 * are then exchanged with the cells of this. So a non-square matrix needs a second buffer of
+	 * its size during the call, which is freed on return unless it takes at most 256 KiB.
+	 * @return reference to this
+	 * @throws bad_alloc if the memory allocation fails (non-square matrices only)
+	 */
+	Matrix<T, Allocator>& transposeInPlace();
 
 	/**
 	 * Calculates and returns the trace of this.
 	 * @return The trace.
 	 * @throws NoSquareException if this matrix is not square
 	 */
-	const T trace() const;
+	T trace() const;
+
+	/**
+	 * Calculates and returns the determinant of this, from its LU decomposition (computed in double
+	 * for integral cells, and rounded).
+	 * @return The determinant.
+	 * @throws NoSquareException if this matrix is not square
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	T det() const;
+
+	/**
+	 * Solves the system this * X = b for X, with one right-hand side per column of b, from the LU
+	 * decomposition of this with partial pivoting. Not available for integral cells.
+	 * @param b The right-hand sides
+	 * @return The solutions X, with the dimensions of b.
+	 * @throws NoSquareException if this matrix is not square
+	 * @throws WrongDimensionsExceptions if the number of rows of b is not the number of rows of
+	 * 		   this.
+	 * @throws SingularMatrixException if this matrix is singular
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	Matrix<T, Allocator> solve(const Matrix<T, Allocator>& b) const;
+
+	/**
+	 * Calculates and returns the inverse of this, by solving this * X = I. Not available for
+	 * integral cells.
+	 * @return The inverse matrix.
+	 * @throws NoSquareException if this matrix is not square
+	 * @throws SingularMatrixException if this matrix is singular
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	Matrix<T, Allocator> inverse() const;
+
+	/**
+	 * Computes y = alpha * this * x, or y += alpha * this * x if accumulate is true (see Gemv.h).
+	 * @param x The vector multiplied, of one cell per column of this
+	 * @param y The result vector, of one cell per row of this, not overlapping this or x
+	 * @param alpha Scale of the product
+	 * @param accumulate Whether the product is added to y instead of overwriting it
+	 * @throws WrongDimensionsExceptions if the sizes of x and y do not match the dimensions of
+	 * 		   this.
+	 */
+	void gemv(MatrixSpan<const T> x, MatrixSpan<T> y, const T& alpha = T(1),
+			  bool accumulate = false) const;
+
+	/**
+	 * Calculates and returns this * x.
+	 * @param x The vector multiplied, of one cell per column of this
+	 * @return The result vector, of one cell per row of this.
+	 * @throws WrongDimensionsExceptions if the size of x is not the number of columns of this.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	std::vector<T> gemv(const std::vector<T>& x) const;
+
+	/**
+	 * Computes y = alpha * trans() * x, or y += alpha * trans() * x if accumulate is true, without
+	 * transposing this. Complex cells are conjugated like trans() does.
+	 * @param x The vector multiplied, of one cell per row of this
+	 * @param y The result vector, of one cell per column of this, not overlapping this or x
+	 * @param alpha Scale of the product
+	 * @param accumulate Whether the product is added to y instead of overwriting it
+	 * @throws WrongDimensionsExceptions if the sizes of x and y do not match the dimensions of
+	 * 		   this.
+	 */
+	void gemvT(MatrixSpan<const T> x, MatrixSpan<T> y, const T& alpha = T(1),
+			   bool accumulate = false) const;
+
+	/**
+	 * Calculates and returns trans() * x, without transposing this.
+	 * @param x The vector multiplied, of one cell per row of this
+	 * @return The result vector, of one cell per column of this.
+	 * @throws WrongDimensionsExceptions if the size of x is not the number of rows of this.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	std::vector<T> gemvT(const std::vector<T>& x) const;
+
+	/**
+	 * Multiplies this by a batch of vectors, reading this once for all of them: ys holds the
+	 * products this * x for every vector x of xs, in the same order.
+	 * @param xs The vectors multiplied, one after the other, of one cell per column of this each
+	 * @param ys The result vectors, one after the other, of one cell per row of this each, not
+	 * 		  overlapping this or xs
+	 * @throws WrongDimensionsExceptions if xs is not made of whole vectors or ys does not hold as
+	 * 		   many results.
+	 */
+	void gemvBatch(MatrixSpan<const T> xs, MatrixSpan<T> ys) const;
 
 	/**
 	 * << operator. Friend function used to allow the << operator of std::ostream object to print
-	 * to output Matrix<T> objects.
+	 * to output Matrix<T> objects. The cells are formatted in large blocks (see MatrixText.h) and
+	 * the stream is not flushed.
 	 * @param os The ostream object
 	 * @param mat The matrix to print
 	 * @return Reference to the ostream object.
 	 */
-	template <class U>
-	friend std::ostream& operator<<(std::ostream& os, const Matrix<U>& mat);
+	template <class U, class A>
+	friend std::ostream& operator<<(std::ostream& os, const Matrix<U, A>& mat);
+
+	/**
+	 * >> operator. Friend function used to allow the >> operator of std::istream object to read
+	 * Matrix<T> objects printed by the << operator: one row per line, up to an empty line or the
+	 * end of the stream. Large matrices are parsed in parallel (see MatrixText.h).
+	 * @param is The istream object
+	 * @param mat The matrix read. It is left unchanged if no matrix could be read.
+	 * @return Reference to the istream object, with failbit set if no matrix could be read.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	template <class U, class A>
+	friend std::istream& operator>>(std::istream& is, Matrix<U, A>& mat);
+
+	/**
+	 * () operator. Returns the cell located in the given coordinates. The coordinates are only
+	 * checked when NDEBUG is not defined; use at() for an access that is always checked.
+	 * @param row The cell row number
+	 * @param col The cell column number
+	 * @return The requested cell
+	 * @throws OutOfMatrixException if the requested cell is not exist in the matrix (without
+	 * 		   NDEBUG).
+	 */
+	inline T& operator()(unsigned int row, unsigned int col)
+	{
+#ifndef NDEBUG
+		_checkCell(row, col);
+#endif
+		return _exposed()[(std::size_t)_cols * row + col];
+	}
+
+	/**
+	 * () operator. Returns the cell located in the given coordinates (const Matrix). The
+	 * coordinates are only checked when NDEBUG is not defined; use at() for an access that is
+	 * always checked.
+	 * @param row The cell row number
+	 * @param col The cell column number
+	 * @return The requested cell
+	 * @throws OutOfMatrixException if the requested cell is not exist in the matrix (without
+	 * 		   NDEBUG).
+	 */
+	inline const T& operator()(unsigned int row, unsigned int col) const
+	{
+#ifndef NDEBUG
+		_checkCell(row, col);
+#endif
+		return _matrix[(std::size_t)_cols * row + col];
+	}
 
 	/**
-	 * () operator. Returns the cell located in the given coordinates.
+	 * Returns the cell located in the given coordinates.
 	 * @param row The cell row number
 	 * @param col The cell column number
 	 * @return The requested cell
 	 * @throws OutOfMatrixException if the requested cell is not exist in the matrix.
 	 */
-	T& operator()(unsigned int row, unsigned int col);
+	T& at(unsigned int row, unsigned int col);
 
 	/**
-	 * () operator. Returns the cell located in the given coordinates (const Matrix).
+	 * Returns the cell located in the given coordinates (const Matrix).
 	 * @param row The cell row number
 	 * @param col The cell column number
 	 * @return The requested cell
 	 * @throws OutOfMatrixException if the requested cell is not exist in the matrix.
 	 */
-	const T operator()(unsigned int row, unsigned int col) const;
+	const T& at(unsigned int row, unsigned int col) const;
+
+	/**
+	 * @return The first cell of the matrix. The cells are stored row by row, each row cols()
+	 * 		   cells after the previous one.
+	 */
+	inline T* data()
+	{
+		return _exposed();
+	}
+
+	/**
+	 * @return The first cell of the matrix (const Matrix). The cells are stored row by row, each
+	 * 		   row cols() cells after the previous one.
+	 */
+	inline const T* data() const
+	{
+		return _matrix.data();
+	}
+
+	/**
+	 * Returns the cells of a row.
+	 * @param row The row number
+	 * @return Span of the cols() cells of the row.
+	 * @throws OutOfMatrixException if the row is not exist in the matrix.
+	 */
+	MatrixSpan<T> row(unsigned int row);
+
+	/**
+	 * Returns the cells of a row (const Matrix).
+	 * @param row The row number
+	 * @return Span of the cols() cells of the row.
+	 * @throws OutOfMatrixException if the row is not exist in the matrix.
+	 */
+	MatrixSpan<const T> row(unsigned int row) const;
+
+	/**
+	 * Returns a view of a block of the cells of this, which refers to them without copying them
+	 * (see MatrixView.h).
+	 * @param row The row number of the first cell of the block
+	 * @param col The column number of the first cell of the block
+	 * @param rows Number of rows of the block
+	 * @param cols Number of columns of the block
+	 * @return The view of the block.
+	 * @throws OutOfMatrixException if the block is not inside the matrix.
+	 */
+	MatrixView<T> view(unsigned int row, unsigned int col, unsigned int rows, unsigned int cols);
+
+	/**
+	 * Returns a read-only view of a block of the cells of this (const Matrix).
+	 * @param row The row number of the first cell of the block
+	 * @param col The column number of the first cell of the block
+	 * @param rows Number of rows of the block
+	 * @param cols Number of columns of the block
+	 * @return The view of the block.
+	 * @throws OutOfMatrixException if the block is not inside the matrix.
+	 */
+	MatrixView<const T> view(unsigned int row, unsigned int col, unsigned int rows,
+							 unsigned int cols) const;
 
 	/**
 	 * @return true if this matrix is square, false otherwise.
 	 */
-	inline bool isSquareMatrix()
+	inline bool isSquareMatrix() const
 	{
 		return (_rows == _cols);
 	}
@@ -173,7 +575,7 @@ public:
 	/**
 	 * @return The number of rows of the matrix.
 	 */
-	inline unsigned int rows()
+	inline unsigned int rows() const
 	{
 		return _rows;
 	}
@@ -181,7 +583,7 @@ public:
 	/**
 	 * The number of columns of the matrix.
 	 */
-	inline unsigned int cols()
+	inline unsigned int cols() const
 	{
 		return _cols;
 	}
@@ -190,12 +592,12 @@ public:
 	/**
 	 * Defining the const_iterator of Matrix as the const_iterator of vector<T>
 	 */
-	typedef typename std::vector<T>::const_iterator const_iterator;
+	typedef typename MatrixStorage<T, Allocator>::type::const_iterator const_iterator;
 
 	/**
 	 * @return iterator for the first cell of the matrix.
 	 */
-	inline const_iterator begin()
+	inline const_iterator begin() const
 	{
 		return _matrix.cbegin();
 	}
@@ -203,106 +605,287 @@ public:
 	/**
 	 * @return iterator for one after the last cell of the matrix.
 	 */
-	inline const_iterator end()
+	inline const_iterator end() const
 	{
 		return _matrix.cend();
 	}
 
 	// ------------------ Parallel --------------------------
 	/**
-	 * Change the value of static member _isParallel to the given parameter.
+	 * Forces all the operations (of every element type) to run in parallel or sequentially.
+	 * Same as ExecutionPolicy::setExecution with Execution::PARALLEL or Execution::SEQUENTIAL;
+	 * by default (Execution::AUTO) the execution is chosen per operation from its size.
 	 * @param isParallel value to set.
 	 */
 	static void setParallel(bool isParallel);
 
+	// ------------------ Multiplication --------------------
+	/**
+	 * Sets the algorithm products are computed with, unless another one is given to multiply().
+	 * Products added to a matrix in place (m += a * b) always use the standard engine.
+	 * @param algorithm The algorithm, STANDARD (the default) or STRASSEN. DEFAULT is STANDARD.
+	 */
+	static void setMultiplyAlgorithm(MultiplyAlgorithm algorithm);
+
+	/**
+	 * Sets the size below which (in any dimension) the Strassen-Winograd engine hands the
+	 * products to the standard engine.
+	 * @param size The crossover size
+	 */
+	static void setStrassenCrossover(unsigned int size);
+
+	// ------------------ Files -----------------------------
+	/**
+	 * Saves this to a binary matrix file (see MatrixFile.h), replacing the file if it exists.
+	 * @param path The path of the file
+	 * @throws MatrixFileException if the file cannot be written.
+	 */
+	void save(const std::string& path) const;
+
+	/**
+	 * Reads a matrix from a binary matrix file saved by save().
+	 * @param path The path of the file
+	 * @return The matrix.
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws MatrixFileException if the file cannot be read or is not a matrix file of T.
+	 */
+	static Matrix<T, Allocator> load(const std::string& path);
+
+	/**
+	 * Maps a binary matrix file saved by save() in memory. The cells are read in place from the
+	 * file, so large matrices are available at once, without reading or copying them.
+	 * @param path The path of the file
+	 * @return The read-only matrix of the file.
+	 * @throws MatrixFileException if the file cannot be mapped or is not a matrix file of T.
+	 */
+	static MappedMatrix<T> mapFile(const std::string& path);
+
 private:
+	/**
+	 * Views split their rows among the threads like matrices (see _rowGrain()).
+	 */
+	template <class U>
+	friend class MatrixView;
+
 	// ------------------ Data members ----------------------
 	unsigned int _rows; /**< Number of rows of the matrix */
 	unsigned int _cols; /**< Number of columns of the matrix */
-	std::vector<T> _matrix; /**< Cells of the matrix */
-	static bool _isParallel; /**< Is the parallel mode is on or off */
+	typename MatrixStorage<T, Allocator>::type _matrix; /**< Cells of the matrix */
+	static MultiplyAlgorithm _multiplyAlgorithm; /**< The algorithm products are computed with */
+	static unsigned int _strassenCrossover; /**< The crossover size of Strassen-Winograd */
 
 	// ------------------ Private functions -----------------
 	/**
-	 * Helper function used by the parallel method in operator +. Calculate the cells of newMatrix
-	 * on the given row.
-	 * @param other The other matrix
-	 * @param newMatrix The result matrix
-	 * @param row The row number
+	 * Checks that the given coordinates are inside the matrix.
+	 * @param row The cell row number
+	 * @param col The cell column number
+	 * @throws OutOfMatrixException if the cell is not exist in the matrix.
 	 */
-	void _addParallel(const Matrix<T>& other, Matrix<T>& newMatrix, unsigned int row) const;
+	inline void _checkCell(unsigned int row, unsigned int col) const
+	{
+		if (row >= _rows || col >= _cols)
+		{
+			throw OutOfMatrixException();
+		}
+	}
 
 	/**
-	 * Helper function used by the parallel method in operator *. Calculate the cells of newMatrix
-	 * on the given row.
-	 * @param other The other matrix
-	 * @param newMatrix The result matrix
-	 * @param row The row number
+	 * Runs func(rowBegin, rowEnd) over the rows of this: on chunks of rows in the thread pool if
+	 * the execution policy runs the operation in parallel, or once on all the rows otherwise.
+	 * @param operation The kind of operation
+	 * @param cellsPerRow The number of cells (or multiply-adds) computed for every row
+	 * @param func The function to run
 	 */
-	void _multParallel(const Matrix<T>& other, Matrix<T>& newMatrix, unsigned int row) const;
-};
+	template <class Func>
+	void _forRows(Operation operation, unsigned long long cellsPerRow, const Func& func) const;
 
-/**
- * default initialization for the _isParallel static member of Matrix<T> as false.
- */
-template <class T>
-bool Matrix<T>::_isParallel = false;
+	/**
+	 * @return A matrix owned by the calling thread, used to hold results that cannot be computed
+	 * 		   in place. Its cells are exchanged with the matrix the result is assigned to, so
+	 * 		   small buffers are reused instead of allocated (see _releaseScratch()).
+	 */
+	static Matrix<T, Allocator>& _scratch();
 
-// ------------------ Constructors ----------------------
-/**
- * Default constructor. Initiates the matrix with size of 1X1 and sets its cell to 0.
- * @throws bad_alloc if the memory allocation fails
- */
-template <class T>
-Matrix<T>::Matrix() : _rows(1), _cols(1)
-{
-	_matrix.push_back(T(0));
-}
+	/**
+	 * Frees the cells of the scratch matrix once its result was used, unless they are small enough
+	 * to be kept for the next results (and not shared with copies).
+	 * @param scratch The scratch matrix
+	 */
+	static void _releaseScratch(Matrix<T, Allocator>& scratch);
 
-/**
- * Initiates the matrix with the size of rows X cols and sets its cells to 0.
- * @param rows Number of rows
- * @param cols Number of columns
- * @throws bad_alloc if the memory allocation fails
- * @throws IllegalMatrixException if one of the arguments rows and cols (but not both) is 0.
- */
-template <class T>
-Matrix<T>::Matrix(unsigned int rows, unsigned int cols)
-{
-	if ((rows == 0 && cols != 0) || (rows != 0 && cols == 0))
+	/**
+	 * @return The first cell, for the accessors that let the caller write the cells at any later
+	 * 		   time. Copy-on-write cells are detached and no longer shared (see MatrixStorage.h).
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	inline T* _exposed()
 	{
-		throw IllegalMatrixException();
+		return MatrixStorage<T, Allocator>::expose(_matrix);
 	}
 
-	_rows = rows;
-	_cols = cols;
-	for (unsigned int i = 0; i < rows * cols; i++)
+	/**
+	 * @return The first cell, for reading only: unlike the non-const _matrix.data(), copy-on-write
+	 * 		   cells are not detached. Used to check whether an expression reads the cells of
+	 * 		   this.
+	 */
+	inline const T* _constData() const
 	{
-		_matrix.push_back(T(0));
+		return _matrix.data();
 	}
-}
-
-/**
- * Copy Constructor. Copy the values of other to this.
- * @param other The other matrix
- * @throws bad_alloc if the memory allocation fails
- */
-template <class T>
-Matrix<T>::Matrix(const Matrix<T>& other) : _rows(other._rows), _cols(other._cols),
-											_matrix(other._matrix)
-{
-}
 
-/**
- * Move Constructor. Move the rvalue of other to this.
- * @param other The other matrix
- * @throws bad_alloc if the memory allocation fails
- */
-template <class T>
-Matrix<T>::Matrix(Matrix<T> && other) : _rows(other._rows), _cols(other._cols),
-									   _matrix(std::move(other._matrix))
-{
-}
+	/**
+	 * @return Whether the cells of this are copy-on-write cells shared with copies.
+	 */
+	inline bool _shared() const
+	{
+		return MatrixStorage<T, Allocator>::shared(_matrix);
+	}
+
+	/**
+	 * Exchanges the dimensions and cells of this and other.
+	 * @param other The other matrix
+	 */
+	void _swap(Matrix<T, Allocator>& other);
+
+	/**
+	 * Sets the dimensions of this for cells that are all about to be written.
+	 * @param rows Number of rows
+	 * @param cols Number of columns
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	void _resize(unsigned int rows, unsigned int cols);
+
+	/**
+	 * Evaluates a cell by cell expression into this, row by row.
+	 * @param expr The expression
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	template <class E>
+	void _assign(const E& expr);
+
+	/**
+	 * Computes a product into this with the multiplication engine.
+	 * @param product The product
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	void _assign(const MatrixProduct<T>& product);
+
+	/**
+	 * Assigns an operand to this. Transposed operands are copied with the blocked transpose, and
+	 * this = this.trans() transposes a square matrix in place.
+	 * @param operand The operand
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	void _assign(const MatrixOperand<T>& operand);
+
+	/**
+	 * Assigns the cells of a matrix of another allocator to this.
+	 * @param other The other matrix
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	template <class A>
+	void _assign(const Matrix<T, A>& other);
+
+	/**
+	 * Adds (or subtracts) a cell by cell expression to this in place, row by row.
+	 * @param expr The expression
+	 * @param subtract Whether to subtract instead of adding
+	 * @throws WrongDimensionsExceptions if the dimensions of this and expr are not the same.
+	 */
+	template <class E>
+	void _update(const E& expr, bool subtract);
+
+	/**
+	 * Adds (or subtracts) a product to this in place with the multiplication engine.
+	 * @param product The product
+	 * @param subtract Whether to subtract instead of adding
+	 * @throws WrongDimensionsExceptions if the dimensions of this and product are not the same.
+	 */
+	void _update(const MatrixProduct<T>& product, bool subtract);
+
+	/**
+	 * Adds (or subtracts) a matrix to this in place.
+	 * @param other The other matrix
+	 * @param subtract Whether to subtract instead of adding
+	 * @throws WrongDimensionsExceptions if the dimensions of this and other are not the same.
+	 */
+	template <class A>
+	void _update(const Matrix<T, A>& other, bool subtract);
+
+	/**
+	 * @param cellsPerRow The number of cells (or multiply-adds) computed for every row
+	 * @return The minimal number of rows given to a thread in the parallel mode, so that each
+	 * 		   chunk has enough work to hide the cost of handing it to the thread pool.
+	 */
+	static unsigned int _rowGrain(unsigned long long cellsPerRow);
+};
+
+/**
+ * default initialization for the _multiplyAlgorithm static member of Matrix<T> as STANDARD.
+ */
+template <class T, class Allocator>
+MultiplyAlgorithm Matrix<T, Allocator>::_multiplyAlgorithm = MultiplyAlgorithm::STANDARD;
+
+/**
+ * default initialization for the _strassenCrossover static member of Matrix<T> as 256, around
+ * where Strassen-Winograd starts to pay off for double (see StrassenBenchmark.cpp).
+ */
+template <class T, class Allocator>
+unsigned int Matrix<T, Allocator>::_strassenCrossover = 256;
+
+// ------------------ Constructors ----------------------
+/**
+ * Default constructor. Initiates the matrix with size of 1X1 and sets its cell to 0.
+ * @throws bad_alloc if the memory allocation fails
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator>::Matrix() : _rows(1), _cols(1), _matrix(1, T(0))
+{
+}
+
+/**
+ * Initiates the matrix with the size of rows X cols and sets its cells to 0.
+ * @param rows Number of rows
+ * @param cols Number of columns
+ * @throws bad_alloc if the memory allocation fails
+ * @throws IllegalMatrixException if one of the arguments rows and cols (but not both) is 0.
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator>::Matrix(unsigned int rows, unsigned int cols)
+{
+	if ((rows == 0 && cols != 0) || (rows != 0 && cols == 0))
+	{
+		throw IllegalMatrixException();
+	}
+
+	_rows = rows;
+	_cols = cols;
+	_matrix.assign((std::size_t)rows * cols, T(0));
+}
+
+/**
+ * Copy Constructor. Copy the values of other to this.
+ * @param other The other matrix
+ * @throws bad_alloc if the memory allocation fails
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator>::Matrix(const Matrix<T, Allocator>& other) :
+	_rows(other._rows), _cols(other._cols)
+{
+	MATRIX_PROFILE(ProfiledOperation::COPY, other._matrix.size(), 0);
+	_matrix = other._matrix;
+}
+
+/**
+ * Move Constructor. Move the rvalue of other to this.
+ * @param other The other matrix
+ * @throws bad_alloc if the memory allocation fails
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator>::Matrix(Matrix<T, Allocator> && other) :
+	_rows(other._rows), _cols(other._cols), _matrix(std::move(other._matrix))
+{
+}
 
 /**
  * Initiates the matrix with the size of rows X cols and sets its cells to the items of cells.
@@ -313,8 +896,8 @@ Matrix<T>::Matrix(Matrix<T> && other) : _rows(other._rows), _cols(other._cols),
  * @throws IllegalMatrixException if one of the arguments rows and cols (but not both) is 0.
  * @throws IllegalVectorException if the size of cells is not matching rows and cols.
  */
-template <class T>
-Matrix<T>::Matrix(unsigned int rows, unsigned int cols, const std::vector<T>& cells)
+template <class T, class Allocator>
+Matrix<T, Allocator>::Matrix(unsigned int rows, unsigned int cols, const std::vector<T>& cells)
 {
 	if ((rows == 0 && cols != 0) || (rows != 0 && cols == 0))
 	{
@@ -328,15 +911,56 @@ Matrix<T>::Matrix(unsigned int rows, unsigned int cols, const std::vector<T>& ce
 
 	_rows = rows;
 	_cols = cols;
-	_matrix = cells;
+	_matrix.assign(cells.begin(), cells.end());
+}
+
+/**
+ * Initiates the matrix with the size of rows X cols and takes the items of cells as its cells,
+ * without copying them.
+ * @param rows Number of rows
+ * @param cols Number of columns
+ * @param cells vector containing the cells of the matrix, left empty.
+ * @throws IllegalMatrixException if one of the arguments rows and cols (but not both) is 0.
+ * @throws IllegalVectorException if the size of cells is not matching rows and cols.
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator>::Matrix(unsigned int rows, unsigned int cols,
+							 std::vector<T, Allocator>&& cells)
+{
+	if ((rows == 0 && cols != 0) || (rows != 0 && cols == 0))
+	{
+		throw IllegalMatrixException();
+	}
+
+	if (cells.size() != (std::size_t)rows * cols)
+	{
+		throw IllegalVectorException();
+	}
+
+	_rows = rows;
+	_cols = cols;
+	_matrix = std::move(cells);
+}
+
+/**
+ * Initiates the matrix with the value of an expression.
+ * @param expr The expression
+ * @throws bad_alloc if the memory allocation fails
+ */
+template <class T, class Allocator>
+template <class E>
+Matrix<T, Allocator>::Matrix(const MatrixExpression<E>& expr) : _rows(0), _cols(0)
+{
+	MATRIX_PROFILE_EXPRESSION(expr.self());
+	_assign(expr.self());
 }
 
 // ------------------ Destructor ------------------------
 /**
  * Destructor for Matrix<T>.
  */
-template <class T>
-Matrix<T>::~Matrix()
+template <class T, class Allocator>
+Matrix<T, Allocator>::~Matrix()
 {
 }
 
@@ -347,9 +971,10 @@ Matrix<T>::~Matrix()
  * @return reference to this
  * @throws bad_alloc if the memory allocation fails
  */
-template <class T>
-Matrix<T>& Matrix<T>::operator=(const Matrix<T>& other)
+template <class T, class Allocator>
+Matrix<T, Allocator>& Matrix<T, Allocator>::operator=(const Matrix<T, Allocator>& other)
 {
+	MATRIX_PROFILE(ProfiledOperation::COPY, other._matrix.size(), 0);
 	_rows = other._rows;
 	_cols = other._cols;
 	_matrix = other._matrix;
@@ -357,117 +982,131 @@ Matrix<T>& Matrix<T>::operator=(const Matrix<T>& other)
 }
 
 /**
- * + operator. Adds this and other and returns the new matrix.
+ * Move assignment operator. Takes the cells of the rvalue other, giving it the old cells of
+ * this in exchange.
  * @param other The other matrix
- * @return The result matrix
+ * @return reference to this
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator>& Matrix<T, Allocator>::operator=(Matrix<T, Allocator>&& other)
+{
+	_swap(other);
+	return *this;
+}
+
+/**
+ * = operator. Assigns the value of an expression to this, evaluating it in a single pass.
+ * @param expr The expression
+ * @return reference to this
  * @throws bad_alloc if the memory allocation fails
- * @throws WrongDimensionsExceptions if the dimensions of this and other are not the same.
  */
-template <class T>
-const Matrix<T> Matrix<T>::operator+(const Matrix<T>& other) const
+template <class T, class Allocator>
+template <class E>
+Matrix<T, Allocator>& Matrix<T, Allocator>::operator=(const MatrixExpression<E>& expr)
 {
-	if (_rows != other._rows || _cols != other._cols)
-	{
-		throw WrongDimensionsException();
-	}
+	MATRIX_PROFILE_EXPRESSION(expr.self());
+	_assign(expr.self());
+	return *this;
+}
 
-	Matrix<T> newMatrix(*this);
-	if(_isParallel)
-	{
-		std::vector<std::thread> threads;
-		threads.resize(_rows);
-		for (unsigned int i = 0; i < _rows; i++)
-		{
-			threads[i] = std::thread(&Matrix<T>::_addParallel, this, other, std::ref(newMatrix), i);
-		}
-		for (unsigned int j = 0; j < _rows; j++)
-		{
-			threads[j].join();
-		}
-	}
-	else
-	{
-		for (unsigned int i = 0; i < _rows * _cols; i++)
-		{
-			newMatrix._matrix[i] += other._matrix[i];
-		}
-	}
+/**
+ * += operator. Adds the value of an expression to this in place.
+ * @param expr The expression
+ * @return reference to this
+ * @throws WrongDimensionsExceptions if the dimensions of this and expr are not the same.
+ */
+template <class T, class Allocator>
+template <class E>
+Matrix<T, Allocator>& Matrix<T, Allocator>::operator+=(const MatrixExpression<E>& expr)
+{
+	MATRIX_PROFILE_UPDATE(expr.self(), false);
+	_update(expr.self(), false);
+	return *this;
+}
 
-	return newMatrix;
+/**
+ * -= operator. Subtracts the value of an expression from this in place.
+ * @param expr The expression
+ * @return reference to this
+ * @throws WrongDimensionsExceptions if the dimensions of this and expr are not the same.
+ */
+template <class T, class Allocator>
+template <class E>
+Matrix<T, Allocator>& Matrix<T, Allocator>::operator-=(const MatrixExpression<E>& expr)
+{
+	MATRIX_PROFILE_UPDATE(expr.self(), true);
+	_update(expr.self(), true);
+	return *this;
 }
 
 /**
- * - operator. Subtracts other from this and returns the new matrix.
- * @param other The other matrix
- * @return The result matrix
+ * *= operator. Multiply this by the value of an expression (according to matrices
+ * multiplication). The product is computed into a buffer kept by the calling thread, which then
+ * takes the old cells of this, so repeated multiplications do not allocate memory.
+ * @param expr The expression
+ * @return reference to this
  * @throws bad_alloc if the memory allocation fails
- * @throws WrongDimensionsExceptions if the dimensions of this and other are not the same.
+ * @throws WrongDimensionsExceptions if number of columns of this is not equal to the number of
+ * 		   rows of expr.
  */
-template <class T>
-const Matrix<T> Matrix<T>::operator-(const Matrix<T>& other) const
+template <class T, class Allocator>
+template <class E>
+Matrix<T, Allocator>& Matrix<T, Allocator>::operator*=(const MatrixExpression<E>& expr)
 {
-	if (_rows != other._rows || _cols != other._cols)
-	{
-		throw WrongDimensionsException();
-	}
+	MATRIX_PROFILE(ProfiledOperation::MULTIPLY, (unsigned long long)_rows * expr.self().cols(),
+				   (unsigned long long)_rows * _cols * expr.self().cols());
+	_assign(*this * expr.self());
+	return *this;
+}
 
-	Matrix<T> newMatrix(*this);
-	for (unsigned int i = 0; i < _rows * _cols; i++)
+/**
+ * *= operator. Multiply the cells of this by a scalar in place.
+ * @param scalar The scalar
+ * @return reference to this
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator>& Matrix<T, Allocator>::operator*=(const T& scalar)
+{
+	MATRIX_PROFILE(ProfiledOperation::MULTIPLY, _matrix.size(), _matrix.size());
+	// Copy-on-write cells are detached here, not by the workers
+	T* cells = _matrix.data();
+	_forRows(Operation::ELEMENTWISE, _cols,
+			 [this, cells, &scalar](unsigned int rowBegin, unsigned int rowEnd)
 	{
-		newMatrix._matrix[i] -= other._matrix[i];
-	}
+		T* first = cells + (std::size_t)rowBegin * _cols;
+		ElementKernels<T>::scale(first, first, scalar, (std::size_t)(rowEnd - rowBegin) * _cols);
+	});
 
-	return newMatrix;
+	return *this;
 }
 
 /**
- * * operator. Multiply this and other (according to matrices multiplication) and returns the
- * new matrix.
+ * Adds alpha * other to this in place.
+ * @param alpha The scale of other
  * @param other The other matrix
- * @return The result matrix.
- * @throws bad_alloc if the memory allocation fails
- * @throws WrongDimensionsExceptions if number of columns of this is not equal to the number of
- * 		   rows of other.
+ * @return reference to this
+ * @throws WrongDimensionsExceptions if the dimensions of this and other are not the same.
  */
-template <class T>
-const Matrix<T> Matrix<T>::operator*(const Matrix<T>& other) const
+template <class T, class Allocator>
+Matrix<T, Allocator>& Matrix<T, Allocator>::axpy(const T& alpha, const Matrix<T, Allocator>& other)
 {
-	if (_cols != other._rows)
+	if (_rows != other._rows || _cols != other._cols)
 	{
 		throw WrongDimensionsException();
 	}
 
-	Matrix<T> newMatrix(_rows, other._cols);
-	if(_isParallel)
+	// Copy-on-write cells are detached here, not by the workers
+	T* cells = _matrix.data();
+	const T* source = other._matrix.data();
+	_forRows(Operation::ELEMENTWISE, _cols,
+			 [this, cells, source, &alpha](unsigned int rowBegin, unsigned int rowEnd)
 	{
-		std::vector<std::thread> threads;
-		threads.resize(_rows);
-		for (unsigned int i = 0; i < _rows; i++)
-		{
-			threads[i] = std::thread(&Matrix<T>::_multParallel, this, other, std::ref(newMatrix), i);
-		}
-		for (unsigned int j = 0; j < _rows; j++)
-		{
-			threads[j].join();
-		}
-	}
-	else
-	{
-		for (unsigned int i = 0; i < newMatrix._rows; i++)
-		{
-			for (unsigned int j = 0; j < newMatrix._cols; j++)
-			{
-				T cell(0);
-				for (unsigned int k = 0; k < _cols; k++)
-				{
-					cell += (*this)(i, k) * other(k, j);
-				}
-				newMatrix(i, j) = cell;
-			}
-		}
-	}
+		ElementKernels<T>::axpy((std::size_t)(rowEnd - rowBegin) * _cols, alpha,
+								source + (std::size_t)rowBegin * _cols,
+								cells + (std::size_t)rowBegin * _cols);
+	});
 
-	return newMatrix;
+	return *this;
 }
 
 /**
@@ -475,8 +1114,8 @@ const Matrix<T> Matrix<T>::operator*(const Matrix<T>& other) const
  * @param other The other matrix
  * @return true if this and other are equal, false otherwise.
  */
-template <class T>
-bool Matrix<T>::operator==(const Matrix<T>& other) const
+template <class T, class Allocator>
+bool Matrix<T, Allocator>::operator==(const Matrix<T, Allocator>& other) const
 {
 	if (_matrix == other._matrix)
 	{
@@ -491,50 +1130,49 @@ bool Matrix<T>::operator==(const Matrix<T>& other) const
  * @param other The other matrix
  * @return true if this and other are not equal, false otherwise.
  */
-template <class T>
-bool Matrix<T>::operator!=(const Matrix<T>& other) const
+template <class T, class Allocator>
+bool Matrix<T, Allocator>::operator!=(const Matrix<T, Allocator>& other) const
 {
 	return !(*this == other);
 }
 
 /**
- * Calculates and returns the transposed matrix of this.
+ * Returns the transposed matrix of this (conjugated for Complex cells). The result refers to
+ * the cells of this and is computed only when assigned to a matrix.
  * @return The transposed matrix.
- * @throws bad_alloc if the memory allocation fails
  */
-template <class T>
-const Matrix<T> Matrix<T>::trans() const
+template <class T, class Allocator>
+MatrixOperand<T> Matrix<T, Allocator>::trans() const
 {
-	Matrix<T> newMatrix(_cols, _rows);
-	for (unsigned int i = 0; i < newMatrix._rows; i++)
-	{
-		for (unsigned int j = 0; j < newMatrix._cols; j++)
-		{
-			newMatrix(i, j) = (*this)(j, i);
-		}
-	}
-
-	return newMatrix;
+	return MatrixOperand<T>(*this).trans();
 }
 
 /**
- * Specialization for the Complex calls. Calculates and returns the conjugated matrix of this.
- * @return The conjugated matrix.
- * @throws bad_alloc if the memory allocation fails
+ * Transposes this in place (conjugated for Complex cells). A square matrix is transposed
+ * without a second buffer; other shapes are transposed into the scratch matrix, whose cells
+ * are then exchanged with the cells of this. So a non-square matrix needs a second buffer of
+ * its size during the call, which is freed on return unless it takes at most 256 KiB.
+ * @return reference to this
+ * @throws bad_alloc if the memory allocation fails (non-square matrices only)
  */
-template <>
-const Matrix<Complex> Matrix<Complex>::trans() const
+template <class T, class Allocator>
+Matrix<T, Allocator>& Matrix<T, Allocator>::transposeInPlace()
 {
-	Matrix<Complex> newMatrix(_cols, _rows);
-	for (unsigned int i = 0; i < newMatrix._rows; i++)
+	MATRIX_PROFILE(ProfiledOperation::TRANSPOSE, _matrix.size(), 0);
+	if (!isSquareMatrix())
 	{
-		for (unsigned int j = 0; j < newMatrix._cols; j++)
-		{
-			newMatrix(i, j) = (*this)(j, i).conj();
-		}
+		_assign(trans());
+		return *this;
 	}
 
-	return newMatrix;
+	// Copy-on-write cells are detached here, not by the workers
+	T* cells = _matrix.data();
+	_forRows(Operation::TRANSPOSE, _cols, [this, cells](unsigned int rowBegin, unsigned int rowEnd)
+	{
+		Transpose<T>::inPlace(_rows, cells, _cols, ElementConjugate<T>::CONJUGATES, rowBegin,
+							  rowEnd);
+	});
+	return *this;
 }
 
 /**
@@ -542,136 +1180,919 @@ const Matrix<Complex> Matrix<Complex>::trans() const
  * @return The trace.
  * @throws NoSquareException if this matrix is not square
  */
-template <class T>
-const T Matrix<T>::trace() const
+template <class T, class Allocator>
+T Matrix<T, Allocator>::trace() const
 {
 	if (_rows != _cols)
 	{
 		throw NoSquareException();
 	}
+	MATRIX_PROFILE(ProfiledOperation::TRACE, _rows, _rows);
 	T trace(0);
 	for (unsigned int i = 0; i < _rows; i++)
 	{
-		trace += (*this)(i, i);
+		trace += _matrix[(std::size_t)i * (_cols + 1)];
 	}
 
 	return trace;
 }
 
 /**
- * << operator. Friend function used to allow the << operator of std::ostream object to print
- * to output Matrix<T> objects.
- * @param os The ostream object
- * @param mat The matrix to print
- * @return Reference to the ostream object.
+ * Calculates and returns the determinant of this, from its LU decomposition (computed in double
+ * for integral cells, and rounded).
+ * @return The determinant.
+ * @throws NoSquareException if this matrix is not square
+ * @throws bad_alloc if the memory allocation fails
  */
-template <class U>
-std::ostream& operator<<(std::ostream& os, const Matrix<U>& mat)
+template <class T, class Allocator>
+T Matrix<T, Allocator>::det() const
 {
-	for (unsigned int i = 0; i < mat._rows; i++)
+	if (_rows != _cols)
 	{
-		for (unsigned int j = 0; j < mat._cols; j++)
-		{
-			os << mat(i, j) << "\t";
-		}
-		os << std::endl;
+		throw NoSquareException();
 	}
-	return os;
+	typedef typename LuElement<T>::type Element;
+	std::vector<Element, AlignedAllocator<Element> > lu(_matrix.begin(), _matrix.end());
+	std::vector<unsigned int> pivots(_rows);
+	if (!LuDecomposition<Element>::factor(_rows, lu.data(), _cols, pivots.data()))
+	{
+		return T(0);
+	}
+	return LuElement<T>::convert(LuDecomposition<Element>::determinant(_rows, lu.data(), _cols,
+																		pivots.data()));
 }
 
 /**
- * () operator. Returns the cell located in the given coordinates.
- * @param row The cell row number
- * @param col The cell column number
- * @return The requested cell
- * @throws OutOfMatrixException if the requested cell is not exist in the matrix.
+ * Solves the system this * X = b for X, with one right-hand side per column of b, from the LU
+ * decomposition of this with partial pivoting. Not available for integral cells.
+ * @param b The right-hand sides
+ * @return The solutions X, with the dimensions of b.
+ * @throws NoSquareException if this matrix is not square
+ * @throws WrongDimensionsExceptions if the number of rows of b is not the number of rows of this.
+ * @throws SingularMatrixException if this matrix is singular
+ * @throws bad_alloc if the memory allocation fails
  */
-template <class T>
-T& Matrix<T>::operator()(unsigned int row, unsigned int col)
+template <class T, class Allocator>
+Matrix<T, Allocator> Matrix<T, Allocator>::solve(const Matrix<T, Allocator>& b) const
 {
-	if (row > _rows || col > _cols)
+	static_assert(!std::is_integral<T>::value, "Systems of integral cells cannot be solved");
+	if (_rows != _cols)
 	{
-		throw OutOfMatrixException();
+		throw NoSquareException();
 	}
-	return _matrix[_cols * row + col];
+	if (b._rows != _rows)
+	{
+		throw WrongDimensionsException();
+	}
+	std::vector<T, Allocator> lu(_matrix.begin(), _matrix.end());
+	std::vector<unsigned int> pivots(_rows);
+	if (!LuDecomposition<T>::factor(_rows, lu.data(), _cols, pivots.data()))
+	{
+		throw SingularMatrixException();
+	}
+	Matrix<T, Allocator> x(b);
+	LuDecomposition<T>::solve(_rows, lu.data(), _cols, pivots.data(), x._cols, x._matrix.data(),
+							  x._cols);
+	return x;
 }
 
 /**
- * () operator. Returns the cell located in the given coordinates (const Matrix).
- * @param row The cell row number
- * @param col The cell column number
- * @return The requested cell
- * @throws OutOfMatrixException if the requested cell is not exist in the matrix.
+ * Calculates and returns the inverse of this, by solving this * X = I. Not available for integral
+ * cells.
+ * @return The inverse matrix.
+ * @throws NoSquareException if this matrix is not square
+ * @throws SingularMatrixException if this matrix is singular
+ * @throws bad_alloc if the memory allocation fails
  */
-template <class T>
-const T Matrix<T>::operator()(unsigned int row, unsigned int col) const
+template <class T, class Allocator>
+Matrix<T, Allocator> Matrix<T, Allocator>::inverse() const
 {
-	if (row > _rows || col > _cols)
+	if (_rows != _cols)
 	{
-		throw OutOfMatrixException();
+		throw NoSquareException();
+	}
+	Matrix<T, Allocator> identity(_rows, _cols);
+	for (unsigned int i = 0; i < _rows; i++)
+	{
+		identity._matrix[(std::size_t)i * (_cols + 1)] = T(1);
 	}
-	return _matrix[_cols * row + col];
+	return solve(identity);
 }
 
-// ------------------ Parallel --------------------------
 /**
- * Change the value of static member _isParallel to the given parameter.
- * @param isParallel value to set.
+ * Computes y = alpha * this * x, or y += alpha * this * x if accumulate is true (see Gemv.h).
+ * @param x The vector multiplied, of one cell per column of this
+ * @param y The result vector, of one cell per row of this, not overlapping this or x
+ * @param alpha Scale of the product
+ * @param accumulate Whether the product is added to y instead of overwriting it
+ * @throws WrongDimensionsExceptions if the sizes of x and y do not match the dimensions of this.
  */
-template <class T>
-void Matrix<T>::setParallel(bool isParallel)
+template <class T, class Allocator>
+void Matrix<T, Allocator>::gemv(MatrixSpan<const T> x, MatrixSpan<T> y, const T& alpha,
+								bool accumulate) const
 {
-	if (isParallel != _isParallel)
+	if (x.size() != _cols || y.size() != _rows)
 	{
-		std::cout << "Generic Matrix mode changed to ";
-		if (isParallel)
-		{
-			std::cout << "parallel";
-		}
-		else
-		{
-			std::cout << "non-parallel";
-		}
-		std::cout << " mode." << std::endl;
+		throw WrongDimensionsException();
 	}
-	_isParallel = isParallel;
+	Gemv<T>::multiply(_rows, _cols, alpha, _matrix.data(), _cols, x.data(), y.data(), accumulate);
 }
 
-// ------------------ Private functions -----------------
 /**
- * Helper function used by the parallel method in operator +. Calculate the cells of newMatrix
- * on the given row.
- * @param other The other matrix
- * @param newMatrix The result matrix
- * @param row The row number
+ * Calculates and returns this * x.
+ * @param x The vector multiplied, of one cell per column of this
+ * @return The result vector, of one cell per row of this.
+ * @throws WrongDimensionsExceptions if the size of x is not the number of columns of this.
+ * @throws bad_alloc if the memory allocation fails
  */
-template <class T>
-void Matrix<T>::_addParallel(const Matrix<T>& other, Matrix<T>& newMatrix, unsigned int row) const
+template <class T, class Allocator>
+std::vector<T> Matrix<T, Allocator>::gemv(const std::vector<T>& x) const
 {
-	for (unsigned int j = 0; j < newMatrix._cols; j++)
-	{
-		newMatrix(row, j) = (*this)(row, j) + other(row, j);
-	}
+	std::vector<T> y(_rows);
+	gemv(x, y);
+	return y;
 }
 
 /**
- * Helper function used by the parallel method in operator *. Calculate the cells of newMatrix
- * on the given row.
- * @param other The other matrix
- * @param newMatrix The result matrix
+ * Computes y = alpha * trans() * x, or y += alpha * trans() * x if accumulate is true, without
+ * transposing this. Complex cells are conjugated like trans() does.
+ * @param x The vector multiplied, of one cell per row of this
+ * @param y The result vector, of one cell per column of this, not overlapping this or x
+ * @param alpha Scale of the product
+ * @param accumulate Whether the product is added to y instead of overwriting it
+ * @throws WrongDimensionsExceptions if the sizes of x and y do not match the dimensions of this.
+ */
+template <class T, class Allocator>
+void Matrix<T, Allocator>::gemvT(MatrixSpan<const T> x, MatrixSpan<T> y, const T& alpha,
+								 bool accumulate) const
+{
+	if (x.size() != _rows || y.size() != _cols)
+	{
+		throw WrongDimensionsException();
+	}
+	Gemv<T>::multiplyTransposed(_rows, _cols, alpha, _matrix.data(), _cols, x.data(), y.data(),
+								accumulate, ElementConjugate<T>::CONJUGATES);
+}
+
+/**
+ * Calculates and returns trans() * x, without transposing this.
+ * @param x The vector multiplied, of one cell per row of this
+ * @return The result vector, of one cell per column of this.
+ * @throws WrongDimensionsExceptions if the size of x is not the number of rows of this.
+ * @throws bad_alloc if the memory allocation fails
+ */
+template <class T, class Allocator>
+std::vector<T> Matrix<T, Allocator>::gemvT(const std::vector<T>& x) const
+{
+	std::vector<T> y(_cols);
+	gemvT(x, y);
+	return y;
+}
+
+/**
+ * Multiplies this by a batch of vectors, reading this once for all of them: ys holds the products
+ * this * x for every vector x of xs, in the same order.
+ * @param xs The vectors multiplied, one after the other, of one cell per column of this each
+ * @param ys The result vectors, one after the other, of one cell per row of this each, not
+ * 		  overlapping this or xs
+ * @throws WrongDimensionsExceptions if xs is not made of whole vectors or ys does not hold as many
+ * 		   results.
+ */
+template <class T, class Allocator>
+void Matrix<T, Allocator>::gemvBatch(MatrixSpan<const T> xs, MatrixSpan<T> ys) const
+{
+	if (_cols == 0 || xs.size() % _cols != 0 || ys.size() != xs.size() / _cols * _rows)
+	{
+		throw WrongDimensionsException();
+	}
+	unsigned int count = (unsigned int)(xs.size() / _cols);
+	if (count > 0)
+	{
+		Gemv<T>::multiplyBatch(_rows, _cols, count, _matrix.data(), _cols, xs.data(), ys.data());
+	}
+}
+
+/**
+ * << operator. Friend function used to allow the << operator of std::ostream object to print
+ * to output Matrix<T> objects. The cells are formatted in large blocks (see MatrixText.h) and
+ * the stream is not flushed.
+ * @param os The ostream object
+ * @param mat The matrix to print
+ * @return Reference to the ostream object.
+ */
+template <class U, class A>
+std::ostream& operator<<(std::ostream& os, const Matrix<U, A>& mat)
+{
+	MatrixText<U>::write(os, mat._matrix.data(), mat._rows, mat._cols);
+	return os;
+}
+
+/**
+ * >> operator. Friend function used to allow the >> operator of std::istream object to read
+ * Matrix<T> objects printed by the << operator: one row per line, up to an empty line or the
+ * end of the stream. Large matrices are parsed in parallel (see MatrixText.h).
+ * @param is The istream object
+ * @param mat The matrix read. It is left unchanged if no matrix could be read.
+ * @return Reference to the istream object, with failbit set if no matrix could be read.
+ * @throws bad_alloc if the memory allocation fails
+ */
+template <class U, class A>
+std::istream& operator>>(std::istream& is, Matrix<U, A>& mat)
+{
+	unsigned int rows, cols;
+	std::vector<U, A> cells;
+	if (!MatrixText<U>::read(is, rows, cols, cells))
+	{
+		is.setstate(std::ios_base::failbit);
+		return is;
+	}
+	mat._rows = rows;
+	mat._cols = cols;
+	mat._matrix = std::move(cells);
+	return is;
+}
+
+/**
+ * + operator for a temporary left operand. Adds right to the cells of left and returns it.
+ * @param left The left matrix, an rvalue
+ * @param right The right matrix
+ * @return The result matrix
+ * @throws WrongDimensionsExceptions if the dimensions of left and right are not the same.
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator> operator+(Matrix<T, Allocator>&& left, const Matrix<T, Allocator>& right)
+{
+	left += right;
+	return std::move(left);
+}
+
+/**
+ * + operator for a temporary right operand. Computes the sum into the cells of right and
+ * returns it.
+ * @param left The left matrix
+ * @param right The right matrix, an rvalue
+ * @return The result matrix
+ * @throws WrongDimensionsExceptions if the dimensions of left and right are not the same.
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator> operator+(const Matrix<T, Allocator>& left, Matrix<T, Allocator>&& right)
+{
+	right = left + right;
+	return std::move(right);
+}
+
+/**
+ * + operator for two temporary operands. Adds right to the cells of left and returns it.
+ * @param left The left matrix, an rvalue
+ * @param right The right matrix, an rvalue
+ * @return The result matrix
+ * @throws WrongDimensionsExceptions if the dimensions of left and right are not the same.
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator> operator+(Matrix<T, Allocator>&& left, Matrix<T, Allocator>&& right)
+{
+	left += right;
+	return std::move(left);
+}
+
+/**
+ * - operator for a temporary left operand. Subtracts right from the cells of left and returns it.
+ * @param left The left matrix, an rvalue
+ * @param right The right matrix
+ * @return The result matrix
+ * @throws WrongDimensionsExceptions if the dimensions of left and right are not the same.
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator> operator-(Matrix<T, Allocator>&& left, const Matrix<T, Allocator>& right)
+{
+	left -= right;
+	return std::move(left);
+}
+
+/**
+ * - operator for a temporary right operand. Computes the difference into the cells of right
+ * and returns it.
+ * @param left The left matrix
+ * @param right The right matrix, an rvalue
+ * @return The result matrix
+ * @throws WrongDimensionsExceptions if the dimensions of left and right are not the same.
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator> operator-(const Matrix<T, Allocator>& left, Matrix<T, Allocator>&& right)
+{
+	right = left - right;
+	return std::move(right);
+}
+
+/**
+ * - operator for two temporary operands. Subtracts right from the cells of left and returns it.
+ * @param left The left matrix, an rvalue
+ * @param right The right matrix, an rvalue
+ * @return The result matrix
+ * @throws WrongDimensionsExceptions if the dimensions of left and right are not the same.
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator> operator-(Matrix<T, Allocator>&& left, Matrix<T, Allocator>&& right)
+{
+	left -= right;
+	return std::move(left);
+}
+
+/**
+ * * operator for a temporary matrix and a scalar. Scales the cells of matrix and returns it.
+ * @param matrix The matrix, an rvalue
+ * @param scalar The scalar
+ * @return The result matrix
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator> operator*(Matrix<T, Allocator>&& matrix,
+							   const typename Matrix<T, Allocator>::value_type& scalar)
+{
+	matrix *= scalar;
+	return std::move(matrix);
+}
+
+/**
+ * * operator for a scalar and a temporary matrix. Scales the cells of matrix and returns it.
+ * @param scalar The scalar
+ * @param matrix The matrix, an rvalue
+ * @return The result matrix
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator> operator*(const typename Matrix<T, Allocator>::value_type& scalar,
+							   Matrix<T, Allocator>&& matrix)
+{
+	matrix *= scalar;
+	return std::move(matrix);
+}
+
+/**
+ * * operator for a matrix and a vector.
+ * @param matrix The matrix
+ * @param x The vector, of one cell per column of matrix
+ * @return The product vector, of one cell per row of matrix.
+ * @throws WrongDimensionsExceptions if the size of x is not the number of columns of matrix.
+ */
+template <class T, class Allocator>
+std::vector<T> operator*(const Matrix<T, Allocator>& matrix, const std::vector<T>& x)
+{
+	return matrix.gemv(x);
+}
+
+/**
+ * Returns the cell located in the given coordinates.
+ * @param row The cell row number
+ * @param col The cell column number
+ * @return The requested cell
+ * @throws OutOfMatrixException if the requested cell is not exist in the matrix.
+ */
+template <class T, class Allocator>
+T& Matrix<T, Allocator>::at(unsigned int row, unsigned int col)
+{
+	_checkCell(row, col);
+	return _exposed()[(std::size_t)_cols * row + col];
+}
+
+/**
+ * Returns the cell located in the given coordinates (const Matrix).
+ * @param row The cell row number
+ * @param col The cell column number
+ * @return The requested cell
+ * @throws OutOfMatrixException if the requested cell is not exist in the matrix.
+ */
+template <class T, class Allocator>
+const T& Matrix<T, Allocator>::at(unsigned int row, unsigned int col) const
+{
+	_checkCell(row, col);
+	return _matrix[(std::size_t)_cols * row + col];
+}
+
+/**
+ * Returns the cells of a row.
  * @param row The row number
+ * @return Span of the cols() cells of the row.
+ * @throws OutOfMatrixException if the row is not exist in the matrix.
+ */
+template <class T, class Allocator>
+MatrixSpan<T> Matrix<T, Allocator>::row(unsigned int row)
+{
+	if (row >= _rows)
+	{
+		throw OutOfMatrixException();
+	}
+	return MatrixSpan<T>(_exposed() + (std::size_t)_cols * row, _cols);
+}
+
+/**
+ * Returns the cells of a row (const Matrix).
+ * @param row The row number
+ * @return Span of the cols() cells of the row.
+ * @throws OutOfMatrixException if the row is not exist in the matrix.
+ */
+template <class T, class Allocator>
+MatrixSpan<const T> Matrix<T, Allocator>::row(unsigned int row) const
+{
+	if (row >= _rows)
+	{
+		throw OutOfMatrixException();
+	}
+	return MatrixSpan<const T>(_matrix.data() + (std::size_t)_cols * row, _cols);
+}
+
+/**
+ * Returns a view of a block of the cells of this, which refers to them without copying them (see
+ * MatrixView.h).
+ * @param row The row number of the first cell of the block
+ * @param col The column number of the first cell of the block
+ * @param rows Number of rows of the block
+ * @param cols Number of columns of the block
+ * @return The view of the block.
+ * @throws OutOfMatrixException if the block is not inside the matrix.
+ */
+template <class T, class Allocator>
+MatrixView<T> Matrix<T, Allocator>::view(unsigned int row, unsigned int col, unsigned int rows,
+										 unsigned int cols)
+{
+	return MatrixView<T>(*this).view(row, col, rows, cols);
+}
+
+/**
+ * Returns a read-only view of a block of the cells of this (const Matrix).
+ * @param row The row number of the first cell of the block
+ * @param col The column number of the first cell of the block
+ * @param rows Number of rows of the block
+ * @param cols Number of columns of the block
+ * @return The view of the block.
+ * @throws OutOfMatrixException if the block is not inside the matrix.
+ */
+template <class T, class Allocator>
+MatrixView<const T> Matrix<T, Allocator>::view(unsigned int row, unsigned int col,
+											   unsigned int rows, unsigned int cols) const
+{
+	return MatrixView<const T>(*this).view(row, col, rows, cols);
+}
+
+// ------------------ Parallel --------------------------
+/**
+ * Forces all the operations (of every element type) to run in parallel or sequentially.
+ * Same as ExecutionPolicy::setExecution with Execution::PARALLEL or Execution::SEQUENTIAL;
+ * by default (Execution::AUTO) the execution is chosen per operation from its size.
+ * @param isParallel value to set.
+ */
+template <class T, class Allocator>
+void Matrix<T, Allocator>::setParallel(bool isParallel)
+{
+	ExecutionPolicy::setExecution(isParallel ? Execution::PARALLEL : Execution::SEQUENTIAL);
+}
+
+// ------------------ Multiplication --------------------
+/**
+ * Sets the algorithm products are computed with, unless another one is given to multiply().
+ * Products added to a matrix in place (m += a * b) always use the standard engine.
+ * @param algorithm The algorithm, STANDARD (the default) or STRASSEN. DEFAULT is STANDARD.
+ */
+template <class T, class Allocator>
+void Matrix<T, Allocator>::setMultiplyAlgorithm(MultiplyAlgorithm algorithm)
+{
+	_multiplyAlgorithm = algorithm == MultiplyAlgorithm::DEFAULT ? MultiplyAlgorithm::STANDARD :
+						 algorithm;
+}
+
+/**
+ * Sets the size below which (in any dimension) the Strassen-Winograd engine hands the
+ * products to the standard engine.
+ * @param size The crossover size
+ */
+template <class T, class Allocator>
+void Matrix<T, Allocator>::setStrassenCrossover(unsigned int size)
+{
+	_strassenCrossover = size;
+}
+
+// ------------------ Files -----------------------------
+/**
+ * Saves this to a binary matrix file (see MatrixFile.h), replacing the file if it exists.
+ * @param path The path of the file
+ * @throws MatrixFileException if the file cannot be written.
+ */
+template <class T, class Allocator>
+void Matrix<T, Allocator>::save(const std::string& path) const
+{
+	static_assert(std::is_trivially_copyable<T>::value,
+				  "Only matrices of trivially copyable cells can be saved");
+	MatrixFileHeader header = MatrixFile::header<T>(_rows, _cols);
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (std::size_t i = sizeof(header); i < header.dataOffset; i++)
+	{
+		file.put(0);
+	}
+	file.write(reinterpret_cast<const char*>(_matrix.data()),
+			   (std::streamsize)(_matrix.size() * sizeof(T)));
+	file.close();
+	if (!file)
+	{
+		throw MatrixFileException();
+	}
+}
+
+/**
+ * Reads a matrix from a binary matrix file saved by save().
+ * @param path The path of the file
+ * @return The matrix.
+ * @throws bad_alloc if the memory allocation fails
+ * @throws MatrixFileException if the file cannot be read or is not a matrix file of T.
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator> Matrix<T, Allocator>::load(const std::string& path)
+{
+	static_assert(std::is_trivially_copyable<T>::value,
+				  "Only matrices of trivially copyable cells can be loaded");
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	std::streamoff size = file.tellg();
+	MatrixFileHeader header;
+	if (!file || size < (std::streamoff)sizeof(header) ||
+		!file.seekg(0).read(reinterpret_cast<char*>(&header), sizeof(header)))
+	{
+		throw MatrixFileException();
+	}
+	MatrixFile::check<T>(header, (std::uint64_t)size);
+
+	Matrix<T, Allocator> matrix((unsigned int)header.rows, (unsigned int)header.cols);
+	if (!file.seekg((std::streamoff)header.dataOffset).read(
+			reinterpret_cast<char*>(matrix._matrix.data()),
+			(std::streamsize)(matrix._matrix.size() * sizeof(T))))
+	{
+		throw MatrixFileException();
+	}
+	return matrix;
+}
+
+/**
+ * Maps a binary matrix file saved by save() in memory. The cells are read in place from the
+ * file, so large matrices are available at once, without reading or copying them.
+ * @param path The path of the file
+ * @return The read-only matrix of the file.
+ * @throws MatrixFileException if the file cannot be mapped or is not a matrix file of T.
+ */
+template <class T, class Allocator>
+MappedMatrix<T> Matrix<T, Allocator>::mapFile(const std::string& path)
+{
+	return MappedMatrix<T>(path);
+}
+
+// ------------------ Private functions -----------------
+/**
+ * Runs func(rowBegin, rowEnd) over the rows of this: on chunks of rows in the thread pool if
+ * the execution policy runs the operation in parallel, or once on all the rows otherwise.
+ * @param operation The kind of operation
+ * @param cellsPerRow The number of cells (or multiply-adds) computed for every row
+ * @param func The function to run
+ */
+template <class T, class Allocator>
+template <class Func>
+void Matrix<T, Allocator>::_forRows(Operation operation, unsigned long long cellsPerRow,
+						 const Func& func) const
+{
+	unsigned long long work = cellsPerRow * _rows;
+	if (operation != Operation::PRODUCT)
+	{
+		work *= sizeof(T);
+	}
+	if (ExecutionPolicy::parallel(operation, work))
+	{
+		ThreadPool::instance().parallelFor(0, _rows, _rowGrain(cellsPerRow), func);
+	}
+	else
+	{
+		func(0, _rows);
+	}
+}
+
+/**
+ * @return A matrix owned by the calling thread, used to hold results that cannot be computed
+ * 		   in place. Its cells are exchanged with the matrix the result is assigned to, so
+ * 		   small buffers are reused instead of allocated (see _releaseScratch()).
+ */
+template <class T, class Allocator>
+Matrix<T, Allocator>& Matrix<T, Allocator>::_scratch()
+{
+	static thread_local Matrix<T, Allocator> scratch(0, 0);
+	return scratch;
+}
+
+/**
+ * Frees the cells of the scratch matrix once its result was used, unless they are small enough
+ * to be kept for the next results. The scratch matrix lives as long as its thread, so keeping
+ * large cells would leave every thread that ever took the fallback of a large matrix (e.g.
+ * m = m.trans()) holding a second buffer of its size. Copy-on-write cells shared with copies are
+ * always let go of, or the copies would copy them on their next write.
+ * @param scratch The scratch matrix
+ */
+template <class T, class Allocator>
+void Matrix<T, Allocator>::_releaseScratch(Matrix<T, Allocator>& scratch)
+{
+	static const std::size_t MAX_KEPT_BYTES = 1 << 18;
+	if (scratch._matrix.size() * sizeof(T) > MAX_KEPT_BYTES || scratch._shared())
+	{
+		typename MatrixStorage<T, Allocator>::type().swap(scratch._matrix);
+		scratch._rows = 0;
+		scratch._cols = 0;
+	}
+}
+
+/**
+ * Exchanges the dimensions and cells of this and other.
+ * @param other The other matrix
+ */
+template <class T, class Allocator>
+void Matrix<T, Allocator>::_swap(Matrix<T, Allocator>& other)
+{
+	std::swap(_rows, other._rows);
+	std::swap(_cols, other._cols);
+	_matrix.swap(other._matrix);
+}
+
+/**
+ * Sets the dimensions of this for cells that are all about to be written. The cells that fit in
+ * the new size are kept, except copy-on-write cells shared with copies, which are replaced by new
+ * cells instead of being copied.
+ * @param rows Number of rows
+ * @param cols Number of columns
+ * @throws bad_alloc if the memory allocation fails
+ */
+template <class T, class Allocator>
+void Matrix<T, Allocator>::_resize(unsigned int rows, unsigned int cols)
+{
+	if (_shared())
+	{
+		_matrix.assign((std::size_t)rows * cols, T());
+	}
+	else
+	{
+		_matrix.resize((std::size_t)rows * cols);
+	}
+	_rows = rows;
+	_cols = cols;
+}
+
+/**
+ * Evaluates a cell by cell expression into this, row by row. If the expression reads the cells
+ * of this other than row by row in place (e.g. this = this.trans()), or reads copy-on-write cells
+ * of this shared with copies, it is evaluated into the scratch matrix first.
+ * @param expr The expression
+ * @throws bad_alloc if the memory allocation fails
  */
-template <class T>
-void Matrix<T>::_multParallel(const Matrix<T>& other, Matrix<T>& newMatrix, unsigned int row) const
+template <class T, class Allocator>
+template <class E>
+void Matrix<T, Allocator>::_assign(const E& expr)
 {
-	for (unsigned int j = 0; j < newMatrix._cols; j++)
+	const T* begin = _constData();
+	const T* end = begin + _matrix.size();
+	bool overlaps = expr.overlaps(begin, end, _cols);
+	if (overlaps && (expr.rows() != _rows || expr.cols() != _cols || _shared() ||
+					 expr.conflicts(begin, end, _cols)))
 	{
-		T cell(0);
-		for (unsigned int k = 0; k < _cols; k++)
+		Matrix<T, Allocator>& result = _scratch();
+		result._assign(expr);
+		_swap(result);
+		_releaseScratch(result);
+		return;
+	}
+
+	_resize(expr.rows(), expr.cols());
+	T* cells = _matrix.data();
+	_forRows(Operation::ELEMENTWISE, _cols,
+			 [this, cells, &expr, overlaps](unsigned int rowBegin, unsigned int rowEnd)
+	{
+		for (unsigned int i = rowBegin; i < rowEnd; i++)
 		{
-			cell += (*this)(row, k) * other(k, j);
+			T* row = cells + (std::size_t)i * _cols;
+			if (overlaps)
+			{
+				T* buffer = ExpressionBuffer<T>::get(0, _cols);
+				expr.evalRow(i, buffer, 1);
+				std::copy(buffer, buffer + _cols, row);
+			}
+			else
+			{
+				expr.evalRow(i, row, 0);
+			}
 		}
-		newMatrix(row, j) = cell;
+	});
+}
+
+/**
+ * Assigns an operand to this. Transposed operands are copied with the blocked transpose, and
+ * this = this.trans() transposes a square matrix in place (unless its copy-on-write cells are
+ * shared with copies).
+ * @param operand The operand
+ * @throws bad_alloc if the memory allocation fails
+ */
+template <class T, class Allocator>
+void Matrix<T, Allocator>::_assign(const MatrixOperand<T>& operand)
+{
+	if (operand.rowStride() != 1 || operand.colStride() == 1)
+	{
+		_assign<MatrixOperand<T> >(operand);
+		return;
+	}
+
+	const T* begin = _constData();
+	const T* end = begin + _matrix.size();
+	if (operand.overlaps(begin, end, _cols))
+	{
+		if (operand.data() == begin && operand.colStride() == _cols && isSquareMatrix() &&
+			operand.rows() == _rows && operand.cols() == _cols && !_shared())
+		{
+			T* cells = _matrix.data();
+			_forRows(Operation::TRANSPOSE, _cols,
+					 [this, cells, &operand](unsigned int rowBegin, unsigned int rowEnd)
+			{
+				Transpose<T>::inPlace(_rows, cells, _cols, operand.conjugated(), rowBegin,
+									  rowEnd);
+			});
+			return;
+		}
+		Matrix<T, Allocator>& result = _scratch();
+		result._assign(operand);
+		_swap(result);
+		_releaseScratch(result);
+		return;
+	}
+
+	_resize(operand.rows(), operand.cols());
+	T* cells = _matrix.data();
+	_forRows(Operation::TRANSPOSE, _cols,
+			 [this, cells, &operand](unsigned int rowBegin, unsigned int rowEnd)
+	{
+		Transpose<T>::copy(_cols, rowEnd - rowBegin, operand.data() + rowBegin,
+						   operand.colStride(), cells + (std::size_t)rowBegin * _cols, _cols,
+						   operand.conjugated());
+	});
+}
+
+/**
+ * Assigns the cells of a matrix of another allocator to this.
+ * @param other The other matrix
+ * @throws bad_alloc if the memory allocation fails
+ */
+template <class T, class Allocator>
+template <class A>
+void Matrix<T, Allocator>::_assign(const Matrix<T, A>& other)
+{
+	_assign(MatrixOperand<T>(other));
+}
+
+/**
+ * Computes a product into this with the multiplication engine. If an operand shares cells with
+ * this, the product is computed into the scratch matrix first.
+ * @param product The product
+ * @throws bad_alloc if the memory allocation fails
+ */
+template <class T, class Allocator>
+void Matrix<T, Allocator>::_assign(const MatrixProduct<T>& product)
+{
+	const T* begin = _constData();
+	if (product.overlaps(begin, begin + _matrix.size(), _cols))
+	{
+		Matrix<T, Allocator>& result = _scratch();
+		result._assign(product);
+		_swap(result);
+		_releaseScratch(result);
+		return;
+	}
+
+	_resize(product.rows(), product.cols());
+	MultiplyAlgorithm algorithm = product.algorithm() == MultiplyAlgorithm::DEFAULT ?
+								  _multiplyAlgorithm : product.algorithm();
+	if (algorithm == MultiplyAlgorithm::STRASSEN)
+	{
+		// The Strassen-Winograd engine reads the cells as they are, so conjugated operands are
+		// evaluated first
+		MatrixOperand<T> a = product.left().conjugated() ?
+							 MatrixOperand<T>::materialize(product.left()) : product.left();
+		MatrixOperand<T> b = product.right().conjugated() ?
+							 MatrixOperand<T>::materialize(product.right()) : product.right();
+		Strassen<T>::multiply(_rows, _cols, a.cols(), a.data(), a.rowStride(), a.colStride(),
+							  b.data(), b.rowStride(), b.colStride(), _matrix.data(), _cols,
+							  _strassenCrossover,
+							  ExecutionPolicy::parallel(Operation::PRODUCT, product.flops()));
+		return;
+	}
+
+	product.compute(_matrix.data(), _cols, T(1), false);
+}
+
+/**
+ * Adds (or subtracts) a cell by cell expression to this in place, row by row. If the expression
+ * reads the cells of this other than row by row in place, or reads copy-on-write cells of this
+ * shared with copies (which are detached first), it is evaluated into the scratch matrix first.
+ * @param expr The expression
+ * @param subtract Whether to subtract instead of adding
+ * @throws WrongDimensionsExceptions if the dimensions of this and expr are not the same.
+ */
+template <class T, class Allocator>
+template <class E>
+void Matrix<T, Allocator>::_update(const E& expr, bool subtract)
+{
+	if (_rows != expr.rows() || _cols != expr.cols())
+	{
+		throw WrongDimensionsException();
+	}
+
+	const T* begin = _constData();
+	const T* end = begin + _matrix.size();
+	if (expr.conflicts(begin, end, _cols) || (_shared() && expr.overlaps(begin, end, _cols)))
+	{
+		Matrix<T, Allocator>& value = _scratch();
+		value._assign(expr);
+		_update(MatrixOperand<T>(value), subtract);
+		_releaseScratch(value);
+		return;
+	}
+
+	// Copy-on-write cells are detached here, not by the workers
+	T* cells = _matrix.data();
+	_forRows(Operation::ELEMENTWISE, _cols,
+			 [this, cells, &expr, subtract](unsigned int rowBegin, unsigned int rowEnd)
+	{
+		for (unsigned int i = rowBegin; i < rowEnd; i++)
+		{
+			T* row = cells + (std::size_t)i * _cols;
+			const T* source = expr.rowPointer(i);
+			if (source == nullptr)
+			{
+				T* buffer = ExpressionBuffer<T>::get(0, _cols);
+				expr.evalRow(i, buffer, 1);
+				source = buffer;
+			}
+
+			if (subtract)
+			{
+				ElementKernels<T>::subtract(row, row, source, _cols);
+			}
+			else
+			{
+				ElementKernels<T>::add(row, row, source, _cols);
+			}
+		}
+	});
+}
+
+/**
+ * Adds (or subtracts) a product to this in place with the multiplication engine.
+ * @param product The product
+ * @param subtract Whether to subtract instead of adding
+ * @throws WrongDimensionsExceptions if the dimensions of this and product are not the same.
+ */
+template <class T, class Allocator>
+void Matrix<T, Allocator>::_update(const MatrixProduct<T>& product, bool subtract)
+{
+	if (_rows != product.rows() || _cols != product.cols())
+	{
+		throw WrongDimensionsException();
+	}
+
+	const T* begin = _constData();
+	if (product.overlaps(begin, begin + _matrix.size(), _cols))
+	{
+		Matrix<T, Allocator>& value = _scratch();
+		value._assign(product);
+		_update(MatrixOperand<T>(value), subtract);
+		_releaseScratch(value);
+		return;
+	}
+
+	product.compute(_matrix.data(), _cols, subtract ? T(-1) : T(1), true);
+}
+
+/**
+ * Adds (or subtracts) a matrix to this in place.
+ * @param other The other matrix
+ * @param subtract Whether to subtract instead of adding
+ * @throws WrongDimensionsExceptions if the dimensions of this and other are not the same.
+ */
+template <class T, class Allocator>
+template <class A>
+void Matrix<T, Allocator>::_update(const Matrix<T, A>& other, bool subtract)
+{
+	_update(MatrixOperand<T>(other), subtract);
+}
+
+/**
+ * @param cellsPerRow The number of cells (or multiply-adds) computed for every row
+ * @return The minimal number of rows given to a thread in the parallel mode, so that each
+ * 		   chunk has enough work to hide the cost of handing it to the thread pool.
+ */
+template <class T, class Allocator>
+unsigned int Matrix<T, Allocator>::_rowGrain(unsigned long long cellsPerRow)
+{
+	static const unsigned long long MIN_CELLS_PER_CHUNK = 1 << 15;
+	if (cellsPerRow == 0 || cellsPerRow >= MIN_CELLS_PER_CHUNK)
+	{
+		return 1;
 	}
+	return (unsigned int)((MIN_CELLS_PER_CHUNK + cellsPerRow - 1) / cellsPerRow);
 }
 #endif /* MATRIX_HPP_ */
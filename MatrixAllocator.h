@@ -0,0 +1,501 @@
+// MatrixAllocator.h
+
+#ifndef MATRIXALLOCATOR_H_
+#define MATRIXALLOCATOR_H_
+
+// ------------------ Includes ------------------------------
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include "NumaPolicy.h"
+#include "MatrixProfiler.h"
+
+/**
+ * The allocators the cells of Matrix<T, Allocator> can be stored with. Both give cells aligned on
+ * a cache line, so rows can be read by the vectorized kernels with aligned loads and no two
+ * matrices share a cache line:
+ * - AlignedAllocator<T> (the default) takes every buffer from the heap.
+ * - PoolAllocator<T> takes buffers from MatrixPool, which keeps the released buffers of every
+ *   thread by size class and hands them to the next matrix of a similar size. Workloads that
+ *   create and destroy many matrices of the same shapes then stop calling malloc.
+ * - InterleavedAllocator<T> spreads the pages of large buffers over all the NUMA nodes, for
+ *   operands read by the threads of every node (see NumaPolicy).
+ * - SharedAllocator<T, Base> takes its buffers from Base, and makes the cells of matrices copy on
+ *   write (see MatrixStorage.h): copies of a matrix share its buffer until one of them is written.
+ */
+
+/**
+ * This class allocates and releases memory aligned on a given number of bytes. The memory is
+ * taken from operator new, a little larger than requested, and the address it returned is kept
+ * just before the aligned memory. In the NUMA mode large buffers are taken from NumaPolicy
+ * instead, which keeps nullptr there.
+ */
+class AlignedMemory
+{
+public:
+	/**
+	 * The alignment of the cells of matrices: the size of a cache line.
+	 */
+	static const std::size_t CACHE_LINE = 64;
+
+	/**
+	 * Allocates memory.
+	 * @param bytes Number of bytes
+	 * @param alignment The alignment, a power of two multiple of sizeof(void*)
+	 * @return The memory.
+	 * @throws bad_alloc if the memory cannot be allocated
+	 */
+	static void* allocate(std::size_t bytes, std::size_t alignment)
+	{
+		if (bytes > std::numeric_limits<std::size_t>::max() - alignment - sizeof(void*))
+		{
+			throw std::bad_alloc();
+		}
+		if (bytes >= NumaPolicy::MIN_BYTES && NumaPolicy::enabled())
+		{
+			void* placed = NumaPolicy::allocate(bytes, alignment, Placement::FIRST_TOUCH);
+			if (placed != nullptr)
+			{
+				return placed;
+			}
+		}
+		char* raw = static_cast<char*>(::operator new(bytes + alignment + sizeof(void*)));
+		std::uintptr_t address = reinterpret_cast<std::uintptr_t>(raw + sizeof(void*));
+		address = (address + alignment - 1) & ~(std::uintptr_t)(alignment - 1);
+		void** memory = reinterpret_cast<void**>(address);
+		memory[-1] = raw;
+		return memory;
+	}
+
+	/**
+	 * Releases memory allocated by allocate().
+	 * @param memory The memory
+	 */
+	static void release(void* memory)
+	{
+		void* raw = static_cast<void**>(memory)[-1];
+		if (raw == nullptr)
+		{
+			NumaPolicy::release(memory);
+			return;
+		}
+		::operator delete(raw);
+	}
+};
+
+/**
+ * This class keeps released buffers for reuse. Buffers are grouped in size classes of powers of
+ * two bytes, and every thread keeps the buffers it released in its own free lists, up to a limit
+ * of cached bytes per thread, so taking or returning a buffer does not lock. Buffers larger than
+ * the largest class are taken from the heap and returned to it. The cached buffers of a thread are
+ * released when it exits.
+ */
+class MatrixPool
+{
+public:
+	/**
+	 * Size of the smallest class, and alignment of all the buffers.
+	 */
+	static const std::size_t MIN_BLOCK = AlignedMemory::CACHE_LINE;
+
+	/**
+	 * Size of the largest class (256 MiB).
+	 */
+	static const std::size_t MAX_BLOCK = (std::size_t)1 << 28;
+
+	/**
+	 * Takes a buffer of at least the given size.
+	 * @param bytes Number of bytes
+	 * @return The buffer, aligned on MIN_BLOCK bytes.
+	 * @throws bad_alloc if the memory cannot be allocated
+	 */
+	static void* allocate(std::size_t bytes)
+	{
+		if (bytes > MAX_BLOCK)
+		{
+			return AlignedMemory::allocate(bytes, MIN_BLOCK);
+		}
+		unsigned int sizeClass = _sizeClass(bytes);
+		_Cache& cache = _cache();
+		_Block* block = cache.free[sizeClass];
+		if (block == nullptr || cache.closed)
+		{
+			return AlignedMemory::allocate(MIN_BLOCK << sizeClass, MIN_BLOCK);
+		}
+		cache.free[sizeClass] = block->next;
+		cache.bytes -= MIN_BLOCK << sizeClass;
+		return block;
+	}
+
+	/**
+	 * Returns a buffer taken by allocate(). It is kept by the calling thread for reuse, or
+	 * released if the thread already keeps its limit of cached bytes.
+	 * @param memory The buffer
+	 * @param bytes The size given to allocate()
+	 */
+	static void release(void* memory, std::size_t bytes)
+	{
+		if (bytes > MAX_BLOCK)
+		{
+			AlignedMemory::release(memory);
+			return;
+		}
+		unsigned int sizeClass = _sizeClass(bytes);
+		std::size_t blockSize = MIN_BLOCK << sizeClass;
+		_Cache& cache = _cache();
+		if (cache.closed || cache.bytes + blockSize > _limit().load(std::memory_order_relaxed))
+		{
+			AlignedMemory::release(memory);
+			return;
+		}
+		_Block* block = static_cast<_Block*>(memory);
+		block->next = cache.free[sizeClass];
+		cache.free[sizeClass] = block;
+		cache.bytes += blockSize;
+	}
+
+	/**
+	 * Sets the number of bytes every thread keeps cached at most (64 MiB by default). Threads
+	 * already keeping more release their buffers as they are taken, not at once.
+	 * @param bytes Number of bytes
+	 */
+	static void setCacheLimit(std::size_t bytes)
+	{
+		_limit().store(bytes);
+	}
+
+	/**
+	 * Releases the buffers cached by the calling thread.
+	 */
+	static void trim()
+	{
+		_state().clear();
+	}
+
+private:
+	/**
+	 * Number of size classes, from MIN_BLOCK to MAX_BLOCK bytes.
+	 */
+	static const unsigned int CLASSES = 23;
+
+	/**
+	 * A cached buffer, linked to the next one of its class.
+	 */
+	struct _Block
+	{
+		_Block* next; /**< The next cached buffer of the class */
+	};
+
+	/**
+	 * The cached buffers of a thread. It has no destructor, so matrices destroyed after the cache
+	 * was cleared at the exit of the thread find it closed and release their buffers directly.
+	 */
+	struct _Cache
+	{
+		_Block* free[CLASSES]; /**< Cached buffers of every class */
+		std::size_t bytes; /**< Number of cached bytes */
+		bool closed; /**< Whether the thread is exiting */
+
+		void clear()
+		{
+			for (unsigned int i = 0; i < CLASSES; i++)
+			{
+				while (free[i] != nullptr)
+				{
+					_Block* next = free[i]->next;
+					AlignedMemory::release(free[i]);
+					free[i] = next;
+				}
+			}
+			bytes = 0;
+		}
+	};
+
+	/**
+	 * Clears and closes the cache of its thread when the thread exits.
+	 */
+	struct _CacheCloser
+	{
+		~_CacheCloser()
+		{
+			_Cache& cache = _state();
+			cache.clear();
+			cache.closed = true;
+		}
+	};
+
+	/**
+	 * @param bytes Number of bytes, at most MAX_BLOCK
+	 * @return The smallest class whose buffers hold the given number of bytes.
+	 */
+	static unsigned int _sizeClass(std::size_t bytes)
+	{
+		unsigned int sizeClass = 0;
+		while ((MIN_BLOCK << sizeClass) < bytes)
+		{
+			sizeClass++;
+		}
+		return sizeClass;
+	}
+
+	/**
+	 * @return The cached buffers of the calling thread, zero initialized.
+	 */
+	static _Cache& _state()
+	{
+		static thread_local _Cache cache;
+		return cache;
+	}
+
+	/**
+	 * @return The cached buffers of the calling thread, set to be cleared when it exits.
+	 */
+	static _Cache& _cache()
+	{
+		static thread_local _CacheCloser closer;
+		(void)closer;
+		return _state();
+	}
+
+	/**
+	 * @return The number of bytes every thread keeps cached at most.
+	 */
+	static std::atomic<std::size_t>& _limit()
+	{
+		static std::atomic<std::size_t> limit((std::size_t)1 << 26);
+		return limit;
+	}
+};
+
+/**
+ * The default allocator of Matrix<T, Allocator>: takes every buffer from the heap, aligned on
+ * Alignment bytes.
+ */
+template <class T, std::size_t Alignment = AlignedMemory::CACHE_LINE>
+class AlignedAllocator
+{
+public:
+	typedef T value_type;
+
+	template <class U>
+	struct rebind
+	{
+		typedef AlignedAllocator<U, Alignment> other;
+	};
+
+	AlignedAllocator()
+	{
+	}
+
+	template <class U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&)
+	{
+	}
+
+	/**
+	 * @param n Number of cells
+	 * @return Memory for n cells.
+	 * @throws bad_alloc if the memory cannot be allocated
+	 */
+	T* allocate(std::size_t n)
+	{
+		if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+		{
+			throw std::bad_alloc();
+		}
+		MATRIX_PROFILE_ALLOCATION(n * sizeof(T));
+		std::size_t alignment = Alignment < alignof(T) ? alignof(T) : Alignment;
+		return static_cast<T*>(AlignedMemory::allocate(n * sizeof(T), alignment));
+	}
+
+	/**
+	 * Releases memory returned by allocate().
+	 * @param memory The memory
+	 */
+	void deallocate(T* memory, std::size_t)
+	{
+		AlignedMemory::release(memory);
+	}
+
+	template <class U>
+	bool operator==(const AlignedAllocator<U, Alignment>&) const
+	{
+		return true;
+	}
+
+	template <class U>
+	bool operator!=(const AlignedAllocator<U, Alignment>&) const
+	{
+		return false;
+	}
+};
+
+/**
+ * An allocator taking its buffers from MatrixPool, for matrices that are created and destroyed
+ * often, e.g. Matrix<double, PoolAllocator<double> >. The buffers are aligned on a cache line.
+ */
+template <class T>
+class PoolAllocator
+{
+public:
+	typedef T value_type;
+
+	template <class U>
+	struct rebind
+	{
+		typedef PoolAllocator<U> other;
+	};
+
+	PoolAllocator()
+	{
+	}
+
+	template <class U>
+	PoolAllocator(const PoolAllocator<U>&)
+	{
+	}
+
+	/**
+	 * @param n Number of cells
+	 * @return Memory for n cells.
+	 * @throws bad_alloc if the memory cannot be allocated
+	 */
+	T* allocate(std::size_t n)
+	{
+		static_assert(alignof(T) <= MatrixPool::MIN_BLOCK, "The cells are aligned on a cache line");
+		if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+		{
+			throw std::bad_alloc();
+		}
+		MATRIX_PROFILE_ALLOCATION(n * sizeof(T));
+		return static_cast<T*>(MatrixPool::allocate(n * sizeof(T)));
+	}
+
+	/**
+	 * Returns memory taken by allocate() to the pool.
+	 * @param memory The memory
+	 * @param n Number of cells given to allocate()
+	 */
+	void deallocate(T* memory, std::size_t n)
+	{
+		MatrixPool::release(memory, n * sizeof(T));
+	}
+
+	template <class U>
+	bool operator==(const PoolAllocator<U>&) const
+	{
+		return true;
+	}
+
+	template <class U>
+	bool operator!=(const PoolAllocator<U>&) const
+	{
+		return false;
+	}
+};
+
+/**
+ * An allocator spreading the pages of buffers of at least NumaPolicy::MIN_BYTES round-robin over
+ * all the NUMA nodes, whether the NUMA mode is enabled or not, e.g. for the right operand of large
+ * products, read whole by every thread: Matrix<double, InterleavedAllocator<double> >. Smaller
+ * buffers are taken from the heap. The buffers are aligned on a cache line.
+ */
+template <class T>
+class InterleavedAllocator
+{
+public:
+	typedef T value_type;
+
+	template <class U>
+	struct rebind
+	{
+		typedef InterleavedAllocator<U> other;
+	};
+
+	InterleavedAllocator()
+	{
+	}
+
+	template <class U>
+	InterleavedAllocator(const InterleavedAllocator<U>&)
+	{
+	}
+
+	/**
+	 * @param n Number of cells
+	 * @return Memory for n cells.
+	 * @throws bad_alloc if the memory cannot be allocated
+	 */
+	T* allocate(std::size_t n)
+	{
+		if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+		{
+			throw std::bad_alloc();
+		}
+		MATRIX_PROFILE_ALLOCATION(n * sizeof(T));
+		std::size_t alignment = AlignedMemory::CACHE_LINE < alignof(T) ? alignof(T) :
+								AlignedMemory::CACHE_LINE;
+		if (n * sizeof(T) >= NumaPolicy::MIN_BYTES)
+		{
+			void* placed = NumaPolicy::allocate(n * sizeof(T), alignment, Placement::INTERLEAVED);
+			if (placed != nullptr)
+			{
+				return static_cast<T*>(placed);
+			}
+		}
+		return static_cast<T*>(AlignedMemory::allocate(n * sizeof(T), alignment));
+	}
+
+	/**
+	 * Releases memory returned by allocate().
+	 * @param memory The memory
+	 */
+	void deallocate(T* memory, std::size_t)
+	{
+		AlignedMemory::release(memory);
+	}
+
+	template <class U>
+	bool operator==(const InterleavedAllocator<U>&) const
+	{
+		return true;
+	}
+
+	template <class U>
+	bool operator!=(const InterleavedAllocator<U>&) const
+	{
+		return false;
+	}
+};
+
+/**
+ * An allocator giving copy-on-write cells to matrices, for matrices copied (passed around, cached)
+ * far more often than they are written: Matrix<double, SharedAllocator<double> >. Copying such a
+ * matrix only shares its buffer, and the buffer is copied when one of the matrices sharing it is
+ * written (see SharedCells). The buffers themselves are taken from Base.
+ */
+template <class T, class Base = AlignedAllocator<T> >
+class SharedAllocator : public Base
+{
+public:
+	typedef T value_type;
+
+	template <class U>
+	struct rebind
+	{
+		typedef SharedAllocator<U, typename Base::template rebind<U>::other> other;
+	};
+
+	SharedAllocator()
+	{
+	}
+
+	template <class U, class B>
+	SharedAllocator(const SharedAllocator<U, B>& other) : Base(static_cast<const B&>(other))
+	{
+	}
+};
+
+#endif /* MATRIXALLOCATOR_H_ */
@@ -0,0 +1,554 @@
+// MatrixBatch.h
+
+#ifndef MATRIXBATCH_H_
+#define MATRIXBATCH_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "ThreadPool.h"
+#include "Gemm.h"
+#include "ElementKernels.h"
+#include "Transpose.h"
+#include "ExecutionPolicy.h"
+#include "MatrixAllocator.h"
+#include "MatrixExpression.h"
+#include "MatrixSpan.h"
+#include "WrongDimensionsException.h"
+#include "NoSquareException.h"
+#include "OutOfMatrixException.h"
+#include "IllegalMatrixException.h"
+#include "IllegalVectorException.h"
+
+/**
+ * This class represents a batch of count independent matrices of the same rows X cols dimensions,
+ * stored one after the other (each row by row) in a single buffer. It is meant for large numbers
+ * of small matrices, which would each be a separate allocation as Matrix<T> objects and too small
+ * for their operations to be split between threads.
+ *
+ * The operations of a batch apply to every matrix of it (or to every pair of matrices of two
+ * batches) and are split between the pool threads by whole matrices, so each matrix is computed
+ * by a single thread. The sums run on the whole buffer at once with the SIMD kernels of
+ * ElementKernels<T>, and a batch multiplied by a single Matrix<T> is one product of the stacked
+ * rows of the batch, computed by Gemm<T>.
+ */
+template <class T, class Allocator = AlignedAllocator<T> >
+class MatrixBatch
+{
+public:
+	/**
+	 * The type of the cells.
+	 */
+	typedef T value_type;
+
+	// ------------------ Constructors ----------------------
+	/**
+	 * Default constructor. Initiates an empty batch of 1X1 matrices.
+	 */
+	MatrixBatch() : _count(0), _rows(1), _cols(1)
+	{
+	}
+
+	/**
+	 * Initiates a batch of count matrices of rows X cols cells set to 0.
+	 * @param count Number of matrices
+	 * @param rows Number of rows of every matrix
+	 * @param cols Number of columns of every matrix
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws IllegalMatrixException if one of the arguments rows and cols (but not both) is 0.
+	 */
+	MatrixBatch(unsigned int count, unsigned int rows, unsigned int cols) :
+		_count(count), _rows(rows), _cols(cols), _cells(_checkSize(count, rows, cols), T(0))
+	{
+	}
+
+	/**
+	 * Initiates a batch of count matrices of rows X cols with the given cells.
+	 * @param count Number of matrices
+	 * @param rows Number of rows of every matrix
+	 * @param cols Number of columns of every matrix
+	 * @param cells The cells of the matrices, one matrix after the other, each row by row
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws IllegalMatrixException if one of the arguments rows and cols (but not both) is 0.
+	 * @throws IllegalVectorException if the size of cells is not matching count, rows and cols.
+	 */
+	MatrixBatch(unsigned int count, unsigned int rows, unsigned int cols,
+				const std::vector<T>& cells) : _count(count), _rows(rows), _cols(cols)
+	{
+		if (cells.size() != _checkSize(count, rows, cols))
+		{
+			throw IllegalVectorException();
+		}
+		_cells.assign(cells.begin(), cells.end());
+	}
+
+	// ------------ Operators and Operations ----------------
+	/**
+	 * == operator.
+	 * @param other The other batch
+	 * @return true if the two batches have the same dimensions and cells, false otherwise.
+	 */
+	bool operator==(const MatrixBatch<T, Allocator>& other) const
+	{
+		return _count == other._count && _rows == other._rows && _cols == other._cols &&
+			   _cells == other._cells;
+	}
+
+	/**
+	 * != operator.
+	 * @param other The other batch
+	 * @return The opposite of == operator.
+	 */
+	bool operator!=(const MatrixBatch<T, Allocator>& other) const
+	{
+		return !(*this == other);
+	}
+
+	/**
+	 * + operator. Adds every matrix of other to the matrix of this at the same position.
+	 * @param other The other batch
+	 * @return The batch of the sums.
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the batches do not have the same dimensions.
+	 */
+	MatrixBatch<T, Allocator> operator+(const MatrixBatch<T, Allocator>& other) const
+	{
+		return _elementwise(other, [](T* dst, const T* a, const T* b, std::size_t n)
+		{
+			ElementKernels<T>::add(dst, a, b, n);
+		});
+	}
+
+	/**
+	 * - operator. Subtracts every matrix of other from the matrix of this at the same position.
+	 * @param other The other batch
+	 * @return The batch of the differences.
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the batches do not have the same dimensions.
+	 */
+	MatrixBatch<T, Allocator> operator-(const MatrixBatch<T, Allocator>& other) const
+	{
+		return _elementwise(other, [](T* dst, const T* a, const T* b, std::size_t n)
+		{
+			ElementKernels<T>::subtract(dst, a, b, n);
+		});
+	}
+
+	/**
+	 * * operator. Multiplies every matrix of this by the matrix of other at the same position.
+	 * @param other The other batch
+	 * @return The batch of the products.
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the batches do not have the same number of matrices,
+	 * 		   or if the number of columns of this is not the number of rows of other.
+	 */
+	MatrixBatch<T, Allocator> operator*(const MatrixBatch<T, Allocator>& other) const
+	{
+		if (_count != other._count || _cols != other._rows)
+		{
+			throw WrongDimensionsException();
+		}
+		MatrixBatch<T, Allocator> result(_count, _rows, other._cols);
+		unsigned int m = _rows, n = other._cols, k = _cols;
+		std::size_t sizeA = size(), sizeB = other.size(), sizeC = result.size();
+		const T* a = _cells.data();
+		const T* b = other._cells.data();
+		T* c = result._cells.data();
+		bool blocked = GemmTraits<T>::BLOCKED && !_fixedWidth(n) &&
+					   ExecutionPolicy::blocked((unsigned long long)m * n * k);
+		_forMatrices(Operation::PRODUCT, (unsigned long long)m * n * k,
+					 [=](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int index = begin; index < end; index++)
+			{
+				const T* left = a + index * sizeA;
+				const T* right = b + index * sizeB;
+				T* target = c + index * sizeC;
+				if (blocked)
+				{
+					Gemm<T>::multiply(m, n, k, T(1), left, k, 1, right, n, 1, target, n);
+				}
+				else
+				{
+					_product(m, n, k, left, right, target);
+				}
+			}
+		});
+		return result;
+	}
+
+	/**
+	 * * operator. Multiplies every matrix of this by the same matrix.
+	 * @param other The matrix
+	 * @return The batch of the products.
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the number of columns of this is not the number of rows
+	 * 		   of other.
+	 */
+	template <class A>
+	MatrixBatch<T, Allocator> operator*(const Matrix<T, A>& other) const
+	{
+		if (_cols != other.rows())
+		{
+			throw WrongDimensionsException();
+		}
+		// The matrices of this, one after the other, are the rows of one (count * rows) X cols
+		// matrix, and so are the products.
+		MatrixBatch<T, Allocator> result(_count, _rows, other.cols());
+		unsigned int m = _rows, n = other.cols(), k = _cols;
+		const T* a = _cells.data();
+		const T* b = other.data();
+		T* c = result._cells.data();
+		_forMatrices(Operation::PRODUCT, (unsigned long long)m * n * k,
+					 [=](unsigned int begin, unsigned int end)
+		{
+			Gemm<T>::multiply((end - begin) * m, n, k, T(1), a + (std::size_t)begin * m * k, k, 1,
+							  b, n, 1, c + (std::size_t)begin * m * n, n);
+		});
+		return result;
+	}
+
+	/**
+	 * Returns the batch of the transposed matrices of this (conjugated for Complex cells, like
+	 * Matrix<T>::trans()).
+	 * @return The transposed batch, of cols X rows matrices.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	MatrixBatch<T, Allocator> trans() const
+	{
+		MatrixBatch<T, Allocator> result(_count, _cols, _rows);
+		unsigned int rows = _rows, cols = _cols;
+		std::size_t cells = size();
+		const T* src = _cells.data();
+		T* dst = result._cells.data();
+		_forMatrices(Operation::TRANSPOSE, cells * sizeof(T),
+					 [=](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int index = begin; index < end; index++)
+			{
+				Transpose<T>::copy(rows, cols, src + index * cells, cols, dst + index * cells, rows,
+								   ElementConjugate<T>::CONJUGATES);
+			}
+		});
+		return result;
+	}
+
+	/**
+	 * Calculates and returns the traces of the matrices of this.
+	 * @return The traces, one per matrix.
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws NoSquareException if the matrices are not square
+	 */
+	std::vector<T> trace() const
+	{
+		if (_rows != _cols)
+		{
+			throw NoSquareException();
+		}
+		std::vector<T> traces(_count);
+		unsigned int n = _rows;
+		std::size_t cells = size();
+		const T* src = _cells.data();
+		T* out = traces.data();
+		_forMatrices(Operation::ELEMENTWISE, n * sizeof(T),
+					 [=](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int index = begin; index < end; index++)
+			{
+				const T* matrix = src + index * cells;
+				T sum(0);
+				for (unsigned int i = 0; i < n; i++)
+				{
+					sum += matrix[(std::size_t)i * (n + 1)];
+				}
+				out[index] = sum;
+			}
+		});
+		return traces;
+	}
+
+	/**
+	 * [] operator. Returns the cells of the matrix at the given index, row by row, without
+	 * checking it.
+	 * @param index The matrix number
+	 * @return The cells of the matrix.
+	 */
+	MatrixSpan<T> operator[](unsigned int index)
+	{
+		return MatrixSpan<T>(_cells.data() + index * size(), size());
+	}
+
+	/**
+	 * [] operator. Returns the cells of the matrix at the given index, row by row, without
+	 * checking it.
+	 * @param index The matrix number
+	 * @return The cells of the matrix.
+	 */
+	MatrixSpan<const T> operator[](unsigned int index) const
+	{
+		return MatrixSpan<const T>(_cells.data() + index * size(), size());
+	}
+
+	/**
+	 * Returns a copy of the matrix at the given index.
+	 * @param index The matrix number
+	 * @return The matrix.
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws OutOfMatrixException if there is no matrix at index.
+	 */
+	Matrix<T, Allocator> get(unsigned int index) const
+	{
+		_checkIndex(index);
+		MatrixSpan<const T> cells = (*this)[index];
+		return Matrix<T, Allocator>(_rows, _cols,
+									std::vector<T, Allocator>(cells.begin(), cells.end()));
+	}
+
+	/**
+	 * Sets the matrix at the given index to the cells of matrix.
+	 * @param index The matrix number
+	 * @param matrix The matrix, of the dimensions of the matrices of this
+	 * @throws OutOfMatrixException if there is no matrix at index.
+	 * @throws WrongDimensionsExceptions if the dimensions of matrix are not the dimensions of the
+	 * 		   matrices of this.
+	 */
+	template <class A>
+	void set(unsigned int index, const Matrix<T, A>& matrix)
+	{
+		_checkIndex(index);
+		if (matrix.rows() != _rows || matrix.cols() != _cols)
+		{
+			throw WrongDimensionsException();
+		}
+		std::copy(matrix.data(), matrix.data() + size(), (*this)[index].begin());
+	}
+
+	/**
+	 * @return The number of matrices.
+	 */
+	unsigned int count() const
+	{
+		return _count;
+	}
+
+	/**
+	 * @return The number of rows of every matrix.
+	 */
+	unsigned int rows() const
+	{
+		return _rows;
+	}
+
+	/**
+	 * @return The number of columns of every matrix.
+	 */
+	unsigned int cols() const
+	{
+		return _cols;
+	}
+
+	/**
+	 * @return The number of cells of every matrix.
+	 */
+	std::size_t size() const
+	{
+		return (std::size_t)_rows * _cols;
+	}
+
+	/**
+	 * @return The cells of all the matrices, one matrix after the other.
+	 */
+	T* data()
+	{
+		return _cells.data();
+	}
+
+	/**
+	 * @return The cells of all the matrices, one matrix after the other.
+	 */
+	const T* data() const
+	{
+		return _cells.data();
+	}
+
+private:
+	// ------------------ Data members ----------------------
+	unsigned int _count; /**< Number of matrices */
+	unsigned int _rows; /**< Number of rows of every matrix */
+	unsigned int _cols; /**< Number of columns of every matrix */
+	std::vector<T, Allocator> _cells; /**< The cells of the matrices, one after the other */
+
+	/**
+	 * Minimal work (as measured by ExecutionPolicy) given to a thread.
+	 */
+	static const unsigned long long MIN_WORK_PER_CHUNK = 1 << 15;
+
+	// ------------------ Private functions -----------------
+	/**
+	 * Checks the dimensions of a batch.
+	 * @param count Number of matrices
+	 * @param rows Number of rows of every matrix
+	 * @param cols Number of columns of every matrix
+	 * @return The number of cells of the batch.
+	 * @throws IllegalMatrixException if one of the arguments rows and cols (but not both) is 0.
+	 */
+	static std::size_t _checkSize(unsigned int count, unsigned int rows, unsigned int cols)
+	{
+		if ((rows == 0 && cols != 0) || (rows != 0 && cols == 0))
+		{
+			throw IllegalMatrixException();
+		}
+		return (std::size_t)count * rows * cols;
+	}
+
+	/**
+	 * Checks a matrix number.
+	 * @param index The matrix number
+	 * @throws OutOfMatrixException if there is no matrix at index.
+	 */
+	void _checkIndex(unsigned int index) const
+	{
+		if (index >= _count)
+		{
+			throw OutOfMatrixException();
+		}
+	}
+
+	/**
+	 * Runs func(begin, end) over the matrices of this: on chunks of whole matrices in the thread
+	 * pool if the execution policy runs an operation of that kind and of the total work in
+	 * parallel, or once on all the matrices otherwise.
+	 * @param operation The kind of operation
+	 * @param work The work of the operation on a single matrix
+	 * @param func The function to run
+	 */
+	template <class Func>
+	void _forMatrices(Operation operation, unsigned long long work, const Func& func) const
+	{
+		if (!ExecutionPolicy::parallel(operation, work * _count))
+		{
+			func(0, _count);
+			return;
+		}
+		unsigned int grain = (unsigned int)std::max<unsigned long long>(
+			MIN_WORK_PER_CHUNK / std::max<unsigned long long>(work, 1), 1);
+		ThreadPool::instance().parallelFor(0, _count, grain, func);
+	}
+
+	/**
+	 * Applies an element-wise kernel to the cells of this and other.
+	 * @param other The other batch
+	 * @param kernel The kernel, called as kernel(dst, a, b, n)
+	 * @return The result batch.
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the batches do not have the same dimensions.
+	 */
+	template <class Kernel>
+	MatrixBatch<T, Allocator> _elementwise(const MatrixBatch<T, Allocator>& other,
+										   const Kernel& kernel) const
+	{
+		if (_count != other._count || _rows != other._rows || _cols != other._cols)
+		{
+			throw WrongDimensionsException();
+		}
+		MatrixBatch<T, Allocator> result(_count, _rows, _cols);
+		std::size_t cells = size();
+		const T* a = _cells.data();
+		const T* b = other._cells.data();
+		T* dst = result._cells.data();
+		_forMatrices(Operation::ELEMENTWISE, cells * sizeof(T),
+					 [=](unsigned int begin, unsigned int end)
+		{
+			kernel(dst + begin * cells, a + begin * cells, b + begin * cells,
+				   (end - begin) * cells);
+		});
+		return result;
+	}
+
+	/**
+	 * @param n Number of columns of a product
+	 * @return true if _product() has its own kernel for products of n columns, false otherwise.
+	 */
+	static bool _fixedWidth(unsigned int n)
+	{
+		return n == 2 || n == 3 || n == 4 || n == 8;
+	}
+
+	/**
+	 * Computes C = A * B for a single small product, a row of C at a time: the rows of B scaled
+	 * by the cells of a row of A are added to the row of C, which the compiler vectorizes. The
+	 * narrowest widths of C have their own kernels, which keep the row of C in registers.
+	 * @param m Number of rows of A and C
+	 * @param n Number of columns of B and C
+	 * @param k Number of columns of A and rows of B
+	 * @param a The cells of A, row by row
+	 * @param b The cells of B, row by row
+	 * @param c The cells of C, row by row, set to 0
+	 */
+	static void _product(unsigned int m, unsigned int n, unsigned int k, const T* a, const T* b,
+						 T* c)
+	{
+		switch (n)
+		{
+		case 2:
+			_fixedProduct<2>(m, k, a, b, c);
+			return;
+		case 3:
+			_fixedProduct<3>(m, k, a, b, c);
+			return;
+		case 4:
+			_fixedProduct<4>(m, k, a, b, c);
+			return;
+		case 8:
+			_fixedProduct<8>(m, k, a, b, c);
+			return;
+		}
+		for (unsigned int i = 0; i < m; i++)
+		{
+			T* row = c + (std::size_t)i * n;
+			const T* cells = a + (std::size_t)i * k;
+			for (unsigned int p = 0; p < k; p++)
+			{
+				T cell = cells[p];
+				const T* other = b + (std::size_t)p * n;
+				for (unsigned int j = 0; j < n; j++)
+				{
+					row[j] += cell * other[j];
+				}
+			}
+		}
+	}
+
+	/**
+	 * _product() for C of N columns.
+	 */
+	template <unsigned int N>
+	static void _fixedProduct(unsigned int m, unsigned int k, const T* a, const T* b, T* c)
+	{
+		for (unsigned int i = 0; i < m; i++)
+		{
+			T row[N] = {};
+			const T* cells = a + (std::size_t)i * k;
+			for (unsigned int p = 0; p < k; p++)
+			{
+				T cell = cells[p];
+				const T* other = b + (std::size_t)p * N;
+				for (unsigned int j = 0; j < N; j++)
+				{
+					row[j] += cell * other[j];
+				}
+			}
+			for (unsigned int j = 0; j < N; j++)
+			{
+				c[(std::size_t)i * N + j] = row[j];
+			}
+		}
+	}
+};
+
+template <class T, class Allocator>
+const unsigned long long MatrixBatch<T, Allocator>::MIN_WORK_PER_CHUNK;
+
+#endif /* MATRIXBATCH_H_ */
@@ -0,0 +1,480 @@
+// MatrixBenchmark.cpp
+
+/**
+ * Measures the operations of Matrix<T>, as a baseline against which performance changes are
+ * judged. For every element type (int, double, Complex), operation (+, -, *, trans, trace, and
+ * the text output << and input >>), size and execution (sequential, parallel and the automatic
+ * choice of ExecutionPolicy) it times repeated runs on random square matrices and reports the
+ * percentiles of the run times, the throughput in GFLOP/s and GB/s and the number of heap
+ * allocations per run.
+ *
+ * The results are printed as a table, and optionally written as CSV and JSON.
+ *
+ * Usage: MatrixBenchmark [--max-size N] [--max-product-size N] [--runs N] [--csv path]
+ *                        [--json path]
+ */
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Matrix.hpp"
+#include "AllocationCounter.h"
+#include "Complex.h"
+
+/**
+ * Sizes of the matrices, and the default limits.
+ */
+static const unsigned int SIZES[] = {16, 64, 128, 256, 512, 1024, 2048};
+static const unsigned int DEFAULT_MAX_SIZE = 1024;
+static const unsigned int DEFAULT_MAX_PRODUCT_SIZE = 512;
+static const unsigned int DEFAULT_RUNS = 20;
+
+/**
+ * A measurement stops after the requested number of runs, or after MIN_RUNS runs once it took
+ * TIME_BUDGET seconds.
+ */
+static const unsigned int MIN_RUNS = 5;
+static const double TIME_BUDGET = 1;
+
+/**
+ * The options of the benchmark.
+ */
+struct Options
+{
+	unsigned int maxSize; /**< Largest size of the element-wise operations */
+	unsigned int maxProductSize; /**< Largest size of the products */
+	unsigned int runs; /**< Number of runs of every measurement */
+	std::string csv; /**< Path of the CSV output, empty for none */
+	std::string json; /**< Path of the JSON output, empty for none */
+};
+
+/**
+ * The result of a measurement.
+ */
+struct Result
+{
+	std::string type; /**< Element type */
+	std::string operation; /**< Operation */
+	std::string execution; /**< Execution */
+	unsigned int size; /**< Number of rows and columns of the operands */
+	unsigned int runs; /**< Number of timed runs */
+	double best; /**< Fastest run, in seconds */
+	double p50; /**< Median run, in seconds */
+	double p90; /**< 90th percentile, in seconds */
+	double p99; /**< 99th percentile, in seconds */
+	double gflops; /**< Arithmetic throughput of the median run */
+	double gbps; /**< Memory throughput of the median run */
+	double allocations; /**< Heap allocations per run */
+};
+
+/**
+ * The name of an element type, and how random cells of it are drawn.
+ */
+template <class T>
+struct Element;
+
+template <>
+struct Element<int>
+{
+	static const char* name()
+	{
+		return "int";
+	}
+
+	static int random(std::mt19937& generator)
+	{
+		return std::uniform_int_distribution<int>(-100, 100)(generator);
+	}
+};
+
+template <>
+struct Element<double>
+{
+	static const char* name()
+	{
+		return "double";
+	}
+
+	static double random(std::mt19937& generator)
+	{
+		return std::uniform_real_distribution<double>(-1, 1)(generator);
+	}
+};
+
+template <>
+struct Element<Complex>
+{
+	static const char* name()
+	{
+		return "Complex";
+	}
+
+	static Complex random(std::mt19937& generator)
+	{
+		std::uniform_real_distribution<double> distribution(-1, 1);
+		double real = distribution(generator);
+		return Complex(real, distribution(generator));
+	}
+};
+
+/**
+ * The operations measured, and their names.
+ */
+enum BenchmarkOperation
+{
+	ADD,
+	SUBTRACT,
+	MULTIPLY,
+	TRANSPOSE,
+	TRACE,
+	WRITE_TEXT,
+	READ_TEXT
+};
+static const char* const OPERATION_NAMES[] = {"+", "-", "*", "trans", "trace", "<<", ">>"};
+
+/**
+ * The executions every operation is measured with.
+ */
+static const Execution EXECUTIONS[] = {Execution::SEQUENTIAL, Execution::PARALLEL,
+									   Execution::AUTO};
+
+/**
+ * @param execution An execution
+ * @return The name of the execution.
+ */
+static const char* executionName(Execution execution)
+{
+	switch (execution)
+	{
+	case Execution::SEQUENTIAL:
+		return "sequential";
+	case Execution::PARALLEL:
+		return "parallel";
+	default:
+		return "auto";
+	}
+}
+
+/**
+ * Creates a matrix with random cells.
+ * @param size Number of rows and columns
+ * @param generator The random generator
+ * @return The matrix
+ */
+template <class T>
+static Matrix<T> randomMatrix(unsigned int size, std::mt19937& generator)
+{
+	std::vector<T> cells((std::size_t)size * size);
+	for (std::size_t i = 0; i < cells.size(); i++)
+	{
+		cells[i] = Element<T>::random(generator);
+	}
+	return Matrix<T>(size, size, cells);
+}
+
+/**
+ * @param sorted Run times in increasing order
+ * @param percent The percentile
+ * @return The nearest-rank percentile of the run times.
+ */
+static double percentile(const std::vector<double>& sorted, unsigned int percent)
+{
+	std::size_t rank = (sorted.size() * percent + 99) / 100;
+	return sorted[std::max(rank, (std::size_t)1) - 1];
+}
+
+/**
+ * Times an operation: one untimed run to warm the caches and the pool, then the timed runs.
+ * @param operation The operation
+ * @param runs Number of runs requested
+ * @param flops Arithmetic operations of a run
+ * @param bytes Bytes read and written by a run
+ * @param result The result, whose measured fields are set
+ */
+static void measure(const std::function<void()>& operation, unsigned int runs, double flops,
+					double bytes, Result& result)
+{
+	operation();
+	std::vector<double> times;
+	times.reserve(runs);
+	double total = 0;
+	unsigned long long allocated = allocations.load();
+	while (times.size() < runs && (times.size() < MIN_RUNS || total < TIME_BUDGET))
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		operation();
+		std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+		times.push_back(std::max(time.count(), 1e-9));
+		total += time.count();
+	}
+	result.allocations = (double)(allocations.load() - allocated) / times.size();
+
+	std::sort(times.begin(), times.end());
+	result.runs = (unsigned int)times.size();
+	result.best = times.front();
+	result.p50 = percentile(times, 50);
+	result.p90 = percentile(times, 90);
+	result.p99 = percentile(times, 99);
+	result.gflops = flops / result.p50 / 1e9;
+	result.gbps = bytes / result.p50 / 1e9;
+}
+
+/**
+ * Measures all the operations on one element type.
+ * @param options The options
+ * @param generator The random generator
+ * @param results The results, to which the measurements are added
+ */
+template <class T>
+static void benchmarkType(const Options& options, std::mt19937& generator,
+						  std::vector<Result>& results)
+{
+	for (unsigned int size : SIZES)
+	{
+		if (size > options.maxSize)
+		{
+			break;
+		}
+		Matrix<T> a = randomMatrix<T>(size, generator);
+		Matrix<T> b = randomMatrix<T>(size, generator);
+		Matrix<T> c(size, size);
+		double cells = (double)size * size;
+		double cellBytes = cells * sizeof(T);
+		std::ostringstream formatted;
+		formatted << a;
+		std::string text = formatted.str();
+
+		for (unsigned int operation = ADD; operation <= READ_TEXT; operation++)
+		{
+			if (operation == MULTIPLY && size > options.maxProductSize)
+			{
+				continue;
+			}
+			std::function<void()> run;
+			double flops = cells, bytes = 3 * cellBytes;
+			switch (operation)
+			{
+			case ADD:
+				run = [&]() { c = a + b; };
+				break;
+			case SUBTRACT:
+				run = [&]() { c = a - b; };
+				break;
+			case MULTIPLY:
+				run = [&]() { c = a * b; };
+				flops = 2 * cells * size;
+				break;
+			case TRANSPOSE:
+				run = [&]() { c = a.trans(); };
+				flops = 0;
+				bytes = 2 * cellBytes;
+				break;
+			case TRACE:
+				run = [&]() { c(0, 0) = a.trace(); };
+				flops = size;
+				bytes = (double)size * sizeof(T);
+				break;
+			case WRITE_TEXT:
+				run = [&]()
+				{
+					std::ostringstream out;
+					out << a;
+				};
+				flops = 0;
+				bytes = (double)text.size();
+				break;
+			default:
+				run = [&]()
+				{
+					std::istringstream in(text);
+					in >> c;
+				};
+				flops = 0;
+				bytes = (double)text.size();
+				break;
+			}
+
+			for (Execution execution : EXECUTIONS)
+			{
+				ScopedExecution scope(execution);
+				Result result;
+				result.type = Element<T>::name();
+				result.operation = OPERATION_NAMES[operation];
+				result.execution = executionName(execution);
+				result.size = size;
+				measure(run, options.runs, flops, bytes, result);
+				results.push_back(result);
+			}
+		}
+	}
+}
+
+/**
+ * Prints the results as a table.
+ * @param results The results
+ */
+static void printTable(const std::vector<Result>& results)
+{
+	std::cout << std::left << std::setw(8) << "type" << std::setw(6) << "op" << std::right
+			  << std::setw(6) << "size" << "  " << std::left << std::setw(11) << "execution"
+			  << std::right << std::setw(5) << "runs" << std::setw(12) << "best(us)"
+			  << std::setw(12) << "p50(us)" << std::setw(12) << "p90(us)" << std::setw(12)
+			  << "p99(us)" << std::setw(10) << "GFLOP/s" << std::setw(10) << "GB/s"
+			  << std::setw(10) << "allocs" << "\n";
+	for (const Result& result : results)
+	{
+		std::cout << std::left << std::setw(8) << result.type << std::setw(6) << result.operation
+				  << std::right << std::setw(6) << result.size << "  " << std::left
+				  << std::setw(11) << result.execution << std::right << std::setw(5)
+				  << result.runs << std::fixed << std::setprecision(2) << std::setw(12)
+				  << result.best * 1e6 << std::setw(12) << result.p50 * 1e6 << std::setw(12)
+				  << result.p90 * 1e6 << std::setw(12) << result.p99 * 1e6
+				  << std::setw(10) << result.gflops << std::setw(10)
+				  << result.gbps << std::setw(10) << result.allocations << "\n";
+	}
+}
+
+/**
+ * Writes the results as CSV, one line per measurement with times in seconds.
+ * @param results The results
+ * @param path The path of the file
+ * @return true if the file was written, false otherwise.
+ */
+static bool writeCsv(const std::vector<Result>& results, const std::string& path)
+{
+	std::ofstream file(path);
+	file << "type,operation,execution,size,runs,best,p50,p90,p99,gflops,gbps,allocations\n";
+	file << std::setprecision(9);
+	for (const Result& result : results)
+	{
+		file << result.type << "," << result.operation << "," << result.execution << ","
+			 << result.size << "," << result.runs << "," << result.best << "," << result.p50
+			 << "," << result.p90 << "," << result.p99 << "," << result.gflops << ","
+			 << result.gbps << "," << result.allocations << "\n";
+	}
+	return (bool)file;
+}
+
+/**
+ * Writes the results as a JSON array of objects with times in seconds.
+ * @param results The results
+ * @param path The path of the file
+ * @return true if the file was written, false otherwise.
+ */
+static bool writeJson(const std::vector<Result>& results, const std::string& path)
+{
+	std::ofstream file(path);
+	file << "[\n" << std::setprecision(9);
+	for (std::size_t i = 0; i < results.size(); i++)
+	{
+		const Result& result = results[i];
+		file << "  {\"type\": \"" << result.type << "\", \"operation\": \"" << result.operation
+			 << "\", \"execution\": \"" << result.execution << "\", \"size\": " << result.size
+			 << ", \"runs\": " << result.runs << ", \"best\": " << result.best
+			 << ", \"p50\": " << result.p50 << ", \"p90\": " << result.p90
+			 << ", \"p99\": " << result.p99 << ", \"gflops\": " << result.gflops
+			 << ", \"gbps\": " << result.gbps << ", \"allocations\": " << result.allocations
+			 << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	file << "]\n";
+	return (bool)file;
+}
+
+/**
+ * Reads the options from the arguments.
+ * @param argc Number of arguments
+ * @param argv The arguments
+ * @param options The options to set
+ * @return true if the arguments are valid, false otherwise.
+ */
+static bool parseOptions(int argc, char* argv[], Options& options)
+{
+	options.maxSize = DEFAULT_MAX_SIZE;
+	options.maxProductSize = DEFAULT_MAX_PRODUCT_SIZE;
+	options.runs = DEFAULT_RUNS;
+	for (int i = 1; i < argc; i += 2)
+	{
+		if (i + 1 >= argc)
+		{
+			return false;
+		}
+		std::string name = argv[i];
+		if (name == "--max-size")
+		{
+			options.maxSize = (unsigned int)std::atoi(argv[i + 1]);
+		}
+		else if (name == "--max-product-size")
+		{
+			options.maxProductSize = (unsigned int)std::atoi(argv[i + 1]);
+		}
+		else if (name == "--runs")
+		{
+			options.runs = std::max(std::atoi(argv[i + 1]), 1);
+		}
+		else if (name == "--csv")
+		{
+			options.csv = argv[i + 1];
+		}
+		else if (name == "--json")
+		{
+			options.json = argv[i + 1];
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Runs the benchmark.
+ * @param argc Number of arguments
+ * @param argv The arguments
+ * @return 0 on success, 1 if the arguments are invalid or an output cannot be written.
+ */
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		std::cerr << "Usage: " << argv[0] << " [--max-size N] [--max-product-size N] [--runs N]"
+				  << " [--csv path] [--json path]" << "\n";
+		return 1;
+	}
+
+	const ExecutionThresholds& thresholds = ExecutionPolicy::thresholds();
+	std::cout << "threads: " << ThreadPool::instance().threadCount()
+			  << ", thresholds: elementwise_bytes " << thresholds.elementwiseBytes
+			  << ", transpose_bytes " << thresholds.transposeBytes << ", product_flops "
+			  << thresholds.productFlops << ", blocked_flops " << thresholds.blockedFlops
+			  << "\n\n";
+
+	std::mt19937 generator(1);
+	std::vector<Result> results;
+	benchmarkType<int>(options, generator, results);
+	benchmarkType<double>(options, generator, results);
+	benchmarkType<Complex>(options, generator, results);
+	printTable(results);
+
+	if (!options.csv.empty() && !writeCsv(results, options.csv))
+	{
+		std::cerr << "Cannot write " << options.csv << "\n";
+		return 1;
+	}
+	if (!options.json.empty() && !writeJson(results, options.json))
+	{
+		std::cerr << "Cannot write " << options.json << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,1274 @@
+// MatrixExpression.h
+
+#ifndef MATRIXEXPRESSION_H_
+#define MATRIXEXPRESSION_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "WrongDimensionsException.h"
+#include "NoSquareException.h"
+#include "OutOfMatrixException.h"
+#include "ElementKernels.h"
+#include "Strassen.h"
+#include "ExecutionPolicy.h"
+#include "ThreadPool.h"
+#include "MatrixProfiler.h"
+#include "MatrixAllocator.h"
+
+/**
+ * The operators +, - and * and trans() of Matrix<T> do not compute their result. They return
+ * light expression objects describing it, and the result is computed once, when the expression is
+ * assigned to (or used to construct) a Matrix<T>:
+ * - Sums and differences are evaluated in a single pass over the rows of the result, without
+ *   temporary matrices for the intermediate results.
+ * - A transposed matrix is the same cells with the row and column strides swapped, so transposing
+ *   does not copy and a transposed operand of * is read in place by the multiplication engine.
+ * - A product is computed directly into the matrix it is assigned to, by the blocked engine or,
+ *   when selected, by the Strassen-Winograd engine.
+ * - Multiplying by a scalar is applied while evaluating the rows of its operand.
+ *
+ * Expressions refer to the matrices they were built from, so they have to be evaluated before
+ * those matrices change or are destroyed (do not keep them in auto variables).
+ */
+
+template <class T, class Allocator = AlignedAllocator<T> >
+class Matrix;
+
+template <class T>
+class MatrixProduct;
+
+/**
+ * Base class of all the matrix expressions (Matrix<T> included). E is the derived class.
+ */
+template <class E>
+class MatrixExpression
+{
+public:
+	/**
+	 * @return The expression as its derived class.
+	 */
+	const E& self() const
+	{
+		return static_cast<const E&>(*this);
+	}
+
+	/**
+	 * Evaluates the expression.
+	 * @return The matrix the expression describes.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	template <class U = E>
+	Matrix<typename U::value_type> eval() const
+	{
+		return Matrix<typename U::value_type>(self());
+	}
+
+	/**
+	 * == operator. Compare between the values of this and other.
+	 * @param other The other expression
+	 * @return true if this and other are equal, false otherwise.
+	 */
+	template <class R>
+	bool operator==(const MatrixExpression<R>& other) const
+	{
+		return eval() == other.eval();
+	}
+
+	/**
+	 * != operator. Returns the opposite of == operator.
+	 * @param other The other expression
+	 * @return true if this and other are not equal, false otherwise.
+	 */
+	template <class R>
+	bool operator!=(const MatrixExpression<R>& other) const
+	{
+		return !(*this == other);
+	}
+};
+
+/**
+ * Row buffers used while evaluating expressions. Every nesting level of an expression gets its
+ * own buffer, owned by the evaluating thread and reused between evaluations.
+ */
+template <class T>
+class ExpressionBuffer
+{
+public:
+	/**
+	 * @param depth The nesting level
+	 * @param size The number of cells needed
+	 * @return The buffer of the given level, holding at least size cells.
+	 */
+	static T* get(unsigned int depth, std::size_t size)
+	{
+		static thread_local std::vector<std::vector<T> > buffers;
+		if (buffers.size() <= depth)
+		{
+			buffers.resize(depth + 1);
+		}
+		if (buffers[depth].size() < size)
+		{
+			buffers[depth].resize(size);
+		}
+		return buffers[depth].data();
+	}
+};
+
+/**
+ * This class represents cells of a matrix given by a pointer and a row and column stride: a
+ * matrix, a transposed matrix or an evaluated sub-expression. It does not own the cells unless it
+ * was created by materialize().
+ */
+template <class T>
+class MatrixOperand : public MatrixExpression<MatrixOperand<T> >
+{
+public:
+	/**
+	 * The type of the cells.
+	 */
+	typedef T value_type;
+
+	/**
+	 * Initiates the operand with the given layout.
+	 * @param data The first cell
+	 * @param rows Number of rows
+	 * @param cols Number of columns
+	 * @param rowStride Distance between two consecutive rows
+	 * @param colStride Distance between two consecutive columns
+	 * @param conjugate Whether the cells are read conjugated
+	 */
+	MatrixOperand(const T* data, unsigned int rows, unsigned int cols, std::size_t rowStride,
+				  std::size_t colStride, bool conjugate = false) :
+		_data(data), _rows(rows), _cols(cols), _rowStride(rowStride), _colStride(colStride),
+		_conjugate(conjugate)
+	{
+	}
+
+	/**
+	 * Initiates the operand with the cells of matrix.
+	 * @param matrix The matrix
+	 */
+	template <class Allocator>
+	explicit MatrixOperand(const Matrix<T, Allocator>& matrix) :
+		_data(matrix.data()), _rows(matrix.rows()), _cols(matrix.cols()),
+		_rowStride(matrix.cols()), _colStride(1), _conjugate(false)
+	{
+	}
+
+	/**
+	 * Evaluates expr into a new matrix owned by the returned operand.
+	 * @param expr The expression
+	 * @return Operand of the evaluated matrix.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	template <class E>
+	static MatrixOperand materialize(const MatrixExpression<E>& expr)
+	{
+		std::shared_ptr<Matrix<T> > matrix = std::make_shared<Matrix<T> >(expr.self());
+		MatrixOperand operand(*matrix);
+		operand._owner = matrix;
+		return operand;
+	}
+
+	/**
+	 * @return The number of rows.
+	 */
+	unsigned int rows() const
+	{
+		return _rows;
+	}
+
+	/**
+	 * @return The number of columns.
+	 */
+	unsigned int cols() const
+	{
+		return _cols;
+	}
+
+	/**
+	 * @return true if the operand is square, false otherwise.
+	 */
+	bool isSquareMatrix() const
+	{
+		return _rows == _cols;
+	}
+
+	/**
+	 * @return The first cell.
+	 */
+	const T* data() const
+	{
+		return _data;
+	}
+
+	/**
+	 * @return The distance between two consecutive rows.
+	 */
+	std::size_t rowStride() const
+	{
+		return _rowStride;
+	}
+
+	/**
+	 * @return The distance between two consecutive columns.
+	 */
+	std::size_t colStride() const
+	{
+		return _colStride;
+	}
+
+	/**
+	 * @return Whether the cells are read conjugated.
+	 */
+	bool conjugated() const
+	{
+		return _conjugate;
+	}
+
+	/**
+	 * () operator. Returns the cell located in the given coordinates. The coordinates are only
+	 * checked when NDEBUG is not defined; use at() for an access that is always checked.
+	 * @param row The cell row number
+	 * @param col The cell column number
+	 * @return The requested cell
+	 * @throws OutOfMatrixException if the requested cell is not exist in the matrix (without
+	 * 		   NDEBUG).
+	 */
+	T operator()(unsigned int row, unsigned int col) const
+	{
+#ifndef NDEBUG
+		return at(row, col);
+#else
+		return _cell(row, col);
+#endif
+	}
+
+	/**
+	 * Returns the cell located in the given coordinates.
+	 * @param row The cell row number
+	 * @param col The cell column number
+	 * @return The requested cell
+	 * @throws OutOfMatrixException if the requested cell is not exist in the matrix.
+	 */
+	T at(unsigned int row, unsigned int col) const
+	{
+		if (row >= _rows || col >= _cols)
+		{
+			throw OutOfMatrixException();
+		}
+		return _cell(row, col);
+	}
+
+	/**
+	 * @return The transposed operand (conjugated for Complex cells), sharing the same cells.
+	 */
+	MatrixOperand trans() const
+	{
+		MatrixOperand transposed(*this);
+		std::swap(transposed._rows, transposed._cols);
+		std::swap(transposed._rowStride, transposed._colStride);
+		transposed._conjugate = ElementConjugate<T>::CONJUGATES && !_conjugate;
+		return transposed;
+	}
+
+	/**
+	 * Calculates and returns the trace.
+	 * @return The trace.
+	 * @throws NoSquareException if the operand is not square
+	 */
+	T trace() const
+	{
+		if (_rows != _cols)
+		{
+			throw NoSquareException();
+		}
+		T trace(0);
+		for (unsigned int i = 0; i < _rows; i++)
+		{
+			trace += _cell(i, i);
+		}
+		return trace;
+	}
+
+	// ------------------ Evaluation ------------------------
+	/**
+	 * @param row The row number
+	 * @return The cells of the row if they are contiguous and not conjugated, nullptr otherwise.
+	 */
+	const T* rowPointer(unsigned int row) const
+	{
+		return (_colStride == 1 && !_conjugate) ? _data + row * _rowStride : nullptr;
+	}
+
+	/**
+	 * Writes the cells of a row to out.
+	 * @param row The row number
+	 * @param out The destination, holding cols() cells
+	 */
+	void evalRow(unsigned int row, T* out, unsigned int) const
+	{
+		const T* source = _data + row * _rowStride;
+		if (_conjugate)
+		{
+			for (unsigned int j = 0; j < _cols; j++)
+			{
+				out[j] = ElementConjugate<T>::apply(source[j * _colStride]);
+			}
+		}
+		else if (_colStride == 1)
+		{
+			if (source != out)
+			{
+				std::copy(source, source + _cols, out);
+			}
+		}
+		else
+		{
+			for (unsigned int j = 0; j < _cols; j++)
+			{
+				out[j] = source[j * _colStride];
+			}
+		}
+	}
+
+	/**
+	 * @param begin The first cell of the destination
+	 * @param end One after the last cell of the destination
+	 * @param rowStride Distance between two consecutive rows of the destination
+	 * @return Whether the cells of the operand overlap the destination. When the operand is laid
+	 * 		   out in rows (or, transposed, in columns) of rowStride cells like the destination,
+	 * 		   as two blocks of the same matrix are, their rows and columns are compared, so
+	 * 		   side by side blocks do not overlap; otherwise their memory ranges are compared.
+	 */
+	bool overlaps(const T* begin, const T* end, std::size_t rowStride) const
+	{
+		if (_rows == 0 || _cols == 0 || begin == end)
+		{
+			return false;
+		}
+		const T* last = _data + (_rows - 1) * _rowStride + (_cols - 1) * _colStride;
+		std::less<const T*> less;
+		if (less(last, begin) || !less(_data, end))
+		{
+			return false;
+		}
+
+		// The operand as a block of blockRows rows of blockCols cells, rowStride cells apart
+		std::size_t blockRows = _rows;
+		std::size_t blockCols = _cols;
+		if (_rowStride == 1 && _colStride == rowStride)
+		{
+			std::swap(blockRows, blockCols);
+		}
+		else if (_colStride != 1 || _rowStride != rowStride)
+		{
+			return true;
+		}
+		if (blockCols > rowStride)
+		{
+			return true;
+		}
+
+		// Cell (i, j) of the operand is offset + i * ld + j cells after begin, in row
+		// rowOffset + i of the destination block if colOffset + j < ld, in the next row otherwise
+		std::ptrdiff_t ld = (std::ptrdiff_t)rowStride;
+		std::ptrdiff_t rows = (end - begin - 1) / ld + 1;
+		std::ptrdiff_t cols = (end - begin) - (rows - 1) * ld;
+		std::ptrdiff_t offset = _data - begin;
+		std::ptrdiff_t rowOffset = offset >= 0 ? offset / ld : -((ld - 1 - offset) / ld);
+		std::ptrdiff_t colOffset = offset - rowOffset * ld;
+		auto rowsMeet = [rows, blockRows](std::ptrdiff_t first)
+		{
+			return first < rows && first + (std::ptrdiff_t)blockRows > 0;
+		};
+		return (colOffset < cols && rowsMeet(rowOffset)) ||
+			   (colOffset + (std::ptrdiff_t)blockCols > ld && rowsMeet(rowOffset + 1));
+	}
+
+	/**
+	 * Checks whether evaluating the operand row by row into a destination matrix may read cells
+	 * the evaluation has already overwritten. Reading the destination itself is safe, since every
+	 * row is read before it is written.
+	 * @param begin The first cell of the destination
+	 * @param end One after the last cell of the destination
+	 * @param rowStride Distance between two consecutive rows of the destination
+	 * @return true if the operand overlaps the destination in any other way.
+	 */
+	bool conflicts(const T* begin, const T* end, std::size_t rowStride) const
+	{
+		return overlaps(begin, end, rowStride) &&
+			   !(_data == begin && _rowStride == rowStride && _colStride == 1 && !_conjugate);
+	}
+
+protected:
+	/**
+	 * Initiates the operand with the given layout, keeping owner alive as long as the operand or
+	 * a copy of it exists.
+	 * @param data The first cell
+	 * @param rows Number of rows
+	 * @param cols Number of columns
+	 * @param rowStride Distance between two consecutive rows
+	 * @param colStride Distance between two consecutive columns
+	 * @param owner The owner of the cells
+	 */
+	MatrixOperand(const T* data, unsigned int rows, unsigned int cols, std::size_t rowStride,
+				  std::size_t colStride, const std::shared_ptr<const void>& owner) :
+		_data(data), _rows(rows), _cols(cols), _rowStride(rowStride), _colStride(colStride),
+		_conjugate(false), _owner(owner)
+	{
+	}
+
+private:
+	// ------------------ Data members ----------------------
+	const T* _data; /**< The first cell */
+	unsigned int _rows; /**< Number of rows */
+	unsigned int _cols; /**< Number of columns */
+	std::size_t _rowStride; /**< Distance between two consecutive rows */
+	std::size_t _colStride; /**< Distance between two consecutive columns */
+	bool _conjugate; /**< Whether the cells are read conjugated */
+	std::shared_ptr<const void> _owner; /**< Keeps a materialized matrix alive */
+
+	// ------------------ Private functions -----------------
+	/**
+	 * @param row The cell row number
+	 * @param col The cell column number
+	 * @return The cell located in the given coordinates, without checking them.
+	 */
+	T _cell(unsigned int row, unsigned int col) const
+	{
+		const T& cell = _data[row * _rowStride + col * _colStride];
+		return _conjugate ? ElementConjugate<T>::apply(cell) : cell;
+	}
+};
+
+/**
+ * How an expression is held inside a larger expression: matrices as operands referring to their
+ * cells, products evaluated into operands, and other expressions by value.
+ */
+template <class E>
+struct ExpressionOperand
+{
+	typedef E type;
+
+	static const E& make(const E& expr)
+	{
+		return expr;
+	}
+};
+
+template <class T, class Allocator>
+struct ExpressionOperand<Matrix<T, Allocator> >
+{
+	typedef MatrixOperand<T> type;
+
+	static type make(const Matrix<T, Allocator>& matrix)
+	{
+		return type(matrix);
+	}
+};
+
+template <class T>
+struct ExpressionOperand<MatrixProduct<T> >
+{
+	typedef MatrixOperand<T> type;
+
+	static type make(const MatrixProduct<T>& product)
+	{
+		return type::materialize(product);
+	}
+};
+
+/**
+ * How an expression is given to the multiplication engine, which reads strided and conjugated
+ * cells: matrices and (conjugate) transposed matrices as they are, and any other expression after
+ * being evaluated.
+ */
+template <class E>
+struct GemmOperand
+{
+	typedef MatrixOperand<typename E::value_type> type;
+
+	static type make(const E& expr)
+	{
+		return type::materialize(expr);
+	}
+};
+
+template <class T, class Allocator>
+struct GemmOperand<Matrix<T, Allocator> >
+{
+	typedef MatrixOperand<T> type;
+
+	static type make(const Matrix<T, Allocator>& matrix)
+	{
+		return type(matrix);
+	}
+};
+
+template <class T>
+struct GemmOperand<MatrixOperand<T> >
+{
+	typedef MatrixOperand<T> type;
+
+	static type make(const MatrixOperand<T>& operand)
+	{
+		return operand;
+	}
+};
+
+/**
+ * The operation of the + operator on cells.
+ */
+struct MatrixAddition
+{
+	template <class T>
+	static void apply(T* dst, const T* a, const T* b, std::size_t n)
+	{
+		ElementKernels<T>::add(dst, a, b, n);
+	}
+
+	template <class T>
+	static T apply(const T& a, const T& b)
+	{
+		return a + b;
+	}
+};
+
+/**
+ * The operation of the - operator on cells.
+ */
+struct MatrixSubtraction
+{
+	template <class T>
+	static void apply(T* dst, const T* a, const T* b, std::size_t n)
+	{
+		ElementKernels<T>::subtract(dst, a, b, n);
+	}
+
+	template <class T>
+	static T apply(const T& a, const T& b)
+	{
+		return a - b;
+	}
+};
+
+/**
+ * This class represents the cell by cell sum (Op = MatrixAddition) or difference
+ * (Op = MatrixSubtraction) of two expressions.
+ */
+template <class L, class R, class Op>
+class MatrixBinaryExpression : public MatrixExpression<MatrixBinaryExpression<L, R, Op> >
+{
+public:
+	/**
+	 * The type of the cells.
+	 */
+	typedef typename L::value_type value_type;
+
+	/**
+	 * Initiates the expression.
+	 * @param left The left operand
+	 * @param right The right operand
+	 * @throws WrongDimensionsExceptions if the dimensions of left and right are not the same.
+	 */
+	MatrixBinaryExpression(const L& left, const R& right) : _left(left), _right(right)
+	{
+		if (left.rows() != right.rows() || left.cols() != right.cols())
+		{
+			throw WrongDimensionsException();
+		}
+	}
+
+	/**
+	 * @return The left operand.
+	 */
+	const L& left() const
+	{
+		return _left;
+	}
+
+	/**
+	 * @return The right operand.
+	 */
+	const R& right() const
+	{
+		return _right;
+	}
+
+	/**
+	 * @return The number of rows.
+	 */
+	unsigned int rows() const
+	{
+		return _left.rows();
+	}
+
+	/**
+	 * @return The number of columns.
+	 */
+	unsigned int cols() const
+	{
+		return _left.cols();
+	}
+
+	/**
+	 * @return The transposed result, evaluated.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	MatrixOperand<value_type> trans() const
+	{
+		return MatrixOperand<value_type>::materialize(*this).trans();
+	}
+
+	/**
+	 * Calculates and returns the trace, as the sum (or difference) of the traces of the operands.
+	 * @return The trace.
+	 * @throws NoSquareException if the result is not square
+	 */
+	value_type trace() const
+	{
+		return Op::apply(_left.trace(), _right.trace());
+	}
+
+	// ------------------ Evaluation ------------------------
+	/**
+	 * @return nullptr, the cells exist only once evaluated.
+	 */
+	const value_type* rowPointer(unsigned int) const
+	{
+		return nullptr;
+	}
+
+	/**
+	 * Writes the cells of a row to out.
+	 * @param row The row number
+	 * @param out The destination, holding cols() cells
+	 * @param depth The nesting level of this expression, selecting its row buffer
+	 */
+	void evalRow(unsigned int row, value_type* out, unsigned int depth) const
+	{
+		const value_type* right = _right.rowPointer(row);
+		if (right == nullptr)
+		{
+			value_type* buffer = ExpressionBuffer<value_type>::get(depth, cols());
+			_right.evalRow(row, buffer, depth + 1);
+			right = buffer;
+		}
+		const value_type* left = _left.rowPointer(row);
+		if (left == nullptr)
+		{
+			_left.evalRow(row, out, depth + 1);
+			left = out;
+		}
+		Op::apply(out, left, right, cols());
+	}
+
+	/**
+	 * @param begin The first cell of the destination
+	 * @param end One after the last cell of the destination
+	 * @param rowStride Distance between two consecutive rows of the destination
+	 * @return Whether the cells of an operand overlap the destination.
+	 */
+	bool overlaps(const value_type* begin, const value_type* end, std::size_t rowStride) const
+	{
+		return _left.overlaps(begin, end, rowStride) || _right.overlaps(begin, end, rowStride);
+	}
+
+	/**
+	 * @param begin The first cell of the destination
+	 * @param end One after the last cell of the destination
+	 * @param rowStride Distance between two consecutive rows of the destination
+	 * @return Whether an operand conflicts with the destination (see MatrixOperand::conflicts).
+	 */
+	bool conflicts(const value_type* begin, const value_type* end, std::size_t rowStride) const
+	{
+		return _left.conflicts(begin, end, rowStride) || _right.conflicts(begin, end, rowStride);
+	}
+
+private:
+	// ------------------ Data members ----------------------
+	L _left; /**< The left operand */
+	R _right; /**< The right operand */
+};
+
+/**
+ * This class represents an expression multiplied by a scalar.
+ */
+template <class E>
+class MatrixScaledExpression : public MatrixExpression<MatrixScaledExpression<E> >
+{
+public:
+	/**
+	 * The type of the cells.
+	 */
+	typedef typename E::value_type value_type;
+
+	/**
+	 * Initiates the expression.
+	 * @param operand The scaled expression
+	 * @param scalar The scalar
+	 */
+	MatrixScaledExpression(const E& operand, const value_type& scalar) :
+		_operand(operand), _scalar(scalar)
+	{
+	}
+
+	/**
+	 * @return The scaled expression.
+	 */
+	const E& operand() const
+	{
+		return _operand;
+	}
+
+	/**
+	 * @return The number of rows.
+	 */
+	unsigned int rows() const
+	{
+		return _operand.rows();
+	}
+
+	/**
+	 * @return The number of columns.
+	 */
+	unsigned int cols() const
+	{
+		return _operand.cols();
+	}
+
+	/**
+	 * @return The transposed result, evaluated.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	MatrixOperand<value_type> trans() const
+	{
+		return MatrixOperand<value_type>::materialize(*this).trans();
+	}
+
+	/**
+	 * Calculates and returns the trace, as the scaled trace of the operand.
+	 * @return The trace.
+	 * @throws NoSquareException if the result is not square
+	 */
+	value_type trace() const
+	{
+		return _scalar * _operand.trace();
+	}
+
+	// ------------------ Evaluation ------------------------
+	/**
+	 * @return nullptr, the cells exist only once evaluated.
+	 */
+	const value_type* rowPointer(unsigned int) const
+	{
+		return nullptr;
+	}
+
+	/**
+	 * Writes the cells of a row to out.
+	 * @param row The row number
+	 * @param out The destination, holding cols() cells
+	 * @param depth The nesting level of this expression
+	 */
+	void evalRow(unsigned int row, value_type* out, unsigned int depth) const
+	{
+		const value_type* source = _operand.rowPointer(row);
+		if (source == nullptr)
+		{
+			_operand.evalRow(row, out, depth + 1);
+			source = out;
+		}
+		ElementKernels<value_type>::scale(out, source, _scalar, cols());
+	}
+
+	/**
+	 * @param begin The first cell of the destination
+	 * @param end One after the last cell of the destination
+	 * @param rowStride Distance between two consecutive rows of the destination
+	 * @return Whether the cells of the operand overlap the destination.
+	 */
+	bool overlaps(const value_type* begin, const value_type* end, std::size_t rowStride) const
+	{
+		return _operand.overlaps(begin, end, rowStride);
+	}
+
+	/**
+	 * @param begin The first cell of the destination
+	 * @param end One after the last cell of the destination
+	 * @param rowStride Distance between two consecutive rows of the destination
+	 * @return Whether the operand conflicts with the destination (see MatrixOperand::conflicts).
+	 */
+	bool conflicts(const value_type* begin, const value_type* end, std::size_t rowStride) const
+	{
+		return _operand.conflicts(begin, end, rowStride);
+	}
+
+private:
+	// ------------------ Data members ----------------------
+	E _operand; /**< The scaled expression */
+	value_type _scalar; /**< The scalar */
+};
+
+/**
+ * This class represents the product of two operands. It is computed by the multiplication engine
+ * directly into the matrix it is assigned to. Conjugated operands (like trans() of a Complex
+ * matrix) are conjugated by the engine as it reads them, so A.trans() * B is computed without
+ * copying A.
+ */
+template <class T>
+class MatrixProduct : public MatrixExpression<MatrixProduct<T> >
+{
+public:
+	/**
+	 * The type of the cells.
+	 */
+	typedef T value_type;
+
+	/**
+	 * Initiates the product.
+	 * @param left The left operand
+	 * @param right The right operand
+	 * @param algorithm The algorithm the product is computed with
+	 * @throws WrongDimensionsExceptions if number of columns of left is not equal to the number of
+	 * 		   rows of right.
+	 */
+	MatrixProduct(const MatrixOperand<T>& left, const MatrixOperand<T>& right,
+				  MultiplyAlgorithm algorithm = MultiplyAlgorithm::DEFAULT) :
+		_left(left), _right(right), _algorithm(algorithm)
+	{
+		if (left.cols() != right.rows())
+		{
+			throw WrongDimensionsException();
+		}
+	}
+
+	/**
+	 * @return The number of rows.
+	 */
+	unsigned int rows() const
+	{
+		return _left.rows();
+	}
+
+	/**
+	 * @return The number of columns.
+	 */
+	unsigned int cols() const
+	{
+		return _right.cols();
+	}
+
+	/**
+	 * @return The left operand.
+	 */
+	const MatrixOperand<T>& left() const
+	{
+		return _left;
+	}
+
+	/**
+	 * @return The right operand.
+	 */
+	const MatrixOperand<T>& right() const
+	{
+		return _right;
+	}
+
+	/**
+	 * @return The number of multiply-adds of the product.
+	 */
+	unsigned long long flops() const
+	{
+		return (unsigned long long)rows() * cols() * _left.cols();
+	}
+
+	/**
+	 * @return The algorithm the product is computed with.
+	 */
+	MultiplyAlgorithm algorithm() const
+	{
+		return _algorithm;
+	}
+
+	/**
+	 * @return The transposed product, as the product of the transposed operands in reverse order.
+	 */
+	MatrixProduct trans() const
+	{
+		return MatrixProduct(GemmOperand<MatrixOperand<T> >::make(_right.trans()),
+							 GemmOperand<MatrixOperand<T> >::make(_left.trans()), _algorithm);
+	}
+
+	/**
+	 * Calculates and returns the trace, from the diagonal cells of the product only.
+	 * @return The trace.
+	 * @throws NoSquareException if the product is not square
+	 */
+	T trace() const
+	{
+		if (rows() != cols())
+		{
+			throw NoSquareException();
+		}
+		T trace(0);
+		for (unsigned int i = 0; i < rows(); i++)
+		{
+			const T* a = _left.data() + i * _left.rowStride();
+			const T* b = _right.data() + i * _right.colStride();
+			for (unsigned int k = 0; k < _left.cols(); k++)
+			{
+				const T& x = a[k * _left.colStride()];
+				const T& y = b[k * _right.rowStride()];
+				trace += (_left.conjugated() ? ElementConjugate<T>::apply(x) : x) *
+						 (_right.conjugated() ? ElementConjugate<T>::apply(y) : y);
+			}
+		}
+		return trace;
+	}
+
+	/**
+	 * @param begin The first cell of the destination
+	 * @param end One after the last cell of the destination
+	 * @param rowStride Distance between two consecutive rows of the destination
+	 * @return Whether the cells of an operand overlap the destination.
+	 */
+	bool overlaps(const T* begin, const T* end, std::size_t rowStride) const
+	{
+		return _left.overlaps(begin, end, rowStride) || _right.overlaps(begin, end, rowStride);
+	}
+
+	/**
+	 * Computes C = alpha * product, or C += alpha * product if accumulate is true, with the
+	 * blocked engine (the naive one for small products). In the parallel mode C is cut into 2D
+	 * tiles run by the thread pool (see ThreadPool::parallelFor2D()), so tall-skinny and
+	 * short-wide products keep every thread busy like square ones. Each tile is computed by the
+	 * cache-blocked engine on its own rows of A and columns of B, so its packed panels stay in the
+	 * caches of the core running it.
+	 * @param c The first cell of C, not overlapping the operands
+	 * @param ldc Distance between two consecutive rows of C
+	 * @param alpha Scale of the product
+	 * @param accumulate Whether the product is added to C instead of overwriting it
+	 */
+	void compute(T* c, std::size_t ldc, const T& alpha, bool accumulate) const
+	{
+		bool blocked = ExecutionPolicy::blocked(flops());
+		if (!ExecutionPolicy::parallel(Operation::PRODUCT, flops()))
+		{
+			_computeTile(c, ldc, alpha, accumulate, blocked, 0, rows(), 0, cols());
+			return;
+		}
+		unsigned int grain = tileGrain(_left.cols());
+		ThreadPool::instance().parallelFor2D(0, rows(), 0, cols(), grain, grain,
+											 [&](unsigned int rowBegin, unsigned int rowEnd,
+												 unsigned int colBegin, unsigned int colEnd)
+		{
+			_computeTile(c, ldc, alpha, accumulate, blocked, rowBegin, rowEnd, colBegin, colEnd);
+		});
+	}
+
+	/**
+	 * @param depth The common dimension of the operands of a product
+	 * @return The minimal number of rows and columns of a tile of its result, in the parallel mode.
+	 */
+	static unsigned int tileGrain(unsigned int depth)
+	{
+		unsigned long long cells = std::max(depth, 1u);
+		unsigned int grain = TILE_ALIGN;
+		while ((unsigned long long)grain * grain * cells < MIN_FLOPS_PER_TILE)
+		{
+			grain += TILE_ALIGN;
+		}
+		return grain;
+	}
+
+private:
+	/**
+	 * Tile sizes are multiples of this, itself a multiple of the micro-kernel sizes of Gemm<T>.
+	 */
+	static const unsigned int TILE_ALIGN = 16;
+
+	/**
+	 * Minimal number of multiply-adds of a tile, to hide the cost of handing it to a thread.
+	 */
+	static const unsigned long long MIN_FLOPS_PER_TILE = 1 << 15;
+
+	// ------------------ Data members ----------------------
+	MatrixOperand<T> _left; /**< The left operand */
+	MatrixOperand<T> _right; /**< The right operand */
+	MultiplyAlgorithm _algorithm; /**< The algorithm the product is computed with */
+
+	// ------------------ Private functions -----------------
+	/**
+	 * Computes the tile [rowBegin, rowEnd) X [colBegin, colEnd) of C (see compute()).
+	 */
+	void _computeTile(T* c, std::size_t ldc, const T& alpha, bool accumulate, bool blocked,
+					  unsigned int rowBegin, unsigned int rowEnd, unsigned int colBegin,
+					  unsigned int colEnd) const
+	{
+		const T* a = _left.data() + rowBegin * _left.rowStride();
+		const T* b = _right.data() + colBegin * _right.colStride();
+		c += rowBegin * ldc + colBegin;
+		if (blocked)
+		{
+			Gemm<T>::multiply(rowEnd - rowBegin, colEnd - colBegin, _left.cols(), alpha, a,
+							  _left.rowStride(), _left.colStride(), b, _right.rowStride(),
+							  _right.colStride(), c, ldc, accumulate, _left.conjugated(),
+							  _right.conjugated());
+			return;
+		}
+		Gemm<T, false>::multiply(rowEnd - rowBegin, colEnd - colBegin, _left.cols(), alpha, a,
+								 _left.rowStride(), _left.colStride(), b, _right.rowStride(),
+								 _right.colStride(), c, ldc, accumulate, _left.conjugated(),
+								 _right.conjugated());
+	}
+};
+
+template <class T>
+const unsigned int MatrixProduct<T>::TILE_ALIGN;
+
+template <class T>
+const unsigned long long MatrixProduct<T>::MIN_FLOPS_PER_TILE;
+
+/**
+ * How the evaluation of an expression is recorded by MatrixProfiler: the operation it is counted
+ * as, and its arithmetic operations. Every sum, difference and scaling in the expression counts
+ * one operation per cell of the result (a + b - a counts two), products their multiply-adds.
+ * This is the case of matrices and views, copied when assigned.
+ */
+template <class E>
+struct ExpressionProfile
+{
+	static ProfiledOperation operation(const E&)
+	{
+		return ProfiledOperation::COPY;
+	}
+
+	static unsigned long long flops(const E&)
+	{
+		return 0;
+	}
+
+	/**
+	 * @return The operation m += expr (or m -= expr) is counted as. Templates, so that the
+	 * 		   specializations inheriting them take their own expression type (not a matrix
+	 * 		   converted from it).
+	 */
+	template <class X>
+	static ProfiledOperation update(const X&, bool subtract)
+	{
+		return subtract ? ProfiledOperation::SUBTRACT : ProfiledOperation::ADD;
+	}
+
+	/**
+	 * @return The arithmetic operations of m += expr (or m -= expr): one per cell, plus the ones
+	 * 		   of expr.
+	 */
+	template <class X>
+	static unsigned long long updateFlops(const X& expr)
+	{
+		return (unsigned long long)expr.rows() * expr.cols() + ExpressionProfile<X>::flops(expr);
+	}
+};
+
+/**
+ * Operands are transposed (or copied, when their columns are contiguous).
+ */
+template <class T>
+struct ExpressionProfile<MatrixOperand<T> > : ExpressionProfile<Matrix<T> >
+{
+	static ProfiledOperation operation(const MatrixOperand<T>& operand)
+	{
+		return operand.colStride() != 1 ? ProfiledOperation::TRANSPOSE : ProfiledOperation::COPY;
+	}
+
+	static unsigned long long flops(const MatrixOperand<T>&)
+	{
+		return 0;
+	}
+};
+
+/**
+ * Sums and differences.
+ */
+template <class L, class R, class Op>
+struct ExpressionProfile<MatrixBinaryExpression<L, R, Op> > :
+	ExpressionProfile<Matrix<typename L::value_type> >
+{
+	static ProfiledOperation operation(const MatrixBinaryExpression<L, R, Op>&)
+	{
+		return std::is_same<Op, MatrixSubtraction>::value ? ProfiledOperation::SUBTRACT :
+			   ProfiledOperation::ADD;
+	}
+
+	static unsigned long long flops(const MatrixBinaryExpression<L, R, Op>& expr)
+	{
+		return (unsigned long long)expr.rows() * expr.cols() +
+			   ExpressionProfile<L>::flops(expr.left()) + ExpressionProfile<R>::flops(expr.right());
+	}
+};
+
+/**
+ * Products by a scalar.
+ */
+template <class E>
+struct ExpressionProfile<MatrixScaledExpression<E> > :
+	ExpressionProfile<Matrix<typename E::value_type> >
+{
+	static ProfiledOperation operation(const MatrixScaledExpression<E>&)
+	{
+		return ProfiledOperation::MULTIPLY;
+	}
+
+	static unsigned long long flops(const MatrixScaledExpression<E>& expr)
+	{
+		return (unsigned long long)expr.rows() * expr.cols() +
+			   ExpressionProfile<E>::flops(expr.operand());
+	}
+};
+
+/**
+ * Matrix products, added in place by the multiplication engine.
+ */
+template <class T>
+struct ExpressionProfile<MatrixProduct<T> >
+{
+	static ProfiledOperation operation(const MatrixProduct<T>&)
+	{
+		return ProfiledOperation::MULTIPLY;
+	}
+
+	static unsigned long long flops(const MatrixProduct<T>& product)
+	{
+		return product.flops();
+	}
+
+	static ProfiledOperation update(const MatrixProduct<T>&, bool)
+	{
+		return ProfiledOperation::MULTIPLY;
+	}
+
+	static unsigned long long updateFlops(const MatrixProduct<T>& product)
+	{
+		return product.flops();
+	}
+};
+
+// ------------------ Operators -------------------------
+/**
+ * + operator. Returns the expression of the sum of left and right.
+ * @param left The left expression
+ * @param right The right expression
+ * @return The sum expression
+ * @throws WrongDimensionsExceptions if the dimensions of left and right are not the same.
+ */
+template <class L, class R>
+MatrixBinaryExpression<typename ExpressionOperand<L>::type, typename ExpressionOperand<R>::type,
+					   MatrixAddition>
+operator+(const MatrixExpression<L>& left, const MatrixExpression<R>& right)
+{
+	return MatrixBinaryExpression<typename ExpressionOperand<L>::type,
+								  typename ExpressionOperand<R>::type, MatrixAddition>(
+		ExpressionOperand<L>::make(left.self()), ExpressionOperand<R>::make(right.self()));
+}
+
+/**
+ * - operator. Returns the expression of the difference of left and right.
+ * @param left The left expression
+ * @param right The right expression
+ * @return The difference expression
+ * @throws WrongDimensionsExceptions if the dimensions of left and right are not the same.
+ */
+template <class L, class R>
+MatrixBinaryExpression<typename ExpressionOperand<L>::type, typename ExpressionOperand<R>::type,
+					   MatrixSubtraction>
+operator-(const MatrixExpression<L>& left, const MatrixExpression<R>& right)
+{
+	return MatrixBinaryExpression<typename ExpressionOperand<L>::type,
+								  typename ExpressionOperand<R>::type, MatrixSubtraction>(
+		ExpressionOperand<L>::make(left.self()), ExpressionOperand<R>::make(right.self()));
+}
+
+/**
+ * * operator. Returns the expression of the product of left and right (according to matrices
+ * multiplication).
+ * @param left The left expression
+ * @param right The right expression
+ * @return The product expression
+ * @throws WrongDimensionsExceptions if number of columns of left is not equal to the number of
+ * 		   rows of right.
+ */
+template <class L, class R>
+MatrixProduct<typename L::value_type> operator*(const MatrixExpression<L>& left,
+												const MatrixExpression<R>& right)
+{
+	return MatrixProduct<typename L::value_type>(GemmOperand<L>::make(left.self()),
+												 GemmOperand<R>::make(right.self()));
+}
+
+/**
+ * Returns the expression of the product of left and right, computed with the given algorithm
+ * instead of the one set by Matrix<T>::setMultiplyAlgorithm.
+ * @param left The left expression
+ * @param right The right expression
+ * @param algorithm The algorithm
+ * @return The product expression
+ * @throws WrongDimensionsExceptions if number of columns of left is not equal to the number of
+ * 		   rows of right.
+ */
+template <class L, class R>
+MatrixProduct<typename L::value_type> multiply(const MatrixExpression<L>& left,
+											   const MatrixExpression<R>& right,
+											   MultiplyAlgorithm algorithm)
+{
+	return MatrixProduct<typename L::value_type>(GemmOperand<L>::make(left.self()),
+												 GemmOperand<R>::make(right.self()), algorithm);
+}
+
+/**
+ * * operator. Returns the expression of expr multiplied by a scalar.
+ * @param expr The expression
+ * @param scalar The scalar
+ * @return The scaled expression
+ */
+template <class E>
+MatrixScaledExpression<typename ExpressionOperand<E>::type>
+operator*(const MatrixExpression<E>& expr, const typename E::value_type& scalar)
+{
+	return MatrixScaledExpression<typename ExpressionOperand<E>::type>(
+		ExpressionOperand<E>::make(expr.self()), scalar);
+}
+
+/**
+ * * operator. Returns the expression of expr multiplied by a scalar.
+ * @param scalar The scalar
+ * @param expr The expression
+ * @return The scaled expression
+ */
+template <class E>
+MatrixScaledExpression<typename ExpressionOperand<E>::type>
+operator*(const typename E::value_type& scalar, const MatrixExpression<E>& expr)
+{
+	return expr * scalar;
+}
+
+/**
+ * << operator. Prints the value of an expression.
+ * @param os The ostream object
+ * @param expr The expression to print
+ * @return Reference to the ostream object.
+ */
+template <class E>
+std::ostream& operator<<(std::ostream& os, const MatrixExpression<E>& expr)
+{
+	return os << expr.eval();
+}
+
+#endif /* MATRIXEXPRESSION_H_ */
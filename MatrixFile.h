@@ -0,0 +1,293 @@
+// MatrixFile.h
+
+#ifndef MATRIXFILE_H_
+#define MATRIXFILE_H_
+
+// ------------------ Includes ------------------------------
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "MatrixExpression.h"
+#include "MatrixFileException.h"
+
+/**
+ * The binary file format of Matrix<T>::save(). A file is a MatrixFileHeader followed, at
+ * dataOffset bytes from its start, by the rows * cols cells stored row by row exactly as they are
+ * in memory. The cells start on a multiple of MatrixFile::ALIGNMENT bytes, so a mapped file can be
+ * read in place (see MappedMatrix<T>).
+ *
+ * The cells are not converted: a file is only read on a machine of the same byte order, and as a
+ * matrix of an element type of the same kind and size as the one it was saved from.
+ */
+
+/**
+ * The kinds of cells a matrix file can hold. With the size of a cell they identify the element
+ * type.
+ */
+enum class MatrixFileElementKind : std::uint32_t
+{
+	OTHER = 0, /**< Any other type */
+	SIGNED_INTEGER = 1, /**< Signed integers */
+	UNSIGNED_INTEGER = 2, /**< Unsigned integers and bool */
+	FLOATING_POINT = 3, /**< float, double and long double */
+	COMPLEX = 4 /**< Complex numbers */
+};
+
+/**
+ * The kind of the cells of a matrix of T. Element types that are not arithmetic specialize it.
+ */
+template <class T>
+struct MatrixFileElement
+{
+	static const MatrixFileElementKind KIND =
+		std::is_floating_point<T>::value ? MatrixFileElementKind::FLOATING_POINT :
+		!std::is_integral<T>::value ? MatrixFileElementKind::OTHER :
+		std::is_signed<T>::value ? MatrixFileElementKind::SIGNED_INTEGER :
+		MatrixFileElementKind::UNSIGNED_INTEGER;
+};
+
+/**
+ * The header at the start of a matrix file (64 bytes).
+ */
+struct MatrixFileHeader
+{
+	char magic[8]; /**< "MATRIX" followed by two zero bytes */
+	std::uint32_t version; /**< Version of the format */
+	std::uint32_t byteOrder; /**< MatrixFile::BYTE_ORDER_MARK as stored by the saver */
+	std::uint32_t elementKind; /**< MatrixFileElementKind of the cells */
+	std::uint32_t elementSize; /**< Size of a cell in bytes */
+	std::uint32_t alignment; /**< Alignment of the cells in the file, in bytes */
+	std::uint32_t flags; /**< Reserved for later versions, 0 */
+	std::uint64_t rows; /**< Number of rows */
+	std::uint64_t cols; /**< Number of columns */
+	std::uint64_t dataOffset; /**< Offset of the first cell from the start of the file */
+	std::uint64_t reserved; /**< Reserved for later versions, 0 */
+};
+
+/**
+ * This class creates and validates the headers of matrix files.
+ */
+class MatrixFile
+{
+public:
+	/**
+	 * The version of the format written by this code, and the newest one it reads.
+	 */
+	static const std::uint32_t VERSION = 1;
+
+	/**
+	 * Stored in native byte order, it reads differently on a machine of the other byte order.
+	 */
+	static const std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+	/**
+	 * Alignment of the cells in the files written by this code.
+	 */
+	static const std::uint32_t ALIGNMENT = 64;
+
+	/**
+	 * Creates the header of a file holding a rows X cols matrix of T.
+	 * @param rows Number of rows
+	 * @param cols Number of columns
+	 * @return The header.
+	 */
+	template <class T>
+	static MatrixFileHeader header(unsigned int rows, unsigned int cols)
+	{
+		MatrixFileHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+		header.version = VERSION;
+		header.byteOrder = BYTE_ORDER_MARK;
+		header.elementKind = (std::uint32_t)MatrixFileElement<T>::KIND;
+		header.elementSize = sizeof(T);
+		header.alignment = ALIGNMENT;
+		header.rows = rows;
+		header.cols = cols;
+		header.dataOffset = (sizeof(MatrixFileHeader) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+		return header;
+	}
+
+	/**
+	 * Checks that a header describes a matrix of T that fits in a file of the given size.
+	 * @param header The header
+	 * @param fileSize Size of the file in bytes
+	 * @throws MatrixFileException if it does not.
+	 */
+	template <class T>
+	static void check(const MatrixFileHeader& header, std::uint64_t fileSize)
+	{
+		if (std::memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 ||
+			header.version == 0 || header.version > VERSION ||
+			header.byteOrder != BYTE_ORDER_MARK ||
+			header.elementKind != (std::uint32_t)MatrixFileElement<T>::KIND ||
+			header.elementSize != sizeof(T) || header.flags != 0)
+		{
+			throw MatrixFileException();
+		}
+		if (header.rows > UINT_MAX || header.cols > UINT_MAX ||
+			(header.rows == 0) != (header.cols == 0))
+		{
+			throw MatrixFileException();
+		}
+		if (header.dataOffset < sizeof(MatrixFileHeader) || header.dataOffset > fileSize ||
+			header.dataOffset % std::alignment_of<T>::value != 0)
+		{
+			throw MatrixFileException();
+		}
+		std::uint64_t cells = (fileSize - header.dataOffset) / sizeof(T);
+		if (header.cols != 0 && header.rows > cells / header.cols)
+		{
+			throw MatrixFileException();
+		}
+	}
+
+private:
+	/**
+	 * The first bytes of every matrix file.
+	 */
+	static constexpr const char* MAGIC = "MATRIX\0";
+};
+
+/**
+ * This class maps a whole file in memory, read-only, and unmaps it when destroyed.
+ */
+class MatrixMapping
+{
+public:
+	/**
+	 * Maps a file.
+	 * @param path The path of the file
+	 * @throws MatrixFileException if the file cannot be opened or mapped.
+	 */
+	explicit MatrixMapping(const std::string& path) : _data(MAP_FAILED), _size(0)
+	{
+		int file = ::open(path.c_str(), O_RDONLY);
+		if (file < 0)
+		{
+			throw MatrixFileException();
+		}
+		struct stat status;
+		if (::fstat(file, &status) == 0 && status.st_size > 0)
+		{
+			_size = (std::size_t)status.st_size;
+			_data = ::mmap(nullptr, _size, PROT_READ, MAP_SHARED, file, 0);
+		}
+		::close(file);
+		if (_data == MAP_FAILED)
+		{
+			throw MatrixFileException();
+		}
+	}
+
+	/**
+	 * Destructor. Unmaps the file.
+	 */
+	~MatrixMapping()
+	{
+		::munmap(_data, _size);
+	}
+
+	/**
+	 * @return The first byte of the file.
+	 */
+	const char* data() const
+	{
+		return static_cast<const char*>(_data);
+	}
+
+	/**
+	 * @return The size of the file in bytes.
+	 */
+	std::size_t size() const
+	{
+		return _size;
+	}
+
+private:
+	MatrixMapping(const MatrixMapping&) = delete;
+	MatrixMapping& operator=(const MatrixMapping&) = delete;
+
+	// ------------------ Data members ----------------------
+	void* _data; /**< The mapped file */
+	std::size_t _size; /**< Size of the file in bytes */
+};
+
+/**
+ * This class represents a read-only matrix whose cells are read in place from a mapped matrix
+ * file, without copying them. It is an operand of expressions like any matrix:
+ *
+ *     MappedMatrix<double> weights = Matrix<double>::mapFile("weights.matrix");
+ *     Matrix<double> result = weights * input;
+ *
+ * The file stays mapped as long as the MappedMatrix<T>, a copy of it or an expression built from
+ * it exists. The pages are loaded by the system when they are first read.
+ */
+template <class T>
+class MappedMatrix : public MatrixOperand<T>
+{
+public:
+	/**
+	 * Maps a matrix file.
+	 * @param path The path of the file
+	 * @throws MatrixFileException if the file cannot be mapped or is not a matrix file of T.
+	 */
+	explicit MappedMatrix(const std::string& path) :
+		MappedMatrix(std::make_shared<const MatrixMapping>(path))
+	{
+	}
+
+private:
+	static_assert(std::is_trivially_copyable<T>::value,
+				  "Only matrices of trivially copyable cells can be mapped");
+
+	/**
+	 * Reads the header of a mapped matrix file.
+	 * @param mapping The mapped file
+	 * @throws MatrixFileException if the file is not a matrix file of T.
+	 */
+	explicit MappedMatrix(const std::shared_ptr<const MatrixMapping>& mapping) :
+		MappedMatrix(mapping, _header(*mapping))
+	{
+	}
+
+	/**
+	 * Reads the cells of a mapped matrix file in place.
+	 * @param mapping The mapped file
+	 * @param header The header of the file
+	 */
+	MappedMatrix(const std::shared_ptr<const MatrixMapping>& mapping,
+				 const MatrixFileHeader& header) :
+		MatrixOperand<T>(reinterpret_cast<const T*>(mapping->data() + header.dataOffset),
+						 (unsigned int)header.rows, (unsigned int)header.cols,
+						 (std::size_t)header.cols, 1, mapping)
+	{
+	}
+
+	/**
+	 * @param mapping The mapped file
+	 * @return The header of the file.
+	 * @throws MatrixFileException if the file is not a matrix file of T.
+	 */
+	static MatrixFileHeader _header(const MatrixMapping& mapping)
+	{
+		MatrixFileHeader header;
+		if (mapping.size() < sizeof(header))
+		{
+			throw MatrixFileException();
+		}
+		std::memcpy(&header, mapping.data(), sizeof(header));
+		MatrixFile::check<T>(header, mapping.size());
+		return header;
+	}
+};
+
+#endif /* MATRIXFILE_H_ */
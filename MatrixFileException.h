@@ -0,0 +1,25 @@
+// MatrixFileException.h
+
+#ifndef MATRIXFILEEXCEPTION_H_
+#define MATRIXFILEEXCEPTION_H_
+
+/**
+ * This class is an exception thrown by Matrix<T> when a matrix file cannot be read or written, or
+ * its header does not describe a matrix of T saved on a machine of the same byte order.
+ */
+class MatrixFileException : std::exception
+{
+public:
+
+	/**
+	 * @return Message informing the caller about the error causing this exception to be thrown.
+	 */
+	virtual const char* what()
+	{
+		return "The matrix file can't be accessed or doesn't match the matrix type.";
+	}
+
+private:
+};
+
+#endif /* MATRIXFILEEXCEPTION_H_ */
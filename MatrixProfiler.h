@@ -0,0 +1,632 @@
+// MatrixProfiler.h
+
+#ifndef MATRIXPROFILER_H_
+#define MATRIXPROFILER_H_
+
+// ------------------ Includes ------------------------------
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * How the evaluation of an expression E is recorded, specialized in MatrixExpression.h.
+ */
+template <class E>
+struct ExpressionProfile;
+
+/**
+ * The operations of Matrix<T> recorded by MatrixProfiler.
+ */
+enum class ProfiledOperation
+{
+	ADD, /**< Sums, m = a + b and m += a */
+	SUBTRACT, /**< Differences, m = a - b and m -= a */
+	MULTIPLY, /**< Products, by matrices and by scalars */
+	TRANSPOSE, /**< Transposed copies and in place transposes */
+	TRACE, /**< Traces */
+	COPY /**< Copies of matrices and views */
+};
+
+/**
+ * The statistics of one operation in a ProfileSnapshot.
+ */
+struct OperationStats
+{
+	/**
+	 * Number of buckets of the wall time histogram: bucket i counts the calls that took
+	 * [2^i, 2^(i+1)) nanoseconds, the last one the calls that took longer.
+	 */
+	static const unsigned int BUCKETS = 40;
+
+	unsigned long long calls; /**< Number of calls */
+	unsigned long long parallelCalls; /**< Calls that split work between the pool threads */
+	unsigned long long elements; /**< Cells of the results */
+	unsigned long long flops; /**< Arithmetic operations (multiply-adds for products) */
+	unsigned long long nanoseconds; /**< Total wall time */
+	unsigned long long allocatedBytes; /**< Bytes allocated for cells by the calling thread */
+	unsigned long long cycles; /**< CPU cycles of the calling thread (hardware counters) */
+	unsigned long long instructions; /**< Instructions of the calling thread */
+	unsigned long long cacheMisses; /**< Last level cache misses of the calling thread */
+	unsigned long long histogram[BUCKETS]; /**< Calls by wall time */
+};
+
+/**
+ * The statistics recorded by MatrixProfiler at a point in time.
+ */
+struct ProfileSnapshot
+{
+	/**
+	 * Number of recorded operations.
+	 */
+	static const unsigned int OPERATIONS = 6;
+
+	OperationStats operations[OPERATIONS]; /**< The statistics, indexed by ProfiledOperation */
+	unsigned long long allocatedBytes; /**< Bytes allocated for cells by all the threads */
+	unsigned long long allocations; /**< Number of buffers allocated for cells */
+	bool hardwareCounters; /**< Whether hardware counters were requested */
+
+	/**
+	 * @param operation An operation
+	 * @return The statistics of the operation.
+	 */
+	const OperationStats& operator[](ProfiledOperation operation) const
+	{
+		return operations[(unsigned int)operation];
+	}
+};
+
+/**
+ * This class records what the Matrix<T> layer does: for +, -, *, trans, trace and copies the
+ * number of calls, the cells and arithmetic operations computed, a histogram of their wall times,
+ * the bytes allocated for cells, and how many ran in parallel. On Linux it can also read the CPU
+ * cycles, instructions and cache misses of every call from the hardware counters
+ * (perf_event_open), when the kernel allows it.
+ *
+ * The recording is compiled in only when MATRIX_PROFILING is defined (-DMATRIX_PROFILING).
+ * Otherwise the hooks in the operations expand to nothing, and snapshot() reports zeros. Once
+ * compiled in, recording still has to be switched on with setEnabled(true), so a service can
+ * turn it on and off while running.
+ *
+ * Only the outermost operation of the calling thread is recorded: m = a * b records a product,
+ * not the copies it may make internally. Wall times, allocations and hardware counters are those
+ * of the calling thread (the pool threads are not included, which makes cycles and instructions
+ * smaller than the total work of parallel calls).
+ *
+ *     MatrixProfiler::setEnabled(true);
+ *     ...
+ *     ProfileSnapshot stats = MatrixProfiler::snapshot();
+ *     MatrixProfiler::dumpJson("matrix-profile.json");
+ */
+class MatrixProfiler
+{
+public:
+	// ------------------ Control ---------------------------
+	/**
+	 * Switches the recording on or off (it starts off).
+	 * @param enabled Whether operations are recorded
+	 */
+	static void setEnabled(bool enabled)
+	{
+		_state().enabled.store(enabled);
+	}
+
+	/**
+	 * @return Whether operations are recorded.
+	 */
+	static bool enabled()
+	{
+		return _state().enabled.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Switches the reading of hardware counters on or off (they start off). Each thread opens
+	 * its counters on its first recorded operation, and records none if it cannot.
+	 * @param enabled Whether hardware counters are read
+	 * @return Whether the counters could be opened on the calling thread.
+	 */
+	static bool setHardwareCounters(bool enabled)
+	{
+		_state().hardwareCounters.store(enabled);
+		return enabled && _counters().open();
+	}
+
+	/**
+	 * Sets all the statistics to zero. Operations running meanwhile may be partly lost.
+	 */
+	static void reset()
+	{
+		_State& state = _state();
+		for (unsigned int i = 0; i < ProfileSnapshot::OPERATIONS; i++)
+		{
+			_Stats& stats = state.operations[i];
+			_Stats::Counter* counters[] = {&stats.calls, &stats.parallelCalls, &stats.elements,
+										   &stats.flops, &stats.nanoseconds,
+										   &stats.allocatedBytes, &stats.cycles,
+										   &stats.instructions, &stats.cacheMisses};
+			for (std::size_t c = 0; c < sizeof(counters) / sizeof(counters[0]); c++)
+			{
+				counters[c]->store(0);
+			}
+			for (unsigned int b = 0; b < OperationStats::BUCKETS; b++)
+			{
+				stats.histogram[b].store(0);
+			}
+		}
+		state.allocatedBytes.store(0);
+		state.allocations.store(0);
+	}
+
+	// ------------------ Reports ---------------------------
+	/**
+	 * @return The statistics recorded since the start or the last reset().
+	 */
+	static ProfileSnapshot snapshot()
+	{
+		_State& state = _state();
+		ProfileSnapshot snapshot;
+		for (unsigned int i = 0; i < ProfileSnapshot::OPERATIONS; i++)
+		{
+			const _Stats& stats = state.operations[i];
+			OperationStats& copy = snapshot.operations[i];
+			copy.calls = stats.calls.load();
+			copy.parallelCalls = stats.parallelCalls.load();
+			copy.elements = stats.elements.load();
+			copy.flops = stats.flops.load();
+			copy.nanoseconds = stats.nanoseconds.load();
+			copy.allocatedBytes = stats.allocatedBytes.load();
+			copy.cycles = stats.cycles.load();
+			copy.instructions = stats.instructions.load();
+			copy.cacheMisses = stats.cacheMisses.load();
+			for (unsigned int b = 0; b < OperationStats::BUCKETS; b++)
+			{
+				copy.histogram[b] = stats.histogram[b].load();
+			}
+		}
+		snapshot.allocatedBytes = state.allocatedBytes.load();
+		snapshot.allocations = state.allocations.load();
+		snapshot.hardwareCounters = state.hardwareCounters.load();
+		return snapshot;
+	}
+
+	/**
+	 * @param operation An operation
+	 * @return The name of the operation in reports: add, subtract, multiply, transpose, trace or
+	 * 		   copy.
+	 */
+	static const char* name(ProfiledOperation operation)
+	{
+		static const char* const NAMES[] = {"add", "subtract", "multiply", "transpose", "trace",
+											"copy"};
+		return NAMES[(unsigned int)operation];
+	}
+
+	/**
+	 * Writes the current statistics as JSON, like the overload taking a snapshot.
+	 * @param out The stream
+	 */
+	static void writeJson(std::ostream& out)
+	{
+		writeJson(out, snapshot());
+	}
+
+	/**
+	 * Writes a snapshot as a JSON object: the allocation totals, and an "operations" array with
+	 * the statistics of every operation called at least once. The histogram lists the non-empty
+	 * buckets as [lower bound in nanoseconds, calls] pairs.
+	 * @param out The stream
+	 * @param snapshot The snapshot
+	 */
+	static void writeJson(std::ostream& out, const ProfileSnapshot& snapshot)
+	{
+		out << "{\n  \"hardware_counters\": " << (snapshot.hardwareCounters ? "true" : "false")
+			<< ",\n  \"allocated_bytes\": " << snapshot.allocatedBytes
+			<< ",\n  \"allocations\": " << snapshot.allocations << ",\n  \"operations\": [";
+		bool first = true;
+		for (unsigned int i = 0; i < ProfileSnapshot::OPERATIONS; i++)
+		{
+			const OperationStats& stats = snapshot.operations[i];
+			if (stats.calls == 0)
+			{
+				continue;
+			}
+			out << (first ? "\n" : ",\n") << std::setprecision(9)
+				<< "    {\"operation\": \"" << name((ProfiledOperation)i) << "\", \"calls\": "
+				<< stats.calls << ", \"parallel_calls\": " << stats.parallelCalls
+				<< ", \"elements\": " << stats.elements << ", \"flops\": " << stats.flops
+				<< ", \"seconds\": " << stats.nanoseconds * 1e-9
+				<< ", \"allocated_bytes\": " << stats.allocatedBytes;
+			if (snapshot.hardwareCounters)
+			{
+				out << ", \"cycles\": " << stats.cycles << ", \"instructions\": "
+					<< stats.instructions << ", \"cache_misses\": " << stats.cacheMisses
+					<< ", \"ipc\": "
+					<< (stats.cycles > 0 ? (double)stats.instructions / stats.cycles : 0.0);
+			}
+			out << ", \"histogram\": [";
+			bool firstBucket = true;
+			for (unsigned int b = 0; b < OperationStats::BUCKETS; b++)
+			{
+				if (stats.histogram[b] > 0)
+				{
+					out << (firstBucket ? "" : ", ") << "[" << (1ull << b) << ", "
+						<< stats.histogram[b] << "]";
+					firstBucket = false;
+				}
+			}
+			out << "]}";
+			first = false;
+		}
+		out << (first ? "]\n}\n" : "\n  ]\n}\n");
+	}
+
+	/**
+	 * Writes the current statistics as JSON (see writeJson()) to a file.
+	 * @param path The path of the file
+	 * @return true if the file was written, false otherwise.
+	 */
+	static bool dumpJson(const std::string& path)
+	{
+		std::ofstream file(path.c_str());
+		writeJson(file);
+		return (bool)file;
+	}
+
+	// ------------------ Hooks -----------------------------
+	/**
+	 * Records the choice of the execution policy in the operation running on the calling thread.
+	 * Called through MATRIX_PROFILE_PATH.
+	 * @param parallel Whether the work is split between the pool threads
+	 */
+	static void path(bool parallel)
+	{
+		_Scope* scope = _current();
+		if (scope != nullptr && parallel)
+		{
+			scope->parallel = true;
+		}
+	}
+
+	/**
+	 * Records a buffer allocated for cells. Called through MATRIX_PROFILE_ALLOCATION.
+	 * @param bytes Number of bytes
+	 */
+	static void allocated(std::size_t bytes)
+	{
+		if (!enabled())
+		{
+			return;
+		}
+		_State& state = _state();
+		state.allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+		state.allocations.fetch_add(1, std::memory_order_relaxed);
+		_Scope* scope = _current();
+		if (scope != nullptr)
+		{
+			scope->allocatedBytes += bytes;
+		}
+	}
+
+private:
+	/**
+	 * The hardware counters read: cycles, instructions and cache misses.
+	 */
+	static const unsigned int HARDWARE_COUNTERS = 3;
+
+	/**
+	 * The statistics of one operation, updated by all threads.
+	 */
+	struct _Stats
+	{
+		typedef std::atomic<unsigned long long> Counter;
+
+		Counter calls{0}; /**< Number of calls */
+		Counter parallelCalls{0}; /**< Calls that ran in parallel */
+		Counter elements{0}; /**< Cells of the results */
+		Counter flops{0}; /**< Arithmetic operations */
+		Counter nanoseconds{0}; /**< Total wall time */
+		Counter allocatedBytes{0}; /**< Bytes allocated by the calling thread */
+		Counter cycles{0}; /**< CPU cycles */
+		Counter instructions{0}; /**< Instructions */
+		Counter cacheMisses{0}; /**< Cache misses */
+		Counter histogram[OperationStats::BUCKETS] = {}; /**< Calls by wall time */
+	};
+
+	/**
+	 * The process-wide statistics and switches.
+	 */
+	struct _State
+	{
+		std::atomic<bool> enabled{false}; /**< Whether operations are recorded */
+		std::atomic<bool> hardwareCounters{false}; /**< Whether hardware counters are read */
+		_Stats operations[ProfileSnapshot::OPERATIONS]; /**< The statistics of each operation */
+		std::atomic<unsigned long long> allocatedBytes{0}; /**< Bytes allocated for cells */
+		std::atomic<unsigned long long> allocations{0}; /**< Buffers allocated for cells */
+	};
+
+	/**
+	 * The hardware counters of a thread, as a perf_event group opened on the first use.
+	 */
+	struct _Counters
+	{
+		int fds[HARDWARE_COUNTERS] = {-1, -1, -1}; /**< The counters, the first one leading */
+		bool tried = false; /**< Whether opening them was tried */
+
+		~_Counters()
+		{
+			close();
+		}
+
+		/**
+		 * Closes the counters that are open.
+		 */
+		void close()
+		{
+#ifdef __linux__
+			for (unsigned int i = 0; i < HARDWARE_COUNTERS; i++)
+			{
+				if (fds[i] >= 0)
+				{
+					::close(fds[i]);
+					fds[i] = -1;
+				}
+			}
+#endif
+		}
+
+		/**
+		 * @return Whether the counters are open, opening them on the first call.
+		 */
+		bool open()
+		{
+#ifdef __linux__
+			if (!tried)
+			{
+				tried = true;
+				static const unsigned long long EVENTS[] = {PERF_COUNT_HW_CPU_CYCLES,
+															PERF_COUNT_HW_INSTRUCTIONS,
+															PERF_COUNT_HW_CACHE_MISSES};
+				for (unsigned int i = 0; i < HARDWARE_COUNTERS; i++)
+				{
+					perf_event_attr attr;
+					std::memset(&attr, 0, sizeof(attr));
+					attr.size = sizeof(attr);
+					attr.type = PERF_TYPE_HARDWARE;
+					attr.config = EVENTS[i];
+					attr.read_format = PERF_FORMAT_GROUP;
+					attr.exclude_kernel = 1;
+					attr.exclude_hv = 1;
+					fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1,
+										  i == 0 ? -1 : fds[0], 0);
+					if (fds[i] < 0)
+					{
+						close();
+						break;
+					}
+				}
+			}
+			return fds[0] >= 0;
+#else
+			return false;
+#endif
+		}
+
+		/**
+		 * Reads the counters.
+		 * @param values Set to the values of the counters
+		 * @return true if they were read, false otherwise.
+		 */
+		bool read(unsigned long long values[HARDWARE_COUNTERS])
+		{
+#ifdef __linux__
+			unsigned long long group[HARDWARE_COUNTERS + 1];
+			if (!open() || ::read(fds[0], group, sizeof(group)) != (ssize_t)sizeof(group))
+			{
+				return false;
+			}
+			for (unsigned int i = 0; i < HARDWARE_COUNTERS; i++)
+			{
+				values[i] = group[i + 1];
+			}
+			return true;
+#else
+			(void)values;
+			return false;
+#endif
+		}
+	};
+
+	/**
+	 * The operation being recorded on a thread.
+	 */
+	struct _Scope
+	{
+		bool parallel; /**< Whether some of its work was split between the pool threads */
+		std::size_t allocatedBytes; /**< Bytes it allocated for cells */
+	};
+
+	/**
+	 * @return The process-wide statistics and switches.
+	 */
+	static _State& _state()
+	{
+		static _State state;
+		return state;
+	}
+
+	/**
+	 * @return The operation being recorded on the calling thread, nullptr if none.
+	 */
+	static _Scope*& _current()
+	{
+		static thread_local _Scope* scope = nullptr;
+		return scope;
+	}
+
+	/**
+	 * @return The hardware counters of the calling thread.
+	 */
+	static _Counters& _counters()
+	{
+		static thread_local _Counters counters;
+		return counters;
+	}
+
+	friend class ProfileScope;
+};
+
+/**
+ * Records one operation from its construction to its destruction, unless the recording is off or
+ * another operation is already recorded on the calling thread. Used through MATRIX_PROFILE.
+ */
+class ProfileScope
+{
+public:
+	/**
+	 * Starts recording an operation.
+	 * @param operation The operation
+	 * @param elements The number of cells of its result
+	 * @param flops Its number of arithmetic operations
+	 */
+	ProfileScope(ProfiledOperation operation, unsigned long long elements,
+				 unsigned long long flops) :
+		_operation(operation), _elements(elements), _flops(flops), _counted(false)
+	{
+		_start();
+	}
+
+	/**
+	 * Starts recording the evaluation of an expression into a matrix.
+	 * @param expr The expression
+	 */
+	template <class E>
+	explicit ProfileScope(const E& expr) :
+		_operation(ExpressionProfile<E>::operation(expr)),
+		_elements((unsigned long long)expr.rows() * expr.cols()),
+		_flops(ExpressionProfile<E>::flops(expr)), _counted(false)
+	{
+		_start();
+	}
+
+	/**
+	 * Starts recording the addition (or subtraction) of an expression to a matrix in place.
+	 * @param expr The expression
+	 * @param subtract Whether it is subtracted
+	 */
+	template <class E>
+	ProfileScope(const E& expr, bool subtract) :
+		_operation(ExpressionProfile<E>::update(expr, subtract)),
+		_elements((unsigned long long)expr.rows() * expr.cols()),
+		_flops(ExpressionProfile<E>::updateFlops(expr)), _counted(false)
+	{
+		_start();
+	}
+
+	/**
+	 * Adds the operation to the statistics.
+	 */
+	~ProfileScope()
+	{
+		if (!_active)
+		{
+			return;
+		}
+		std::chrono::steady_clock::duration time = std::chrono::steady_clock::now() - _startTime;
+		unsigned long long nanoseconds =
+			std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+		MatrixProfiler::_current() = nullptr;
+
+		MatrixProfiler::_Stats& stats =
+			MatrixProfiler::_state().operations[(unsigned int)_operation];
+		std::memory_order relaxed = std::memory_order_relaxed;
+		stats.calls.fetch_add(1, relaxed);
+		stats.parallelCalls.fetch_add(_scope.parallel ? 1 : 0, relaxed);
+		stats.elements.fetch_add(_elements, relaxed);
+		stats.flops.fetch_add(_flops, relaxed);
+		stats.nanoseconds.fetch_add(nanoseconds, relaxed);
+		stats.allocatedBytes.fetch_add(_scope.allocatedBytes, relaxed);
+		unsigned int bucket = 0;
+		while (bucket + 1 < OperationStats::BUCKETS && (nanoseconds >> (bucket + 1)) > 0)
+		{
+			bucket++;
+		}
+		stats.histogram[bucket].fetch_add(1, relaxed);
+
+		unsigned long long hardware[MatrixProfiler::HARDWARE_COUNTERS];
+		if (_counted && MatrixProfiler::_counters().read(hardware))
+		{
+			stats.cycles.fetch_add(hardware[0] - _hardware[0], relaxed);
+			stats.instructions.fetch_add(hardware[1] - _hardware[1], relaxed);
+			stats.cacheMisses.fetch_add(hardware[2] - _hardware[2], relaxed);
+		}
+	}
+
+private:
+	ProfiledOperation _operation; /**< The operation */
+	unsigned long long _elements; /**< The cells of its result */
+	unsigned long long _flops; /**< Its arithmetic operations */
+	bool _active; /**< Whether it is recorded */
+	bool _counted; /**< Whether the hardware counters were read at the start */
+	MatrixProfiler::_Scope _scope; /**< Its path and allocations */
+	std::chrono::steady_clock::time_point _startTime; /**< The start time */
+	unsigned long long _hardware[MatrixProfiler::HARDWARE_COUNTERS]; /**< Counters at the start */
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+	/**
+	 * Starts the recording if it is on and no other operation is recorded on the thread.
+	 */
+	void _start()
+	{
+		_active = MatrixProfiler::enabled() && MatrixProfiler::_current() == nullptr;
+		if (!_active)
+		{
+			return;
+		}
+		_scope.parallel = false;
+		_scope.allocatedBytes = 0;
+		MatrixProfiler::_current() = &_scope;
+		if (MatrixProfiler::_state().hardwareCounters.load(std::memory_order_relaxed))
+		{
+			_counted = MatrixProfiler::_counters().read(_hardware);
+		}
+		_startTime = std::chrono::steady_clock::now();
+	}
+};
+
+/**
+ * The hooks of the operations. Without MATRIX_PROFILING they expand to nothing and their
+ * arguments are not evaluated.
+ * - MATRIX_PROFILE(operation, elements, flops) records the enclosing block as an operation.
+ * - MATRIX_PROFILE_EXPRESSION(expr) records it as the evaluation of an expression into a matrix.
+ * - MATRIX_PROFILE_UPDATE(expr, subtract) records it as the addition (or subtraction) of an
+ *   expression to a matrix in place.
+ * - MATRIX_PROFILE_PATH(parallel) records a choice of the execution policy.
+ * - MATRIX_PROFILE_ALLOCATION(bytes) records a buffer allocated for cells.
+ */
+#ifdef MATRIX_PROFILING
+#define MATRIX_PROFILE(operation, elements, flops) \
+	ProfileScope matrixProfileScope_((operation), (elements), (flops))
+#define MATRIX_PROFILE_EXPRESSION(expr) ProfileScope matrixProfileScope_(expr)
+#define MATRIX_PROFILE_UPDATE(expr, subtract) ProfileScope matrixProfileScope_((expr), (subtract))
+#define MATRIX_PROFILE_PATH(parallel) MatrixProfiler::path(parallel)
+#define MATRIX_PROFILE_ALLOCATION(bytes) MatrixProfiler::allocated(bytes)
+#else
+#define MATRIX_PROFILE(operation, elements, flops) ((void)0)
+#define MATRIX_PROFILE_EXPRESSION(expr) ((void)0)
+#define MATRIX_PROFILE_UPDATE(expr, subtract) ((void)0)
+#define MATRIX_PROFILE_PATH(parallel) ((void)0)
+#define MATRIX_PROFILE_ALLOCATION(bytes) ((void)0)
+#endif
+
+#endif /* MATRIXPROFILER_H_ */
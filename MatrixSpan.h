@@ -0,0 +1,124 @@
+// MatrixSpan.h
+
+#ifndef MATRIXSPAN_H_
+#define MATRIXSPAN_H_
+
+// ------------------ Includes ------------------------------
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+/**
+ * This class represents a non-owning view of a contiguous run of cells, such as a row of a
+ * Matrix<T>. It stays valid as long as the cells it refers to are not reallocated.
+ */
+template <class T>
+class MatrixSpan
+{
+public:
+	typedef T value_type;
+	typedef T* iterator;
+
+	/**
+	 * Initiates an empty span.
+	 */
+	MatrixSpan() : _data(nullptr), _size(0)
+	{
+	}
+
+	/**
+	 * Initiates a span of size cells starting at data.
+	 * @param data The first cell
+	 * @param size Number of cells
+	 */
+	MatrixSpan(T* data, std::size_t size) : _data(data), _size(size)
+	{
+	}
+
+	/**
+	 * Initiates a span of the cells of a vector.
+	 * @param vector The vector, of cells convertible to T
+	 */
+	template <class U, class A,
+			  class = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	MatrixSpan(std::vector<U, A>& vector) : _data(vector.data()), _size(vector.size())
+	{
+	}
+
+	/**
+	 * Initiates a span of the cells of a const vector.
+	 * @param vector The vector, of cells convertible to T
+	 */
+	template <class U, class A,
+			  class = typename std::enable_if<std::is_convertible<const U*, T*>::value>::type>
+	MatrixSpan(const std::vector<U, A>& vector) : _data(vector.data()), _size(vector.size())
+	{
+	}
+
+	/**
+	 * Initiates a span of the cells of another span, such as a const span of a non-const one.
+	 * @param other The other span, of cells convertible to T
+	 */
+	template <class U,
+			  class = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	MatrixSpan(const MatrixSpan<U>& other) : _data(other.data()), _size(other.size())
+	{
+	}
+
+	/**
+	 * @return The first cell.
+	 */
+	T* data() const
+	{
+		return _data;
+	}
+
+	/**
+	 * @return The number of cells.
+	 */
+	std::size_t size() const
+	{
+		return _size;
+	}
+
+	/**
+	 * @return true if the span has no cells, false otherwise.
+	 */
+	bool empty() const
+	{
+		return _size == 0;
+	}
+
+	/**
+	 * [] operator. Returns the cell at the given index, without checking it.
+	 * @param index The cell index
+	 * @return The requested cell
+	 */
+	T& operator[](std::size_t index) const
+	{
+		return _data[index];
+	}
+
+	/**
+	 * @return iterator for the first cell.
+	 */
+	iterator begin() const
+	{
+		return _data;
+	}
+
+	/**
+	 * @return iterator for one after the last cell.
+	 */
+	iterator end() const
+	{
+		return _data + _size;
+	}
+
+private:
+	// ------------------ Data members ----------------------
+	T* _data; /**< The first cell */
+	std::size_t _size; /**< Number of cells */
+};
+
+#endif /* MATRIXSPAN_H_ */
@@ -0,0 +1,430 @@
+// MatrixStorage.h
+
+#ifndef MATRIXSTORAGE_H_
+#define MATRIXSTORAGE_H_
+
+// ------------------ Includes ------------------------------
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "MatrixAllocator.h"
+
+/**
+ * This class holds the copy-on-write cells of a Matrix<T, SharedAllocator<T, Base> >. The cells
+ * are in a buffer with an atomic count of its owners: copying only adds an owner, and a buffer
+ * with other owners is copied before it is written (detached), so the copies of a matrix cost
+ * nothing until one of them is changed.
+ *
+ * The non-const data() and [] operator are for writes by the operations of Matrix<T>, which hold
+ * no pointer to the cells afterwards. The accessors of Matrix<T> that give the caller a way to
+ * write the cells later (the non-const () operator, at(), data(), row() and views) use expose()
+ * instead, which also makes the buffer unshareable: the next copies of the matrix copy the cells,
+ * so that a write through an old reference cannot change them. The buffer becomes shareable again
+ * when the matrix gets another buffer, e.g. when another matrix is assigned to it. Like the cells
+ * of a std::vector, references to the cells are invalidated by assigning to the matrix.
+ *
+ * As for std::vector, a matrix may be copied by several threads at once, and its copies used by
+ * any thread, but a matrix must not be written while another thread reads it.
+ */
+template <class T, class Allocator>
+class SharedCells
+{
+public:
+	/**
+	 * Iterator over the cells.
+	 */
+	typedef typename std::vector<T, Allocator>::const_iterator const_iterator;
+
+	// ------------------ Constructors ----------------------
+	/**
+	 * Default constructor. No cells.
+	 */
+	SharedCells() : _buffer(_empty()), _shareable(true)
+	{
+		_buffer->owners.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Initiates size cells set to value.
+	 * @param size Number of cells
+	 * @param value The value of the cells
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	SharedCells(std::size_t size, const T& value) : _buffer(new _Buffer(size, value)),
+		_shareable(true)
+	{
+	}
+
+	/**
+	 * Copy constructor. Shares the buffer of other, or copies it if it is unshareable.
+	 * @param other The other cells
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	SharedCells(const SharedCells& other) : _buffer(other._share()), _shareable(true)
+	{
+	}
+
+	/**
+	 * Move constructor. Takes the buffer of other, leaving it without cells.
+	 * @param other The other cells
+	 */
+	SharedCells(SharedCells&& other) : SharedCells()
+	{
+		swap(other);
+	}
+
+	/**
+	 * Destructor. Releases the buffer, freed with its last owner.
+	 */
+	~SharedCells()
+	{
+		_release(_buffer);
+	}
+
+	// ------------------ Assignment ------------------------
+	/**
+	 * Shares the buffer of other, or copies it if it is unshareable.
+	 * @param other The other cells
+	 * @return reference to this
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	SharedCells& operator=(const SharedCells& other)
+	{
+		if (this != &other)
+		{
+			_replace(other._share());
+		}
+		return *this;
+	}
+
+	/**
+	 * Exchanges the buffers of this and other.
+	 * @param other The other cells
+	 * @return reference to this
+	 */
+	SharedCells& operator=(SharedCells&& other)
+	{
+		swap(other);
+		return *this;
+	}
+
+	/**
+	 * Takes the cells of a vector, without copying them.
+	 * @param cells The cells, left empty
+	 * @return reference to this
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	SharedCells& operator=(std::vector<T, Allocator>&& cells)
+	{
+		_replace(new _Buffer(std::move(cells)));
+		return *this;
+	}
+
+	/**
+	 * Replaces the cells by size cells set to value, in place if the buffer is not shared.
+	 * @param size Number of cells
+	 * @param value The value of the cells
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	void assign(std::size_t size, const T& value)
+	{
+		if (_unique())
+		{
+			_buffer->cells.assign(size, value);
+			return;
+		}
+		_replace(new _Buffer(size, value));
+	}
+
+	/**
+	 * Replaces the cells by those of a range, in place if the buffer is not shared.
+	 * @param first The first cell of the range
+	 * @param last One after the last cell of the range
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	template <class Iterator>
+	void assign(Iterator first, Iterator last)
+	{
+		if (_unique())
+		{
+			_buffer->cells.assign(first, last);
+			return;
+		}
+		_replace(new _Buffer(first, last));
+	}
+
+	/**
+	 * Changes the number of cells, keeping those that fit.
+	 * @param size Number of cells
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	void resize(std::size_t size)
+	{
+		_detach();
+		_buffer->cells.resize(size);
+	}
+
+	/**
+	 * Exchanges the buffers of this and other.
+	 * @param other The other cells
+	 */
+	void swap(SharedCells& other)
+	{
+		std::swap(_buffer, other._buffer);
+		std::swap(_shareable, other._shareable);
+	}
+
+	// ------------------ Access ----------------------------
+	/**
+	 * @return Whether other cells share the buffer, so that writing it would copy it first.
+	 */
+	bool shared() const
+	{
+		return !_unique();
+	}
+
+	/**
+	 * @return The number of cells.
+	 */
+	std::size_t size() const
+	{
+		return _buffer->cells.size();
+	}
+
+	/**
+	 * @return The first cell, for reading.
+	 */
+	const T* data() const
+	{
+		return _buffer->cells.data();
+	}
+
+	/**
+	 * @return The first cell, for writing now. The buffer is detached first if it is shared.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	T* data()
+	{
+		_detach();
+		return _buffer->cells.data();
+	}
+
+	/**
+	 * @param index The cell number
+	 * @return The cell, for reading.
+	 */
+	const T& operator[](std::size_t index) const
+	{
+		return _buffer->cells[index];
+	}
+
+	/**
+	 * @param index The cell number
+	 * @return The cell, for writing now. The buffer is detached first if it is shared.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	T& operator[](std::size_t index)
+	{
+		_detach();
+		return _buffer->cells[index];
+	}
+
+	/**
+	 * Detaches the buffer if it is shared and makes it unshareable, so that the cells can be
+	 * written through the returned pointer at any later time.
+	 * @return The first cell.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	T* expose()
+	{
+		_detach();
+		_shareable = false;
+		return _buffer->cells.data();
+	}
+
+	/**
+	 * @return iterator for the first cell.
+	 */
+	const_iterator begin() const
+	{
+		return _buffer->cells.cbegin();
+	}
+
+	/**
+	 * @return iterator for one after the last cell.
+	 */
+	const_iterator end() const
+	{
+		return _buffer->cells.cend();
+	}
+
+	/**
+	 * @return iterator for the first cell.
+	 */
+	const_iterator cbegin() const
+	{
+		return begin();
+	}
+
+	/**
+	 * @return iterator for one after the last cell.
+	 */
+	const_iterator cend() const
+	{
+		return end();
+	}
+
+	/**
+	 * == operator. Cells sharing a buffer are equal without being compared.
+	 * @param other The other cells
+	 * @return true if the cells of this and other are equal, false otherwise.
+	 */
+	bool operator==(const SharedCells& other) const
+	{
+		return _buffer == other._buffer || _buffer->cells == other._buffer->cells;
+	}
+
+private:
+	/**
+	 * A buffer of cells and the number of its owners.
+	 */
+	struct _Buffer
+	{
+		_Buffer() : owners(1)
+		{
+		}
+
+		_Buffer(std::size_t size, const T& value) : owners(1), cells(size, value)
+		{
+		}
+
+		explicit _Buffer(const std::vector<T, Allocator>& other) : owners(1), cells(other)
+		{
+		}
+
+		explicit _Buffer(std::vector<T, Allocator>&& other) : owners(1), cells(std::move(other))
+		{
+		}
+
+		template <class Iterator>
+		_Buffer(Iterator first, Iterator last) : owners(1), cells(first, last)
+		{
+		}
+
+		std::atomic<std::size_t> owners; /**< Number of SharedCells holding the buffer */
+		std::vector<T, Allocator> cells; /**< The cells */
+	};
+
+	// ------------------ Data members ----------------------
+	_Buffer* _buffer; /**< The buffer */
+	bool _shareable; /**< Whether the buffer may be shared by copies (see expose()) */
+
+	// ------------------ Private functions -----------------
+	/**
+	 * @return The empty buffer shared by all the cells without a buffer of their own. It is never
+	 * 		   freed, and never written since it always has another owner.
+	 */
+	static _Buffer* _empty()
+	{
+		static _Buffer* empty = new _Buffer();
+		return empty;
+	}
+
+	/**
+	 * @return Whether this is the only owner of the buffer. The acquire load orders the writes
+	 * 		   that follow after the reads of the owners that released it.
+	 */
+	bool _unique() const
+	{
+		return _buffer->owners.load(std::memory_order_acquire) == 1;
+	}
+
+	/**
+	 * @return The buffer with one more owner, or a copy of it if it is unshareable.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	_Buffer* _share() const
+	{
+		if (!_shareable)
+		{
+			return new _Buffer(_buffer->cells);
+		}
+		_buffer->owners.fetch_add(1, std::memory_order_relaxed);
+		return _buffer;
+	}
+
+	/**
+	 * Copies the buffer if it has other owners.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	void _detach()
+	{
+		if (!_unique())
+		{
+			_replace(new _Buffer(_buffer->cells));
+		}
+	}
+
+	/**
+	 * Releases the buffer and takes another one, shareable.
+	 * @param buffer The other buffer, already counting this as an owner
+	 */
+	void _replace(_Buffer* buffer)
+	{
+		_release(_buffer);
+		_buffer = buffer;
+		_shareable = true;
+	}
+
+	/**
+	 * Removes an owner of a buffer, and frees it if that was the last one.
+	 * @param buffer The buffer
+	 */
+	static void _release(_Buffer* buffer)
+	{
+		if (buffer->owners.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			delete buffer;
+		}
+	}
+};
+
+/**
+ * The container the cells of Matrix<T, Allocator> are stored in: a std::vector<T, Allocator>, or
+ * SharedCells for SharedAllocator. expose() gives the cells to accessors that let the caller write
+ * them later (see SharedCells::expose()), and shared() tells whether they are shared with copies.
+ */
+template <class T, class Allocator>
+struct MatrixStorage
+{
+	typedef std::vector<T, Allocator> type;
+
+	static T* expose(type& cells)
+	{
+		return cells.data();
+	}
+
+	static bool shared(const type&)
+	{
+		return false;
+	}
+};
+
+template <class T, class Base>
+struct MatrixStorage<T, SharedAllocator<T, Base> >
+{
+	typedef SharedCells<T, SharedAllocator<T, Base> > type;
+
+	static T* expose(type& cells)
+	{
+		return cells.expose();
+	}
+
+	static bool shared(const type& cells)
+	{
+		return cells.shared();
+	}
+};
+
+#endif /* MATRIXSTORAGE_H_ */
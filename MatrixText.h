@@ -0,0 +1,549 @@
+// MatrixText.h
+
+#ifndef MATRIXTEXT_H_
+#define MATRIXTEXT_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#if __cplusplus >= 201703L
+#include <charconv>
+#endif
+#include "ThreadPool.h"
+#include "ExecutionPolicy.h"
+
+/**
+ * How floating point cells are written, taken from the flags and the precision of the stream.
+ * TextFormat only follows the precision and the notation (fixed, scientific or general) of the
+ * stream, so the other flags must be checked with supports() first.
+ */
+struct TextStyle
+{
+	int precision; /**< The precision of the stream */
+	char conversion; /**< 'f' (std::fixed), 'e' (std::scientific) or 'g' */
+
+	/**
+	 * @param os The stream
+	 * @return The style of the stream.
+	 */
+	static TextStyle of(const std::ios_base& os)
+	{
+		std::ios_base::fmtflags floatField = os.flags() & std::ios_base::floatfield;
+		TextStyle style;
+		style.precision = (int)std::max(os.precision(), (std::streamsize)0);
+		style.conversion = floatField == std::ios_base::fixed ? 'f' :
+						   floatField == std::ios_base::scientific ? 'e' : 'g';
+		return style;
+	}
+
+	/**
+	 * @param os The stream
+	 * @return Whether TextFormat writes numbers as the stream would: the stream uses the
+	 * 		   decimal base, no hexadecimal floats, no showbase, showpoint, showpos or uppercase,
+	 * 		   no field width and the classic locale.
+	 */
+	static bool supports(const std::ios_base& os)
+	{
+		const std::ios_base::fmtflags ignored = std::ios_base::showbase |
+			std::ios_base::showpoint | std::ios_base::showpos | std::ios_base::uppercase;
+		std::ios_base::fmtflags base = os.flags() & std::ios_base::basefield;
+		std::ios_base::fmtflags floatField = os.flags() & std::ios_base::floatfield;
+		return (os.flags() & ignored) == 0 && (base == std::ios_base::dec || base == 0) &&
+			   floatField != std::ios_base::floatfield && os.width() == 0 &&
+			   os.getloc() == std::locale::classic();
+	}
+};
+
+/**
+ * Conversion of cells to and from text for MatrixText<T>. Numbers (wider than a char) are
+ * converted directly in memory buffers, like std::to_chars and std::from_chars, which are used
+ * for floating point numbers when compiled as C++17. Other element types specialize it (see
+ * Complex in Matrix.hpp) or, when FAST is false, are converted with their iostream operators.
+ */
+template <class T, bool = std::is_arithmetic<T>::value && (sizeof(T) > 1)>
+struct TextFormat
+{
+	static const bool FAST = false;
+};
+
+template <class T>
+struct TextFormat<T, true>
+{
+	static const bool FAST = true;
+
+	/**
+	 * @param style The style
+	 * @return The largest number of characters format() writes.
+	 */
+	static std::size_t maxLength(const TextStyle& style)
+	{
+		return std::is_integral<T>::value ? 24 :
+			   std::numeric_limits<T>::max_exponent10 + style.precision + 16;
+	}
+
+	/**
+	 * Writes a cell.
+	 * @param out Where to write, with room for maxLength(style) characters
+	 * @param value The cell
+	 * @param style The style
+	 * @return One after the last character written.
+	 */
+	static char* format(char* out, T value, const TextStyle& style)
+	{
+		return _format(out, value, style, std::is_integral<T>());
+	}
+
+	/**
+	 * Reads a cell. The text must not start with a white space.
+	 * @param first The first character
+	 * @param last One after the last character
+	 * @param value The cell read
+	 * @return One after the last character of the cell, or nullptr if there is no valid cell.
+	 */
+	static const char* parse(const char* first, const char* last, T& value)
+	{
+		return _parse(first, last, value, std::is_integral<T>());
+	}
+
+private:
+	/**
+	 * @return Whether value is negative (for signed integers).
+	 */
+	static bool _negative(T value, std::true_type)
+	{
+		return value < 0;
+	}
+
+	/**
+	 * @return false (for unsigned integers).
+	 */
+	static bool _negative(T, std::false_type)
+	{
+		return false;
+	}
+
+	/**
+	 * Writes an integer in decimal.
+	 */
+	static char* _format(char* out, T value, const TextStyle&, std::true_type)
+	{
+		typedef typename std::make_unsigned<T>::type Unsigned;
+		char digits[24];
+		char* first = digits + sizeof(digits);
+		bool negative = _negative(value, std::is_signed<T>());
+		Unsigned magnitude = negative ? Unsigned(0) - Unsigned(value) : Unsigned(value);
+		do
+		{
+			*--first = (char)('0' + magnitude % 10);
+			magnitude /= 10;
+		} while (magnitude != 0);
+		if (negative)
+		{
+			*out++ = '-';
+		}
+		return std::copy(first, digits + sizeof(digits), out);
+	}
+
+	/**
+	 * Writes a floating point number like printf with the conversion and precision of style.
+	 */
+	static char* _format(char* out, T value, const TextStyle& style, std::false_type)
+	{
+#if __cplusplus >= 201703L
+		std::chars_format format = style.conversion == 'f' ? std::chars_format::fixed :
+								   style.conversion == 'e' ? std::chars_format::scientific :
+								   std::chars_format::general;
+		return std::to_chars(out, out + maxLength(style), value, format, style.precision).ptr;
+#else
+		char spec[] = "%.*Lg";
+		spec[4] = style.conversion;
+		if (!std::is_same<T, long double>::value)
+		{
+			spec[3] = style.conversion;
+			spec[4] = '\0';
+		}
+		int length = std::snprintf(out, maxLength(style), spec, style.precision,
+								   _promote(value));
+		return out + std::max(length, 0);
+#endif
+	}
+
+#if __cplusplus < 201703L
+	/**
+	 * @return value as given to snprintf for %g (float and double).
+	 */
+	static double _promote(double value)
+	{
+		return value;
+	}
+
+	/**
+	 * @return value as given to snprintf for %Lg (long double).
+	 */
+	static long double _promote(long double value)
+	{
+		return value;
+	}
+
+	/**
+	 * Converts the float at the start of text. The text must be followed by a character that is
+	 * not part of a number.
+	 */
+	static float _convert(const char* text, char** end, float)
+	{
+		return std::strtof(text, end);
+	}
+
+	/**
+	 * Converts the double at the start of text.
+	 */
+	static double _convert(const char* text, char** end, double)
+	{
+		return std::strtod(text, end);
+	}
+
+	/**
+	 * Converts the long double at the start of text.
+	 */
+	static long double _convert(const char* text, char** end, long double)
+	{
+		return std::strtold(text, end);
+	}
+#endif
+
+	/**
+	 * Reads a decimal integer with an optional sign.
+	 */
+	static const char* _parse(const char* first, const char* last, T& value, std::true_type)
+	{
+		bool negative = false;
+		if (first != last && (*first == '+' || *first == '-'))
+		{
+			negative = *first == '-';
+			first++;
+		}
+		const char* digits = first;
+		unsigned long long magnitude = 0;
+		const unsigned long long maxValue = std::numeric_limits<unsigned long long>::max();
+		for (; first != last && *first >= '0' && *first <= '9'; first++)
+		{
+			unsigned int digit = (unsigned int)(*first - '0');
+			if (magnitude > (maxValue - digit) / 10)
+			{
+				return nullptr;
+			}
+			magnitude = magnitude * 10 + digit;
+		}
+		if (first == digits)
+		{
+			return nullptr;
+		}
+		unsigned long long maxMagnitude = (unsigned long long)std::numeric_limits<T>::max();
+		if (negative)
+		{
+			maxMagnitude = std::is_signed<T>::value ? maxMagnitude + 1 : 0;
+		}
+		if (magnitude > maxMagnitude)
+		{
+			return nullptr;
+		}
+		value = negative ? (T)(0 - magnitude) : (T)magnitude;
+		return first;
+	}
+
+	/**
+	 * Reads a floating point number.
+	 */
+	static const char* _parse(const char* first, const char* last, T& value, std::false_type)
+	{
+		if (first != last && *first == '+')
+		{
+			first++;
+		}
+#if __cplusplus >= 201703L
+		std::from_chars_result result = std::from_chars(first, last, value);
+		return result.ec == std::errc() ? result.ptr : nullptr;
+#else
+		char* end;
+		errno = 0;
+		T read = _convert(first, &end, value);
+		if (end == first || end > last || (errno == ERANGE && std::fabs(read) > 1))
+		{
+			return nullptr;
+		}
+		value = read;
+		return end;
+#endif
+	}
+};
+
+/**
+ * This class reads and writes the cells of matrices as text: one line per row, every cell
+ * followed by a tab. Cells are formatted into a buffer owned by the calling thread, which is
+ * handed to the stream in large blocks and never flushed. Reading gathers the lines of the matrix
+ * and parses them in place, splitting the rows between the pool threads when the text is large
+ * enough for the execution policy.
+ */
+template <class T>
+class MatrixText
+{
+public:
+	/**
+	 * Writes cells as text, as their << operator would with the flags of the stream. Cells are
+	 * formatted with TextFormat<T> when the stream only sets the precision and the notation of
+	 * floating point numbers (see TextStyle::supports()), and with their << operator otherwise.
+	 * @param os The stream
+	 * @param cells The first cell, followed by the others row by row
+	 * @param rows Number of rows
+	 * @param cols Number of columns
+	 */
+	static void write(std::ostream& os, const T* cells, unsigned int rows, unsigned int cols)
+	{
+		if (TextFormat<T>::FAST && !TextStyle::supports(os))
+		{
+			_write(os, cells, rows, cols, std::false_type());
+			return;
+		}
+		_write(os, cells, rows, cols, std::integral_constant<bool, TextFormat<T>::FAST>());
+	}
+
+	/**
+	 * Reads cells written by write(). Empty lines before the first row are skipped, and the rows
+	 * end at the first empty line (which is consumed) or at the end of the stream.
+	 * @param is The stream
+	 * @param rows Number of rows read
+	 * @param cols Number of columns read
+	 * @param cells The cells read, row by row
+	 * @return true if a matrix was read, false if the stream has no rows, the rows have different
+	 * 		   lengths or a cell is not valid.
+	 */
+	template <class Allocator>
+	static bool read(std::istream& is, unsigned int& rows, unsigned int& cols,
+					 std::vector<T, Allocator>& cells)
+	{
+		std::string text;
+		std::vector<std::size_t> lines;
+		std::string line;
+		while (std::getline(is, line))
+		{
+			if (_blank(line.data(), line.data() + line.size()))
+			{
+				if (lines.empty())
+				{
+					continue;
+				}
+				break;
+			}
+			lines.push_back(text.size());
+			text += line;
+			text += '\n';
+		}
+		if (lines.empty())
+		{
+			return false;
+		}
+		is.clear(is.rdstate() & ~std::ios_base::failbit);
+		lines.push_back(text.size());
+		return parse(text, lines, rows, cols, cells);
+	}
+
+	/**
+	 * Parses the cells of text.
+	 * @param text The lines of the matrix, each ended by a new line
+	 * @param lines Offsets of the first character of every line in text, followed by the size of
+	 * 		   text
+	 * @param rows Number of rows read
+	 * @param cols Number of columns read
+	 * @param cells The cells read, row by row
+	 * @return true if the text is valid, false otherwise.
+	 */
+	template <class Allocator>
+	static bool parse(const std::string& text, const std::vector<std::size_t>& lines,
+					  unsigned int& rows, unsigned int& cols, std::vector<T, Allocator>& cells)
+	{
+		rows = (unsigned int)(lines.size() - 1);
+		cols = _countCells(text.data() + lines[0], text.data() + lines[1]);
+		cells.assign((std::size_t)rows * cols, T());
+		std::atomic<bool> valid(true);
+		auto parseRows = [&](unsigned int rowBegin, unsigned int rowEnd)
+		{
+			for (unsigned int i = rowBegin;
+				 i < rowEnd && valid.load(std::memory_order_relaxed); i++)
+			{
+				if (!_parseRow(text.data() + lines[i], text.data() + lines[i + 1],
+							   cells.data() + (std::size_t)i * cols, cols,
+							   std::integral_constant<bool, TextFormat<T>::FAST>()))
+				{
+					valid.store(false, std::memory_order_relaxed);
+				}
+			}
+		};
+		if (TextFormat<T>::FAST && ExecutionPolicy::parallel(Operation::ELEMENTWISE, text.size()))
+		{
+			unsigned int grain = (unsigned int)std::max<std::size_t>(
+				1, MIN_CHUNK_SIZE * rows / std::max<std::size_t>(text.size(), 1));
+			ThreadPool::instance().parallelFor(0, rows, grain, parseRows);
+		}
+		else
+		{
+			parseRows(0, rows);
+		}
+		return valid.load();
+	}
+
+private:
+	/**
+	 * Size of the blocks handed to the stream, and the smallest amount of text parsed by a task.
+	 */
+	static const std::size_t BUFFER_SIZE = 1 << 18;
+	static const std::size_t MIN_CHUNK_SIZE = 1 << 16;
+
+	/**
+	 * @param c A character
+	 * @return Whether c separates cells.
+	 */
+	static bool _space(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+	}
+
+	/**
+	 * @param first The first character
+	 * @param last One after the last character
+	 * @return Whether the characters are all white spaces.
+	 */
+	static bool _blank(const char* first, const char* last)
+	{
+		return std::find_if(first, last, [](char c) { return !_space(c); }) == last;
+	}
+
+	/**
+	 * @param first The first character of a line
+	 * @param last One after the last character of the line
+	 * @return The number of cells (runs of characters that are not white spaces) of the line.
+	 */
+	static unsigned int _countCells(const char* first, const char* last)
+	{
+		unsigned int count = 0;
+		bool inCell = false;
+		for (; first != last; first++)
+		{
+			bool space = _space(*first);
+			count += (!space && !inCell) ? 1 : 0;
+			inCell = !space;
+		}
+		return count;
+	}
+
+	/**
+	 * Writes cells with TextFormat<T>.
+	 */
+	static void _write(std::ostream& os, const T* cells, unsigned int rows, unsigned int cols,
+					   std::true_type)
+	{
+		static thread_local std::vector<char> buffer(BUFFER_SIZE);
+		TextStyle style = TextStyle::of(os);
+		std::size_t maxLength = TextFormat<T>::maxLength(style) + 2;
+		if (buffer.size() < 2 * maxLength)
+		{
+			buffer.resize(2 * maxLength);
+		}
+		char* out = buffer.data();
+		char* limit = buffer.data() + buffer.size() - maxLength;
+		for (unsigned int i = 0; i < rows; i++)
+		{
+			const T* row = cells + (std::size_t)i * cols;
+			for (unsigned int j = 0; j < cols; j++)
+			{
+				if (out > limit)
+				{
+					os.write(buffer.data(), out - buffer.data());
+					out = buffer.data();
+				}
+				out = TextFormat<T>::format(out, row[j], style);
+				*out++ = '\t';
+			}
+			*out++ = '\n';
+		}
+		os.write(buffer.data(), out - buffer.data());
+	}
+
+	/**
+	 * Writes cells with their << operator.
+	 */
+	static void _write(std::ostream& os, const T* cells, unsigned int rows, unsigned int cols,
+					   std::false_type)
+	{
+		for (unsigned int i = 0; i < rows; i++)
+		{
+			for (unsigned int j = 0; j < cols; j++)
+			{
+				os << cells[(std::size_t)i * cols + j] << '\t';
+			}
+			os << '\n';
+		}
+	}
+
+	/**
+	 * Parses a row with TextFormat<T>.
+	 * @param first The first character of the line
+	 * @param last One after the last character of the line
+	 * @param out The cells of the row
+	 * @param cols Number of cells expected
+	 * @return true if the line holds cols valid cells, false otherwise.
+	 */
+	static bool _parseRow(const char* first, const char* last, T* out, unsigned int cols,
+						  std::true_type)
+	{
+		for (unsigned int j = 0; j < cols; j++)
+		{
+			while (first != last && _space(*first))
+			{
+				first++;
+			}
+			first = first == last ? nullptr : TextFormat<T>::parse(first, last, out[j]);
+			if (first == nullptr || (first != last && !_space(*first)))
+			{
+				return false;
+			}
+		}
+		return _blank(first, last);
+	}
+
+	/**
+	 * Parses a row with the >> operator of T.
+	 */
+	static bool _parseRow(const char* first, const char* last, T* out, unsigned int cols,
+						  std::false_type)
+	{
+		std::istringstream row(std::string(first, last));
+		for (unsigned int j = 0; j < cols; j++)
+		{
+			if (!(row >> out[j]))
+			{
+				return false;
+			}
+		}
+		return (row >> std::ws).eof();
+	}
+};
+
+template <class T>
+const std::size_t MatrixText<T>::BUFFER_SIZE;
+
+template <class T>
+const std::size_t MatrixText<T>::MIN_CHUNK_SIZE;
+
+#endif /* MATRIXTEXT_H_ */
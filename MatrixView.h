@@ -0,0 +1,670 @@
+// MatrixView.h
+
+#ifndef MATRIXVIEW_H_
+#define MATRIXVIEW_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include "ThreadPool.h"
+#include "Gemm.h"
+#include "ElementKernels.h"
+#include "Transpose.h"
+#include "ExecutionPolicy.h"
+#include "MatrixExpression.h"
+#include "MatrixSpan.h"
+#include "WrongDimensionsException.h"
+#include "NoSquareException.h"
+#include "OutOfMatrixException.h"
+
+/**
+ * This class represents a rectangular block of the cells of a matrix, without owning them: rows X
+ * cols cells starting at data, each row ld cells after the previous one (ld is the number of
+ * columns of the matrix the block was taken from). MatrixView<const T> is a read-only view.
+ *
+ * A view is a matrix expression, so it is an operand of +, -, * and trans() like a Matrix<T>, read
+ * in place (a product of views runs the multiplication engine on the cells of the viewed
+ * matrices), and it can be assigned to a Matrix<T>. The results of expressions can be written
+ * into a view with =, += and -=, which compute them directly into the cells of the viewed matrix:
+ * C.view(0, 0, n, n) += A.view(0, k, n, k) * B.view(k, 0, k, n) updates a block of C without
+ * copying any block. Assigning one view to another copies the cells; copying a view object does
+ * not.
+ *
+ * A view stays valid as long as the cells it refers to are not reallocated. When the value
+ * written into a view may read cells of the view in any other order than row by row in place,
+ * it is evaluated into a temporary matrix first.
+ */
+template <class T>
+class MatrixView : public MatrixExpression<MatrixView<T> >
+{
+public:
+	/**
+	 * The type of the cells.
+	 */
+	typedef typename std::remove_const<T>::type value_type;
+
+	// ------------------ Constructors ----------------------
+	/**
+	 * Initiates the view with the given layout.
+	 * @param data The first cell
+	 * @param rows Number of rows
+	 * @param cols Number of columns
+	 * @param ld Distance between two consecutive rows
+	 */
+	MatrixView(T* data, unsigned int rows, unsigned int cols, std::size_t ld) :
+		_data(data), _rows(rows), _cols(cols), _ld(ld)
+	{
+	}
+
+	/**
+	 * Initiates a view of all the cells of a matrix.
+	 * @param matrix The matrix
+	 */
+	template <class U, class A,
+			  class = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	MatrixView(Matrix<U, A>& matrix) : _data(matrix.data()), _rows(matrix.rows()),
+									   _cols(matrix.cols()), _ld(matrix.cols())
+	{
+	}
+
+	/**
+	 * Initiates a read-only view of all the cells of a matrix.
+	 * @param matrix The matrix
+	 */
+	template <class U, class A,
+			  class = typename std::enable_if<std::is_convertible<const U*, T*>::value>::type>
+	MatrixView(const Matrix<U, A>& matrix) : _data(matrix.data()), _rows(matrix.rows()),
+											 _cols(matrix.cols()), _ld(matrix.cols())
+	{
+	}
+
+	/**
+	 * Initiates a view of the cells of another view, such as a read-only view of a view.
+	 * @param other The other view
+	 */
+	template <class U,
+			  class = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	MatrixView(const MatrixView<U>& other) : _data(other.data()), _rows(other.rows()),
+											 _cols(other.cols()), _ld(other.ld())
+	{
+	}
+
+	/**
+	 * Copy Constructor. Refers to the same cells as other.
+	 * @param other The other view
+	 */
+	MatrixView(const MatrixView<T>& other) = default;
+
+	// ------------ Operators and Operations ----------------
+	/**
+	 * = operator. Copies the cells of other into the cells of this.
+	 * @param other The other view
+	 * @return reference to this
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the dimensions of this and other are not the same.
+	 */
+	MatrixView<T>& operator=(const MatrixView<T>& other)
+	{
+		static_assert(!std::is_const<T>::value, "A read-only view cannot be assigned");
+		MATRIX_PROFILE_EXPRESSION(other);
+		_assign(other);
+		return *this;
+	}
+
+	/**
+	 * = operator. Writes the value of an expression into the cells of this.
+	 * @param expr The expression
+	 * @return reference to this
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the dimensions of this and expr are not the same.
+	 */
+	template <class E>
+	MatrixView<T>& operator=(const MatrixExpression<E>& expr)
+	{
+		static_assert(!std::is_const<T>::value, "A read-only view cannot be assigned");
+		MATRIX_PROFILE_EXPRESSION(expr.self());
+		_assign(expr.self());
+		return *this;
+	}
+
+	/**
+	 * += operator. Adds the value of an expression to the cells of this.
+	 * @param expr The expression
+	 * @return reference to this
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the dimensions of this and expr are not the same.
+	 */
+	template <class E>
+	MatrixView<T>& operator+=(const MatrixExpression<E>& expr)
+	{
+		static_assert(!std::is_const<T>::value, "A read-only view cannot be assigned");
+		MATRIX_PROFILE_UPDATE(expr.self(), false);
+		_update(expr.self(), false);
+		return *this;
+	}
+
+	/**
+	 * -= operator. Subtracts the value of an expression from the cells of this.
+	 * @param expr The expression
+	 * @return reference to this
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the dimensions of this and expr are not the same.
+	 */
+	template <class E>
+	MatrixView<T>& operator-=(const MatrixExpression<E>& expr)
+	{
+		static_assert(!std::is_const<T>::value, "A read-only view cannot be assigned");
+		MATRIX_PROFILE_UPDATE(expr.self(), true);
+		_update(expr.self(), true);
+		return *this;
+	}
+
+	/**
+	 * *= operator. Multiplies the cells of this by a scalar.
+	 * @param scalar The scalar
+	 * @return reference to this
+	 */
+	MatrixView<T>& operator*=(const value_type& scalar)
+	{
+		static_assert(!std::is_const<T>::value, "A read-only view cannot be assigned");
+		MATRIX_PROFILE(ProfiledOperation::MULTIPLY, (unsigned long long)_rows * _cols,
+					   (unsigned long long)_rows * _cols);
+		_forRows(Operation::ELEMENTWISE, _cols, [this, &scalar](unsigned int rowBegin,
+																unsigned int rowEnd)
+		{
+			for (unsigned int i = rowBegin; i < rowEnd; i++)
+			{
+				T* row = _data + i * _ld;
+				ElementKernels<value_type>::scale(row, row, scalar, _cols);
+			}
+		});
+		return *this;
+	}
+
+	/**
+	 * == operator. Compares the cells of this with the value of an expression, reading matrices
+	 * and views in place.
+	 * @param other The other expression
+	 * @return true if this and other have the same dimensions and cells, false otherwise.
+	 */
+	template <class E>
+	bool operator==(const MatrixExpression<E>& other) const
+	{
+		return _equals(GemmOperand<E>::make(other.self()));
+	}
+
+	/**
+	 * != operator.
+	 * @param other The other expression
+	 * @return The opposite of == operator.
+	 */
+	template <class E>
+	bool operator!=(const MatrixExpression<E>& other) const
+	{
+		return !(*this == other);
+	}
+
+	/**
+	 * @return The transposed view (conjugated for Complex cells), sharing the same cells.
+	 */
+	MatrixOperand<value_type> trans() const
+	{
+		return operand().trans();
+	}
+
+	/**
+	 * Calculates and returns the trace of this.
+	 * @return The trace.
+	 * @throws NoSquareException if this view is not square
+	 */
+	value_type trace() const
+	{
+		if (_rows != _cols)
+		{
+			throw NoSquareException();
+		}
+		MATRIX_PROFILE(ProfiledOperation::TRACE, _rows, _rows);
+		value_type trace(0);
+		for (unsigned int i = 0; i < _rows; i++)
+		{
+			trace += _data[i * (_ld + 1)];
+		}
+		return trace;
+	}
+
+	/**
+	 * Returns a view of a block of the cells of this.
+	 * @param row The row number of the first cell of the block
+	 * @param col The column number of the first cell of the block
+	 * @param rows Number of rows of the block
+	 * @param cols Number of columns of the block
+	 * @return The view of the block.
+	 * @throws OutOfMatrixException if the block is not inside this view.
+	 */
+	MatrixView<T> view(unsigned int row, unsigned int col, unsigned int rows,
+					   unsigned int cols) const
+	{
+		if ((unsigned long long)row + rows > _rows || (unsigned long long)col + cols > _cols)
+		{
+			throw OutOfMatrixException();
+		}
+		return MatrixView<T>(_data + row * _ld + col, rows, cols, _ld);
+	}
+
+	/**
+	 * () operator. Returns the cell located in the given coordinates, without checking them.
+	 * @param row The cell row number
+	 * @param col The cell column number
+	 * @return The requested cell
+	 */
+	T& operator()(unsigned int row, unsigned int col) const
+	{
+		return _data[row * _ld + col];
+	}
+
+	/**
+	 * Returns the cell located in the given coordinates.
+	 * @param row The cell row number
+	 * @param col The cell column number
+	 * @return The requested cell
+	 * @throws OutOfMatrixException if the requested cell is not exist in the view.
+	 */
+	T& at(unsigned int row, unsigned int col) const
+	{
+		if (row >= _rows || col >= _cols)
+		{
+			throw OutOfMatrixException();
+		}
+		return (*this)(row, col);
+	}
+
+	/**
+	 * Returns the cells of a row.
+	 * @param row The row number
+	 * @return Span of the cols() cells of the row.
+	 * @throws OutOfMatrixException if the row is not exist in the view.
+	 */
+	MatrixSpan<T> row(unsigned int row) const
+	{
+		if (row >= _rows)
+		{
+			throw OutOfMatrixException();
+		}
+		return MatrixSpan<T>(_data + row * _ld, _cols);
+	}
+
+	/**
+	 * @return The number of rows.
+	 */
+	unsigned int rows() const
+	{
+		return _rows;
+	}
+
+	/**
+	 * @return The number of columns.
+	 */
+	unsigned int cols() const
+	{
+		return _cols;
+	}
+
+	/**
+	 * @return The distance between two consecutive rows.
+	 */
+	std::size_t ld() const
+	{
+		return _ld;
+	}
+
+	/**
+	 * @return The first cell.
+	 */
+	T* data() const
+	{
+		return _data;
+	}
+
+	/**
+	 * @return true if this view is square, false otherwise.
+	 */
+	bool isSquareMatrix() const
+	{
+		return _rows == _cols;
+	}
+
+	/**
+	 * @return The operand of the cells of this, as read by expressions.
+	 */
+	MatrixOperand<value_type> operand() const
+	{
+		return MatrixOperand<value_type>(_data, _rows, _cols, _ld, 1);
+	}
+
+	// ------------------ Evaluation ------------------------
+	/**
+	 * @param row The row number
+	 * @return The cells of the row.
+	 */
+	const value_type* rowPointer(unsigned int row) const
+	{
+		return _data + row * _ld;
+	}
+
+	/**
+	 * Writes the cells of a row to out.
+	 * @param row The row number
+	 * @param out The destination, holding cols() cells
+	 */
+	void evalRow(unsigned int row, value_type* out, unsigned int) const
+	{
+		const value_type* source = rowPointer(row);
+		if (source != out)
+		{
+			std::copy(source, source + _cols, out);
+		}
+	}
+
+	/**
+	 * @param begin The first cell of the destination
+	 * @param end One after the last cell of the destination
+	 * @param rowStride Distance between two consecutive rows of the destination
+	 * @return Whether the cells of the view overlap the destination.
+	 */
+	bool overlaps(const value_type* begin, const value_type* end, std::size_t rowStride) const
+	{
+		return operand().overlaps(begin, end, rowStride);
+	}
+
+	/**
+	 * @param begin The first cell of the destination
+	 * @param end One after the last cell of the destination
+	 * @param rowStride Distance between two consecutive rows of the destination
+	 * @return Whether the view conflicts with the destination (see MatrixOperand::conflicts).
+	 */
+	bool conflicts(const value_type* begin, const value_type* end, std::size_t rowStride) const
+	{
+		return operand().conflicts(begin, end, rowStride);
+	}
+
+private:
+	// ------------------ Data members ----------------------
+	T* _data; /**< The first cell */
+	unsigned int _rows; /**< Number of rows */
+	unsigned int _cols; /**< Number of columns */
+	std::size_t _ld; /**< Distance between two consecutive rows */
+
+	// ------------------ Private functions -----------------
+	/**
+	 * @return One after the last cell of the view.
+	 */
+	const value_type* _end() const
+	{
+		return (_rows == 0 || _cols == 0) ? _data : _data + (_rows - 1) * _ld + _cols;
+	}
+
+	/**
+	 * Checks that a value written into this has the dimensions of this.
+	 * @param rows Number of rows of the value
+	 * @param cols Number of columns of the value
+	 * @throws WrongDimensionsExceptions if the dimensions are not the same.
+	 */
+	void _checkDimensions(unsigned int rows, unsigned int cols) const
+	{
+		if (rows != _rows || cols != _cols)
+		{
+			throw WrongDimensionsException();
+		}
+	}
+
+	/**
+	 * Runs func(rowBegin, rowEnd) over the rows of this, like Matrix<T>::_forRows.
+	 * @param operation The kind of operation
+	 * @param cellsPerRow The number of cells (or multiply-adds) computed for every row
+	 * @param func The function to run
+	 */
+	template <class Func>
+	void _forRows(Operation operation, unsigned long long cellsPerRow, const Func& func) const
+	{
+		unsigned long long work = cellsPerRow * _rows;
+		if (operation != Operation::PRODUCT)
+		{
+			work *= sizeof(value_type);
+		}
+		if (!ExecutionPolicy::parallel(operation, work))
+		{
+			func(0, _rows);
+			return;
+		}
+		ThreadPool::instance().parallelFor(0, _rows, Matrix<value_type>::_rowGrain(cellsPerRow),
+										   func);
+	}
+
+	/**
+	 * Compares the cells of this with an operand.
+	 * @param other The operand
+	 * @return true if the dimensions and the cells are the same, false otherwise.
+	 */
+	bool _equals(const MatrixOperand<value_type>& other) const
+	{
+		if (other.rows() != _rows || other.cols() != _cols)
+		{
+			return false;
+		}
+		for (unsigned int i = 0; i < _rows; i++)
+		{
+			const value_type* cells = other.rowPointer(i);
+			if (cells == nullptr)
+			{
+				value_type* buffer = ExpressionBuffer<value_type>::get(0, _cols);
+				other.evalRow(i, buffer, 1);
+				cells = buffer;
+			}
+			if (!std::equal(cells, cells + _cols, rowPointer(i)))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Evaluates a cell by cell expression into this, row by row, like Matrix<T>::_assign.
+	 * @param expr The expression
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the dimensions of this and expr are not the same.
+	 */
+	template <class E>
+	void _assign(const E& expr)
+	{
+		_checkDimensions(expr.rows(), expr.cols());
+		if (expr.conflicts(_data, _end(), _ld))
+		{
+			Matrix<value_type> value(expr);
+			_assign(MatrixOperand<value_type>(value));
+			return;
+		}
+
+		bool overlaps = expr.overlaps(_data, _end(), _ld);
+		_forRows(Operation::ELEMENTWISE, _cols,
+				 [this, &expr, overlaps](unsigned int rowBegin, unsigned int rowEnd)
+		{
+			for (unsigned int i = rowBegin; i < rowEnd; i++)
+			{
+				T* row = _data + i * _ld;
+				if (overlaps)
+				{
+					value_type* buffer = ExpressionBuffer<value_type>::get(0, _cols);
+					expr.evalRow(i, buffer, 1);
+					std::copy(buffer, buffer + _cols, row);
+				}
+				else
+				{
+					expr.evalRow(i, row, 0);
+				}
+			}
+		});
+	}
+
+	/**
+	 * Assigns an operand to this. Transposed operands are copied with the blocked transpose.
+	 * @param operand The operand
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the dimensions of this and operand are not the same.
+	 */
+	void _assign(const MatrixOperand<value_type>& operand)
+	{
+		if (operand.rowStride() != 1 || operand.colStride() == 1 ||
+			operand.overlaps(_data, _end(), _ld))
+		{
+			_assign<MatrixOperand<value_type> >(operand);
+			return;
+		}
+
+		_checkDimensions(operand.rows(), operand.cols());
+		_forRows(Operation::TRANSPOSE, _cols,
+				 [this, &operand](unsigned int rowBegin, unsigned int rowEnd)
+		{
+			Transpose<value_type>::copy(_cols, rowEnd - rowBegin, operand.data() + rowBegin,
+										operand.colStride(), _data + rowBegin * _ld, _ld,
+										operand.conjugated());
+		});
+	}
+
+	/**
+	 * Assigns the cells of a matrix to this.
+	 * @param matrix The matrix
+	 * @throws WrongDimensionsExceptions if the dimensions of this and matrix are not the same.
+	 */
+	template <class A>
+	void _assign(const Matrix<value_type, A>& matrix)
+	{
+		_assign(MatrixOperand<value_type>(matrix));
+	}
+
+	/**
+	 * Computes a product into this with the multiplication engine. If an operand shares cells
+	 * with this, the product is computed into a temporary matrix first. Views always use the
+	 * blocked engine, even when Matrix<T> is set to the Strassen-Winograd one.
+	 * @param product The product
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the dimensions of this and product are not the same.
+	 */
+	void _assign(const MatrixProduct<value_type>& product)
+	{
+		_checkDimensions(product.rows(), product.cols());
+		if (product.overlaps(_data, _end(), _ld))
+		{
+			Matrix<value_type> value(product);
+			_assign(MatrixOperand<value_type>(value));
+			return;
+		}
+		product.compute(_data, _ld, value_type(1), false);
+	}
+
+	/**
+	 * Adds (or subtracts) a cell by cell expression to this in place, row by row.
+	 * @param expr The expression
+	 * @param subtract Whether to subtract instead of adding
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the dimensions of this and expr are not the same.
+	 */
+	template <class E>
+	void _update(const E& expr, bool subtract)
+	{
+		_checkDimensions(expr.rows(), expr.cols());
+		if (expr.conflicts(_data, _end(), _ld))
+		{
+			Matrix<value_type> value(expr);
+			_update(MatrixOperand<value_type>(value), subtract);
+			return;
+		}
+
+		_forRows(Operation::ELEMENTWISE, _cols,
+				 [this, &expr, subtract](unsigned int rowBegin, unsigned int rowEnd)
+		{
+			for (unsigned int i = rowBegin; i < rowEnd; i++)
+			{
+				T* row = _data + i * _ld;
+				const value_type* source = expr.rowPointer(i);
+				if (source == nullptr)
+				{
+					value_type* buffer = ExpressionBuffer<value_type>::get(0, _cols);
+					expr.evalRow(i, buffer, 1);
+					source = buffer;
+				}
+
+				if (subtract)
+				{
+					ElementKernels<value_type>::subtract(row, row, source, _cols);
+				}
+				else
+				{
+					ElementKernels<value_type>::add(row, row, source, _cols);
+				}
+			}
+		});
+	}
+
+	/**
+	 * Adds (or subtracts) the cells of a matrix to this.
+	 * @param matrix The matrix
+	 * @param subtract Whether to subtract instead of adding
+	 * @throws WrongDimensionsExceptions if the dimensions of this and matrix are not the same.
+	 */
+	template <class A>
+	void _update(const Matrix<value_type, A>& matrix, bool subtract)
+	{
+		_update(MatrixOperand<value_type>(matrix), subtract);
+	}
+
+	/**
+	 * Adds (or subtracts) a product to this in place with the multiplication engine.
+	 * @param product The product
+	 * @param subtract Whether to subtract instead of adding
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the dimensions of this and product are not the same.
+	 */
+	void _update(const MatrixProduct<value_type>& product, bool subtract)
+	{
+		_checkDimensions(product.rows(), product.cols());
+		if (product.overlaps(_data, _end(), _ld))
+		{
+			Matrix<value_type> value(product);
+			_update(MatrixOperand<value_type>(value), subtract);
+			return;
+		}
+		product.compute(_data, _ld, subtract ? value_type(-1) : value_type(1), true);
+	}
+};
+
+/**
+ * Views are held inside larger expressions as operands referring to their cells.
+ */
+template <class T>
+struct ExpressionOperand<MatrixView<T> >
+{
+	typedef MatrixOperand<typename MatrixView<T>::value_type> type;
+
+	static type make(const MatrixView<T>& view)
+	{
+		return view.operand();
+	}
+};
+
+/**
+ * Views are read in place by the multiplication engine.
+ */
+template <class T>
+struct GemmOperand<MatrixView<T> >
+{
+	typedef MatrixOperand<typename MatrixView<T>::value_type> type;
+
+	static type make(const MatrixView<T>& view)
+	{
+		return view.operand();
+	}
+};
+
+#endif /* MATRIXVIEW_H_ */
@@ -0,0 +1,604 @@
+// MixedGemm.h
+
+#ifndef MIXEDGEMM_H_
+#define MIXEDGEMM_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+#include "Gemm.h"
+#include "ElementKernels.h"
+
+#if defined(MATRIX_SIMD_X86) && \
+	((defined(__clang__) && __clang_major__ >= 12) || (!defined(__clang__) && __GNUC__ >= 11))
+#define MATRIX_AVX_VNNI 1
+#endif
+
+/**
+ * The type the products of cells of type T are summed in by mixedMultiply() (see
+ * MixedPrecision.h): a wider type for integers, whose sums would overflow T, and double for float,
+ * whose long sums lose accuracy. The other types are summed in themselves.
+ */
+template <class T>
+struct AccumulatorTraits
+{
+	typedef T type;
+};
+
+template <>
+struct AccumulatorTraits<std::int8_t>
+{
+	typedef std::int32_t type;
+};
+
+template <>
+struct AccumulatorTraits<std::uint8_t>
+{
+	typedef std::int32_t type;
+};
+
+template <>
+struct AccumulatorTraits<std::int16_t>
+{
+	typedef std::int32_t type;
+};
+
+template <>
+struct AccumulatorTraits<std::uint16_t>
+{
+	typedef std::int64_t type;
+};
+
+template <>
+struct AccumulatorTraits<std::int32_t>
+{
+	typedef std::int64_t type;
+};
+
+template <>
+struct AccumulatorTraits<std::uint32_t>
+{
+	typedef std::uint64_t type;
+};
+
+template <>
+struct AccumulatorTraits<float>
+{
+	typedef double type;
+};
+
+/**
+ * This class is the multiplication engine of products whose cells are summed in a wider type than
+ * the one of the operands. It computes C = A * B (or C += A * B) where A (m X k) and B (k X n) have
+ * cells of type T, given by a pointer and a row and column stride as for Gemm<T>, and C has cells
+ * of type Acc, row-major with the given leading dimension.
+ *
+ * This generic version widens KC-deep slices of A and B to Acc and multiplies them with Gemm<Acc>,
+ * so it costs a conversion of the operands on top of a product in Acc. int8 cells summed in
+ * int32 get their own engine below.
+ */
+template <class T, class Acc,
+		  bool = std::is_same<T, std::int8_t>::value && std::is_same<Acc, std::int32_t>::value>
+class MixedGemm
+{
+public:
+	/**
+	 * Computes C = A * B, or C += A * B if accumulate is true.
+	 * @param m Number of rows of A and C
+	 * @param n Number of columns of B and C
+	 * @param k Number of columns of A and rows of B
+	 * @param a The first cell of A
+	 * @param rsA Distance between two consecutive rows of A
+	 * @param csA Distance between two consecutive columns of A
+	 * @param b The first cell of B
+	 * @param rsB Distance between two consecutive rows of B
+	 * @param csB Distance between two consecutive columns of B
+	 * @param c The first cell of C
+	 * @param ldc Distance between two consecutive rows of C
+	 * @param accumulate Whether the product is added to C instead of overwriting it
+	 */
+	static void multiply(unsigned int m, unsigned int n, unsigned int k,
+						 const T* a, std::size_t rsA, std::size_t csA,
+						 const T* b, std::size_t rsB, std::size_t csB,
+						 Acc* c, std::size_t ldc, bool accumulate = false)
+	{
+		if (m == 0 || n == 0)
+		{
+			return;
+		}
+		if (k == 0)
+		{
+			if (!accumulate)
+			{
+				for (unsigned int i = 0; i < m; i++)
+				{
+					std::fill(c + i * ldc, c + i * ldc + n, Acc(0));
+				}
+			}
+			return;
+		}
+
+		std::vector<Acc>& wideA = _buffer(0);
+		std::vector<Acc>& wideB = _buffer(1);
+		for (unsigned int pc = 0; pc < k; pc += KC)
+		{
+			unsigned int kc = std::min(KC, k - pc);
+			_widen(m, kc, a + pc * csA, rsA, csA, wideA);
+			_widen(kc, n, b + pc * rsB, rsB, csB, wideB);
+			Gemm<Acc>::multiply(m, n, kc, Acc(1), wideA.data(), kc, 1, wideB.data(), n, 1, c, ldc,
+								accumulate || pc > 0);
+		}
+	}
+
+private:
+	/**
+	 * Depth of the widened slices of A and B.
+	 */
+	static const unsigned int KC = 256;
+
+	/**
+	 * @param index The buffer number
+	 * @return A buffer of widened cells owned by the calling thread, reused between calls.
+	 */
+	static std::vector<Acc>& _buffer(int index)
+	{
+		static thread_local std::vector<Acc> buffers[2];
+		return buffers[index];
+	}
+
+	/**
+	 * Copies a block of cells of type T into a row-major block of cells of type Acc.
+	 * @param rows Number of rows of the block
+	 * @param cols Number of columns of the block
+	 * @param src The first cell of the block
+	 * @param rs Distance between two consecutive rows of the source
+	 * @param cs Distance between two consecutive columns of the source
+	 * @param dst The destination buffer
+	 */
+	static void _widen(unsigned int rows, unsigned int cols, const T* src, std::size_t rs,
+					   std::size_t cs, std::vector<Acc>& dst)
+	{
+		dst.resize((std::size_t)rows * cols);
+		Acc* out = dst.data();
+		for (unsigned int i = 0; i < rows; i++)
+		{
+			for (unsigned int j = 0; j < cols; j++)
+			{
+				*out++ = Acc(src[i * rs + j * cs]);
+			}
+		}
+	}
+};
+
+template <class T, class Acc, bool INT8>
+const unsigned int MixedGemm<T, Acc, INT8>::KC;
+
+/**
+ * Specialization for int8 cells summed in int32, the products of quantized matrices (see
+ * QuantizedMatrix). It is blocked like Gemm<T>, with the operands packed four cells deep: every
+ * 32-bit word of a packed sliver of A holds 4 consecutive cells of a row, and every 32-bit word of
+ * a packed sliver of B the 4 matching cells of a column. This is the layout of the dot product
+ * instructions of VNNI (vpdpbusd), which multiply 4 pairs of bytes and add them to a 32-bit sum in
+ * a single instruction, 64 of them per 512-bit vector.
+ *
+ * Those instructions multiply unsigned bytes of A by signed bytes of B, so A is packed shifted by
+ * 128 (a + 128 is in [0, 255]) and 128 times the sum of every column of B is taken back from the
+ * result. Every sum is exact.
+ *
+ * The micro-kernel is chosen for the running CPU on the first call: AVX-512 VNNI, AVX-VNNI, AVX2
+ * (which multiplies pairs of 16-bit cells instead, also exactly) or a plain loop.
+ */
+template <class T, class Acc>
+class MixedGemm<T, Acc, true>
+{
+public:
+	/**
+	 * Computes C = A * B, or C += A * B if accumulate is true.
+	 * @param m Number of rows of A and C
+	 * @param n Number of columns of B and C
+	 * @param k Number of columns of A and rows of B
+	 * @param a The first cell of A
+	 * @param rsA Distance between two consecutive rows of A
+	 * @param csA Distance between two consecutive columns of A
+	 * @param b The first cell of B
+	 * @param rsB Distance between two consecutive rows of B
+	 * @param csB Distance between two consecutive columns of B
+	 * @param c The first cell of C
+	 * @param ldc Distance between two consecutive rows of C
+	 * @param accumulate Whether the product is added to C instead of overwriting it
+	 */
+	static void multiply(unsigned int m, unsigned int n, unsigned int k,
+						 const T* a, std::size_t rsA, std::size_t csA,
+						 const T* b, std::size_t rsB, std::size_t csB,
+						 Acc* c, std::size_t ldc, bool accumulate = false)
+	{
+		if (m == 0 || n == 0)
+		{
+			return;
+		}
+		if (k == 0)
+		{
+			if (!accumulate)
+			{
+				for (unsigned int i = 0; i < m; i++)
+				{
+					std::fill(c + i * ldc, c + i * ldc + n, Acc(0));
+				}
+			}
+			return;
+		}
+
+		_Buffers& buffers = _buffers();
+		for (unsigned int jc = 0; jc < n; jc += NC)
+		{
+			unsigned int nc = std::min(NC, n - jc);
+			for (unsigned int pc = 0; pc < k; pc += KC)
+			{
+				unsigned int kc = std::min(KC, k - pc);
+				bool add = accumulate || pc > 0;
+				_packB(kc, nc, b + pc * rsB + jc * csB, rsB, csB, buffers.b, buffers.sums);
+				for (unsigned int ic = 0; ic < m; ic += MC)
+				{
+					unsigned int mc = std::min(MC, m - ic);
+					_packA(mc, kc, a + ic * rsA + pc * csA, rsA, csA, buffers.a);
+					_macroKernel(mc, nc, (kc + 3) / 4, buffers, c + ic * ldc + jc, ldc, add);
+				}
+			}
+		}
+	}
+
+private:
+	/**
+	 * Rows of C computed by one call to the micro-kernel.
+	 */
+	static const unsigned int MR = 4;
+
+	/**
+	 * Columns of C computed by one call to the micro-kernel (one 512-bit vector of int32 sums).
+	 */
+	static const unsigned int NR = 16;
+
+	/**
+	 * Depth of a block, a multiple of 4. An MR X KC sliver of A and a KC X NR sliver of B take
+	 * 10 KiB of L1.
+	 */
+	static const unsigned int KC = 512;
+
+	/**
+	 * Rows of a block of A.
+	 */
+	static const unsigned int MC = 96;
+
+	/**
+	 * Columns of a panel of B.
+	 */
+	static const unsigned int NC = 4096;
+
+	/**
+	 * The micro-kernel: adds the products of `quads` groups of 4 cells of a packed sliver of A
+	 * (unsigned) and of a packed sliver of B (signed) into an MR X NR row-major tile of sums.
+	 */
+	typedef void (*_Kernel)(unsigned int quads, const std::uint8_t* a, const std::int8_t* b,
+							std::int32_t* tile);
+
+	/**
+	 * The packing buffers of a thread.
+	 */
+	struct _Buffers
+	{
+		std::vector<std::uint8_t> a; /**< The packed block of A */
+		std::vector<std::int8_t> b; /**< The packed panel of B */
+		std::vector<std::int32_t> sums; /**< The sums of the columns of the panel of B */
+	};
+
+	/**
+	 * @return The packing buffers owned by the calling thread, reused between calls.
+	 */
+	static _Buffers& _buffers()
+	{
+		static thread_local _Buffers buffers;
+		return buffers;
+	}
+
+	/**
+	 * Packs an mc X kc block of A into consecutive MR-row slivers. Every sliver holds, for every
+	 * group of 4 columns, the 4 cells of its first row, then of its second row and so on, each
+	 * plus 128. Missing rows and columns are packed as 0 cells.
+	 * @param mc Number of rows of the block
+	 * @param kc Number of columns of the block
+	 * @param a The first cell of the block
+	 * @param rsA Distance between two consecutive rows of A
+	 * @param csA Distance between two consecutive columns of A
+	 * @param packed The destination buffer
+	 */
+	static void _packA(unsigned int mc, unsigned int kc, const T* a, std::size_t rsA,
+					   std::size_t csA, std::vector<std::uint8_t>& packed)
+	{
+		unsigned int slivers = (mc + MR - 1) / MR;
+		unsigned int quads = (kc + 3) / 4;
+		packed.resize((std::size_t)slivers * MR * quads * 4);
+		std::uint8_t* out = packed.data();
+		for (unsigned int ir = 0; ir < mc; ir += MR)
+		{
+			unsigned int mr = std::min(MR, mc - ir);
+			for (unsigned int q = 0; q < quads; q++)
+			{
+				for (unsigned int i = 0; i < MR; i++)
+				{
+					for (unsigned int t = 0; t < 4; t++)
+					{
+						unsigned int p = 4 * q + t;
+						int cell = i < mr && p < kc ? a[(ir + i) * rsA + p * csA] : 0;
+						out[4 * i + t] = (std::uint8_t)(cell + 128);
+					}
+				}
+				out += MR * 4;
+			}
+		}
+	}
+
+	/**
+	 * Packs a kc X nc panel of B into consecutive NR-column slivers. Every sliver holds, for every
+	 * group of 4 rows, the 4 cells of its first column, then of its second column and so on.
+	 * Missing rows and columns are packed as 0 cells. Also sums every column of the panel.
+	 * @param kc Number of rows of the panel
+	 * @param nc Number of columns of the panel
+	 * @param b The first cell of the panel
+	 * @param rsB Distance between two consecutive rows of B
+	 * @param csB Distance between two consecutive columns of B
+	 * @param packed The destination buffer
+	 * @param sums The sums of the columns, NR for every sliver
+	 */
+	static void _packB(unsigned int kc, unsigned int nc, const T* b, std::size_t rsB,
+					   std::size_t csB, std::vector<std::int8_t>& packed,
+					   std::vector<std::int32_t>& sums)
+	{
+		unsigned int slivers = (nc + NR - 1) / NR;
+		unsigned int quads = (kc + 3) / 4;
+		packed.assign((std::size_t)slivers * NR * quads * 4, 0);
+		sums.assign((std::size_t)slivers * NR, 0);
+		std::int8_t* out = packed.data();
+		for (unsigned int jr = 0; jr < nc; jr += NR)
+		{
+			unsigned int nr = std::min(NR, nc - jr);
+			std::int32_t* sum = sums.data() + jr;
+			for (unsigned int q = 0; q < quads; q++)
+			{
+				for (unsigned int t = 0; t < 4 && 4 * q + t < kc; t++)
+				{
+					const T* row = b + (4 * q + t) * rsB + jr * csB;
+					for (unsigned int j = 0; j < nr; j++)
+					{
+						out[4 * j + t] = row[j * csB];
+						sum[j] += row[j * csB];
+					}
+				}
+				out += NR * 4;
+			}
+		}
+	}
+
+	/**
+	 * Multiplies a packed block of A by a packed panel of B into C.
+	 * @param mc Number of rows of the block
+	 * @param nc Number of columns of the panel
+	 * @param quads The common dimension, in groups of 4
+	 * @param buffers The packed block, panel and column sums
+	 * @param c The first cell of the block of C
+	 * @param ldc Distance between two consecutive rows of C
+	 * @param accumulate Whether the product is added to C instead of overwriting it
+	 */
+	static void _macroKernel(unsigned int mc, unsigned int nc, unsigned int quads,
+							 const _Buffers& buffers, Acc* c, std::size_t ldc, bool accumulate)
+	{
+		_Kernel kernel = _kernel();
+		std::int32_t tile[MR * NR];
+		for (unsigned int jr = 0; jr < nc; jr += NR)
+		{
+			unsigned int nr = std::min(NR, nc - jr);
+			const std::int32_t* sums = buffers.sums.data() + jr;
+			for (unsigned int ir = 0; ir < mc; ir += MR)
+			{
+				unsigned int mr = std::min(MR, mc - ir);
+				kernel(quads, buffers.a.data() + (std::size_t)ir * quads * 4,
+					   buffers.b.data() + (std::size_t)jr * quads * 4, tile);
+				for (unsigned int i = 0; i < mr; i++)
+				{
+					Acc* row = c + (ir + i) * ldc + jr;
+					for (unsigned int j = 0; j < nr; j++)
+					{
+						// Sums past 2^31 wrap in the kernels, and back again here.
+						Acc cell = (Acc)((std::uint32_t)tile[i * NR + j] -
+										 128u * (std::uint32_t)sums[j]);
+						row[j] = accumulate ? row[j] + cell : cell;
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * The micro-kernel of CPUs without the instructions below.
+	 */
+	static void _plainKernel(unsigned int quads, const std::uint8_t* a, const std::int8_t* b,
+							 std::int32_t* tile)
+	{
+		std::uint32_t sums[MR * NR] = {};
+		for (unsigned int q = 0; q < quads; q++)
+		{
+			for (unsigned int i = 0; i < MR; i++)
+			{
+				for (unsigned int j = 0; j < NR; j++)
+				{
+					std::int32_t dot = 0;
+					for (unsigned int t = 0; t < 4; t++)
+					{
+						dot += a[4 * i + t] * b[4 * j + t];
+					}
+					sums[i * NR + j] += (std::uint32_t)dot;
+				}
+			}
+			a += MR * 4;
+			b += NR * 4;
+		}
+		std::memcpy(tile, sums, sizeof(sums));
+	}
+
+#ifdef MATRIX_SIMD_X86
+	/**
+	 * @param a 4 packed cells of A
+	 * @return The 4 cells as a 32-bit word.
+	 */
+	static std::int32_t _quad(const std::uint8_t* a)
+	{
+		std::int32_t quad;
+		std::memcpy(&quad, a, sizeof(quad));
+		return quad;
+	}
+
+	/**
+	 * The micro-kernel of AVX-512 VNNI: one vpdpbusd per row and group of 4.
+	 */
+	MATRIX_TARGET("avx512f,avx512vnni")
+	static void _avx512VnniKernel(unsigned int quads, const std::uint8_t* a, const std::int8_t* b,
+								  std::int32_t* tile)
+	{
+		__m512i sums[MR];
+		for (unsigned int i = 0; i < MR; i++)
+		{
+			sums[i] = _mm512_setzero_si512();
+		}
+		for (unsigned int q = 0; q < quads; q++)
+		{
+			__m512i column = _mm512_loadu_si512(b);
+			for (unsigned int i = 0; i < MR; i++)
+			{
+				sums[i] = _mm512_dpbusd_epi32(sums[i], _mm512_set1_epi32(_quad(a + 4 * i)), column);
+			}
+			a += MR * 4;
+			b += NR * 4;
+		}
+		for (unsigned int i = 0; i < MR; i++)
+		{
+			_mm512_storeu_si512(tile + i * NR, sums[i]);
+		}
+	}
+
+#ifdef MATRIX_AVX_VNNI
+	/**
+	 * The micro-kernel of AVX-VNNI: as AVX-512 VNNI, on two 256-bit halves of the columns.
+	 */
+	MATRIX_TARGET("avx2,avxvnni")
+	static void _avxVnniKernel(unsigned int quads, const std::uint8_t* a, const std::int8_t* b,
+							   std::int32_t* tile)
+	{
+		__m256i sums[MR][2];
+		for (unsigned int i = 0; i < MR; i++)
+		{
+			sums[i][0] = sums[i][1] = _mm256_setzero_si256();
+		}
+		for (unsigned int q = 0; q < quads; q++)
+		{
+			__m256i low = _mm256_loadu_si256((const __m256i*)b);
+			__m256i high = _mm256_loadu_si256((const __m256i*)(b + 32));
+			for (unsigned int i = 0; i < MR; i++)
+			{
+				__m256i row = _mm256_set1_epi32(_quad(a + 4 * i));
+				sums[i][0] = _mm256_dpbusd_avx_epi32(sums[i][0], row, low);
+				sums[i][1] = _mm256_dpbusd_avx_epi32(sums[i][1], row, high);
+			}
+			a += MR * 4;
+			b += NR * 4;
+		}
+		for (unsigned int i = 0; i < MR; i++)
+		{
+			_mm256_storeu_si256((__m256i*)(tile + i * NR), sums[i][0]);
+			_mm256_storeu_si256((__m256i*)(tile + i * NR + 8), sums[i][1]);
+		}
+	}
+#endif
+
+	/**
+	 * The micro-kernel of AVX2, which has no byte dot product that cannot saturate: the cells are
+	 * widened to 16 bits and multiplied in pairs (vpmaddwd), two 32-bit sums per column that are
+	 * added together at the end. It runs over the columns in two halves of 8 to stay within the 16
+	 * vector registers.
+	 */
+	MATRIX_TARGET("avx2")
+	static void _avx2Kernel(unsigned int quads, const std::uint8_t* a, const std::int8_t* b,
+							std::int32_t* tile)
+	{
+		for (unsigned int half = 0; half < 2; half++)
+		{
+			const std::uint8_t* rows = a;
+			const std::int8_t* columns = b + 32 * half;
+			__m256i sums[MR][2];
+			for (unsigned int i = 0; i < MR; i++)
+			{
+				sums[i][0] = sums[i][1] = _mm256_setzero_si256();
+			}
+			for (unsigned int q = 0; q < quads; q++)
+			{
+				const __m128i* bytes = (const __m128i*)columns;
+				__m256i low = _mm256_cvtepi8_epi16(_mm_loadu_si128(bytes));
+				__m256i high = _mm256_cvtepi8_epi16(_mm_loadu_si128(bytes + 1));
+				for (unsigned int i = 0; i < MR; i++)
+				{
+					__m128i quad = _mm_cvtepu8_epi16(_mm_cvtsi32_si128(_quad(rows + 4 * i)));
+					__m256i row = _mm256_broadcastq_epi64(quad);
+					sums[i][0] = _mm256_add_epi32(sums[i][0], _mm256_madd_epi16(row, low));
+					sums[i][1] = _mm256_add_epi32(sums[i][1], _mm256_madd_epi16(row, high));
+				}
+				rows += MR * 4;
+				columns += NR * 4;
+			}
+			for (unsigned int i = 0; i < MR; i++)
+			{
+				// The pairs of sums of columns 0 to 3 and 4 to 7, added and put back in order.
+				__m256i pairs = _mm256_hadd_epi32(sums[i][0], sums[i][1]);
+				_mm256_storeu_si256((__m256i*)(tile + i * NR + 8 * half),
+									_mm256_permute4x64_epi64(pairs, _MM_SHUFFLE(3, 1, 2, 0)));
+			}
+		}
+	}
+#endif
+
+	/**
+	 * @return The micro-kernel chosen for the running CPU, detected on the first call.
+	 */
+	static _Kernel _kernel()
+	{
+#ifdef MATRIX_SIMD_X86
+		static const _Kernel kernel =
+			__builtin_cpu_supports("avx512vnni") ? &_avx512VnniKernel :
+#ifdef MATRIX_AVX_VNNI
+			__builtin_cpu_supports("avxvnni") ? &_avxVnniKernel :
+#endif
+			__builtin_cpu_supports("avx2") ? &_avx2Kernel : &_plainKernel;
+		return kernel;
+#else
+		return &_plainKernel;
+#endif
+	}
+};
+
+template <class T, class Acc>
+const unsigned int MixedGemm<T, Acc, true>::MR;
+
+template <class T, class Acc>
+const unsigned int MixedGemm<T, Acc, true>::NR;
+
+template <class T, class Acc>
+const unsigned int MixedGemm<T, Acc, true>::KC;
+
+template <class T, class Acc>
+const unsigned int MixedGemm<T, Acc, true>::MC;
+
+template <class T, class Acc>
+const unsigned int MixedGemm<T, Acc, true>::NC;
+
+#endif /* MIXEDGEMM_H_ */
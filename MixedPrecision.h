@@ -0,0 +1,310 @@
+// MixedPrecision.h
+
+#ifndef MIXEDPRECISION_H_
+#define MIXEDPRECISION_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#include "Matrix.hpp"
+#include "MixedGemm.h"
+
+/**
+ * The type the cells of mixedMultiply() are summed in: Acc, or AccumulatorTraits<T>::type if Acc
+ * is void.
+ */
+template <class Acc, class T>
+struct MixedAccumulator
+{
+	typedef Acc type;
+};
+
+template <class T>
+struct MixedAccumulator<void, T>
+{
+	typedef typename AccumulatorTraits<T>::type type;
+};
+
+/**
+ * This class computes products whose cells are summed in a wider type than the one of the
+ * operands, with MixedGemm<T, Acc>. Like MatrixProduct<T>, in the parallel mode the result is cut
+ * into 2D tiles run by the thread pool.
+ */
+template <class T, class Acc>
+class MixedProduct
+{
+public:
+	/**
+	 * Computes C = left * right.
+	 * @param left The left operand
+	 * @param right The right operand
+	 * @param c The first cell of C
+	 * @param ldc Distance between two consecutive rows of C
+	 */
+	static void compute(const MatrixOperand<T>& left, const MatrixOperand<T>& right, Acc* c,
+						std::size_t ldc)
+	{
+		unsigned long long flops = (unsigned long long)left.rows() * right.cols() * left.cols();
+		if (!ExecutionPolicy::parallel(Operation::PRODUCT, flops))
+		{
+			_computeTile(left, right, c, ldc, 0, left.rows(), 0, right.cols());
+			return;
+		}
+		unsigned int grain = MatrixProduct<T>::tileGrain(left.cols());
+		ThreadPool::instance().parallelFor2D(0, left.rows(), 0, right.cols(), grain, grain,
+											 [&](unsigned int rowBegin, unsigned int rowEnd,
+												 unsigned int colBegin, unsigned int colEnd)
+		{
+			_computeTile(left, right, c, ldc, rowBegin, rowEnd, colBegin, colEnd);
+		});
+	}
+
+private:
+	/**
+	 * Computes the tile [rowBegin, rowEnd) X [colBegin, colEnd) of C (see compute()).
+	 */
+	static void _computeTile(const MatrixOperand<T>& left, const MatrixOperand<T>& right, Acc* c,
+							 std::size_t ldc, unsigned int rowBegin, unsigned int rowEnd,
+							 unsigned int colBegin, unsigned int colEnd)
+	{
+		MixedGemm<T, Acc>::multiply(rowEnd - rowBegin, colEnd - colBegin, left.cols(),
+									left.data() + rowBegin * left.rowStride(), left.rowStride(),
+									left.colStride(), right.data() + colBegin * right.colStride(),
+									right.rowStride(), right.colStride(),
+									c + rowBegin * ldc + colBegin, ldc);
+	}
+};
+
+/**
+ * Returns the product of left and right with its cells summed, and returned, in a wider type than
+ * the one of the operands, by default the one of AccumulatorTraits: int8 and int16 cells give
+ * int32 cells, int cells int64 cells, and float cells double cells. So
+ * mixedMultiply(a, b) does not overflow where a * b would for integer matrices, and
+ * mixedMultiply<double>(a, b) of float matrices is as accurate as a product of double matrices,
+ * with the operands taking half of the memory. The operands are not widened as a whole, only a
+ * slice of them at a time, and int8 matrices have dedicated kernels (see MixedGemm).
+ * @param left The left expression
+ * @param right The right expression
+ * @return The product, with cells of type Acc (AccumulatorTraits<T>::type if Acc is void).
+ * @throws WrongDimensionsExceptions if number of columns of left is not equal to the number of
+ * 		   rows of right.
+ * @throws bad_alloc if the memory allocation fails
+ */
+template <class Acc = void, class L, class R>
+Matrix<typename MixedAccumulator<Acc, typename L::value_type>::type>
+mixedMultiply(const MatrixExpression<L>& left, const MatrixExpression<R>& right)
+{
+	typedef typename L::value_type T;
+	typedef typename MixedAccumulator<Acc, T>::type Wide;
+	static_assert(std::is_same<T, typename R::value_type>::value,
+				  "The operands must have the same cell type");
+	static_assert(std::is_arithmetic<T>::value, "Mixed products need arithmetic cells");
+	if (left.self().cols() != right.self().rows())
+	{
+		throw WrongDimensionsException();
+	}
+	MatrixOperand<T> a = GemmOperand<L>::make(left.self());
+	MatrixOperand<T> b = GemmOperand<R>::make(right.self());
+	MATRIX_PROFILE(ProfiledOperation::MULTIPLY, (unsigned long long)a.rows() * b.cols(),
+				   (unsigned long long)a.rows() * b.cols() * a.cols());
+	Matrix<Wide> product(a.rows(), b.cols());
+	MixedProduct<T, Wide>::compute(a, b, product.data(), b.cols());
+	return product;
+}
+
+/**
+ * Whether the cells of a QuantizedMatrix share a scale by row or by column.
+ */
+enum class QuantizationAxis
+{
+	ROWS, /**< One scale for every row */
+	COLUMNS /**< One scale for every column */
+};
+
+/**
+ * This class represents a matrix of float quantized to int8 cells: cell (i, j) stands for
+ * scale * q(i, j), where q(i, j) is in [-127, 127] and the scale is the one of row i or of
+ * column j.
+ * quantize() picks the scale of every row (or column) so that its largest cell becomes 127.
+ *
+ * The product of a matrix quantized by row (activations) by a matrix quantized by column (weights)
+ * is computed on the int8 cells, summed exactly in int32 by the VNNI and AVX2 kernels of
+ * MixedGemm, and only then scaled back to float: c(i, j) = rowScale(i) * colScale(j) * sum. The
+ * operands take a quarter of the memory of float matrices and are multiplied by 64 cells per
+ * instruction with AVX-512 VNNI, against 16 for float.
+ */
+class QuantizedMatrix
+{
+public:
+	// ------------------ Constructors ----------------------
+	/**
+	 * Default constructor. Initiates a quantized matrix of a single cell set to 0, of scale 1.
+	 */
+	QuantizedMatrix() : _cells(), _scales(1, 1.0f), _axis(QuantizationAxis::ROWS)
+	{
+	}
+
+	/**
+	 * Initiates a quantized matrix from its int8 cells and scales.
+	 * @param cells The cells
+	 * @param scales The scale of every row (or column) of cells
+	 * @param axis Whether the scales are those of the rows or of the columns
+	 * @throws IllegalVectorException if the number of scales is not the number of rows (or
+	 * 		   columns) of cells.
+	 */
+	QuantizedMatrix(const Matrix<std::int8_t>& cells, const std::vector<float>& scales,
+					QuantizationAxis axis) : _cells(cells), _scales(scales), _axis(axis)
+	{
+		if (_scales.size() != (axis == QuantizationAxis::ROWS ? cells.rows() : cells.cols()))
+		{
+			throw IllegalVectorException();
+		}
+	}
+
+	/**
+	 * Quantizes a matrix: every row (or column) is given the scale that maps its largest cell, in
+	 * absolute value, to 127, and its cells are rounded to the nearest multiple of the scale.
+	 * A row (or column) of zeros gets the scale 1.
+	 * @param matrix The matrix
+	 * @param axis Whether the rows or the columns get a scale each
+	 * @return The quantized matrix.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	template <class A>
+	static QuantizedMatrix quantize(const Matrix<float, A>& matrix, QuantizationAxis axis)
+	{
+		bool byRow = axis == QuantizationAxis::ROWS;
+		std::vector<float> scales(byRow ? matrix.rows() : matrix.cols(), 0.0f);
+		for (unsigned int i = 0; i < matrix.rows(); i++)
+		{
+			for (unsigned int j = 0; j < matrix.cols(); j++)
+			{
+				float& largest = scales[byRow ? i : j];
+				largest = std::max(largest, std::fabs(matrix(i, j)));
+			}
+		}
+		for (unsigned int i = 0; i < scales.size(); i++)
+		{
+			scales[i] = scales[i] > 0 ? scales[i] / (float)MAX_CELL : 1.0f;
+		}
+
+		Matrix<std::int8_t> cells(matrix.rows(), matrix.cols());
+		for (unsigned int i = 0; i < matrix.rows(); i++)
+		{
+			for (unsigned int j = 0; j < matrix.cols(); j++)
+			{
+				float q = std::round(matrix(i, j) / scales[byRow ? i : j]);
+				cells(i, j) = (std::int8_t)std::max(-(float)MAX_CELL, std::min((float)MAX_CELL, q));
+			}
+		}
+		return QuantizedMatrix(cells, scales, axis);
+	}
+
+	// ------------------ Accessors -------------------------
+	/**
+	 * @return The number of rows.
+	 */
+	unsigned int rows() const
+	{
+		return _cells.rows();
+	}
+
+	/**
+	 * @return The number of columns.
+	 */
+	unsigned int cols() const
+	{
+		return _cells.cols();
+	}
+
+	/**
+	 * @return The int8 cells.
+	 */
+	const Matrix<std::int8_t>& cells() const
+	{
+		return _cells;
+	}
+
+	/**
+	 * @return The scale of every row (or column).
+	 */
+	const std::vector<float>& scales() const
+	{
+		return _scales;
+	}
+
+	/**
+	 * @return Whether the scales are those of the rows or of the columns.
+	 */
+	QuantizationAxis axis() const
+	{
+		return _axis;
+	}
+
+	// ------------------ Operations ------------------------
+	/**
+	 * @return The matrix of float the quantized matrix stands for.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	Matrix<float> dequantize() const
+	{
+		bool byRow = _axis == QuantizationAxis::ROWS;
+		Matrix<float> matrix(rows(), cols());
+		for (unsigned int i = 0; i < rows(); i++)
+		{
+			for (unsigned int j = 0; j < cols(); j++)
+			{
+				matrix(i, j) = _scales[byRow ? i : j] * _cells(i, j);
+			}
+		}
+		return matrix;
+	}
+
+	/**
+	 * * operator. Multiplies this, quantized by row, by other, quantized by column.
+	 * @param other The right operand
+	 * @return The product, scaled back to float.
+	 * @throws WrongDimensionsException if the number of columns of this is not equal to the number
+	 * 		   of rows of other, or if this is not quantized by row or other by column (scales
+	 * 		   along the common dimension could not be taken out of the sums).
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	Matrix<float> operator*(const QuantizedMatrix& other) const
+	{
+		if (cols() != other.rows() || _axis != QuantizationAxis::ROWS ||
+			other._axis != QuantizationAxis::COLUMNS)
+		{
+			throw WrongDimensionsException();
+		}
+		Matrix<std::int32_t> sums = mixedMultiply(_cells, other._cells);
+		Matrix<float> product(rows(), other.cols());
+		for (unsigned int i = 0; i < rows(); i++)
+		{
+			const std::int32_t* sum = sums.data() + (std::size_t)i * other.cols();
+			float* cell = product.data() + (std::size_t)i * other.cols();
+			for (unsigned int j = 0; j < other.cols(); j++)
+			{
+				cell[j] = _scales[i] * other._scales[j] * (float)sum[j];
+			}
+		}
+		return product;
+	}
+
+private:
+	/**
+	 * The largest quantized cell, in absolute value. -128 is left out so that the range is
+	 * symmetric.
+	 */
+	static const int MAX_CELL = 127;
+
+	// ------------------ Data members ----------------------
+	Matrix<std::int8_t> _cells; /**< The int8 cells */
+	std::vector<float> _scales; /**< The scale of every row (or column) */
+	QuantizationAxis _axis; /**< Whether the scales are those of the rows or of the columns */
+};
+
+#endif /* MIXEDPRECISION_H_ */
@@ -0,0 +1,138 @@
+// NumaBenchmark.cpp
+
+/**
+ * Measures the NUMA mode (see NumaPolicy) against the default one on machines with several
+ * sockets. Large matrices are created and operated on in parallel three ways:
+ * - default: cells zero filled by the calling thread, so all of them are on its node, and the
+ *   workers run anywhere;
+ * - numa: cells first touched in parallel by the pool threads (mostly the ones that compute
+ *   them, see NumaPolicy), and workers pinned;
+ * - numa+interleaved: as numa, with the right operand of the product interleaved over all the
+ *   nodes.
+ * For each it prints the bandwidth of c = a + b and the speed of c = a * b. On a machine with a
+ * single node the three are the same up to noise.
+ *
+ * Usage: NumaBenchmark [sumSize] [productSize] [repetitions]
+ */
+
+// ------------------ Includes ------------------------------
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "Matrix.hpp"
+
+/**
+ * The default sizes and number of runs.
+ */
+static const unsigned int DEFAULT_SUM_SIZE = 8192;
+static const unsigned int DEFAULT_PRODUCT_SIZE = 2048;
+static const unsigned int DEFAULT_REPETITIONS = 5;
+
+/**
+ * Creates a square matrix whose cells are all value.
+ * @param size Number of rows and columns
+ * @param value The value of the cells
+ * @return The matrix
+ */
+template <class A>
+static Matrix<double, A> filledMatrix(unsigned int size, double value)
+{
+	return Matrix<double, A>(size, size, std::vector<double>((std::size_t)size * size, value));
+}
+
+/**
+ * Times a function.
+ * @param func The function
+ * @param repetitions Number of runs
+ * @return The best time of the runs, in seconds.
+ */
+template <class Func>
+static double best(const Func& func, unsigned int repetitions)
+{
+	double best = 0;
+	for (unsigned int i = 0; i < repetitions; i++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		func();
+		std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+		if (i == 0 || time.count() < best)
+		{
+			best = time.count();
+		}
+	}
+	return best;
+}
+
+/**
+ * Creates the matrices of one mode, in that mode, and prints the speed of its operations.
+ * @param name The name of the mode
+ * @param sumSize Size of the added matrices
+ * @param productSize Size of the multiplied matrices
+ * @param repetitions Number of runs of every operation
+ * @param baseline The speeds of the default mode (sum, product), 0 while measuring it
+ * @return The speeds of the mode (sum in GB/s, product in GFLOP/s).
+ */
+template <class RightAllocator>
+static std::vector<double> measure(const char* name, unsigned int sumSize,
+								   unsigned int productSize, unsigned int repetitions,
+								   const std::vector<double>& baseline)
+{
+	std::vector<double> speeds(2);
+	{
+		Matrix<double> a = filledMatrix<AlignedAllocator<double> >(sumSize, 1);
+		Matrix<double> b = filledMatrix<AlignedAllocator<double> >(sumSize, 2);
+		Matrix<double> c(sumSize, sumSize);
+		double time = best([&]() { c = a + b; }, repetitions);
+		speeds[0] = 3.0 * sizeof(double) * sumSize * sumSize / time / 1e9;
+	}
+	{
+		Matrix<double> a = filledMatrix<AlignedAllocator<double> >(productSize, 1);
+		Matrix<double, RightAllocator> b = filledMatrix<RightAllocator>(productSize, 2);
+		Matrix<double> c(productSize, productSize);
+		double time = best([&]() { c = a * b; }, repetitions);
+		speeds[1] = (double)productSize * productSize * productSize / time / 1e9;
+	}
+
+	std::cout << std::left << std::setw(18) << name << std::right << std::fixed
+			  << std::setprecision(2) << std::setw(10) << speeds[0] << std::setw(10)
+			  << speeds[1];
+	if (!baseline.empty())
+	{
+		std::cout << std::setw(9) << speeds[0] / baseline[0] << "x" << std::setw(9)
+				  << speeds[1] / baseline[1] << "x";
+	}
+	std::cout << "\n";
+	return speeds;
+}
+
+/**
+ * Runs the benchmark.
+ * @param argc Number of arguments
+ * @param argv The arguments: the size of the sums, of the products, and the number of runs
+ * @return 0
+ */
+int main(int argc, char* argv[])
+{
+	unsigned int sumSize = argc > 1 ? (unsigned int)std::atoi(argv[1]) : DEFAULT_SUM_SIZE;
+	unsigned int productSize = argc > 2 ? (unsigned int)std::atoi(argv[2]) :
+							   DEFAULT_PRODUCT_SIZE;
+	unsigned int repetitions = argc > 3 ? (unsigned int)std::atoi(argv[3]) : DEFAULT_REPETITIONS;
+	ExecutionPolicy::setExecution(Execution::PARALLEL);
+
+	std::cout << NumaPolicy::nodes().size() << " node(s), "
+			  << ThreadPool::instance().threadCount() << " thread(s)\n";
+	std::cout << std::left << std::setw(18) << "mode" << std::right << std::setw(10) << "+ GB/s"
+			  << std::setw(10) << "* GF/s" << std::setw(10) << "+ gain" << std::setw(10)
+			  << "* gain" << "\n";
+
+	std::vector<double> baseline = measure<AlignedAllocator<double> >(
+		"default", sumSize, productSize, repetitions, std::vector<double>());
+	NumaPolicy::setEnabled(true);
+	measure<AlignedAllocator<double> >("numa", sumSize, productSize, repetitions, baseline);
+	measure<InterleavedAllocator<double> >("numa+interleaved", sumSize, productSize, repetitions,
+										   baseline);
+	NumaPolicy::setEnabled(false);
+	return 0;
+}
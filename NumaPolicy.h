@@ -0,0 +1,297 @@
+// NumaPolicy.h
+
+#ifndef NUMAPOLICY_H_
+#define NUMAPOLICY_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "ThreadPool.h"
+
+/**
+ * Where the pages of a buffer are placed on a machine with several NUMA nodes.
+ */
+enum class Placement
+{
+	FIRST_TOUCH, /**< Every part on the node of the pool thread that computes it */
+	INTERLEAVED /**< Pages spread round-robin over all the nodes */
+};
+
+/**
+ * This class places the cells of matrices on machines with several NUMA nodes (sockets). Linux
+ * puts a page on the node of the thread that first writes it, so a buffer zero-filled by a single
+ * thread lands on one node, and the pool threads of the other nodes read and write it across the
+ * interconnect.
+ *
+ * The NUMA mode is off by default. Once enabled:
+ * - Buffers of at least MIN_BYTES taken by AlignedAllocator<T> (the default allocator of
+ *   Matrix<T>) are mapped directly from the system and first touched in parallel, in
+ *   threadCount() equal parts handed out by the pool. The pool gives worker w the w-th part of a
+ *   loop when it is free, so the parts usually land on the nodes of the threads that later
+ *   compute the same rows. This is best effort: the pool steals work, so a busy worker's part
+ *   may be touched, and its rows later computed, by another thread on another node.
+ * - The workers of the pool are pinned to the allowed CPUs ordered by node, worker w to the w-th
+ *   one. The first CPU is left to the calling thread.
+ * Operands read whole by every thread, like the right operand of a product, have no part of
+ * their own: InterleavedAllocator<T> spreads their pages over all the nodes instead.
+ * NumaBenchmark compares the modes; whether they pay off depends on the machine.
+ *
+ * On systems other than Linux nothing is placed and matrices keep taking their cells from the
+ * heap.
+ */
+class NumaPolicy
+{
+public:
+	/**
+	 * Size from which buffers are placed (2 MiB, a huge page).
+	 */
+	static const std::size_t MIN_BYTES = (std::size_t)1 << 21;
+
+	// ------------------ Mode ------------------------------
+	/**
+	 * Enables or disables the NUMA mode, and pins or unpins the workers of the pool accordingly.
+	 * Must not be called while other threads run operations. Buffers keep the placement they
+	 * were allocated with.
+	 * @param enabled Whether the mode is enabled
+	 */
+	static void setEnabled(bool enabled)
+	{
+		_enabled().store(enabled);
+		ThreadPool::setAffinity(enabled ? cpus() : std::vector<unsigned int>());
+	}
+
+	/**
+	 * @return Whether the NUMA mode is enabled.
+	 */
+	static bool enabled()
+	{
+		return _enabled().load(std::memory_order_relaxed);
+	}
+
+	// ------------------ Topology --------------------------
+	/**
+	 * @return The numbers of the online nodes, {0} if unknown.
+	 */
+	static std::vector<unsigned int> nodes()
+	{
+		std::vector<unsigned int> online = _readList("/sys/devices/system/node/online");
+		if (online.empty())
+		{
+			online.push_back(0);
+		}
+		return online;
+	}
+
+	/**
+	 * @return The CPUs the process may run on, those of the first node first, then those of the
+	 * 		   second one, and so on.
+	 */
+	static std::vector<unsigned int> cpus()
+	{
+		std::vector<unsigned int> allowed;
+#ifdef __linux__
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if (sched_getaffinity(0, sizeof(set), &set) == 0)
+		{
+			for (unsigned int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			{
+				if (CPU_ISSET(cpu, &set))
+				{
+					allowed.push_back(cpu);
+				}
+			}
+		}
+#endif
+
+		std::vector<unsigned int> ordered;
+		std::vector<unsigned int> online = nodes();
+		for (unsigned int i = 0; i < online.size(); i++)
+		{
+			std::ostringstream path;
+			path << "/sys/devices/system/node/node" << online[i] << "/cpulist";
+			std::vector<unsigned int> local = _readList(path.str());
+			for (unsigned int j = 0; j < local.size(); j++)
+			{
+				if (std::find(allowed.begin(), allowed.end(), local[j]) != allowed.end() &&
+					std::find(ordered.begin(), ordered.end(), local[j]) == ordered.end())
+				{
+					ordered.push_back(local[j]);
+				}
+			}
+		}
+		for (unsigned int i = 0; i < allowed.size(); i++)
+		{
+			if (std::find(ordered.begin(), ordered.end(), allowed[i]) == ordered.end())
+			{
+				ordered.push_back(allowed[i]);
+			}
+		}
+		return ordered;
+	}
+
+	// ------------------ Memory ----------------------------
+	/**
+	 * Maps memory directly from the system and places it. The memory starts one page after the
+	 * mapping, whose last two words before it hold nullptr (telling AlignedMemory::release() the
+	 * memory is not from the heap) and the length of the mapping.
+	 * @param bytes Number of bytes
+	 * @param alignment The alignment, at most a page
+	 * @param placement Where the pages are placed
+	 * @return The memory, zero filled, or nullptr if it cannot be mapped (or on systems other
+	 * 		   than Linux).
+	 */
+	static void* allocate(std::size_t bytes, std::size_t alignment, Placement placement)
+	{
+#ifdef __linux__
+		std::size_t page = (std::size_t)sysconf(_SC_PAGESIZE);
+		std::size_t pages = (bytes + page - 1) / page;
+		if (alignment > page || pages > (std::size_t)-1 / page - 1)
+		{
+			return nullptr;
+		}
+		std::size_t length = (pages + 1) * page;
+		void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+							 -1, 0);
+		if (mapping == MAP_FAILED)
+		{
+			return nullptr;
+		}
+		char* memory = static_cast<char*>(mapping) + page;
+		reinterpret_cast<void**>(memory)[-1] = nullptr;
+		reinterpret_cast<std::size_t*>(memory)[-2] = length;
+
+		if (placement == Placement::INTERLEAVED)
+		{
+			_interleave(memory, pages * page);
+		}
+		else
+		{
+			// Part w goes to worker w if it is free, to whichever thread steals it otherwise
+			ThreadPool& pool = ThreadPool::instance();
+			unsigned int parts = pool.threadCount();
+			pool.parallelFor(0, parts, 1, [=](unsigned int partBegin, unsigned int partEnd)
+			{
+				std::size_t first = (unsigned long long)pages * partBegin / parts;
+				std::size_t last = (unsigned long long)pages * partEnd / parts;
+				for (std::size_t p = first; p < last; p++)
+				{
+					memory[p * page] = 0;
+				}
+			});
+		}
+		return memory;
+#else
+		(void)bytes;
+		(void)alignment;
+		(void)placement;
+		return nullptr;
+#endif
+	}
+
+	/**
+	 * Unmaps memory returned by allocate().
+	 * @param memory The memory
+	 */
+	static void release(void* memory)
+	{
+#ifdef __linux__
+		std::size_t page = (std::size_t)sysconf(_SC_PAGESIZE);
+		std::size_t length = static_cast<std::size_t*>(memory)[-2];
+		munmap(static_cast<char*>(memory) - page, length);
+#else
+		(void)memory;
+#endif
+	}
+
+private:
+	/**
+	 * The interleave policy of mbind(), from <numaif.h> which is not always installed.
+	 */
+	static const int MPOL_INTERLEAVE_POLICY = 3;
+
+	/**
+	 * @return Whether the NUMA mode is enabled.
+	 */
+	static std::atomic<bool>& _enabled()
+	{
+		static std::atomic<bool> enabled(false);
+		return enabled;
+	}
+
+	/**
+	 * Reads a list of numbers like "0-3,8,10-11" from a file.
+	 * @param path The path of the file
+	 * @return The numbers, empty if the file cannot be read.
+	 */
+	static std::vector<unsigned int> _readList(const std::string& path)
+	{
+		std::vector<unsigned int> numbers;
+		std::ifstream file(path.c_str());
+		std::string list;
+		if (!(file >> list))
+		{
+			return numbers;
+		}
+		std::istringstream ranges(list);
+		std::string range;
+		while (std::getline(ranges, range, ','))
+		{
+			unsigned int first = 0;
+			unsigned int last = 0;
+			char dash = 0;
+			std::istringstream fields(range);
+			if (!(fields >> first))
+			{
+				continue;
+			}
+			last = fields >> dash >> last ? last : first;
+			for (unsigned int n = first; n <= last; n++)
+			{
+				numbers.push_back(n);
+			}
+		}
+		return numbers;
+	}
+
+	/**
+	 * Sets the pages of a range not yet touched to be placed round-robin over the online nodes.
+	 * The range keeps the default placement if the kernel refuses it.
+	 * @param memory The first cell of the range, at the start of a page
+	 * @param bytes The length of the range, a multiple of the page size
+	 */
+	static void _interleave(void* memory, std::size_t bytes)
+	{
+#if defined(__linux__) && defined(SYS_mbind)
+		static const unsigned int BITS = 8 * sizeof(unsigned long);
+		std::vector<unsigned int> online = nodes();
+		if (online.size() <= 1)
+		{
+			return;
+		}
+		std::vector<unsigned long> mask(*std::max_element(online.begin(), online.end()) / BITS + 1);
+		for (unsigned int i = 0; i < online.size(); i++)
+		{
+			mask[online[i] / BITS] |= 1ul << (online[i] % BITS);
+		}
+		syscall(SYS_mbind, memory, bytes, MPOL_INTERLEAVE_POLICY, mask.data(),
+				mask.size() * BITS + 1, 0);
+#else
+		(void)memory;
+		(void)bytes;
+#endif
+	}
+};
+
+#endif /* NUMAPOLICY_H_ */
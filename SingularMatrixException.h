@@ -0,0 +1,25 @@
+// SingularMatrixException.h
+
+#ifndef SINGULARMATRIXEXCEPTION_H_
+#define SINGULARMATRIXEXCEPTION_H_
+
+/**
+ * This class is an exception thrown by Matrix<T> when the functions solve() or inverse() of
+ * Matrix<T> are called on a singular matrix.
+ */
+class SingularMatrixException : std::exception
+{
+public:
+
+	/**
+	 * @return Message informing the caller about the error causing this exception to be thrown.
+	 */
+	virtual const char* what()
+	{
+		return "The given matrix is singular.";
+	}
+
+private:
+};
+
+#endif /* SINGULARMATRIXEXCEPTION_H_ */
@@ -0,0 +1,883 @@
+// SparseMatrix.h
+
+#ifndef SPARSEMATRIX_H_
+#define SPARSEMATRIX_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "ThreadPool.h"
+#include "ElementKernels.h"
+#include "ExecutionPolicy.h"
+#include "MatrixExpression.h"
+#include "WrongDimensionsException.h"
+#include "NoSquareException.h"
+#include "OutOfMatrixException.h"
+#include "IllegalMatrixException.h"
+#include "IllegalVectorException.h"
+
+/**
+ * The storage formats a matrix can be kept in.
+ */
+enum class MatrixFormat
+{
+	DENSE, /**< Every cell, in a Matrix<T> */
+	SPARSE /**< Only the non-zero cells, in a SparseMatrix<T> */
+};
+
+/**
+ * A cell of a sparse matrix, given by its coordinates.
+ */
+template <class T>
+struct SparseEntry
+{
+	unsigned int row; /**< The cell row number */
+	unsigned int col; /**< The cell column number */
+	T value; /**< The value of the cell */
+};
+
+/**
+ * This class represents a mathematical matrix of which only the non-zero cells are stored, in
+ * compressed sparse row (CSR) form: the column numbers and values of the non-zero cells row by
+ * row, in increasing column order, and the offset of every row in them. A rows X cols matrix
+ * takes memory in proportion to rows and to its number of non-zero cells only, so matrices that
+ * are almost all zeros can be far larger than a Matrix<T>, and their products skip the zeros.
+ *
+ * The products (with a sparse matrix, a dense Matrix<T> or a vector) and the sums are split by
+ * rows between the pool threads when the execution policy runs them in parallel. Cells that cancel
+ * out in a sum or a product are not stored.
+ *
+ * format() tells which of the two representations suits a matrix of a given density better.
+ */
+template <class T>
+class SparseMatrix
+{
+public:
+	/**
+	 * The type of the cells.
+	 */
+	typedef T value_type;
+
+	// ------------------ Constructors ----------------------
+	/**
+	 * Default constructor. Initiates the matrix with size of 1X1 and no non-zero cells.
+	 */
+	SparseMatrix() : _rows(1), _cols(1), _offsets(2, 0)
+	{
+	}
+
+	/**
+	 * Initiates the matrix with the size of rows X cols and no non-zero cells.
+	 * @param rows Number of rows
+	 * @param cols Number of columns
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws IllegalMatrixException if one of the arguments rows and cols (but not both) is 0.
+	 */
+	SparseMatrix(unsigned int rows, unsigned int cols) : _rows(rows), _cols(cols),
+														 _offsets((std::size_t)rows + 1, 0)
+	{
+		_checkSize(rows, cols);
+	}
+
+	/**
+	 * Initiates the matrix with the size of rows X cols and the given cells. Entries of the same
+	 * cell are added together, and cells that are 0 are not stored.
+	 * @param rows Number of rows
+	 * @param cols Number of columns
+	 * @param entries The cells, in any order
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws IllegalMatrixException if one of the arguments rows and cols (but not both) is 0.
+	 * @throws OutOfMatrixException if an entry is not inside the matrix.
+	 */
+	SparseMatrix(unsigned int rows, unsigned int cols,
+				 const std::vector<SparseEntry<T> >& entries) :
+		_rows(rows), _cols(cols), _offsets((std::size_t)rows + 1, 0)
+	{
+		_checkSize(rows, cols);
+		for (const SparseEntry<T>& entry : entries)
+		{
+			if (entry.row >= rows || entry.col >= cols)
+			{
+				throw OutOfMatrixException();
+			}
+			_offsets[entry.row + 1]++;
+		}
+		for (unsigned int i = 0; i < rows; i++)
+		{
+			_offsets[i + 1] += _offsets[i];
+		}
+
+		std::vector<std::size_t> next(_offsets.begin(), _offsets.end() - 1);
+		std::vector<unsigned int> indices(entries.size());
+		std::vector<T> values(entries.size());
+		for (const SparseEntry<T>& entry : entries)
+		{
+			std::size_t position = next[entry.row]++;
+			indices[position] = entry.col;
+			values[position] = entry.value;
+		}
+
+		std::vector<std::pair<unsigned int, T> > row;
+		std::size_t count = 0;
+		for (unsigned int i = 0; i < rows; i++)
+		{
+			row.clear();
+			for (std::size_t p = _offsets[i]; p < _offsets[i + 1]; p++)
+			{
+				row.push_back(std::make_pair(indices[p], values[p]));
+			}
+			std::sort(row.begin(), row.end(),
+					  [](const std::pair<unsigned int, T>& a, const std::pair<unsigned int, T>& b)
+			{
+				return a.first < b.first;
+			});
+			_offsets[i] = count;
+			for (std::size_t p = 0; p < row.size(); p++)
+			{
+				T sum = row[p].second;
+				while (p + 1 < row.size() && row[p + 1].first == row[p].first)
+				{
+					sum += row[++p].second;
+				}
+				if (sum != T(0))
+				{
+					indices[count] = row[p].first;
+					values[count++] = sum;
+				}
+			}
+		}
+		_offsets[rows] = count;
+		indices.resize(count);
+		values.resize(count);
+		_indices.swap(indices);
+		_values.swap(values);
+	}
+
+	/**
+	 * Initiates the matrix with the size of rows X cols from its CSR arrays, without copying them.
+	 * @param rows Number of rows
+	 * @param cols Number of columns
+	 * @param offsets rows + 1 offsets: the cells of row i are at [offsets[i], offsets[i + 1])
+	 * @param indices The column numbers of the cells, increasing in every row
+	 * @param values The values of the cells
+	 * @throws IllegalMatrixException if one of the arguments rows and cols (but not both) is 0.
+	 * @throws IllegalVectorException if the arrays do not describe a rows X cols CSR matrix.
+	 */
+	SparseMatrix(unsigned int rows, unsigned int cols, std::vector<std::size_t>&& offsets,
+				 std::vector<unsigned int>&& indices, std::vector<T>&& values) :
+		_rows(rows), _cols(cols), _offsets(std::move(offsets)), _indices(std::move(indices)),
+		_values(std::move(values))
+	{
+		_checkSize(rows, cols);
+		if (_offsets.size() != (std::size_t)rows + 1 || _offsets[0] != 0 ||
+			_offsets[rows] != _indices.size() || _indices.size() != _values.size())
+		{
+			throw IllegalVectorException();
+		}
+		for (unsigned int i = 0; i < rows; i++)
+		{
+			if (_offsets[i] > _offsets[i + 1])
+			{
+				throw IllegalVectorException();
+			}
+			for (std::size_t p = _offsets[i]; p < _offsets[i + 1]; p++)
+			{
+				if (_indices[p] >= cols || (p > _offsets[i] && _indices[p] <= _indices[p - 1]))
+				{
+					throw IllegalVectorException();
+				}
+			}
+		}
+	}
+
+	/**
+	 * Initiates the matrix with the non-zero cells of a dense matrix.
+	 * @param dense The dense matrix
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	template <class Allocator>
+	explicit SparseMatrix(const Matrix<T, Allocator>& dense) : _rows(dense.rows()),
+																_cols(dense.cols())
+	{
+		const T* cells = dense.data();
+		unsigned int cols = _cols;
+		_build(*this, (unsigned long long)_rows * _cols, nullptr,
+			   [cells, cols](unsigned int i, std::vector<unsigned int>& indices,
+							 std::vector<T>& values)
+		{
+			const T* row = cells + (std::size_t)i * cols;
+			for (unsigned int j = 0; j < cols; j++)
+			{
+				if (row[j] != T(0))
+				{
+					indices.push_back(j);
+					values.push_back(row[j]);
+				}
+			}
+		});
+	}
+
+	/**
+	 * @return The dense matrix of the same cells.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	Matrix<T> toDense() const
+	{
+		Matrix<T> dense(_rows, _cols);
+		T* cells = dense.data();
+		for (unsigned int i = 0; i < _rows; i++)
+		{
+			T* row = cells + (std::size_t)i * _cols;
+			for (std::size_t p = _offsets[i]; p < _offsets[i + 1]; p++)
+			{
+				row[_indices[p]] = _values[p];
+			}
+		}
+		return dense;
+	}
+
+	// ------------ Operators and Operations ----------------
+	/**
+	 * == operator. Compare between this and other.
+	 * @param other The other matrix
+	 * @return true if this and other are equal, false otherwise.
+	 */
+	bool operator==(const SparseMatrix<T>& other) const
+	{
+		return _rows == other._rows && _cols == other._cols && _offsets == other._offsets &&
+			   _indices == other._indices && _values == other._values;
+	}
+
+	/**
+	 * != operator. Returns the opposite of == operator.
+	 * @param other The other matrix
+	 * @return true if this and other are not equal, false otherwise.
+	 */
+	bool operator!=(const SparseMatrix<T>& other) const
+	{
+		return !(*this == other);
+	}
+
+	/**
+	 * + operator. Returns the sum of this and other.
+	 * @param other The other matrix
+	 * @return The result matrix
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the dimensions of this and other are not the same.
+	 */
+	SparseMatrix<T> operator+(const SparseMatrix<T>& other) const
+	{
+		return _merge(other, [](const T& a, const T& b) { return a + b; });
+	}
+
+	/**
+	 * - operator. Returns the difference of this and other.
+	 * @param other The other matrix
+	 * @return The result matrix
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the dimensions of this and other are not the same.
+	 */
+	SparseMatrix<T> operator-(const SparseMatrix<T>& other) const
+	{
+		return _merge(other, [](const T& a, const T& b) { return a - b; });
+	}
+
+	/**
+	 * * operator. Returns the product of this and other, row by row (Gustavson): the non-zero
+	 * cells of a row of this select the rows of other that are scaled and accumulated into a dense
+	 * row owned by the thread, whose touched columns are then gathered in order.
+	 * @param other The other matrix
+	 * @return The result matrix
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if number of columns of this is not equal to the number of
+	 * 		   rows of other.
+	 */
+	SparseMatrix<T> operator*(const SparseMatrix<T>& other) const
+	{
+		if (_cols != other._rows)
+		{
+			throw WrongDimensionsException();
+		}
+		SparseMatrix<T> result(_rows, other._cols);
+		unsigned long long work = nonZeros() *
+								  (other.nonZeros() / std::max(other._rows, 1u) + 1);
+		unsigned int cols = other._cols;
+		_build(result, work, this, [this, &other, cols](unsigned int i,
+														std::vector<unsigned int>& indices,
+														std::vector<T>& values)
+		{
+			static thread_local std::vector<T> accumulator;
+			static thread_local std::vector<unsigned int> marker;
+			static thread_local std::vector<unsigned int> touched;
+			if (accumulator.size() < cols)
+			{
+				accumulator.assign(cols, T(0));
+				marker.assign(cols, NONE_ROW);
+			}
+			touched.clear();
+			for (std::size_t p = _offsets[i]; p < _offsets[i + 1]; p++)
+			{
+				const T& scale = _values[p];
+				unsigned int k = _indices[p];
+				for (std::size_t q = other._offsets[k]; q < other._offsets[k + 1]; q++)
+				{
+					unsigned int j = other._indices[q];
+					if (marker[j] != i)
+					{
+						marker[j] = i;
+						accumulator[j] = T(0);
+						touched.push_back(j);
+					}
+					accumulator[j] += scale * other._values[q];
+				}
+			}
+			std::sort(touched.begin(), touched.end());
+			for (unsigned int j : touched)
+			{
+				marker[j] = NONE_ROW;
+				if (accumulator[j] != T(0))
+				{
+					indices.push_back(j);
+					values.push_back(accumulator[j]);
+				}
+			}
+		});
+		return result;
+	}
+
+	/**
+	 * Returns the transposed matrix of this (conjugated for Complex cells).
+	 * @return The transposed matrix.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	SparseMatrix<T> trans() const
+	{
+		return _transpose(ElementConjugate<T>::CONJUGATES);
+	}
+
+	/**
+	 * Returns the compressed sparse column (CSC) form of this: a matrix whose rows are the
+	 * columns of this, not conjugated. Its offsets, indices and values are the CSC arrays of this.
+	 * @return The matrix of the columns of this.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	SparseMatrix<T> columns() const
+	{
+		return _transpose(false);
+	}
+
+	/**
+	 * Calculates and returns the trace of this.
+	 * @return The trace.
+	 * @throws NoSquareException if this matrix is not square
+	 */
+	T trace() const
+	{
+		if (_rows != _cols)
+		{
+			throw NoSquareException();
+		}
+		T trace(0);
+		for (unsigned int i = 0; i < _rows; i++)
+		{
+			std::size_t position = _find(i, i);
+			if (position != NONE)
+			{
+				trace += _values[position];
+			}
+		}
+		return trace;
+	}
+
+	/**
+	 * Returns the cell located in the given coordinates.
+	 * @param row The cell row number
+	 * @param col The cell column number
+	 * @return The requested cell
+	 * @throws OutOfMatrixException if the requested cell is not exist in the matrix.
+	 */
+	T at(unsigned int row, unsigned int col) const
+	{
+		if (row >= _rows || col >= _cols)
+		{
+			throw OutOfMatrixException();
+		}
+		std::size_t position = _find(row, col);
+		return position == NONE ? T(0) : _values[position];
+	}
+
+	/**
+	 * Computes y = this * x.
+	 * @param x The cols() cells of the vector
+	 * @param y The rows() cells of the result
+	 */
+	void multiply(const T* x, T* y) const
+	{
+		_forRows(nonZeros(), [this, x, y](unsigned int rowBegin, unsigned int rowEnd)
+		{
+			for (unsigned int i = rowBegin; i < rowEnd; i++)
+			{
+				T sum(0);
+				for (std::size_t p = _offsets[i]; p < _offsets[i + 1]; p++)
+				{
+					sum += _values[p] * x[_indices[p]];
+				}
+				y[i] = sum;
+			}
+		});
+	}
+
+	/**
+	 * Computes c = this * b for a dense b of cols() rows, row by row of c: every non-zero cell of
+	 * a row of this adds a scaled row of b.
+	 * @param b The first cell of b, stored row by row
+	 * @param n Number of columns of b and c
+	 * @param c The first cell of c (rows() X n), stored row by row
+	 */
+	void multiply(const T* b, unsigned int n, T* c) const
+	{
+		_forRows((unsigned long long)nonZeros() * n,
+				 [this, b, n, c](unsigned int rowBegin, unsigned int rowEnd)
+		{
+			for (unsigned int i = rowBegin; i < rowEnd; i++)
+			{
+				T* row = c + (std::size_t)i * n;
+				std::fill(row, row + n, T(0));
+				for (std::size_t p = _offsets[i]; p < _offsets[i + 1]; p++)
+				{
+					ElementKernels<T>::axpy(n, _values[p], b + (std::size_t)_indices[p] * n, row);
+				}
+			}
+		});
+	}
+
+	/**
+	 * @return true if this matrix is square, false otherwise.
+	 */
+	bool isSquareMatrix() const
+	{
+		return _rows == _cols;
+	}
+
+	/**
+	 * @return The number of rows of the matrix.
+	 */
+	unsigned int rows() const
+	{
+		return _rows;
+	}
+
+	/**
+	 * @return The number of columns of the matrix.
+	 */
+	unsigned int cols() const
+	{
+		return _cols;
+	}
+
+	/**
+	 * @return The number of stored (non-zero) cells.
+	 */
+	std::size_t nonZeros() const
+	{
+		return _values.size();
+	}
+
+	/**
+	 * @return The fraction of the cells that are stored.
+	 */
+	double density() const
+	{
+		return _rows == 0 ? 0 : (double)nonZeros() / ((double)_rows * _cols);
+	}
+
+	/**
+	 * @return rows() + 1 offsets: the cells of row i are at [offsets()[i], offsets()[i + 1]) in
+	 * 		   indices() and values().
+	 */
+	const std::vector<std::size_t>& offsets() const
+	{
+		return _offsets;
+	}
+
+	/**
+	 * @return The column numbers of the stored cells, row by row.
+	 */
+	const std::vector<unsigned int>& indices() const
+	{
+		return _indices;
+	}
+
+	/**
+	 * @return The values of the stored cells, row by row.
+	 */
+	const std::vector<T>& values() const
+	{
+		return _values;
+	}
+
+	// ------------------ Format ----------------------------
+	/**
+	 * Chooses the format of a matrix from its density.
+	 * @param density The fraction of the cells of the matrix that are not 0
+	 * @return SPARSE if the density is below the density threshold, DENSE otherwise.
+	 */
+	static MatrixFormat format(double density)
+	{
+		return density < _densityThreshold ? MatrixFormat::SPARSE : MatrixFormat::DENSE;
+	}
+
+	/**
+	 * Chooses the format of a dense matrix by counting its non-zero cells.
+	 * @param dense The dense matrix
+	 * @return SPARSE if the density of dense is below the density threshold, DENSE otherwise.
+	 */
+	template <class Allocator>
+	static MatrixFormat format(const Matrix<T, Allocator>& dense)
+	{
+		std::size_t size = (std::size_t)dense.rows() * dense.cols();
+		std::size_t count = (std::size_t)std::count_if(dense.data(), dense.data() + size,
+													   [](const T& x) { return x != T(0); });
+		return format(size == 0 ? 0 : (double)count / size);
+	}
+
+	/**
+	 * Sets the density below which format() chooses the sparse format.
+	 * @param density The density threshold
+	 */
+	static void setDensityThreshold(double density)
+	{
+		_densityThreshold = density;
+	}
+
+private:
+	// ------------------ Data members ----------------------
+	unsigned int _rows; /**< Number of rows of the matrix */
+	unsigned int _cols; /**< Number of columns of the matrix */
+	std::vector<std::size_t> _offsets; /**< Offset of the first cell of every row, and the end */
+	std::vector<unsigned int> _indices; /**< Column numbers of the stored cells */
+	std::vector<T> _values; /**< Values of the stored cells */
+	static double _densityThreshold; /**< The density below which the sparse format is chosen */
+
+	/**
+	 * Returned by _find() for cells that are not stored.
+	 */
+	static const std::size_t NONE = (std::size_t)-1;
+
+	/**
+	 * Marks the columns not touched yet by the row of a product.
+	 */
+	static const unsigned int NONE_ROW = (unsigned int)-1;
+
+	/**
+	 * Number of blocks of rows built per thread, so a slow thread does not hold back the others.
+	 */
+	static const unsigned int BLOCKS_PER_THREAD = 4;
+
+	/**
+	 * Smallest number of stored cells handled by a chunk of rows in parallel.
+	 */
+	static const unsigned long long MIN_CELLS_PER_CHUNK = 1 << 14;
+
+	// ------------------ Private functions -----------------
+	/**
+	 * Checks the dimensions of a matrix.
+	 * @param rows Number of rows
+	 * @param cols Number of columns
+	 * @throws IllegalMatrixException if one of the arguments rows and cols (but not both) is 0.
+	 */
+	static void _checkSize(unsigned int rows, unsigned int cols)
+	{
+		if ((rows == 0 && cols != 0) || (rows != 0 && cols == 0))
+		{
+			throw IllegalMatrixException();
+		}
+	}
+
+	/**
+	 * @param row The cell row number
+	 * @param col The cell column number
+	 * @return The position of the cell in the stored cells, or NONE if it is not stored.
+	 */
+	std::size_t _find(unsigned int row, unsigned int col) const
+	{
+		std::vector<unsigned int>::const_iterator first = _indices.begin() + _offsets[row];
+		std::vector<unsigned int>::const_iterator last = _indices.begin() + _offsets[row + 1];
+		std::vector<unsigned int>::const_iterator found = std::lower_bound(first, last, col);
+		return (found == last || *found != col) ? NONE : (std::size_t)(found - _indices.begin());
+	}
+
+	/**
+	 * Runs func(rowBegin, rowEnd) over the rows of this: on chunks of rows in the thread pool if
+	 * the execution policy runs a product of the given work in parallel, or once on all the rows
+	 * otherwise.
+	 * @param work The number of multiply-adds of the operation
+	 * @param func The function to run
+	 */
+	template <class Func>
+	void _forRows(unsigned long long work, const Func& func) const
+	{
+		if (!ExecutionPolicy::parallel(Operation::PRODUCT, work))
+		{
+			func(0, _rows);
+			return;
+		}
+		unsigned long long perRow = std::max<unsigned long long>(nonZeros() / std::max(_rows, 1u),
+																 1);
+		unsigned int grain = (unsigned int)std::max<unsigned long long>(
+			MIN_CELLS_PER_CHUNK / perRow, 1);
+		ThreadPool::instance().parallelFor(0, _rows, grain, func);
+	}
+
+	/**
+	 * Sets result to a rows X cols matrix whose rows are built by rowFunc(i, indices, values),
+	 * which appends the column numbers (increasing) and the values of the cells of row i. The
+	 * rows are split in blocks of about the same number of stored cells of a reference matrix
+	 * (or of rows, if reference is nullptr), which are built in parallel if the execution policy
+	 * runs a product of the given work in parallel.
+	 * @param result The matrix built
+	 * @param work The number of multiply-adds (or cells read) of building the matrix
+	 * @param reference The matrix the rows are balanced by, or nullptr
+	 * @param rowFunc The function building a row
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	template <class RowFunc>
+	static void _build(SparseMatrix<T>& result, unsigned long long work,
+					   const SparseMatrix<T>* reference, const RowFunc& rowFunc)
+	{
+		unsigned int rows = result._rows;
+		unsigned int blocks = 1;
+		if (ExecutionPolicy::parallel(Operation::PRODUCT, work))
+		{
+			blocks = std::min(rows, ThreadPool::instance().threadCount() * BLOCKS_PER_THREAD);
+			blocks = std::max(blocks, 1u);
+		}
+
+		std::vector<unsigned int> bounds(blocks + 1, rows);
+		for (unsigned int b = 0; b < blocks; b++)
+		{
+			if (reference == nullptr)
+			{
+				bounds[b] = (unsigned int)((unsigned long long)rows * b / blocks);
+				continue;
+			}
+			std::size_t target = reference->nonZeros() * b / blocks;
+			bounds[b] = (unsigned int)(std::lower_bound(reference->_offsets.begin(),
+														reference->_offsets.end(), target) -
+									   reference->_offsets.begin());
+		}
+
+		std::vector<std::vector<unsigned int> > indices(blocks);
+		std::vector<std::vector<T> > values(blocks);
+		result._offsets.assign((std::size_t)rows + 1, 0);
+		std::vector<std::size_t>& offsets = result._offsets;
+		ThreadPool::instance().parallelFor(0, blocks, 1,
+										   [&](unsigned int blockBegin, unsigned int blockEnd)
+		{
+			for (unsigned int b = blockBegin; b < blockEnd; b++)
+			{
+				for (unsigned int i = bounds[b]; i < bounds[b + 1]; i++)
+				{
+					rowFunc(i, indices[b], values[b]);
+					offsets[i + 1] = indices[b].size();
+				}
+			}
+		});
+
+		if (blocks == 1)
+		{
+			result._indices.swap(indices[0]);
+			result._values.swap(values[0]);
+			return;
+		}
+		std::vector<std::size_t> starts(blocks + 1, 0);
+		for (unsigned int b = 0; b < blocks; b++)
+		{
+			starts[b + 1] = starts[b] + indices[b].size();
+		}
+		result._indices.resize(starts[blocks]);
+		result._values.resize(starts[blocks]);
+		ThreadPool::instance().parallelFor(0, blocks, 1,
+										   [&](unsigned int blockBegin, unsigned int blockEnd)
+		{
+			for (unsigned int b = blockBegin; b < blockEnd; b++)
+			{
+				for (unsigned int i = bounds[b]; i < bounds[b + 1]; i++)
+				{
+					offsets[i + 1] += starts[b];
+				}
+				std::copy(indices[b].begin(), indices[b].end(),
+						  result._indices.begin() + starts[b]);
+				std::copy(values[b].begin(), values[b].end(), result._values.begin() + starts[b]);
+			}
+		});
+	}
+
+	/**
+	 * Merges the rows of this and other, combining the cells stored in both with op(a, b) and the
+	 * cells stored in only one with op(a, 0) or op(0, b).
+	 * @param other The other matrix
+	 * @param op The combination of cells
+	 * @return The merged matrix.
+	 * @throws bad_alloc if the memory allocation fails
+	 * @throws WrongDimensionsExceptions if the dimensions of this and other are not the same.
+	 */
+	template <class Op>
+	SparseMatrix<T> _merge(const SparseMatrix<T>& other, const Op& op) const
+	{
+		if (_rows != other._rows || _cols != other._cols)
+		{
+			throw WrongDimensionsException();
+		}
+		SparseMatrix<T> result(_rows, _cols);
+		const SparseMatrix<T>* reference = nonZeros() >= other.nonZeros() ? this : &other;
+		_build(result, nonZeros() + other.nonZeros(), reference,
+			   [this, &other, &op](unsigned int i, std::vector<unsigned int>& indices,
+								   std::vector<T>& values)
+		{
+			std::size_t p = _offsets[i], pEnd = _offsets[i + 1];
+			std::size_t q = other._offsets[i], qEnd = other._offsets[i + 1];
+			while (p < pEnd || q < qEnd)
+			{
+				unsigned int col;
+				T value;
+				if (q == qEnd || (p < pEnd && _indices[p] < other._indices[q]))
+				{
+					col = _indices[p];
+					value = op(_values[p++], T(0));
+				}
+				else if (p == pEnd || other._indices[q] < _indices[p])
+				{
+					col = other._indices[q];
+					value = op(T(0), other._values[q++]);
+				}
+				else
+				{
+					col = _indices[p];
+					value = op(_values[p++], other._values[q++]);
+				}
+				if (value != T(0))
+				{
+					indices.push_back(col);
+					values.push_back(value);
+				}
+			}
+		});
+		return result;
+	}
+
+	/**
+	 * Transposes this by counting the cells of every column.
+	 * @param conjugate Whether the cells are conjugated
+	 * @return The transposed matrix.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	SparseMatrix<T> _transpose(bool conjugate) const
+	{
+		std::vector<std::size_t> offsets((std::size_t)_cols + 1, 0);
+		for (unsigned int col : _indices)
+		{
+			offsets[col + 1]++;
+		}
+		for (unsigned int j = 0; j < _cols; j++)
+		{
+			offsets[j + 1] += offsets[j];
+		}
+		std::vector<std::size_t> next(offsets.begin(), offsets.end() - 1);
+		std::vector<unsigned int> indices(nonZeros());
+		std::vector<T> values(nonZeros());
+		for (unsigned int i = 0; i < _rows; i++)
+		{
+			for (std::size_t p = _offsets[i]; p < _offsets[i + 1]; p++)
+			{
+				std::size_t position = next[_indices[p]]++;
+				indices[position] = i;
+				values[position] = conjugate ? ElementConjugate<T>::apply(_values[p]) : _values[p];
+			}
+		}
+		return SparseMatrix<T>(_cols, _rows, std::move(offsets), std::move(indices),
+							   std::move(values), _Unchecked());
+	}
+
+	/**
+	 * Tag of the constructor that takes CSR arrays known to be valid.
+	 */
+	struct _Unchecked
+	{
+	};
+
+	/**
+	 * Initiates the matrix from CSR arrays known to be valid, without checking them.
+	 */
+	SparseMatrix(unsigned int rows, unsigned int cols, std::vector<std::size_t>&& offsets,
+				 std::vector<unsigned int>&& indices, std::vector<T>&& values, _Unchecked) :
+		_rows(rows), _cols(cols), _offsets(std::move(offsets)), _indices(std::move(indices)),
+		_values(std::move(values))
+	{
+	}
+};
+
+/**
+ * default initialization for the _densityThreshold static member of SparseMatrix<T> as 0.1: below
+ * it the products of a sparse matrix skip enough zeros to make up for its indirect accesses.
+ */
+template <class T>
+double SparseMatrix<T>::_densityThreshold = 0.1;
+
+template <class T>
+const std::size_t SparseMatrix<T>::NONE;
+
+template <class T>
+const unsigned int SparseMatrix<T>::NONE_ROW;
+
+template <class T>
+const unsigned int SparseMatrix<T>::BLOCKS_PER_THREAD;
+
+template <class T>
+const unsigned long long SparseMatrix<T>::MIN_CELLS_PER_CHUNK;
+
+/**
+ * * operator. Returns the product of a sparse matrix and a dense matrix.
+ * @param left The sparse matrix
+ * @param right The dense matrix
+ * @return The dense result matrix
+ * @throws bad_alloc if the memory allocation fails
+ * @throws WrongDimensionsExceptions if number of columns of left is not equal to the number of
+ * 		   rows of right.
+ */
+template <class T, class Allocator>
+Matrix<T> operator*(const SparseMatrix<T>& left, const Matrix<T, Allocator>& right)
+{
+	if (left.cols() != right.rows())
+	{
+		throw WrongDimensionsException();
+	}
+	Matrix<T> result(left.rows(), right.cols());
+	left.multiply(right.data(), right.cols(), result.data());
+	return result;
+}
+
+/**
+ * * operator. Returns the product of a sparse matrix and a vector.
+ * @param left The sparse matrix
+ * @param right The cells of the vector
+ * @return The cells of the result vector.
+ * @throws bad_alloc if the memory allocation fails
+ * @throws WrongDimensionsExceptions if number of columns of left is not equal to the size of
+ * 		   right.
+ */
+template <class T>
+std::vector<T> operator*(const SparseMatrix<T>& left, const std::vector<T>& right)
+{
+	if (left.cols() != right.size())
+	{
+		throw WrongDimensionsException();
+	}
+	std::vector<T> result(left.rows());
+	left.multiply(right.data(), result.data());
+	return result;
+}
+
+#endif /* SPARSEMATRIX_H_ */
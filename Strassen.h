@@ -0,0 +1,303 @@
+// Strassen.h
+
+#ifndef STRASSEN_H_
+#define STRASSEN_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include "Gemm.h"
+#include "ElementKernels.h"
+#include "ThreadPool.h"
+
+/**
+ * The algorithms Matrix<T> can compute a product with.
+ */
+enum class MultiplyAlgorithm
+{
+	DEFAULT, /**< The algorithm set by Matrix<T>::setMultiplyAlgorithm */
+	STANDARD, /**< The blocked O(n^3) engine of Gemm<T> */
+	STRASSEN /**< Strassen-Winograd recursion down to the crossover size, then Gemm<T> */
+};
+
+/**
+ * This class is the Strassen-Winograd multiplication engine. It computes C = A * B where A is
+ * m X k, B is k X n and C is m X n, with A and B given by a pointer and a row and column stride
+ * like in Gemm<T> and C row-major with the given leading dimension.
+ *
+ * Every level of the recursion splits the operands into quadrants and computes the product with
+ * 7 half-size products and 15 additions instead of 8 products, until one of the dimensions is
+ * at most the crossover size, where Gemm<T> takes over. Odd dimensions are peeled: the even part
+ * goes through the recursion and the last row, column or rank-1 term is fixed up with Gemm<T>.
+ * The products are scheduled so each level needs only two temporaries, carved from a workspace
+ * owned by the calling thread that is reused between calls.
+ */
+template <class T>
+class Strassen
+{
+public:
+	/**
+	 * Computes C = A * B.
+	 * @param m Number of rows of A and C
+	 * @param n Number of columns of B and C
+	 * @param k Number of columns of A and rows of B
+	 * @param a The first cell of A
+	 * @param rsA Distance between two consecutive rows of A
+	 * @param csA Distance between two consecutive columns of A
+	 * @param b The first cell of B
+	 * @param rsB Distance between two consecutive rows of B
+	 * @param csB Distance between two consecutive columns of B
+	 * @param c The first cell of C
+	 * @param ldc Distance between two consecutive rows of C
+	 * @param crossover Size below which (in any dimension) products are computed by Gemm<T>
+	 * @param parallel Whether the products computed by Gemm<T> are split between the pool threads
+	 * @throws bad_alloc if the workspace cannot be allocated
+	 */
+	static void multiply(unsigned int m, unsigned int n, unsigned int k,
+						 const T* a, std::size_t rsA, std::size_t csA,
+						 const T* b, std::size_t rsB, std::size_t csB,
+						 T* c, std::size_t ldc, unsigned int crossover, bool parallel)
+	{
+		crossover = std::max(crossover, 1u);
+		std::vector<T>& workspace = _workspace();
+		std::size_t size = _workspaceSize(m, n, k, crossover);
+		if (workspace.size() < size)
+		{
+			workspace.resize(size);
+		}
+		_multiply(m, n, k, a, rsA, csA, b, rsB, csB, c, ldc, workspace.data(), crossover, parallel);
+	}
+
+private:
+	/**
+	 * @return The workspace owned by the calling thread, reused between calls.
+	 */
+	static std::vector<T>& _workspace()
+	{
+		static thread_local std::vector<T> workspace;
+		return workspace;
+	}
+
+	/**
+	 * @param m Number of rows of A and C
+	 * @param n Number of columns of B and C
+	 * @param k Number of columns of A and rows of B
+	 * @param crossover The crossover size
+	 * @return The number of cells of workspace the recursion needs.
+	 */
+	static std::size_t _workspaceSize(unsigned int m, unsigned int n, unsigned int k,
+									  unsigned int crossover)
+	{
+		if (m <= crossover || n <= crossover || k <= crossover)
+		{
+			return 0;
+		}
+		std::size_t hm = m / 2, hn = n / 2, hk = k / 2;
+		return hm * std::max(hk, hn) + hk * hn + _workspaceSize(hm, hn, hk, crossover);
+	}
+
+	/**
+	 * Computes C = A * B, peeling odd dimensions.
+	 * @param m Number of rows of A and C
+	 * @param n Number of columns of B and C
+	 * @param k Number of columns of A and rows of B
+	 * @param a The first cell of A
+	 * @param rsA Distance between two consecutive rows of A
+	 * @param csA Distance between two consecutive columns of A
+	 * @param b The first cell of B
+	 * @param rsB Distance between two consecutive rows of B
+	 * @param csB Distance between two consecutive columns of B
+	 * @param c The first cell of C
+	 * @param ldc Distance between two consecutive rows of C
+	 * @param workspace The free part of the workspace
+	 * @param crossover The crossover size
+	 * @param parallel Whether the products computed by Gemm<T> are split between the pool threads
+	 */
+	static void _multiply(unsigned int m, unsigned int n, unsigned int k,
+						  const T* a, std::size_t rsA, std::size_t csA,
+						  const T* b, std::size_t rsB, std::size_t csB,
+						  T* c, std::size_t ldc, T* workspace, unsigned int crossover,
+						  bool parallel)
+	{
+		if (m <= crossover || n <= crossover || k <= crossover)
+		{
+			_gemm(m, n, k, a, rsA, csA, b, rsB, csB, c, ldc, parallel);
+			return;
+		}
+
+		unsigned int m2 = m & ~1u, n2 = n & ~1u, k2 = k & ~1u;
+		_winograd(m2, n2, k2, a, rsA, csA, b, rsB, csB, c, ldc, workspace, crossover, parallel);
+		if (k2 != k)
+		{
+			Gemm<T>::multiply(m2, n2, 1, T(1), a + k2 * csA, rsA, csA, b + k2 * rsB, rsB, csB,
+							  c, ldc, true);
+		}
+		if (n2 != n)
+		{
+			Gemm<T>::multiply(m2, 1, k, T(1), a, rsA, csA, b + n2 * csB, rsB, csB, c + n2, ldc);
+		}
+		if (m2 != m)
+		{
+			Gemm<T>::multiply(1, n, k, T(1), a + m2 * rsA, rsA, csA, b, rsB, csB, c + m2 * ldc,
+							  ldc);
+		}
+	}
+
+	/**
+	 * Computes C = A * B for even dimensions with one level of Strassen-Winograd. The schedule
+	 * keeps the temporaries in X (m/2 X max(k/2, n/2)) and Y (k/2 X n/2) and the other partial
+	 * results in the quadrants of C.
+	 * @param m Number of rows of A and C
+	 * @param n Number of columns of B and C
+	 * @param k Number of columns of A and rows of B
+	 * @param a The first cell of A
+	 * @param rsA Distance between two consecutive rows of A
+	 * @param csA Distance between two consecutive columns of A
+	 * @param b The first cell of B
+	 * @param rsB Distance between two consecutive rows of B
+	 * @param csB Distance between two consecutive columns of B
+	 * @param c The first cell of C
+	 * @param ldc Distance between two consecutive rows of C
+	 * @param workspace The free part of the workspace
+	 * @param crossover The crossover size
+	 * @param parallel Whether the products computed by Gemm<T> are split between the pool threads
+	 */
+	static void _winograd(unsigned int m, unsigned int n, unsigned int k,
+						  const T* a, std::size_t rsA, std::size_t csA,
+						  const T* b, std::size_t rsB, std::size_t csB,
+						  T* c, std::size_t ldc, T* workspace, unsigned int crossover,
+						  bool parallel)
+	{
+		unsigned int hm = m / 2, hn = n / 2, hk = k / 2;
+		const T* a11 = a;
+		const T* a12 = a + hk * csA;
+		const T* a21 = a + hm * rsA;
+		const T* a22 = a21 + hk * csA;
+		const T* b11 = b;
+		const T* b12 = b + hn * csB;
+		const T* b21 = b + hk * rsB;
+		const T* b22 = b21 + hn * csB;
+		T* c11 = c;
+		T* c12 = c + hn;
+		T* c21 = c + hm * ldc;
+		T* c22 = c21 + hn;
+		T* x = workspace;
+		T* y = x + (std::size_t)hm * std::max(hk, hn);
+		T* rest = y + (std::size_t)hk * hn;
+
+		// S3 = A11 - A21, T3 = B22 - B12, P7 = S3 * T3 in C21
+		_combine(hm, hk, a11, rsA, csA, a21, rsA, csA, x, hk, true);
+		_combine(hk, hn, b22, rsB, csB, b12, rsB, csB, y, hn, true);
+		_multiply(hm, hn, hk, x, hk, 1, y, hn, 1, c21, ldc, rest, crossover, parallel);
+		// S1 = A21 + A22, T1 = B12 - B11, P5 = S1 * T1 in C22
+		_combine(hm, hk, a21, rsA, csA, a22, rsA, csA, x, hk, false);
+		_combine(hk, hn, b12, rsB, csB, b11, rsB, csB, y, hn, true);
+		_multiply(hm, hn, hk, x, hk, 1, y, hn, 1, c22, ldc, rest, crossover, parallel);
+		// S2 = S1 - A11, T2 = B22 - T1, P6 = S2 * T2 in C12
+		_combine(hm, hk, x, hk, 1, a11, rsA, csA, x, hk, true);
+		_combine(hk, hn, b22, rsB, csB, y, hn, 1, y, hn, true);
+		_multiply(hm, hn, hk, x, hk, 1, y, hn, 1, c12, ldc, rest, crossover, parallel);
+		// S4 = A12 - S2, P3 = S4 * B22 in C11
+		_combine(hm, hk, a12, rsA, csA, x, hk, 1, x, hk, true);
+		_multiply(hm, hn, hk, x, hk, 1, b22, rsB, csB, c11, ldc, rest, crossover, parallel);
+		// P1 = A11 * B11 in X
+		_multiply(hm, hn, hk, a11, rsA, csA, b11, rsB, csB, x, hn, rest, crossover, parallel);
+		// U2 = P1 + P6 in C12, U3 = U2 + P7 in C21, U4 = U2 + P5 in C12, U7 = U3 + P5 in C22,
+		// U5 = U4 + P3 in C12
+		_combine(hm, hn, x, hn, 1, c12, ldc, 1, c12, ldc, false);
+		_combine(hm, hn, c12, ldc, 1, c21, ldc, 1, c21, ldc, false);
+		_combine(hm, hn, c12, ldc, 1, c22, ldc, 1, c12, ldc, false);
+		_combine(hm, hn, c21, ldc, 1, c22, ldc, 1, c22, ldc, false);
+		_combine(hm, hn, c12, ldc, 1, c11, ldc, 1, c12, ldc, false);
+		// T4 = T2 - B21, P4 = A22 * T4 in C11, U6 = U3 - P4 in C21
+		_combine(hk, hn, y, hn, 1, b21, rsB, csB, y, hn, true);
+		_multiply(hm, hn, hk, a22, rsA, csA, y, hn, 1, c11, ldc, rest, crossover, parallel);
+		_combine(hm, hn, c21, ldc, 1, c11, ldc, 1, c21, ldc, true);
+		// P2 = A12 * B21 in C11, U1 = P1 + P2 in C11
+		_multiply(hm, hn, hk, a12, rsA, csA, b21, rsB, csB, c11, ldc, rest, crossover, parallel);
+		_combine(hm, hn, x, hn, 1, c11, ldc, 1, c11, ldc, false);
+	}
+
+	/**
+	 * Computes out = x + y, or out = x - y if subtract is true. out may be x or y.
+	 * @param rows Number of rows
+	 * @param cols Number of columns
+	 * @param x The first cell of x
+	 * @param rsX Distance between two consecutive rows of x
+	 * @param csX Distance between two consecutive columns of x
+	 * @param y The first cell of y
+	 * @param rsY Distance between two consecutive rows of y
+	 * @param csY Distance between two consecutive columns of y
+	 * @param out The first cell of out
+	 * @param ldOut Distance between two consecutive rows of out
+	 * @param subtract Whether to subtract instead of adding
+	 */
+	static void _combine(unsigned int rows, unsigned int cols,
+						 const T* x, std::size_t rsX, std::size_t csX,
+						 const T* y, std::size_t rsY, std::size_t csY,
+						 T* out, std::size_t ldOut, bool subtract)
+	{
+		for (unsigned int i = 0; i < rows; i++)
+		{
+			const T* rowX = x + i * rsX;
+			const T* rowY = y + i * rsY;
+			T* row = out + i * ldOut;
+			if (csX == 1 && csY == 1)
+			{
+				if (subtract)
+				{
+					ElementKernels<T>::subtract(row, rowX, rowY, cols);
+				}
+				else
+				{
+					ElementKernels<T>::add(row, rowX, rowY, cols);
+				}
+			}
+			else
+			{
+				for (unsigned int j = 0; j < cols; j++)
+				{
+					const T& left = rowX[j * csX];
+					const T& right = rowY[j * csY];
+					row[j] = subtract ? left - right : left + right;
+				}
+			}
+		}
+	}
+
+	/**
+	 * Computes C = A * B with Gemm<T>, splitting the rows of C between the pool threads if
+	 * parallel is true.
+	 * @param m Number of rows of A and C
+	 * @param n Number of columns of B and C
+	 * @param k Number of columns of A and rows of B
+	 * @param a The first cell of A
+	 * @param rsA Distance between two consecutive rows of A
+	 * @param csA Distance between two consecutive columns of A
+	 * @param b The first cell of B
+	 * @param rsB Distance between two consecutive rows of B
+	 * @param csB Distance between two consecutive columns of B
+	 * @param c The first cell of C
+	 * @param ldc Distance between two consecutive rows of C
+	 * @param parallel Whether to split the rows between the pool threads
+	 */
+	static void _gemm(unsigned int m, unsigned int n, unsigned int k,
+					  const T* a, std::size_t rsA, std::size_t csA,
+					  const T* b, std::size_t rsB, std::size_t csB,
+					  T* c, std::size_t ldc, bool parallel)
+	{
+		if (!parallel)
+		{
+			Gemm<T>::multiply(m, n, k, T(1), a, rsA, csA, b, rsB, csB, c, ldc);
+			return;
+		}
+		ThreadPool::instance().parallelFor(0, m, 1, [=](unsigned int rowBegin, unsigned int rowEnd)
+		{
+			Gemm<T>::multiply(rowEnd - rowBegin, n, k, T(1), a + rowBegin * rsA, rsA, csA,
+							  b, rsB, csB, c + rowBegin * ldc, ldc);
+		});
+	}
+};
+
+#endif /* STRASSEN_H_ */
@@ -0,0 +1,126 @@
+// StrassenBenchmark.cpp
+
+/**
+ * Finds the Strassen-Winograd crossover size on the running machine. For every matrix size it
+ * times the product of two random square matrices with the standard engine and with
+ * Strassen-Winograd at several crossover sizes, and prints the best time of each.
+ *
+ * Usage: StrassenBenchmark [maxSize] [repetitions]
+ */
+
+// ------------------ Includes ------------------------------
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "Matrix.hpp"
+
+/**
+ * Sizes of the matrices, the crossover sizes tried at each of them, and the default limits.
+ */
+static const unsigned int SIZES[] = {256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096};
+static const unsigned int CROSSOVERS[] = {64, 128, 256, 512, 1024};
+static const unsigned int DEFAULT_MAX_SIZE = 2048;
+static const unsigned int DEFAULT_REPETITIONS = 3;
+
+/**
+ * Creates a matrix with random cells.
+ * @param size Number of rows and columns
+ * @param generator The random generator
+ * @return The matrix
+ */
+static Matrix<double> randomMatrix(unsigned int size, std::mt19937& generator)
+{
+	std::uniform_real_distribution<double> distribution(-1, 1);
+	std::vector<double> cells((std::size_t)size * size);
+	for (std::size_t i = 0; i < cells.size(); i++)
+	{
+		cells[i] = distribution(generator);
+	}
+	return Matrix<double>(size, size, cells);
+}
+
+/**
+ * Times a product.
+ * @param a The left matrix
+ * @param b The right matrix
+ * @param algorithm The algorithm
+ * @param repetitions Number of runs
+ * @return The best time of the runs, in seconds.
+ */
+static double timeProduct(const Matrix<double>& a, const Matrix<double>& b,
+						  MultiplyAlgorithm algorithm, unsigned int repetitions)
+{
+	Matrix<double> c(a.rows(), b.cols());
+	double best = 0;
+	for (unsigned int i = 0; i < repetitions; i++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		c = multiply(a, b, algorithm);
+		std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+		if (i == 0 || time.count() < best)
+		{
+			best = time.count();
+		}
+	}
+	return best;
+}
+
+/**
+ * Runs the benchmark.
+ * @param argc Number of arguments
+ * @param argv The arguments: the largest size and the number of runs of every product
+ * @return 0
+ */
+int main(int argc, char* argv[])
+{
+	unsigned int maxSize = argc > 1 ? (unsigned int)std::atoi(argv[1]) : DEFAULT_MAX_SIZE;
+	unsigned int repetitions = argc > 2 ? (unsigned int)std::atoi(argv[2]) : DEFAULT_REPETITIONS;
+	std::mt19937 generator(1);
+
+	std::cout << std::setw(6) << "size" << std::setw(12) << "standard";
+	for (unsigned int crossover : CROSSOVERS)
+	{
+		std::cout << std::setw(11) << "strassen/" << std::left << std::setw(5) << crossover
+				  << std::right;
+	}
+	std::cout << std::setw(10) << "best" << "\n";
+
+	for (unsigned int size : SIZES)
+	{
+		if (size > maxSize)
+		{
+			break;
+		}
+		Matrix<double> a = randomMatrix(size, generator);
+		Matrix<double> b = randomMatrix(size, generator);
+		double standard = timeProduct(a, b, MultiplyAlgorithm::STANDARD, repetitions);
+		double best = standard;
+		unsigned int bestCrossover = 0;
+		std::cout << std::fixed << std::setprecision(4) << std::setw(6) << size
+				  << std::setw(12) << standard;
+		for (unsigned int crossover : CROSSOVERS)
+		{
+			Matrix<double>::setStrassenCrossover(crossover);
+			double strassen = timeProduct(a, b, MultiplyAlgorithm::STRASSEN, repetitions);
+			if (strassen < best)
+			{
+				best = strassen;
+				bestCrossover = crossover;
+			}
+			std::cout << std::setw(16) << strassen;
+		}
+		std::cout << std::setw(10);
+		if (bestCrossover == 0)
+		{
+			std::cout << "standard" << "\n";
+		}
+		else
+		{
+			std::cout << bestCrossover << "\n";
+		}
+	}
+	return 0;
+}
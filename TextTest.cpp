@@ -0,0 +1,158 @@
+// TextTest.cpp
+
+/**
+ * Checks the text output of Matrix<T> (see MatrixText.h): for int, double and Complex cells and
+ * for streams set to other bases, showbase, showpos, showpoint, uppercase, a field width, a fill
+ * character or a precision and notation, the << operator writes the matrix exactly as the <<
+ * operator of T would write its cells one by one, followed by tabs and new lines.
+ *
+ * Usage: TextTest
+ * Returns 0 if every check passes, 1 otherwise.
+ */
+
+// ------------------ Includes ------------------------------
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "Matrix.hpp"
+
+/**
+ * Number of rows and columns of the matrices written.
+ */
+static const unsigned int ROWS = 3;
+static const unsigned int COLS = 4;
+
+/**
+ * Sets the flags, width, fill or precision of a stream.
+ */
+typedef std::function<void(std::ostream&)> StreamStyle;
+
+/**
+ * @param name The name of the check, printed with the result
+ * @param matrix The matrix written
+ * @param style Applied to the stream before the matrix is written
+ * @return true if the matrix was written as its cells one by one, false otherwise.
+ */
+template <class T>
+static bool checkStyle(const std::string& name, const Matrix<T>& matrix, const StreamStyle& style)
+{
+	std::ostringstream written;
+	style(written);
+	written << matrix;
+
+	std::ostringstream expected;
+	style(expected);
+	for (unsigned int i = 0; i < matrix.rows(); i++)
+	{
+		for (unsigned int j = 0; j < matrix.cols(); j++)
+		{
+			expected << matrix(i, j) << '\t';
+		}
+		expected << '\n';
+	}
+
+	bool passed = written.str() == expected.str();
+	std::cout << (passed ? "ok     " : "FAILED ") << name << "\n";
+	if (!passed)
+	{
+		std::cout << "written:\n" << written.str() << "expected:\n" << expected.str();
+	}
+	return passed;
+}
+
+/**
+ * Writes a matrix with every style.
+ * @param type The name of the cell type, printed with the results
+ * @param matrix The matrix written
+ * @return true if every check passed, false otherwise.
+ */
+template <class T>
+static bool checkType(const std::string& type, const Matrix<T>& matrix)
+{
+	bool passed = true;
+	passed &= checkStyle(type + " default", matrix, [](std::ostream&)
+	{
+	});
+	passed &= checkStyle(type + " fixed, precision 2", matrix, [](std::ostream& os)
+	{
+		os << std::fixed << std::setprecision(2);
+	});
+	passed &= checkStyle(type + " scientific", matrix, [](std::ostream& os)
+	{
+		os << std::scientific;
+	});
+	passed &= checkStyle(type + " hex", matrix, [](std::ostream& os)
+	{
+		os << std::hex;
+	});
+	passed &= checkStyle(type + " oct, showbase", matrix, [](std::ostream& os)
+	{
+		os << std::oct << std::showbase;
+	});
+	passed &= checkStyle(type + " hex, showbase, uppercase", matrix, [](std::ostream& os)
+	{
+		os << std::hex << std::showbase << std::uppercase;
+	});
+	passed &= checkStyle(type + " showpos", matrix, [](std::ostream& os)
+	{
+		os << std::showpos;
+	});
+	passed &= checkStyle(type + " showpoint", matrix, [](std::ostream& os)
+	{
+		os << std::showpoint;
+	});
+	passed &= checkStyle(type + " scientific, uppercase", matrix, [](std::ostream& os)
+	{
+		os << std::scientific << std::uppercase;
+	});
+	passed &= checkStyle(type + " width 12, fill *", matrix, [](std::ostream& os)
+	{
+		os << std::setw(12) << std::setfill('*');
+	});
+	passed &= checkStyle(type + " left, width 12", matrix, [](std::ostream& os)
+	{
+		os << std::left << std::setw(12);
+	});
+	return passed;
+}
+
+/**
+ * @param cell Computes the cell of a row and a column
+ * @return A matrix of ROWS rows and COLS columns.
+ */
+template <class T>
+static Matrix<T> makeMatrix(const std::function<T(unsigned int, unsigned int)>& cell)
+{
+	Matrix<T> matrix(ROWS, COLS);
+	for (unsigned int i = 0; i < ROWS; i++)
+	{
+		for (unsigned int j = 0; j < COLS; j++)
+		{
+			matrix(i, j) = cell(i, j);
+		}
+	}
+	return matrix;
+}
+
+/**
+ * Runs the checks.
+ * @return 0 if every check passed, 1 otherwise.
+ */
+int main()
+{
+	bool passed = checkType("int", makeMatrix<int>([](unsigned int i, unsigned int j)
+	{
+		return ((int)(i * COLS + j) - 5) * 997;
+	}));
+	passed &= checkType("double", makeMatrix<double>([](unsigned int i, unsigned int j)
+	{
+		return ((double)(i * COLS + j) - 5.5) * 1234.0625;
+	}));
+	passed &= checkType("Complex", makeMatrix<Complex>([](unsigned int i, unsigned int j)
+	{
+		return Complex(i * 0.75 - 1, 2.5 - j * 1.25);
+	}));
+	return passed ? 0 : 1;
+}
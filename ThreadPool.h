@@ -0,0 +1,679 @@
+// ThreadPool.h
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/**
+ * This class represents a process-wide pool of worker threads used by the parallel mode of
+ * Matrix<T>. The pool is created lazily on first use and its workers live until the end of the
+ * process, so parallel operations no longer pay for creating and joining threads.
+ *
+ * The chunks of a loop are scheduled by work stealing: every thread taking part in the loop owns
+ * a contiguous range of chunks and runs them in order, so neighbouring chunks (which usually share
+ * data) run on the same core. A thread that runs out of chunks steals the upper half of the range
+ * of another thread, so the load stays balanced when chunks take different times. A thread
+ * waiting for the end of its loop runs the chunks of other loops in the meantime, so nested loops
+ * keep every thread busy. Worker w takes the w-th range of a loop when it is free (the calling
+ * thread the first one), so loops over the same range usually give the same parts to the same
+ * threads; a worker busy elsewhere, or a range stolen, breaks this.
+ */
+class ThreadPool
+{
+public:
+	// ------------------ Access ----------------------------
+	/**
+	 * @return The process-wide pool. The pool is created on the first call.
+	 * @throws system_error if the worker threads cannot be started
+	 */
+	static ThreadPool& instance()
+	{
+		static ThreadPool pool(_requestedThreads());
+		return pool;
+	}
+
+	/**
+	 * Sets the number of threads taking part in parallel operations (the calling thread included).
+	 * If the pool was already created it is resized, otherwise the value is used when it is
+	 * created. 0 means the number of hardware threads.
+	 * @param threads The number of threads
+	 */
+	static void setThreadCount(unsigned int threads)
+	{
+		_requestedThreads() = threads;
+		instance()._resize(threads);
+	}
+
+	/**
+	 * Pins the workers to CPUs: worker w (from 1) to cpus[w % cpus.size()], so cpus[0] is left to
+	 * the calling thread. The workers are restarted to apply it. Only supported on Linux; does
+	 * nothing elsewhere.
+	 * @param cpus The CPU numbers, empty to let the workers run anywhere
+	 */
+	static void setAffinity(const std::vector<unsigned int>& cpus)
+	{
+		_affinity() = cpus;
+		ThreadPool& pool = instance();
+		pool._resize(pool._threadCount);
+	}
+
+	/**
+	 * @return The number of threads taking part in parallel operations (the calling thread
+	 * 		   included).
+	 */
+	unsigned int threadCount() const
+	{
+		return _threadCount;
+	}
+
+	/**
+	 * @return Whether the calling thread is running a chunk of a loop of the pool, so that the
+	 * 		   other threads may be busy with the other chunks of that loop.
+	 */
+	static bool inChunk()
+	{
+		return _chunkDepth() > 0;
+	}
+
+	// ------------------ Scheduling ------------------------
+	/**
+	 * Runs func on consecutive chunks of the range [begin, end) and returns when all of them were
+	 * done. The range is cut into chunks of about equal sizes, no more than its size divided by
+	 * grain (rounded up), so a chunk holds fewer than grain indices, though at least grain / 2,
+	 * when the size of the range is not a multiple of grain. The calling thread runs chunks
+	 * itself, so the range is processed inline when it holds at most grain indices or when the
+	 * pool has a single thread. Calls may be nested.
+	 *
+	 * While it waits for the chunks run by other threads, the calling thread runs the chunks of
+	 * any other queued loop, including other chunks of a loop this call is nested in. So func of
+	 * another loop may run on the calling thread before this returns: a caller must not hold a
+	 * lock or state that such a chunk could need (e.g. a non-recursive mutex or a std::call_once
+	 * that the chunk also enters).
+	 * @param begin The first index of the range
+	 * @param end One after the last index of the range
+	 * @param grain The number of indices worth a chunk of their own (see above)
+	 * @param func Function called as func(chunkBegin, chunkEnd)
+	 * @throws any exception thrown by func
+	 */
+	template <class Func>
+	void parallelFor(unsigned int begin, unsigned int end, unsigned int grain, const Func& func)
+	{
+		if (begin >= end)
+		{
+			return;
+		}
+
+		unsigned int total = end - begin;
+		grain = std::max(grain, 1u);
+		unsigned int maxChunks = (total + grain - 1) / grain;
+		unsigned int chunks = std::min(maxChunks, _threadCount * CHUNKS_PER_THREAD);
+		if (chunks <= 1 || _threadCount <= 1)
+		{
+			func(begin, end);
+			return;
+		}
+
+		unsigned int helpers = std::min(chunks - 1, _threadCount - 1);
+		std::shared_ptr<_Loop> loop = _makeLoop(begin, total, chunks, helpers + 1);
+		loop->body = [&func](unsigned int chunkBegin, unsigned int chunkEnd)
+		{
+			func(chunkBegin, chunkEnd);
+		};
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			for (unsigned int i = 0; i < helpers; i++)
+			{
+				_tasks.push_back(loop);
+			}
+		}
+		_hasWork.notify_all();
+
+		_runChunks(*loop);
+		_wait(*loop);
+		_release(loop);
+		if (loop->error)
+		{
+			std::rethrow_exception(loop->error);
+		}
+	}
+
+	/**
+	 * Runs func on the tiles of the 2D range [rowBegin, rowEnd) X [colBegin, colEnd) and returns
+	 * when all of them were done. The range is cut into about CHUNKS_PER_THREAD tiles per thread,
+	 * as square as the grains allow so that each tile reads as little data as possible for its
+	 * work, and every tile boundary is a multiple of the grain from the start of the range. The
+	 * tiles are scheduled like the chunks of parallelFor(), in row-major order, so a thread runs
+	 * neighbouring tiles of the same tile row. Calls may be nested.
+	 * @param rowBegin The first row of the range
+	 * @param rowEnd One after the last row of the range
+	 * @param colBegin The first column of the range
+	 * @param colEnd One after the last column of the range
+	 * @param rowGrain The minimal number of rows in a tile
+	 * @param colGrain The minimal number of columns in a tile
+	 * @param func Function called as func(tileRowBegin, tileRowEnd, tileColBegin, tileColEnd)
+	 * @throws any exception thrown by func
+	 */
+	template <class Func>
+	void parallelFor2D(unsigned int rowBegin, unsigned int rowEnd, unsigned int colBegin,
+					   unsigned int colEnd, unsigned int rowGrain, unsigned int colGrain,
+					   const Func& func)
+	{
+		if (rowBegin >= rowEnd || colBegin >= colEnd)
+		{
+			return;
+		}
+
+		unsigned int rows = rowEnd - rowBegin;
+		unsigned int cols = colEnd - colBegin;
+		rowGrain = std::max(rowGrain, 1u);
+		colGrain = std::max(colGrain, 1u);
+		unsigned int maxGridRows = std::max(rows / rowGrain, 1u);
+		unsigned int maxGridCols = std::max(cols / colGrain, 1u);
+		unsigned long long target = (unsigned long long)_threadCount * CHUNKS_PER_THREAD;
+		if (_threadCount <= 1 || (maxGridRows == 1 && maxGridCols == 1))
+		{
+			func(rowBegin, rowEnd, colBegin, colEnd);
+			return;
+		}
+
+		// Square tiles of side s make rows * cols / (s * s) tiles. The rows are cut first, then
+		// the columns, then the rows again if the columns were limited by their grain.
+		double side = std::sqrt((double)rows * cols / target);
+		unsigned int gridRows = (unsigned int)std::min<double>(
+			std::max(rows / side + 0.5, 1.0), std::min<unsigned long long>(maxGridRows, target));
+		unsigned int gridCols = (unsigned int)std::min<unsigned long long>(
+			(target + gridRows - 1) / gridRows, maxGridCols);
+		unsigned long long neededRows = (target + gridCols - 1) / gridCols;
+		gridRows = (unsigned int)std::min<unsigned long long>(
+			std::max<unsigned long long>(gridRows, neededRows), maxGridRows);
+
+		parallelFor(0, gridRows * gridCols, 1,
+					[&](unsigned int tileBegin, unsigned int tileEnd)
+		{
+			for (unsigned int tile = tileBegin; tile < tileEnd; tile++)
+			{
+				unsigned int r = tile / gridCols;
+				unsigned int c = tile % gridCols;
+				func(rowBegin + _boundary(rows, gridRows, rowGrain, r),
+					 rowBegin + _boundary(rows, gridRows, rowGrain, r + 1),
+					 colBegin + _boundary(cols, gridCols, colGrain, c),
+					 colBegin + _boundary(cols, gridCols, colGrain, c + 1));
+			}
+		});
+	}
+
+	/**
+	 * Destructor. Stops and joins the workers.
+	 */
+	~ThreadPool()
+	{
+		_resize(1);
+	}
+
+private:
+	/**
+	 * Number of chunks created per thread, so a slow thread does not hold back the others.
+	 */
+	static const unsigned int CHUNKS_PER_THREAD = 4;
+
+	/**
+	 * Number of loop states kept by every thread for its next loops (see _makeLoop()).
+	 */
+	static const unsigned int CACHED_LOOPS = 4;
+
+	/**
+	 * The shared state of a single parallelFor call. Workers hold it through a shared pointer, so
+	 * a worker that wakes up after the loop was finished by others only finds no chunk left. Once
+	 * no worker holds it any more, the state is reused by the next call of the same thread (see
+	 * _makeLoop()), so parallel operations run in a loop do not allocate.
+	 *
+	 * Every thread taking part gets a slot, holding the range of chunks it still has to run as
+	 * (front << 32 | back) in a single atomic word: the owner takes chunks from the front, thieves
+	 * take the upper half from the back, both with a compare-and-swap on the whole range.
+	 */
+	struct _Loop
+	{
+		/**
+		 * Creates a loop for up to capacity threads, set up by reset().
+		 * @param capacity The largest number of threads taking part
+		 */
+		explicit _Loop(unsigned int capacity) : begin(0), total(0), chunks(0), slots(0),
+			capacity(capacity), holders(0), ranges(new std::atomic<unsigned long long>[capacity]),
+			taken(new std::atomic<bool>[capacity])
+		{
+		}
+
+		/**
+		 * Sets the loop up for a range, with the chunks shared evenly between the slots, and held
+		 * by the calling thread and the slots - 1 entries it is about to queue.
+		 * @param first The first index of the range
+		 * @param size The number of indices in the range
+		 * @param count The number of chunks
+		 * @param threads The number of threads taking part, at most capacity
+		 */
+		void reset(unsigned int first, unsigned int size, unsigned int count, unsigned int threads)
+		{
+			begin = first;
+			total = size;
+			chunks = count;
+			slots = threads;
+			for (unsigned int s = 0; s < slots; s++)
+			{
+				ranges[s].store(_range((unsigned long long)chunks * s / slots,
+									   (unsigned long long)chunks * (s + 1) / slots));
+				taken[s].store(false);
+			}
+			done = 0;
+			error = nullptr;
+			holders.store(threads, std::memory_order_relaxed);
+		}
+
+		unsigned int begin; /**< The first index of the range */
+		unsigned int total; /**< The number of indices in the range */
+		unsigned int chunks; /**< The number of chunks */
+		unsigned int slots; /**< The number of threads taking part */
+		unsigned int capacity; /**< The largest number of threads taking part */
+		std::atomic<unsigned int> holders; /**< Threads and queue entries still using the loop */
+		std::function<void(unsigned int, unsigned int)> body; /**< The chunk function */
+		std::unique_ptr<std::atomic<unsigned long long>[]> ranges; /**< The chunks of each slot */
+		std::unique_ptr<std::atomic<bool>[]> taken; /**< Whether each slot has a thread */
+		unsigned int done = 0; /**< The number of finished chunks */
+		std::exception_ptr error; /**< The first exception thrown by body */
+		std::mutex mutex; /**< Guards done and error */
+		std::condition_variable finished; /**< Signaled when all the chunks are done */
+	};
+
+	// ------------------ Data members ----------------------
+	unsigned int _threadCount; /**< Number of threads including the calling thread */
+	std::vector<std::thread> _workers; /**< The worker threads */
+	std::vector<std::shared_ptr<_Loop>> _tasks; /**< Loops waiting for a helper, in order */
+	std::mutex _mutex; /**< Guards _tasks and _stopping */
+	std::condition_variable _hasWork; /**< Signaled when tasks are added or on stop */
+	bool _stopping; /**< Whether the workers are asked to exit */
+
+	// ------------------ Private functions -----------------
+	/**
+	 * Creates the pool with the given number of threads.
+	 * @param threads The number of threads, 0 for the number of hardware threads
+	 */
+	explicit ThreadPool(unsigned int threads) : _threadCount(1), _stopping(false)
+	{
+		_resize(threads);
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/**
+	 * @return The CPUs set by setAffinity (empty for none).
+	 */
+	static std::vector<unsigned int>& _affinity()
+	{
+		static std::vector<unsigned int> cpus;
+		return cpus;
+	}
+
+	/**
+	 * @return The number of the calling thread in the pool: w for worker w, 0 for other threads.
+	 */
+	static unsigned int& _index()
+	{
+		static thread_local unsigned int index = 0;
+		return index;
+	}
+
+	/**
+	 * @return The number of chunks the calling thread is running, nested in each other.
+	 */
+	static unsigned int& _chunkDepth()
+	{
+		static thread_local unsigned int depth = 0;
+		return depth;
+	}
+
+	/**
+	 * @return The thread count requested by setThreadCount (0 for the default).
+	 */
+	static unsigned int& _requestedThreads()
+	{
+		static unsigned int threads = 0;
+		return threads;
+	}
+
+	/**
+	 * Stops the current workers and starts threads - 1 new ones.
+	 * @param threads The number of threads, 0 for the number of hardware threads
+	 */
+	void _resize(unsigned int threads)
+	{
+		if (threads == 0)
+		{
+			threads = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stopping = true;
+		}
+		_hasWork.notify_all();
+		for (unsigned int i = 0; i < _workers.size(); i++)
+		{
+			_workers[i].join();
+		}
+		_workers.clear();
+
+		_stopping = false;
+		_threadCount = threads;
+		for (unsigned int i = 1; i < threads; i++)
+		{
+			const std::vector<unsigned int>& cpus = _affinity();
+			int cpu = cpus.empty() ? -1 : (int)cpus[i % cpus.size()];
+			_workers.push_back(std::thread(&ThreadPool::_workerLoop, this, i, cpu));
+		}
+	}
+
+	/**
+	 * The function run by every worker: waits for loops and helps running their chunks.
+	 * @param index The number of the worker, from 1
+	 * @param cpu The CPU the worker is pinned to, -1 for none
+	 */
+	void _workerLoop(unsigned int index, int cpu)
+	{
+		_index() = index;
+		_pin(cpu);
+		while (true)
+		{
+			std::shared_ptr<_Loop> loop;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_hasWork.wait(lock, [this]() { return _stopping || !_tasks.empty(); });
+				if (_tasks.empty())
+				{
+					return;
+				}
+				loop = std::move(_tasks.front());
+				_tasks.erase(_tasks.begin());
+			}
+			_runChunks(*loop);
+			loop->holders.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	/**
+	 * Returns the state of a new loop. Every thread allocates CACHED_LOOPS states on its first
+	 * loop, and then reuses one that no thread holds any more; a new state is only allocated when
+	 * all of them are still held, by nested loops or by workers that have not let go of a finished
+	 * loop yet, or when the pool has grown beyond the slots of the state.
+	 * @param begin The first index of the range
+	 * @param total The number of indices in the range
+	 * @param chunks The number of chunks
+	 * @param slots The number of threads taking part
+	 * @return The loop.
+	 * @throws bad_alloc if the memory allocation fails
+	 */
+	std::shared_ptr<_Loop> _makeLoop(unsigned int begin, unsigned int total, unsigned int chunks,
+									 unsigned int slots)
+	{
+		static thread_local std::shared_ptr<_Loop> cached[CACHED_LOOPS];
+		unsigned int capacity = std::max(slots, _threadCount);
+		if (!cached[0])
+		{
+			for (unsigned int i = 0; i < CACHED_LOOPS; i++)
+			{
+				cached[i] = std::make_shared<_Loop>(capacity);
+			}
+		}
+
+		for (unsigned int i = 0; i < CACHED_LOOPS; i++)
+		{
+			// The acquire load orders the last reads of the holders before the writes of reset()
+			if (cached[i]->holders.load(std::memory_order_acquire) == 0)
+			{
+				if (cached[i]->capacity < slots)
+				{
+					cached[i] = std::make_shared<_Loop>(capacity);
+				}
+				cached[i]->reset(begin, total, chunks, slots);
+				return cached[i];
+			}
+		}
+
+		std::shared_ptr<_Loop> loop = std::make_shared<_Loop>(capacity);
+		loop->reset(begin, total, chunks, slots);
+		return loop;
+	}
+
+	/**
+	 * Lets go of a finished loop for the calling thread, and removes from the queue its entries
+	 * that no helper took, so that the workers do not wake up for it and its state can be reused
+	 * at once.
+	 * @param loop The loop
+	 */
+	void _release(const std::shared_ptr<_Loop>& loop)
+	{
+		unsigned int removed;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			std::vector<std::shared_ptr<_Loop> >::iterator last =
+				std::remove(_tasks.begin(), _tasks.end(), loop);
+			removed = (unsigned int)(_tasks.end() - last);
+			_tasks.erase(last, _tasks.end());
+		}
+		loop->holders.fetch_sub(removed + 1, std::memory_order_release);
+	}
+
+	/**
+	 * Waits until all the chunks of the given loop are done, running the chunks of other waiting
+	 * loops in the meantime. These are usually loops nested in the chunks still running, but they
+	 * may be any queued loop, including the loop the waiting call is itself nested in, so the
+	 * chunks of arbitrary loops run on the waiting thread (see parallelFor()).
+	 * @param loop The loop
+	 */
+	void _wait(_Loop& loop)
+	{
+		while (true)
+		{
+			{
+				std::lock_guard<std::mutex> lock(loop.mutex);
+				if (loop.done == loop.chunks)
+				{
+					return;
+				}
+			}
+
+			std::shared_ptr<_Loop> other;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (!_tasks.empty())
+				{
+					other = std::move(_tasks.front());
+					_tasks.erase(_tasks.begin());
+				}
+			}
+			if (!other)
+			{
+				break;
+			}
+			_runChunks(*other);
+			other->holders.fetch_sub(1, std::memory_order_release);
+		}
+
+		std::unique_lock<std::mutex> lock(loop.mutex);
+		loop.finished.wait(lock, [&loop]() { return loop.done == loop.chunks; });
+	}
+
+	/**
+	 * Takes a slot in the given loop and runs chunks until none is left: the chunks of the slot,
+	 * then the chunks stolen from the other slots.
+	 * @param loop The loop
+	 */
+	static void _runChunks(_Loop& loop)
+	{
+		unsigned int slot = loop.slots;
+		for (unsigned int i = 0; i < loop.slots && slot == loop.slots; i++)
+		{
+			unsigned int candidate = (_index() + i) % loop.slots;
+			if (!loop.taken[candidate].exchange(true))
+			{
+				slot = candidate;
+			}
+		}
+		if (slot == loop.slots)
+		{
+			return;
+		}
+
+		unsigned int chunk;
+		while (_claim(loop, slot, chunk))
+		{
+			unsigned int chunkBegin = loop.begin + (unsigned int)((unsigned long long)loop.total *
+																 chunk / loop.chunks);
+			unsigned int chunkEnd = loop.begin + (unsigned int)((unsigned long long)loop.total *
+															   (chunk + 1) / loop.chunks);
+			std::exception_ptr error;
+			_chunkDepth()++;
+			try
+			{
+				loop.body(chunkBegin, chunkEnd);
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+			_chunkDepth()--;
+
+			std::lock_guard<std::mutex> lock(loop.mutex);
+			if (error && !loop.error)
+			{
+				loop.error = error;
+			}
+			if (++loop.done == loop.chunks)
+			{
+				loop.finished.notify_all();
+			}
+		}
+	}
+
+	/**
+	 * Claims the next chunk of a slot: the front of its range, or, when the range is empty, the
+	 * first chunk of the upper half stolen from another slot, the rest of the half becoming the
+	 * range of the slot. Only the owner refills a range, and only once it is empty, so thieves
+	 * never take chunks from a range being refilled.
+	 * @param loop The loop
+	 * @param slot The slot of the calling thread
+	 * @param chunk Set to the claimed chunk
+	 * @return false if no chunk was left.
+	 */
+	static bool _claim(_Loop& loop, unsigned int slot, unsigned int& chunk)
+	{
+		std::atomic<unsigned long long>& own = loop.ranges[slot];
+		unsigned long long range = own.load();
+		while (_front(range) < _back(range))
+		{
+			if (own.compare_exchange_weak(range, _range(_front(range) + 1, _back(range))))
+			{
+				chunk = _front(range);
+				return true;
+			}
+		}
+
+		for (unsigned int i = 1; i < loop.slots; i++)
+		{
+			std::atomic<unsigned long long>& victim = loop.ranges[(slot + i) % loop.slots];
+			range = victim.load();
+			while (_front(range) < _back(range))
+			{
+				unsigned int front = _front(range);
+				unsigned int back = _back(range);
+				unsigned int middle = back - (back - front + 1) / 2;
+				if (victim.compare_exchange_weak(range, _range(front, middle)))
+				{
+					chunk = middle;
+					own.store(_range(middle + 1, back));
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * Pins the calling thread to a CPU.
+	 * @param cpu The CPU, -1 for none
+	 */
+	static void _pin(int cpu)
+	{
+#ifdef __linux__
+		if (cpu >= 0 && cpu < CPU_SETSIZE)
+		{
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(cpu, &set);
+			pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		}
+#else
+		(void)cpu;
+#endif
+	}
+
+	/**
+	 * @return The range of chunks [front, back) packed in a single word.
+	 */
+	static unsigned long long _range(unsigned long long front, unsigned long long back)
+	{
+		return front << 32 | back;
+	}
+
+	/**
+	 * @return The first chunk of a packed range.
+	 */
+	static unsigned int _front(unsigned long long range)
+	{
+		return (unsigned int)(range >> 32);
+	}
+
+	/**
+	 * @return One after the last chunk of a packed range.
+	 */
+	static unsigned int _back(unsigned long long range)
+	{
+		return (unsigned int)range;
+	}
+
+	/**
+	 * @param total The number of indices of a dimension
+	 * @param parts The number of tiles along the dimension
+	 * @param grain The minimal number of indices in a tile
+	 * @param part A tile number, up to parts
+	 * @return The first index of the given tile (total for parts): the even split rounded down to
+	 * 		   a multiple of the grain. parts is at most total / grain, so no tile is empty.
+	 */
+	static unsigned int _boundary(unsigned int total, unsigned int parts, unsigned int grain,
+								  unsigned int part)
+	{
+		if (part >= parts)
+		{
+			return total;
+		}
+		unsigned int boundary = (unsigned int)((unsigned long long)total * part / parts);
+		return boundary / grain * grain;
+	}
+};
+
+#endif /* THREADPOOL_H_ */
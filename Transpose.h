@@ -0,0 +1,166 @@
+// Transpose.h
+
+#ifndef TRANSPOSE_H_
+#define TRANSPOSE_H_
+
+// ------------------ Includes ------------------------------
+#include <algorithm>
+#include <cstddef>
+#include "MatrixExpression.h"
+
+/**
+ * This class transposes row-major matrices for Matrix<T>. Out of place, the matrix is split
+ * recursively along its longer side until the pieces fit in L1, so both the reads and the writes
+ * use every cache line they touch whatever the sizes of the caches are. In place, a square matrix
+ * is transposed tile pair by tile pair, without a second buffer.
+ */
+template <class T>
+class Transpose
+{
+public:
+	/**
+	 * Side of the largest tile transposed without splitting it further.
+	 */
+	static const unsigned int BLOCK = 32;
+
+	/**
+	 * Computes dst[j * ldDst + i] = src[i * ldSrc + j] (conjugated if conjugate is true) for every
+	 * i < rows and j < cols. The source and the destination must not overlap.
+	 * @param rows Number of rows of the source
+	 * @param cols Number of columns of the source
+	 * @param src The first cell of the source
+	 * @param ldSrc Distance between two consecutive rows of the source
+	 * @param dst The first cell of the destination
+	 * @param ldDst Distance between two consecutive rows of the destination
+	 * @param conjugate Whether the cells are conjugated
+	 */
+	static void copy(unsigned int rows, unsigned int cols, const T* src, std::size_t ldSrc,
+					 T* dst, std::size_t ldDst, bool conjugate)
+	{
+		if (rows <= BLOCK && cols <= BLOCK)
+		{
+			_tile(rows, cols, src, ldSrc, dst, ldDst, conjugate);
+		}
+		else if (rows >= cols)
+		{
+			unsigned int half = _half(rows);
+			copy(half, cols, src, ldSrc, dst, ldDst, conjugate);
+			copy(rows - half, cols, src + half * ldSrc, ldSrc, dst + half, ldDst, conjugate);
+		}
+		else
+		{
+			unsigned int half = _half(cols);
+			copy(rows, half, src, ldSrc, dst, ldDst, conjugate);
+			copy(rows, cols - half, src + half, ldSrc, dst + half * ldDst, ldDst, conjugate);
+		}
+	}
+
+	/**
+	 * Transposes (and conjugates if conjugate is true) the n X n matrix a in place. Only the tiles
+	 * whose first row is in [rowBegin, rowEnd) are swapped with their mirror tiles, so disjoint
+	 * ranges of rows can be processed concurrently.
+	 * @param n Number of rows and columns of the matrix
+	 * @param a The first cell of the matrix
+	 * @param ld Distance between two consecutive rows of the matrix
+	 * @param conjugate Whether the cells are conjugated
+	 * @param rowBegin The first row
+	 * @param rowEnd One after the last row
+	 */
+	static void inPlace(unsigned int n, T* a, std::size_t ld, bool conjugate,
+						unsigned int rowBegin, unsigned int rowEnd)
+	{
+		T tile[BLOCK * BLOCK];
+		for (unsigned int ib = rowBegin; ib < rowEnd; ib += BLOCK)
+		{
+			unsigned int ie = std::min(ib + BLOCK, rowEnd);
+			for (unsigned int i = ib; i < ie; i++)
+			{
+				T* row = a + i * ld;
+				if (conjugate)
+				{
+					row[i] = ElementConjugate<T>::apply(row[i]);
+				}
+				for (unsigned int j = i + 1; j < ie; j++)
+				{
+					T cell = row[j];
+					row[j] = _read(a[j * ld + i], conjugate);
+					a[j * ld + i] = _read(cell, conjugate);
+				}
+			}
+
+			unsigned int rows = ie - ib;
+			for (unsigned int jb = ie; jb < n; jb += BLOCK)
+			{
+				unsigned int cols = std::min(BLOCK, n - jb);
+				T* upper = a + ib * ld + jb;
+				T* lower = a + jb * ld + ib;
+				_tile(rows, cols, upper, ld, tile, rows, conjugate);
+				_tile(cols, rows, lower, ld, upper, ld, conjugate);
+				for (unsigned int j = 0; j < cols; j++)
+				{
+					std::copy(tile + j * rows, tile + (j + 1) * rows, lower + j * ld);
+				}
+			}
+		}
+	}
+
+private:
+	/**
+	 * @param size The size of a side longer than BLOCK
+	 * @return Where to split the side, rounded to a multiple of 8 so the tiles keep whole cache
+	 * 		   lines of float and double cells.
+	 */
+	static unsigned int _half(unsigned int size)
+	{
+		return ((size / 2) + 7) & ~7u;
+	}
+
+	/**
+	 * @param cell A cell
+	 * @param conjugate Whether the cell is conjugated
+	 * @return The cell, conjugated if conjugate is true.
+	 */
+	static T _read(const T& cell, bool conjugate)
+	{
+		return conjugate ? ElementConjugate<T>::apply(cell) : cell;
+	}
+
+	/**
+	 * Transposes a tile of at most BLOCK X BLOCK cells. The tile fits in L1, and the loop writes
+	 * the destination contiguously so the compiler can vectorize it.
+	 * @param rows Number of rows of the source
+	 * @param cols Number of columns of the source
+	 * @param src The first cell of the source
+	 * @param ldSrc Distance between two consecutive rows of the source
+	 * @param dst The first cell of the destination
+	 * @param ldDst Distance between two consecutive rows of the destination
+	 * @param conjugate Whether the cells are conjugated
+	 */
+	static void _tile(unsigned int rows, unsigned int cols, const T* src, std::size_t ldSrc,
+					  T* dst, std::size_t ldDst, bool conjugate)
+	{
+		for (unsigned int j = 0; j < cols; j++)
+		{
+			T* out = dst + j * ldDst;
+			if (conjugate)
+			{
+				for (unsigned int i = 0; i < rows; i++)
+				{
+					out[i] = ElementConjugate<T>::apply(src[i * ldSrc + j]);
+				}
+			}
+			else
+			{
+				for (unsigned int i = 0; i < rows; i++)
+				{
+					out[i] = src[i * ldSrc + j];
+				}
+			}
+		}
+	}
+};
+
+template <class T>
+const unsigned int Transpose<T>::BLOCK;
+
+#endif /* TRANSPOSE_H_ */